@@ -0,0 +1,434 @@
+﻿/*
+	SPDX-License-Identifier: MIT
+	Copyright © 2022-2024 Amebis
+*/
+
+#include "pch.h"
+
+using namespace std;
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace UnitTests
+{
+	class fake_dispatch : public IDispatch
+	{
+	public:
+		ULONG refcount = 1;
+		ULONG lookups = 0;
+		LONG value = 0;
+
+		STDMETHOD(QueryInterface)(REFIID riid, void** ppvObject) override
+		{
+			if (riid == __uuidof(IUnknown) || riid == __uuidof(IDispatch)) {
+				*ppvObject = static_cast<IDispatch*>(this);
+				AddRef();
+				return S_OK;
+			}
+			*ppvObject = NULL;
+			return E_NOINTERFACE;
+		}
+		STDMETHOD_(ULONG, AddRef)() override { return ++refcount; }
+		STDMETHOD_(ULONG, Release)() override { return --refcount; }
+		STDMETHOD(GetTypeInfoCount)(UINT* pctinfo) override { *pctinfo = 0; return S_OK; }
+		STDMETHOD(GetTypeInfo)(UINT, LCID, ITypeInfo** ppTInfo) override { *ppTInfo = NULL; return DISP_E_BADINDEX; }
+		STDMETHOD(GetIDsOfNames)(REFIID, LPOLESTR* rgszNames, UINT cNames, LCID, DISPID* rgDispId) override
+		{
+			lookups++;
+			for (UINT i = 0; i < cNames; ++i) {
+				if (_wcsicmp(rgszNames[i], L"Sub") == 0) rgDispId[i] = 1;
+				else if (_wcsicmp(rgszNames[i], L"Value") == 0) rgDispId[i] = 2;
+				else return DISP_E_UNKNOWNNAME;
+			}
+			return S_OK;
+		}
+		STDMETHOD(Invoke)(DISPID dispIdMember, REFIID, LCID, WORD wFlags, DISPPARAMS* pDispParams, VARIANT* pVarResult, EXCEPINFO*, UINT*) override
+		{
+			switch (dispIdMember) {
+			case 1:
+				// Arguments come in reverse order.
+				if (pDispParams->cArgs != 2 || V_VT(&pDispParams->rgvarg[0]) != VT_I4 || V_VT(&pDispParams->rgvarg[1]) != VT_I4)
+					return DISP_E_TYPEMISMATCH;
+				V_VT(pVarResult) = VT_I4;
+				V_I4(pVarResult) = V_I4(&pDispParams->rgvarg[1]) - V_I4(&pDispParams->rgvarg[0]);
+				return S_OK;
+			case 2:
+				if (wFlags & DISPATCH_PROPERTYPUT) {
+					if (pDispParams->cNamedArgs != 1 || pDispParams->rgdispidNamedArgs[0] != DISPID_PROPERTYPUT)
+						return DISP_E_PARAMNOTOPTIONAL;
+					value = V_I4(&pDispParams->rgvarg[0]);
+					return S_OK;
+				}
+				V_VT(pVarResult) = VT_I4;
+				V_I4(pVarResult) = value;
+				return S_OK;
+			}
+			return DISP_E_MEMBERNOTFOUND;
+		}
+	};
+
+	class fake_factory : public IClassFactory
+	{
+	public:
+		ULONG refcount = 1;
+		LONG locks = 0;
+		ULONG created = 0;
+		HRESULT fail = S_OK;
+		fake_dispatch obj;
+
+		STDMETHOD(QueryInterface)(REFIID riid, void** ppvObject) override
+		{
+			if (riid == __uuidof(IUnknown) || riid == __uuidof(IClassFactory)) {
+				*ppvObject = static_cast<IClassFactory*>(this);
+				AddRef();
+				return S_OK;
+			}
+			*ppvObject = NULL;
+			return E_NOINTERFACE;
+		}
+		STDMETHOD_(ULONG, AddRef)() override { return ++refcount; }
+		STDMETHOD_(ULONG, Release)() override { return --refcount; }
+		STDMETHOD(CreateInstance)(IUnknown*, REFIID riid, void** ppvObject) override
+		{
+			if (FAILED(fail)) {
+				HRESULT hr = fail;
+				fail = S_OK;
+				*ppvObject = NULL;
+				return hr;
+			}
+			created++;
+			return obj.QueryInterface(riid, ppvObject);
+		}
+		STDMETHOD(LockServer)(BOOL fLock) override { locks += fLock ? 1 : -1; return S_OK; }
+	};
+
+	class fake_factory_cache : public winstd::class_factory_cache
+	{
+	public:
+		fake_factory factory;
+		ULONG lookups = 0;
+
+	protected:
+		HRESULT get_class_object(REFCLSID rclsid, DWORD, IClassFactory** ppf) override
+		{
+			lookups++;
+			if (rclsid != __uuidof(IDispatch)) {
+				*ppf = NULL;
+				return REGDB_E_CLASSNOTREG;
+			}
+			*ppf = &factory;
+			factory.AddRef();
+			return S_OK;
+		}
+	};
+
+	TEST_CLASS(COM)
+	{
+	public:
+		TEST_METHOD(span_stream)
+		{
+			static const char data[] = "The quick brown fox jumps over the lazy dog";
+			winstd::com_obj<IStream> s = winstd::span_stream<>::create(data, sizeof(data) - 1);
+			char buf[sizeof(data)] = {};
+			ULONG n;
+			Assert::AreEqual(S_OK, s->Read(buf, 9, &n));
+			Assert::AreEqual<ULONG>(9, n);
+			Assert::AreEqual("The quick", buf);
+
+			winstd::com_obj<IStream> clone;
+			Assert::AreEqual(S_OK, s->Clone(&clone));
+			LARGE_INTEGER move = { 0 };
+			ULARGE_INTEGER pos;
+			Assert::AreEqual(S_OK, clone->Seek(move, STREAM_SEEK_CUR, &pos));
+			Assert::AreEqual<ULONGLONG>(9, pos.QuadPart);
+
+			move.QuadPart = -3;
+			Assert::AreEqual(S_OK, s->Seek(move, STREAM_SEEK_END, NULL));
+			memset(buf, 0, sizeof(buf));
+			Assert::AreEqual(S_FALSE, s->Read(buf, 10, &n));
+			Assert::AreEqual<ULONG>(3, n);
+			Assert::AreEqual("dog", buf);
+			Assert::AreEqual(STG_E_ACCESSDENIED, s->Write(data, 1, NULL));
+
+			move.QuadPart = -1;
+			Assert::AreEqual(STG_E_INVALIDFUNCTION, s->Seek(move, STREAM_SEEK_SET, NULL));
+
+			STATSTG stat;
+			Assert::AreEqual(S_OK, clone->Stat(&stat, STATFLAG_NONAME));
+			Assert::AreEqual<ULONGLONG>(sizeof(data) - 1, stat.cbSize.QuadPart);
+		}
+
+		TEST_METHOD(chunked_stream)
+		{
+			winstd::chunk_pool pool(16);
+			winstd::com_obj<IStream> s = winstd::chunked_stream<true>::create(pool);
+			vector<unsigned char> data(1000);
+			for (size_t i = 0; i < data.size(); ++i)
+				data[i] = static_cast<unsigned char>(i * 7);
+			ULONG n;
+			Assert::AreEqual(S_OK, s->Write(data.data(), static_cast<ULONG>(data.size()), &n));
+			Assert::AreEqual<ULONG>(1000, n);
+
+			LARGE_INTEGER move = { 0 };
+			move.QuadPart = 500;
+			Assert::AreEqual(S_OK, s->Seek(move, STREAM_SEEK_SET, NULL));
+			vector<unsigned char> buf(1000);
+			Assert::AreEqual(S_FALSE, s->Read(buf.data(), static_cast<ULONG>(buf.size()), &n));
+			Assert::AreEqual<ULONG>(500, n);
+			Assert::IsTrue(memcmp(buf.data(), data.data() + 500, 500) == 0);
+
+			// Grown area reads as zeros.
+			ULARGE_INTEGER size;
+			size.QuadPart = 1100;
+			Assert::AreEqual(S_OK, s->SetSize(size));
+			Assert::AreEqual(S_OK, s->Read(buf.data(), 100, &n));
+			Assert::AreEqual<ULONG>(100, n);
+			for (ULONG i = 0; i < n; ++i)
+				Assert::AreEqual<int>(0, buf[i]);
+
+			// Copy to another stream straight from the chunks.
+			winstd::com_obj<IStream> dst = winstd::chunked_stream<>::create();
+			move.QuadPart = 0;
+			Assert::AreEqual(S_OK, s->Seek(move, STREAM_SEEK_SET, NULL));
+			ULARGE_INTEGER cb, read, written;
+			cb.QuadPart = ULLONG_MAX;
+			Assert::AreEqual(S_OK, s->CopyTo(dst, cb, &read, &written));
+			Assert::AreEqual<ULONGLONG>(1100, read.QuadPart);
+			Assert::AreEqual<ULONGLONG>(1100, written.QuadPart);
+			Assert::AreEqual(S_OK, dst->Seek(move, STREAM_SEEK_SET, NULL));
+			Assert::AreEqual(S_OK, dst->Read(buf.data(), 1000, &n));
+			Assert::IsTrue(memcmp(buf.data(), data.data(), 1000) == 0);
+		}
+
+		TEST_METHOD(dispatch_invoker)
+		{
+			fake_dispatch obj;
+			{
+				winstd::dispatch_invoker inv(&obj);
+				winstd::variant result;
+				for (LONG i = 0; i < 100; ++i) {
+					inv.call(L"Sub", &result, i, 3L);
+					Assert::AreEqual<int>(VT_I4, V_VT(&result));
+					Assert::AreEqual<LONG>(i - 3, V_I4(&result));
+				}
+				inv.put(L"VALUE", 42L);
+				inv.get(L"value", &result);
+				Assert::AreEqual<LONG>(42, V_I4(&result));
+				Assert::ExpectException<winstd::com_runtime_error>([&] { inv.call(L"Missing", NULL); });
+
+				Assert::AreEqual<ULONG>(3, obj.lookups);
+				Assert::AreEqual<uint64_t>(102, inv.get_stats().calls);
+				Assert::AreEqual<uint64_t>(103, inv.get_stats().lookups);
+				Assert::AreEqual<uint64_t>(0, inv.get_stats().direct_calls);
+			}
+			Assert::AreEqual<ULONG>(1, obj.refcount);
+		}
+
+		TEST_METHOD(class_factory_cache)
+		{
+			fake_factory_cache cache;
+			for (int i = 0; i < 100; ++i) {
+				winstd::com_obj<IDispatch> obj = cache.create<IDispatch>(__uuidof(IDispatch));
+				Assert::IsTrue(obj == &cache.factory.obj);
+			}
+			Assert::AreEqual<ULONG>(1, cache.lookups);
+			Assert::AreEqual<ULONG>(100, cache.factory.created);
+			Assert::AreEqual<LONG>(1, cache.factory.locks);
+			Assert::AreEqual<ULONG>(1, cache.factory.obj.refcount);
+			auto stats = cache.get_stats();
+			Assert::AreEqual<uint64_t>(100, stats.creations);
+			Assert::AreEqual<uint64_t>(99, stats.hits);
+			Assert::AreEqual<uint64_t>(1, stats.misses);
+
+			// A disconnected server makes the factory to be obtained again.
+			cache.factory.fail = RPC_E_DISCONNECTED;
+			winstd::com_obj<IDispatch> obj;
+			Assert::AreEqual(S_OK, cache.create(__uuidof(IDispatch), NULL, CLSCTX_INPROC_SERVER, obj));
+			Assert::AreEqual<ULONG>(2, cache.lookups);
+			Assert::AreEqual<LONG>(1, cache.factory.locks);
+			obj.free();
+
+			winstd::com_obj<IUnknown> unk;
+			Assert::AreEqual(REGDB_E_CLASSNOTREG, cache.create(__uuidof(IUnknown), NULL, CLSCTX_INPROC_SERVER, unk));
+			Assert::AreEqual<uint64_t>(1, cache.get_stats().failures);
+
+			// Another apartment gets its own factory and releases only that.
+			size_t cached = 0, invalidated = 0;
+			thread([&] {
+				if (FAILED(CoInitializeEx(NULL, COINIT_APARTMENTTHREADED)))
+					return;
+				winstd::com_obj<IDispatch> sta_obj;
+				if (SUCCEEDED(cache.create(__uuidof(IDispatch), NULL, CLSCTX_INPROC_SERVER, sta_obj)))
+					cached = cache.size();
+				sta_obj.free();
+				cache.invalidate(__uuidof(IDispatch));
+				invalidated = cache.size();
+				cache.clear();
+				CoUninitialize();
+			}).join();
+			Assert::AreEqual<size_t>(2, cached);
+			Assert::AreEqual<size_t>(1, invalidated);
+			Assert::AreEqual<size_t>(1, cache.size());
+			Assert::AreEqual<ULONG>(3, cache.lookups);
+			Assert::AreEqual<LONG>(1, cache.factory.locks);
+
+			cache.clear();
+			Assert::AreEqual<size_t>(0, cache.size());
+			Assert::AreEqual<LONG>(0, cache.factory.locks);
+			Assert::AreEqual<ULONG>(1, cache.factory.refcount);
+		}
+
+		TEST_METHOD(safearray_view)
+		{
+			SAFEARRAYBOUND bounds[2] = { { 3, 1 }, { 4, -2 } };
+			winstd::safearray sa(SafeArrayCreate(VT_R8, 2, bounds));
+			{
+				winstd::safearray_view<double> v(sa);
+				Assert::AreEqual<size_t>(2, v.rank());
+				Assert::AreEqual<ULONG>(3, v.extent(0));
+				Assert::AreEqual<LONG>(-2, v.lbound(1));
+				Assert::AreEqual<size_t>(12, v.size());
+				v.for_each([](double& e, const LONG* idx) { e = idx[0] * 10.0 + idx[1]; });
+				Assert::AreEqual(21.0, v(2, 1));
+				Assert::IsTrue(v.column(0) == &v(1, 0));
+				Assert::AreEqual(234.0, v.sum());
+				Assert::AreEqual(234.0, v.parallel_sum(5, 3));
+				Assert::AreEqual(19.5, v.mean());
+				Assert::AreEqual(8.0, v.minmax().first);
+				Assert::AreEqual(31.0, v.minmax().second);
+			}
+			LONG idx[2] = { 3, -1 };
+			double value;
+			Assert::AreEqual(S_OK, SafeArrayGetElement(sa, idx, &value));
+			Assert::AreEqual(29.0, value);
+			Assert::ExpectException<std::invalid_argument>([&] { winstd::safearray_view<LONGLONG> v(sa); });
+
+			winstd::safearray cells(SafeArrayCreateVector(VT_VARIANT, 0, 5));
+			{
+				winstd::safearray_view<VARIANT> v(cells);
+				V_VT(&v(1)) = VT_R8;
+				V_VT(&v(2)) = VT_NULL;
+				V_VT(&v(4)) = VT_I4;
+				Assert::AreEqual<size_t>(2, v.count_non_empty());
+			}
+		}
+
+		TEST_METHOD(VariantChangeTypeBatch)
+		{
+			static const LPCOLESTR strings[] = {
+				L"0", L"-0", L"42", L" 42 ", L"+17", L"-128", L"-129", L"255", L"256", L"32767", L"-32768", L"65535",
+				L"2147483647", L"2147483648", L"-2147483648", L"4294967295", L"4294967296",
+				L"9223372036854775807", L"-9223372036854775808", L"18446744073709551615", L"18446744073709551616", L"12345678901234567890", L"-12345678901234567890", L"000000000000000000000042",
+				L"2.5", L"3.5", L"-2.5", L"0.1", L"1e3", L"1.5E-3", L".5", L"5.", L"123456789012345678901234567890",
+				L"1e400", L"abc", L"", L"1,000", L"0x10", L"12 34", L"3.4028236e38" };
+			static const VARTYPE types[] = { VT_I1, VT_I2, VT_I4, VT_INT, VT_I8, VT_UI1, VT_UI2, VT_UI4, VT_UINT, VT_UI8, VT_R4, VT_R8, VT_BOOL };
+			const size_t count = _countof(strings) + 5;
+
+			VARIANT src[count], dst[count];
+			for (size_t i = 0; i < _countof(strings); ++i)
+				src[i] << strings[i];
+			src[_countof(strings)] << static_cast<LONG>(-5) << static_cast<ULONGLONG>(0x8000000000000000) << 1e10 << -0.5 << 2.5f;
+			for (auto& v : dst)
+				VariantInit(&v);
+
+			for (auto vt : types) {
+				uint64_t errors[(count + 63) / 64];
+				size_t failed = winstd::VariantChangeTypeBatch(src, dst, count, vt, errors);
+				size_t expected_failed = 0;
+				for (size_t i = 0; i < count; ++i) {
+					winstd::variant expected;
+					HRESULT hr = VariantChangeTypeEx(&expected, &src[i], LOCALE_INVARIANT, 0, vt);
+					const bool error = (errors[i / 64] >> (i % 64)) & 1;
+					Assert::AreEqual(FAILED(hr), error);
+					if (FAILED(hr)) {
+						expected_failed++;
+						Assert::AreEqual<int>(VT_EMPTY, V_VT(&dst[i]));
+					} else
+						Assert::AreEqual<HRESULT>(VARCMP_EQ, VarCmp(&expected, &dst[i], LOCALE_INVARIANT, 0));
+				}
+				Assert::AreEqual(expected_failed, failed);
+			}
+
+			for (size_t i = 0; i < count; ++i) {
+				VariantClear(&src[i]);
+				VariantClear(&dst[i]);
+			}
+
+			// Strings are parsed in the given locale.
+			VARIANT comma, r8;
+			comma << L"1,5";
+			VariantInit(&r8);
+			Assert::AreEqual<size_t>(0, winstd::VariantChangeTypeBatch(&comma, &r8, 1, VT_R8, NULL, MAKELCID(MAKELANGID(LANG_GERMAN, SUBLANG_GERMAN), SORT_DEFAULT)));
+			Assert::AreEqual(1.5, V_R8(&r8));
+			VariantClear(&comma);
+		}
+
+		TEST_METHOD(variant_codec)
+		{
+			// Numeric arrays are stored as raw blocks.
+			winstd::safearray numbers(SafeArrayCreateVector(VT_R8, 1, 1000));
+			{
+				winstd::safearray_accessor<double> a(numbers);
+				for (size_t i = 0; i < 1000; ++i)
+					a.data()[i] = i * 0.25;
+			}
+			VARIANT v;
+			V_VT(&v) = VT_ARRAY | VT_R8;
+			V_ARRAY(&v) = numbers;
+			Assert::AreEqual<size_t>(2 + 2 + 8 + 1000 * sizeof(double), winstd::variant_codec::encoded_size(v));
+			vector<uint8_t> data;
+			winstd::variant_codec::encode(v, data);
+			Assert::AreEqual<size_t>(winstd::variant_codec::encoded_size(v), data.size());
+
+			// Decode into a preallocated array.
+			winstd::safearray target(SafeArrayCreateVector(VT_R8, 1, 1000));
+			Assert::AreEqual(data.size(), winstd::variant_codec::decode(data.data(), data.size(), target));
+			{
+				winstd::safearray_accessor<double> a(target);
+				Assert::AreEqual(999 * 0.25, a.data()[999]);
+			}
+			winstd::safearray mismatch(SafeArrayCreateVector(VT_R8, 0, 1000));
+			Assert::ExpectException<std::invalid_argument>([&] { winstd::variant_codec::decode(data.data(), data.size(), mismatch); });
+
+			// Mixed tree
+			SAFEARRAYBOUND bounds[2] = { { 2, 0 }, { 3, 1 } };
+			winstd::safearray cells(SafeArrayCreate(VT_VARIANT, 2, bounds));
+			{
+				winstd::safearray_accessor<VARIANT> a(cells);
+				a.data()[0] << L"Hello" << static_cast<LONG>(-7) << 3.5 << static_cast<LONGLONG>(1) << static_cast<BYTE>(200);
+				V_VT(&a.data()[1]) = VT_NULL;
+				VarDecFromStr(L"12345678901234567890.123", LOCALE_INVARIANT, 0, &V_DECIMAL(&a.data()[4]));
+				V_VT(&a.data()[4]) = VT_DECIMAL;
+				V_VT(&a.data()[5]) = VT_ARRAY | VT_R8;
+				SafeArrayCopy(numbers, &V_ARRAY(&a.data()[5]));
+			}
+			V_VT(&v) = VT_ARRAY | VT_VARIANT;
+			V_ARRAY(&v) = cells;
+			winstd::com_obj<IStream> stream = winstd::chunked_stream<>::create();
+			winstd::variant_codec::encode(v, stream);
+			LARGE_INTEGER zero = {};
+			Assert::AreEqual(S_OK, stream->Seek(zero, STREAM_SEEK_SET, NULL));
+			winstd::variant decoded;
+			winstd::variant_codec::decode(stream, decoded);
+			Assert::AreEqual<int>(VT_ARRAY | VT_VARIANT, V_VT(&decoded));
+			Assert::AreEqual<UINT>(2, SafeArrayGetDim(V_ARRAY(&decoded)));
+			{
+				winstd::safearray_accessor<VARIANT> a(cells), b(V_ARRAY(&decoded));
+				for (size_t i = 0; i < 5; ++i) {
+					Assert::AreEqual<int>(V_VT(&a.data()[i]), V_VT(&b.data()[i]));
+					if (V_VT(&a.data()[i]) != VT_NULL)
+						Assert::AreEqual<HRESULT>(VARCMP_EQ, VarCmp(&a.data()[i], &b.data()[i], LOCALE_INVARIANT, 0));
+				}
+				Assert::AreEqual<int>(VT_ARRAY | VT_R8, V_VT(&b.data()[5]));
+				winstd::safearray_accessor<double> c(V_ARRAY(&b.data()[5]));
+				Assert::AreEqual(500 * 0.25, c.data()[500]);
+			}
+
+			// Truncated data
+			data.clear();
+			winstd::variant_codec::encode(v, data);
+			winstd::variant partial;
+			Assert::ExpectException<std::invalid_argument>([&] { winstd::variant_codec::decode(data.data(), data.size() - 1, partial); });
+			Assert::AreEqual<int>(VT_EMPTY, V_VT(&partial));
+		}
+	};
+}
@@ -0,0 +1,105 @@
+﻿/*
+	SPDX-License-Identifier: MIT
+	Copyright © 2022-2024 Amebis
+*/
+
+#include "pch.h"
+#include <map>
+#include <unordered_map>
+
+using namespace std;
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace UnitTests
+{
+	TEST_CLASS(Common)
+	{
+	public:
+		TEST_METHOD(ordinal_icase_compare)
+		{
+			static const wchar_t* const strings[] = {
+				L"",
+				L"a",
+				L"A",
+				L"[",
+				L"winlogon.exe",
+				L"WinLogon.EXE",
+				L"WINLOGON.EXE.",
+				L"C:\\Windows\\System32\\DriverStore\\FileRepository",
+				L"c:\\windows\\system32\\driverstore\\filerepository",
+				L"c:\\windows\\system32\\driverstore\\filerepositorz",
+				L"\u00c4\u00d6\u00dc \u00e4\u00f6\u00fc \u00ff \u0101 \u03b1\u03b2\u03b3 \u0430\u0431\u0432",
+				L"\u00e4\u00f6\u00fc \u00c4\u00d6\u00dc \u0178 \u0100 \u0391\u0392\u0393 \u0410\u0411\u0412",
+				L"\u00e4\u00f6\u00fc \u00c4\u00d6\u00dc \u0178 \u0100 \u0391\u0392\u0393 \u0410\u0411\u0413",
+			};
+			for (auto a : strings) {
+				for (auto b : strings) {
+					const int expected = CompareStringOrdinal(a, -1, b, -1, TRUE) - CSTR_EQUAL;
+					const int result = winstd::ordinal_icase_compare(a, wcslen(a), b, wcslen(b));
+					Assert::AreEqual(expected, result < 0 ? -1 : result > 0 ? 1 : 0);
+				}
+			}
+		}
+
+		TEST_METHOD(ordinal_icase_hash)
+		{
+			unordered_map<wstring, int, winstd::ordinal_icase_hash<>, winstd::ordinal_icase_equal_to<>> cache;
+			cache[L"HKEY_LOCAL_MACHINE\\SOFTWARE\\Microsoft\\Windows NT\\CurrentVersion"] = 1;
+			cache[L"\u00c4\u00d6\u00dc"] = 2;
+			Assert::AreEqual<size_t>(2, cache.size());
+			Assert::AreEqual(1, cache[L"hkey_local_machine\\software\\microsoft\\windows nt\\currentversion"]);
+			Assert::AreEqual(2, cache[L"\u00e4\u00f6\u00fc"]);
+			Assert::AreEqual<size_t>(2, cache.size());
+
+			map<wstring, int, winstd::ordinal_icase_less<>> sorted{ { L"b", 2 }, { L"A", 1 }, { L"C", 3 } };
+			Assert::AreEqual(1, sorted.begin()->second);
+			Assert::IsTrue(sorted.find(wstring_view(L"c")) != sorted.end());
+		}
+
+		TEST_METHOD(guid_map)
+		{
+			winstd::guid_map<string> map;
+			map[__uuidof(IUnknown)] = "IUnknown";
+			map[__uuidof(IDispatch)] = "IDispatch";
+			Assert::AreEqual<size_t>(2, map.size());
+			Assert::AreEqual("IUnknown", map.at(__uuidof(IUnknown)).c_str());
+			Assert::IsFalse(map.try_emplace(__uuidof(IUnknown), "other").second);
+
+			vector<GUID> guids(1000);
+			for (auto& g : guids) {
+				Assert::AreEqual(S_OK, CoCreateGuid(&g));
+				map[g] = winstd::string_guid(g);
+			}
+			Assert::AreEqual<size_t>(1002, map.size());
+			for (size_t i = 0; i < guids.size(); i += 2)
+				Assert::AreEqual<size_t>(1, map.erase(guids[i]));
+			for (size_t i = 0; i < guids.size(); ++i)
+				Assert::AreEqual<size_t>(i % 2, map.count(guids[i]));
+			size_t n = 0;
+			for (auto& v : map) {
+				Assert::IsTrue(winstd::guid_equal(v.first, __uuidof(IUnknown)) || winstd::guid_equal(v.first, __uuidof(IDispatch)) || v.second == (string)winstd::string_guid(v.first));
+				++n;
+			}
+			Assert::AreEqual(map.size(), n);
+
+			winstd::guid_map_rcu<int> rcu;
+			auto snapshot = rcu.snapshot();
+			rcu.update([](winstd::guid_map<int>& m) { m[__uuidof(IUnknown)] = 1; });
+			int value = 0;
+			Assert::IsTrue(rcu.find(__uuidof(IUnknown), value));
+			Assert::AreEqual(1, value);
+			Assert::IsTrue(snapshot->empty());
+		}
+
+		TEST_METHOD(guid_set)
+		{
+			winstd::guid_set set{ __uuidof(IDispatch), __uuidof(IUnknown), __uuidof(IDispatch) };
+			Assert::AreEqual<size_t>(2, set.size());
+			Assert::IsTrue(winstd::guid_equal(*set.begin(), __uuidof(IUnknown)));
+			Assert::IsTrue(set.contains(__uuidof(IDispatch)));
+			Assert::IsFalse(set.insert(__uuidof(IUnknown)).second);
+			Assert::AreEqual<size_t>(1, set.erase(__uuidof(IUnknown)));
+			Assert::IsFalse(set.contains(__uuidof(IUnknown)));
+		}
+	};
+}
@@ -0,0 +1,351 @@
+﻿/*
+	SPDX-License-Identifier: MIT
+	Copyright © 2022-2024 Amebis
+*/
+
+#include "pch.h"
+
+using namespace std;
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace UnitTests
+{
+	class fake_random_pool : public winstd::random_pool
+	{
+	protected:
+		void generate(void* data, size_t size) override
+		{
+			memset(data, 0x5a, size);
+		}
+	};
+
+	TEST_CLASS(Crypt)
+	{
+	public:
+		TEST_METHOD(reusable_hash)
+		{
+			static const uint8_t sha256_abc[] = {
+				0xba, 0x78, 0x16, 0xbf, 0x8f, 0x01, 0xcf, 0xea, 0x41, 0x41, 0x40, 0xde, 0x5d, 0xae, 0x22, 0x23,
+				0xb0, 0x03, 0x61, 0xa3, 0x96, 0x17, 0x7a, 0x9c, 0xb4, 0x10, 0xff, 0x61, 0xf2, 0x00, 0x15, 0xad };
+			static const uint8_t sha256_empty[] = {
+				0xe3, 0xb0, 0xc4, 0x42, 0x98, 0xfc, 0x1c, 0x14, 0x9a, 0xfb, 0xf4, 0xc8, 0x99, 0x6f, 0xb9, 0x24,
+				0x27, 0xae, 0x41, 0xe4, 0x64, 0x9b, 0x93, 0x4c, 0xa4, 0x95, 0x99, 0x1b, 0x78, 0x52, 0xb8, 0x55 };
+			auto& pool = winstd::bcrypt_alg_pool::instance();
+			BCRYPT_ALG_HANDLE alg = pool.get(BCRYPT_SHA256_ALGORITHM);
+			Assert::IsTrue(alg == pool.get(BCRYPT_SHA256_ALGORITHM));
+			vector<uint8_t> object(winstd::reusable_hash::object_length(alg));
+			winstd::reusable_hash hash(alg, object.data(), static_cast<ULONG>(object.size()));
+			Assert::AreEqual<ULONG>(32, hash.length());
+			uint8_t value[32];
+			for (int i = 0; i < 3; ++i) {
+				hash.compute("abc", 3, value);
+				Assert::AreEqual(0, memcmp(value, sha256_abc, sizeof(value)));
+				hash.compute(NULL, 0, value);
+				Assert::AreEqual(0, memcmp(value, sha256_empty, sizeof(value)));
+			}
+			hash.update("a", 1);
+			hash.update("bc", 2);
+			hash.finish(value);
+			Assert::AreEqual(0, memcmp(value, sha256_abc, sizeof(value)));
+		}
+
+		TEST_METHOD(aes_gcm)
+		{
+			BCRYPT_ALG_HANDLE alg = winstd::bcrypt_alg_pool::instance().get(BCRYPT_AES_ALGORITHM, 0, BCRYPT_CHAIN_MODE_GCM);
+			uint8_t secret[32] = {}, nonce[12] = { 1 }, aad[] = { 'h', 'd', 'r' }, tag[16];
+			winstd::bcrypt_key key;
+			Assert::IsTrue(BCRYPT_SUCCESS(BCryptGenerateSymmetricKey(alg, NULL, 0, secret, sizeof(secret), 0, key)));
+			char data[] = "The quick brown fox jumps over the lazy dog";
+			const string plain(data);
+			winstd::aes_gcm_encrypt(key, nonce, sizeof(nonce), aad, sizeof(aad), data, static_cast<ULONG>(plain.size()), tag, sizeof(tag));
+			Assert::AreNotEqual(0, memcmp(data, plain.data(), plain.size()));
+			char copy[sizeof(data)];
+			memcpy(copy, data, sizeof(data));
+			Assert::IsTrue(winstd::aes_gcm_decrypt(key, nonce, sizeof(nonce), aad, sizeof(aad), data, static_cast<ULONG>(plain.size()), tag, sizeof(tag)));
+			Assert::AreEqual(plain, string(data, plain.size()));
+			copy[5] ^= 1;
+			Assert::IsFalse(winstd::aes_gcm_decrypt(key, nonce, sizeof(nonce), aad, sizeof(aad), copy, static_cast<ULONG>(plain.size()), tag, sizeof(tag)));
+		}
+
+		TEST_METHOD(aes_ctr)
+		{
+			BCRYPT_ALG_HANDLE alg = winstd::bcrypt_alg_pool::instance().get(BCRYPT_AES_ALGORITHM, 0, BCRYPT_CHAIN_MODE_ECB);
+			uint8_t secret[16] = { 0x2b, 0x7e, 0x15, 0x16, 0x28, 0xae, 0xd2, 0xa6, 0xab, 0xf7, 0x15, 0x88, 0x09, 0xcf, 0x4f, 0x3c };
+			winstd::bcrypt_key key;
+			Assert::IsTrue(BCRYPT_SUCCESS(BCryptGenerateSymmetricKey(alg, NULL, 0, secret, sizeof(secret), 0, key)));
+
+			// NIST SP 800-38A F.5.1, first block
+			static const uint8_t counter[16] = { 0xf0, 0xf1, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8, 0xf9, 0xfa, 0xfb, 0xfc, 0xfd, 0xfe, 0xff };
+			uint8_t block[16] = { 0x6b, 0xc1, 0xbe, 0xe2, 0x2e, 0x40, 0x9f, 0x96, 0xe9, 0x3d, 0x7e, 0x11, 0x73, 0x93, 0x17, 0x2a };
+			static const uint8_t expected[16] = { 0x87, 0x4d, 0x61, 0x91, 0xb6, 0x20, 0xe3, 0x26, 0x1b, 0xef, 0x68, 0x64, 0x99, 0x0d, 0xb6, 0xce };
+			winstd::aes_ctr_crypt(key, counter, block, sizeof(block));
+			Assert::AreEqual(0, memcmp(block, expected, sizeof(block)));
+
+			vector<uint8_t> data(10000);
+			for (size_t i = 0; i < data.size(); ++i)
+				data[i] = static_cast<uint8_t>(i * 7);
+			vector<uint8_t> orig(data);
+			winstd::aes_ctr_crypt(key, counter, data.data(), data.size());
+			Assert::IsFalse(data == orig);
+			winstd::aes_ctr_crypt(key, counter, data.data(), data.size());
+			Assert::IsTrue(data == orig);
+		}
+
+		TEST_METHOD(x509_cert)
+		{
+			static const uint8_t der[] = {
+				0x30, 0x82, 0x02, 0x7d, 0x30, 0x82, 0x02, 0x23, 0xa0, 0x03, 0x02, 0x01, 0x02, 0x02, 0x14, 0x4f,
+				0x99, 0xe6, 0xae, 0xc4, 0x2f, 0x7a, 0x65, 0xb4, 0x11, 0xdf, 0xbb, 0x69, 0x94, 0x26, 0xfa, 0x3a,
+				0x05, 0x19, 0x11, 0x30, 0x0a, 0x06, 0x08, 0x2a, 0x86, 0x48, 0xce, 0x3d, 0x04, 0x03, 0x02, 0x30,
+				0x57, 0x31, 0x0b, 0x30, 0x09, 0x06, 0x03, 0x55, 0x04, 0x06, 0x13, 0x02, 0x53, 0x49, 0x31, 0x0f,
+				0x30, 0x0d, 0x06, 0x03, 0x55, 0x04, 0x0a, 0x0c, 0x06, 0x41, 0x6d, 0x65, 0x62, 0x69, 0x73, 0x31,
+				0x1c, 0x30, 0x0b, 0x06, 0x03, 0x55, 0x04, 0x0b, 0x0c, 0x04, 0x54, 0x65, 0x73, 0x74, 0x30, 0x0d,
+				0x06, 0x03, 0x55, 0x04, 0x07, 0x0c, 0x06, 0x4b, 0x61, 0x6d, 0x6e, 0x69, 0x6b, 0x31, 0x19, 0x30,
+				0x17, 0x06, 0x03, 0x55, 0x04, 0x03, 0x0c, 0x10, 0x74, 0x65, 0x73, 0x74, 0x2e, 0x65, 0x78, 0x61,
+				0x6d, 0x70, 0x6c, 0x65, 0x2e, 0x63, 0x6f, 0x6d, 0x30, 0x1e, 0x17, 0x0d, 0x32, 0x36, 0x31, 0x30,
+				0x31, 0x38, 0x30, 0x38, 0x32, 0x33, 0x35, 0x31, 0x5a, 0x17, 0x0d, 0x33, 0x36, 0x31, 0x30, 0x31,
+				0x35, 0x30, 0x38, 0x32, 0x33, 0x35, 0x31, 0x5a, 0x30, 0x57, 0x31, 0x0b, 0x30, 0x09, 0x06, 0x03,
+				0x55, 0x04, 0x06, 0x13, 0x02, 0x53, 0x49, 0x31, 0x0f, 0x30, 0x0d, 0x06, 0x03, 0x55, 0x04, 0x0a,
+				0x0c, 0x06, 0x41, 0x6d, 0x65, 0x62, 0x69, 0x73, 0x31, 0x1c, 0x30, 0x0b, 0x06, 0x03, 0x55, 0x04,
+				0x0b, 0x0c, 0x04, 0x54, 0x65, 0x73, 0x74, 0x30, 0x0d, 0x06, 0x03, 0x55, 0x04, 0x07, 0x0c, 0x06,
+				0x4b, 0x61, 0x6d, 0x6e, 0x69, 0x6b, 0x31, 0x19, 0x30, 0x17, 0x06, 0x03, 0x55, 0x04, 0x03, 0x0c,
+				0x10, 0x74, 0x65, 0x73, 0x74, 0x2e, 0x65, 0x78, 0x61, 0x6d, 0x70, 0x6c, 0x65, 0x2e, 0x63, 0x6f,
+				0x6d, 0x30, 0x59, 0x30, 0x13, 0x06, 0x07, 0x2a, 0x86, 0x48, 0xce, 0x3d, 0x02, 0x01, 0x06, 0x08,
+				0x2a, 0x86, 0x48, 0xce, 0x3d, 0x03, 0x01, 0x07, 0x03, 0x42, 0x00, 0x04, 0x08, 0x30, 0x15, 0xc8,
+				0x9d, 0xff, 0xad, 0x3a, 0x1e, 0x8f, 0x8e, 0xae, 0x3c, 0xcc, 0x41, 0x23, 0x90, 0xc7, 0x58, 0x6b,
+				0x42, 0x85, 0x51, 0x98, 0x3d, 0x61, 0x12, 0x41, 0x91, 0xb5, 0x0c, 0x37, 0x48, 0x72, 0x61, 0x03,
+				0xcc, 0x90, 0x17, 0x08, 0xbd, 0xf4, 0xca, 0xa4, 0xc1, 0x35, 0x0d, 0x44, 0xce, 0xc2, 0x78, 0x66,
+				0x26, 0x7b, 0xa9, 0x85, 0x33, 0x3e, 0x9e, 0xa5, 0x45, 0x4a, 0x5a, 0x9d, 0xa3, 0x81, 0xcc, 0x30,
+				0x81, 0xc9, 0x30, 0x1d, 0x06, 0x03, 0x55, 0x1d, 0x0e, 0x04, 0x16, 0x04, 0x14, 0xfc, 0x23, 0x75,
+				0x22, 0xce, 0xf3, 0x23, 0xab, 0x2f, 0x83, 0x81, 0xf8, 0xe1, 0x6f, 0x9b, 0x9e, 0x92, 0x5b, 0x18,
+				0xb3, 0x30, 0x1f, 0x06, 0x03, 0x55, 0x1d, 0x23, 0x04, 0x18, 0x30, 0x16, 0x80, 0x14, 0xfc, 0x23,
+				0x75, 0x22, 0xce, 0xf3, 0x23, 0xab, 0x2f, 0x83, 0x81, 0xf8, 0xe1, 0x6f, 0x9b, 0x9e, 0x92, 0x5b,
+				0x18, 0xb3, 0x30, 0x0f, 0x06, 0x03, 0x55, 0x1d, 0x13, 0x01, 0x01, 0xff, 0x04, 0x05, 0x30, 0x03,
+				0x01, 0x01, 0xff, 0x30, 0x57, 0x06, 0x03, 0x55, 0x1d, 0x11, 0x04, 0x50, 0x30, 0x4e, 0x82, 0x10,
+				0x74, 0x65, 0x73, 0x74, 0x2e, 0x65, 0x78, 0x61, 0x6d, 0x70, 0x6c, 0x65, 0x2e, 0x63, 0x6f, 0x6d,
+				0x82, 0x0f, 0x77, 0x77, 0x77, 0x2e, 0x65, 0x78, 0x61, 0x6d, 0x70, 0x6c, 0x65, 0x2e, 0x63, 0x6f,
+				0x6d, 0x87, 0x04, 0xc0, 0xa8, 0x01, 0x01, 0x81, 0x0d, 0x61, 0x40, 0x65, 0x78, 0x61, 0x6d, 0x70,
+				0x6c, 0x65, 0x2e, 0x63, 0x6f, 0x6d, 0x86, 0x14, 0x68, 0x74, 0x74, 0x70, 0x73, 0x3a, 0x2f, 0x2f,
+				0x65, 0x78, 0x61, 0x6d, 0x70, 0x6c, 0x65, 0x2e, 0x63, 0x6f, 0x6d, 0x2f, 0x30, 0x1d, 0x06, 0x03,
+				0x55, 0x1d, 0x25, 0x04, 0x16, 0x30, 0x14, 0x06, 0x08, 0x2b, 0x06, 0x01, 0x05, 0x05, 0x07, 0x03,
+				0x01, 0x06, 0x08, 0x2b, 0x06, 0x01, 0x05, 0x05, 0x07, 0x03, 0x02, 0x30, 0x0a, 0x06, 0x08, 0x2a,
+				0x86, 0x48, 0xce, 0x3d, 0x04, 0x03, 0x02, 0x03, 0x48, 0x00, 0x30, 0x45, 0x02, 0x20, 0x5d, 0xdd,
+				0x10, 0x8a, 0xbf, 0xda, 0x85, 0x80, 0x4a, 0x64, 0x07, 0x16, 0xb9, 0xec, 0x8d, 0x72, 0xbd, 0x5f,
+				0x81, 0xac, 0x7e, 0x85, 0xab, 0xce, 0xfc, 0x50, 0x99, 0x6e, 0x57, 0x7d, 0x8a, 0x3a, 0x02, 0x21,
+				0x00, 0xc9, 0xed, 0x96, 0x7a, 0x62, 0xab, 0xbf, 0x2a, 0x5b, 0x7a, 0xcf, 0x22, 0x76, 0x47, 0xd5,
+				0x9d, 0x4f, 0xcf, 0x57, 0xd1, 0x5d, 0xe6, 0x43, 0x3c, 0x1b, 0xad, 0xc0, 0xe7, 0xdc, 0xa4, 0xc2,
+				0x8c };
+			winstd::x509_cert cert(der, sizeof(der));
+			Assert::AreEqual(3u, cert.version());
+			Assert::AreEqual<size_t>(sizeof(der), cert.encoded().size());
+			Assert::AreEqual(string("1.2.840.10045.4.3.2"), winstd::der_oid_to_string(cert.signature_algorithm()));
+			Assert::IsTrue(string_view("test.example.com") == cert.common_name());
+
+			auto& subject = cert.subject_attributes();
+			Assert::AreEqual<size_t>(5, subject.size());
+			Assert::AreEqual(string("2.5.4.6"), winstd::der_oid_to_string(subject[0].oid));
+			Assert::IsTrue(string_view("SI") == subject[0].value);
+			Assert::AreEqual<size_t>(2, subject[2].rdn);
+			Assert::AreEqual<size_t>(2, subject[3].rdn);
+			Assert::IsTrue(string_view("Kamnik") == subject[3].value);
+			auto o = winstd::x509_cert::find(cert.issuer_attributes(), string_view("\x55\x04\x0a", 3));
+			Assert::IsNotNull(o);
+			Assert::IsTrue(string_view("Amebis") == o->value);
+
+			auto& san = cert.alt_names();
+			Assert::AreEqual<size_t>(5, san.size());
+			Assert::AreEqual<int>(2, san[1].type);
+			Assert::IsTrue(string_view("www.example.com") == san[1].value);
+			Assert::AreEqual<int>(7, san[2].type);
+			Assert::IsTrue(string_view("\xc0\xa8\x01\x01", 4) == san[2].value);
+			Assert::IsTrue(string_view("a@example.com") == san[3].value);
+
+			Assert::AreEqual<size_t>(2, cert.ekus().size());
+			Assert::AreEqual(string(szOID_PKIX_KP_SERVER_AUTH), winstd::der_oid_to_string(cert.ekus()[0]));
+			Assert::AreEqual(string(szOID_PKIX_KP_CLIENT_AUTH), winstd::der_oid_to_string(cert.ekus()[1]));
+			Assert::AreEqual<size_t>(5, cert.extensions().size());
+			Assert::IsTrue(cert.extensions()[2].critical);
+
+			winstd::cert_context ctx(CertCreateCertificateContext(X509_ASN_ENCODING, der, sizeof(der)));
+			Assert::IsTrue(!!ctx);
+			FILETIME ft;
+			const uint64_t not_after = winstd::der_time_to_filetime(cert.not_after().tag, cert.not_after().value);
+			ft = ctx->pCertInfo->NotAfter;
+			Assert::AreEqual(((uint64_t)ft.dwHighDateTime << 32) | ft.dwLowDateTime, not_after);
+			Assert::AreEqual<size_t>(ctx->pCertInfo->SerialNumber.cbData, cert.serial().size());
+
+			static const uint8_t sha1[] = { 0x85, 0xf4, 0x02, 0x52, 0x94, 0x17, 0x4d, 0x3c, 0xe4, 0x6d, 0x80, 0x91, 0xbc, 0xe2, 0x46, 0xbd, 0x4d, 0x95, 0x5c, 0x82 };
+			PCCERT_CONTEXT certs[64];
+			for (size_t i = 0; i < _countof(certs); ++i)
+				certs[i] = ctx;
+			CERT_CONTEXT broken = *ctx;
+			broken.cbCertEncoded /= 2;
+			certs[7] = &broken;
+			atomic<size_t> valid(0), invalid(0);
+			winstd::x509_parse_batch(certs, _countof(certs), [&](size_t i, const winstd::x509_cert* c, const uint8_t* thumbprint) {
+				if (c) {
+					if (c->common_name() == "test.example.com" && memcmp(thumbprint, sha1, sizeof(sha1)) == 0)
+						++valid;
+				}
+				else if (i == 7)
+					++invalid;
+			}, 4);
+			Assert::AreEqual<size_t>(_countof(certs) - 1, valid);
+			Assert::AreEqual<size_t>(1, invalid);
+
+			Assert::ExpectException<invalid_argument>([&] { winstd::x509_cert c(der, sizeof(der) - 1); });
+		}
+
+		TEST_METHOD(random_pool)
+		{
+			auto& pool = winstd::random_pool::local();
+			uint8_t a[16], b[16];
+			pool.fill(a, sizeof(a));
+			pool.fill(b, sizeof(b));
+			Assert::AreNotEqual(0, memcmp(a, b, sizeof(a)));
+			for (int i = 0; i < 1000; ++i) {
+				GUID g = pool.guid(), h = pool.guid();
+				Assert::AreEqual<int>(0x4000, g.Data3 & 0xf000);
+				Assert::AreEqual<int>(0x80, g.Data4[0] & 0xc0);
+				Assert::IsFalse(IsEqualGUID(g, h));
+			}
+			vector<uint8_t> bulk(100000);
+			pool.fill(bulk.data(), bulk.size());
+			size_t zeros = 0;
+			for (auto x : bulk)
+				if (!x) ++zeros;
+			Assert::IsTrue(zeros < 1000);
+			pool.wipe();
+			uint64_t x = pool.get<uint64_t>(), y = pool.get<uint64_t>();
+			Assert::AreNotEqual(x, y);
+
+			fake_random_pool fake;
+			Assert::IsNull(winstd::random_pool::install(&fake));
+			Assert::AreEqual<uint32_t>(0x5a5a5a5a, winstd::random_pool::local().get<uint32_t>());
+			Assert::IsTrue(winstd::random_pool::install(NULL) == &fake);
+			Assert::IsTrue(&winstd::random_pool::local() == &pool);
+		}
+
+		TEST_METHOD(base64)
+		{
+			static const char* vectors[][2] = {
+				{ "", "" }, { "f", "Zg==" }, { "fo", "Zm8=" }, { "foo", "Zm9v" }, { "foob", "Zm9vYg==" }, { "fooba", "Zm9vYmE=" }, { "foobar", "Zm9vYmFy" } };
+			for (auto& v : vectors) {
+				string text;
+				winstd::base64_encode(v[0], strlen(v[0]), text);
+				Assert::AreEqual(string(v[1]), text);
+				vector<char> data;
+				winstd::base64_decode(v[1], strlen(v[1]), data);
+				Assert::AreEqual(string(v[0]), string(data.begin(), data.end()));
+			}
+
+			vector<uint8_t> data(1000);
+			for (size_t i = 0; i < data.size(); ++i)
+				data[i] = static_cast<uint8_t>(i * 13 + (i >> 3));
+			winstd::sanitizing_string text;
+			winstd::base64_encode(data.data(), data.size(), text);
+			Assert::AreEqual(winstd::base64_encoded_size(data.size()), text.size());
+			Assert::AreEqual(data.size(), winstd::base64_decoded_size(text.data(), text.size()));
+			vector<uint8_t> decoded;
+			winstd::base64_decode(text.data(), text.size(), decoded);
+			Assert::IsTrue(data == decoded);
+
+			winstd::base64_encoder encoder;
+			string streamed;
+			char buf[64];
+			for (size_t i = 0; i < data.size(); i += 7)
+				streamed.append(buf, encoder.update(data.data() + i, min<size_t>(7, data.size() - i), buf));
+			streamed.append(buf, encoder.finish(buf));
+			Assert::IsTrue(string_view(text.data(), text.size()) == streamed);
+			winstd::base64_decoder decoder;
+			decoded.resize(data.size() + 2);
+			size_t written = 0;
+			for (size_t i = 0; i < streamed.size(); i += 33)
+				written += decoder.update(streamed.data() + i, min<size_t>(33, streamed.size() - i), decoded.data() + written);
+			written += decoder.finish(decoded.data() + written);
+			decoded.resize(written);
+			Assert::IsTrue(data == decoded);
+
+			decoded.clear();
+			Assert::ExpectException<invalid_argument>([&] { winstd::base64_decode("Zm9v\r\nYmFy", 10, decoded); });
+			Assert::ExpectException<invalid_argument>([&] { winstd::base64_decode("Zh==", 4, decoded); });
+			Assert::ExpectException<invalid_argument>([&] { winstd::base64_decode("Zg", 2, decoded); });
+			Assert::ExpectException<invalid_argument>([&] { winstd::base64_decode("Zm9v!", 5, decoded, winstd::codec_mode::lenient); });
+			Assert::IsTrue(decoded.empty());
+			winstd::base64_decode("Zm9v\r\nYmFy", 10, decoded, winstd::codec_mode::lenient);
+			winstd::base64_decode(" Zg", 3, decoded, winstd::codec_mode::lenient);
+			Assert::AreEqual(string("foobarf"), string(decoded.begin(), decoded.end()));
+		}
+
+		TEST_METHOD(hex)
+		{
+			static const uint8_t data[] = { 0x00, 0x01, 0x7f, 0x80, 0xab, 0xcd, 0xef, 0xff, 0x10, 0x32, 0x54, 0x76, 0x98, 0xba, 0xdc, 0xfe, 0x5a, 0xa5 };
+			string text;
+			winstd::hex_encode(data, sizeof(data), text);
+			Assert::AreEqual(string("00017f80abcdefff1032547698badcfe5aa5"), text);
+			text.clear();
+			winstd::hex_encode(data, sizeof(data), text, true);
+			Assert::AreEqual(string("00017F80ABCDEFFF1032547698BADCFE5AA5"), text);
+			vector<uint8_t> decoded;
+			winstd::hex_decode(text.data(), text.size(), decoded);
+			Assert::AreEqual<size_t>(sizeof(data), decoded.size());
+			Assert::AreEqual(0, memcmp(data, decoded.data(), sizeof(data)));
+
+			static const char separated[] = "00:01:7f:80 ab-cd-ef-ff";
+			decoded.clear();
+			Assert::ExpectException<invalid_argument>([&] { winstd::hex_decode(separated, sizeof(separated) - 1, decoded); });
+			Assert::ExpectException<invalid_argument>([&] { winstd::hex_decode("abc", 3, decoded, winstd::codec_mode::lenient); });
+			Assert::AreEqual<size_t>(8, winstd::hex_decoded_size(separated, sizeof(separated) - 1, winstd::codec_mode::lenient));
+			winstd::hex_decode(separated, sizeof(separated) - 1, decoded, winstd::codec_mode::lenient);
+			Assert::AreEqual<size_t>(8, decoded.size());
+			Assert::AreEqual(0, memcmp(data, decoded.data(), 8));
+		}
+
+		TEST_METHOD(secret_vault)
+		{
+			winstd::secret_vault vault;
+			Assert::AreEqual<uint32_t>(0, vault.key_id());
+			Assert::AreEqual<uint32_t>(1, vault.rotate());
+			static const char secret[] = "correct horse battery staple";
+			vector<uint8_t> envelopes[3];
+			for (auto& e : envelopes) {
+				vault.encrypt(secret, sizeof(secret), e);
+				Assert::AreEqual(sizeof(secret) + winstd::secret_vault::overhead, e.size());
+				Assert::AreEqual<uint32_t>(1, winstd::secret_vault::key_id(e.data(), e.size()));
+			}
+			Assert::IsFalse(envelopes[0] == envelopes[1]);
+			winstd::secret_vault::buffer plain;
+			vault.decrypt(envelopes[0].data(), envelopes[0].size(), plain);
+			Assert::AreEqual(0, memcmp(plain.data(), secret, sizeof(secret)));
+
+			vector<uint8_t> wrapped1;
+			vault.wrap(1, wrapped1);
+			Assert::AreEqual<uint32_t>(2, vault.rotate());
+			vault.encrypt(secret, sizeof(secret), envelopes[2]);
+			Assert::AreEqual<size_t>(2, vault.rewrap(envelopes, _countof(envelopes)));
+			vault.retire(1);
+			for (auto& e : envelopes) {
+				Assert::AreEqual<uint32_t>(2, winstd::secret_vault::key_id(e.data(), e.size()));
+				vault.decrypt(e.data(), e.size(), plain);
+				Assert::AreEqual(0, memcmp(plain.data(), secret, sizeof(secret)));
+			}
+
+			vector<uint8_t> wrapped2;
+			vault.wrap(2, wrapped2);
+			winstd::secret_vault restored;
+			restored.load(1, wrapped1.data(), wrapped1.size(), false);
+			restored.load(2, wrapped2.data(), wrapped2.size());
+			Assert::AreEqual<uint32_t>(2, restored.key_id());
+			restored.decrypt(envelopes[1].data(), envelopes[1].size(), plain);
+			Assert::AreEqual(0, memcmp(plain.data(), secret, sizeof(secret)));
+
+			envelopes[1][winstd::secret_vault::header_size] ^= 1;
+			Assert::ExpectException<invalid_argument>([&] { restored.decrypt(envelopes[1].data(), envelopes[1].size(), plain); });
+			Assert::ExpectException<invalid_argument>([&] { vault.retire(2); });
+
+			restored.load(3, wrapped1.data(), wrapped1.size(), false);
+			restored.retire(3);
+			Assert::AreEqual<uint32_t>(4, restored.rotate());
+		}
+	};
+}
@@ -0,0 +1,69 @@
+﻿/*
+	SPDX-License-Identifier: MIT
+	Copyright © 2022-2024 Amebis
+*/
+
+#include "pch.h"
+
+using namespace std;
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace UnitTests
+{
+	TEST_CLASS(EAP)
+	{
+	public:
+		TEST_METHOD(eap_tls_fragmenter)
+		{
+			vector<BYTE> message(5000);
+			for (size_t i = 0; i < message.size(); ++i)
+				message[i] = static_cast<BYTE>(i * 31);
+
+			winstd::eap_tls_fragmenter tx, rx;
+			tx.send(message.data(), message.size(), 1000);
+			winstd::eap_tls_fragmenter::fragment f;
+			vector<BYTE> packet;
+			size_t fragments = 0;
+			bool complete = false;
+			while (tx.next(f)) {
+				Assert::IsFalse(complete);
+				Assert::IsTrue(f.packet_size() <= 1000);
+				Assert::AreEqual(fragments == 0, (f.flags & winstd::eap_tls_fragmenter::flag_length_included) != 0);
+				Assert::IsTrue(f.data >= message.data() && f.data + f.size <= message.data() + message.size());
+				packet.resize(f.packet_size());
+				f.write_packet(EapCodeRequest, 1, winstd::eap_type_t::tls, packet.data());
+				complete = rx.receive(reinterpret_cast<const EapPacket*>(packet.data()), packet.size());
+				++fragments;
+			}
+			Assert::IsTrue(complete);
+			Assert::AreEqual<size_t>(6, fragments);
+			Assert::AreEqual(message.size(), rx.message().size());
+			Assert::AreEqual(0, memcmp(message.data(), rx.message().data(), message.size()));
+
+			// Packets never exceed the EAP Length field.
+			vector<BYTE> large(100000);
+			tx.send(large.data(), large.size(), 1000000);
+			Assert::IsTrue(tx.next(f));
+			Assert::IsTrue(f.packet_size() <= 0xffff);
+
+			// Single fragment is not copied.
+			static const BYTE single[] = { 0x00, 0x16, 0x03, 0x01 };
+			Assert::IsTrue(rx.receive(single, sizeof(single)));
+			Assert::IsTrue(reinterpret_cast<const BYTE*>(rx.message().data()) == single + 1);
+			Assert::AreEqual<size_t>(3, rx.message().size());
+
+			// Limits
+			static const BYTE too_large[] = { 0xc0, 0x00, 0x10, 0x00, 0x01, 0x16 };
+			Assert::ExpectException<invalid_argument>([&] { rx.receive(too_large, sizeof(too_large)); });
+			static const BYTE no_length[] = { 0x40, 0x16 };
+			Assert::ExpectException<invalid_argument>([&] { rx.receive(no_length, sizeof(no_length)); });
+			static const BYTE first[] = { 0xc0, 0x00, 0x00, 0x00, 0x04, 0x16, 0x03 }, overflow[] = { 0x00, 0x01, 0x02, 0x03 };
+			Assert::IsFalse(rx.receive(first, sizeof(first)));
+			Assert::ExpectException<invalid_argument>([&] { rx.receive(overflow, sizeof(overflow)); });
+			winstd::eap_tls_fragmenter limited(0x10000, 1);
+			static const BYTE more[] = { 0x40, 0x01 };
+			Assert::IsFalse(limited.receive(first, sizeof(first)));
+			Assert::ExpectException<invalid_argument>([&] { limited.receive(more, sizeof(more)); });
+		}
+	};
+}
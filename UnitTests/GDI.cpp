@@ -0,0 +1,83 @@
+﻿/*
+	SPDX-License-Identifier: MIT
+	Copyright © 2022-2024 Amebis
+*/
+
+#include "pch.h"
+
+using namespace std;
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace UnitTests
+{
+	class fake_icon_cache : public winstd::icon_cache
+	{
+	public:
+		fake_icon_cache(size_t max_icons) : winstd::icon_cache(max_icons) {}
+
+		virtual ~fake_icon_cache()
+		{
+			wait();
+		}
+
+		atomic<int> loads = 0;
+
+	protected:
+		HICON load(const winstd::icon_key& key) override
+		{
+			++loads;
+			if (key.name == L"missing")
+				return NULL;
+			this_thread::sleep_for(chrono::milliseconds(10));
+			return CopyIcon(LoadIcon(NULL, IDI_APPLICATION));
+		}
+	};
+
+	TEST_CLASS(GDI)
+	{
+	public:
+		TEST_METHOD(icon_key)
+		{
+			const auto txt = winstd::icon_key::file(L"C:\\Dir.X\\Readme.TXT", FILE_ATTRIBUTE_NORMAL, 16);
+			Assert::IsTrue(txt.source == winstd::icon_key::source_t::file_type);
+			Assert::AreEqual(wstring(L".txt"), txt.name);
+			Assert::IsTrue(txt == winstd::icon_key::file(L"D:\\notes.txt", FILE_ATTRIBUTE_ARCHIVE, 16));
+			Assert::AreEqual(winstd::icon_key_hash()(txt), winstd::icon_key_hash()(winstd::icon_key::file(L"D:\\notes.txt", FILE_ATTRIBUTE_ARCHIVE, 16)));
+			Assert::IsTrue(txt != winstd::icon_key::file(L"D:\\notes.txt", FILE_ATTRIBUTE_NORMAL, 16, 144));
+			Assert::AreEqual(24, winstd::icon_key::file(L"D:\\notes.txt", FILE_ATTRIBUTE_NORMAL, 16, 144).pixels());
+			Assert::AreEqual(wstring(L"c:\\app\\app.exe"), winstd::icon_key::file(L"C:\\App\\App.EXE", FILE_ATTRIBUTE_NORMAL, 16).name);
+			Assert::IsTrue(winstd::icon_key::file(L"C:\\Dir.X\\README", FILE_ATTRIBUTE_NORMAL, 16).name.empty());
+			Assert::IsTrue(winstd::icon_key::file(L"C:\\Windows", FILE_ATTRIBUTE_DIRECTORY, 16).source == winstd::icon_key::source_t::directory);
+			Assert::AreEqual(wstring(L"#101"), winstd::icon_key::resource(NULL, MAKEINTRESOURCEW(101), 32).name);
+		}
+
+		TEST_METHOD(icon_cache)
+		{
+			fake_icon_cache cache(2);
+			auto a = cache.get(winstd::icon_key::file(L"a.txt", FILE_ATTRIBUTE_NORMAL, 16));
+			Assert::IsNotNull(a.get());
+			Assert::IsTrue(a == cache.get(winstd::icon_key::file(L"B.TXT", FILE_ATTRIBUTE_NORMAL, 16)));
+			Assert::IsNull(cache.get(winstd::icon_key::resource(NULL, L"missing", 16)).get());
+			for (int i = 0; i < 10; ++i)
+				cache.get(winstd::icon_key::file(L"file." + to_wstring(i), FILE_ATTRIBUTE_NORMAL, 16));
+
+			// Held icon survives eviction.
+			auto stats = cache.get_stats();
+			Assert::AreEqual<uint64_t>(1, stats.hits);
+			Assert::AreEqual<uint64_t>(12, stats.misses);
+			Assert::AreEqual<uint64_t>(1, stats.failures);
+			Assert::AreEqual<uint64_t>(9, stats.evictions);
+			Assert::AreEqual<size_t>(2, stats.size);
+			Assert::IsTrue(a == cache.get(winstd::icon_key::file(L"c.txt", FILE_ATTRIBUTE_NORMAL, 16)));
+
+			// Concurrent asynchronous requests share one load.
+			atomic<int> received = 0;
+			const int loads = cache.loads;
+			for (int i = 0; i < 6; ++i)
+				cache.get_async(winstd::icon_key::file(L"archive.zip", FILE_ATTRIBUTE_NORMAL, 32), [&](const shared_ptr<winstd::icon>& i) { if (i) ++received; });
+			cache.wait();
+			Assert::AreEqual(6, received.load());
+			Assert::AreEqual(loads + 1, cache.loads.load());
+		}
+	};
+}
@@ -0,0 +1,95 @@
+﻿/*
+	SPDX-License-Identifier: MIT
+	Copyright © 2022-2024 Amebis
+*/
+
+#include "pch.h"
+
+using namespace std;
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace UnitTests
+{
+	class fake_msi_property_bag : public winstd::msi_property_bag
+	{
+	public:
+		fake_msi_property_bag() : winstd::msi_property_bag(0) {}
+
+		map<wstring, wstring> properties;
+		size_t formats = 0, gets = 0, sets = 0;
+
+	protected:
+		wstring format_record(wstring_view tmpl) override
+		{
+			++formats;
+			wstring text;
+			for (size_t i = 0; i < tmpl.size();) {
+				if (tmpl[i] == L'[') {
+					const size_t end = tmpl.find(L']', i);
+					text += properties[wstring(tmpl.substr(i + 1, end - i - 1))];
+					i = end + 1;
+				}
+				else
+					text += tmpl[i++];
+			}
+			return text;
+		}
+
+		wstring get_property(LPCWSTR name) override
+		{
+			++gets;
+			return properties[name];
+		}
+
+		void set_property(LPCWSTR name, LPCWSTR value) override
+		{
+			++sets;
+			properties[name] = value;
+		}
+	};
+
+	TEST_CLASS(MSI)
+	{
+	public:
+		TEST_METHOD(msi_property_bag)
+		{
+			fake_msi_property_bag bag;
+			bag.properties = { { L"A", L"1" }, { L"B", L"" }, { L"C", L"3" }, { L"INSTALLDIR", L"C:\\Program Files\\Foo\\" } };
+
+			// Prefetch in a single call
+			bag.prefetch({ L"INSTALLDIR", L"A", L"B", L"A" });
+			Assert::AreEqual<size_t>(1, bag.formats);
+			Assert::IsTrue(bag.get(L"A") == L"1");
+			Assert::IsTrue(bag.get(L"B").empty());
+			Assert::IsTrue(bag.get(L"INSTALLDIR") == L"C:\\Program Files\\Foo\\");
+			Assert::AreEqual<size_t>(0, bag.gets);
+			Assert::IsTrue(bag.get(L"C") == L"3");
+			Assert::IsTrue(bag.get(L"C") == L"3");
+			Assert::AreEqual<size_t>(1, bag.gets);
+
+			// Memoized formatting
+			Assert::AreEqual(wstring(L"C:\\Program Files\\Foo\\bin"), bag.format(L"[INSTALLDIR]bin"));
+			bag.format(L"[INSTALLDIR]bin");
+			Assert::AreEqual<size_t>(2, bag.formats);
+
+			// Batched writes
+			bag.set(L"A", L"9");
+			bag.set(L"D", L"4");
+			bag.set(L"A", L"10");
+			Assert::IsTrue(bag.get(L"A") == L"10");
+			Assert::AreEqual<size_t>(0, bag.sets);
+			Assert::AreEqual(wstring(L"104"), bag.format(L"[A][D]"));
+			Assert::AreEqual<size_t>(2, bag.sets);
+			bag.format(L"[INSTALLDIR]bin");
+			Assert::AreEqual<size_t>(4, bag.formats);
+
+			// Values containing the separator fall back to one read per property.
+			bag.properties[L"E"] = L"x\x1fy";
+			bag.prefetch({ L"A", L"E" });
+			Assert::AreEqual<size_t>(3, bag.gets);
+			Assert::IsTrue(bag.get(L"E") == L"x\x1fy");
+
+			Assert::ExpectException<invalid_argument>([&] { bag.prefetch({ L"[A]" }); });
+		}
+	};
+}
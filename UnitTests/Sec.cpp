@@ -0,0 +1,120 @@
+﻿/*
+	SPDX-License-Identifier: MIT
+	Copyright © 2022-2024 Amebis
+*/
+
+#include "pch.h"
+
+using namespace std;
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace UnitTests
+{
+	class fake_acceptor : public winstd::sspi_acceptor
+	{
+	public:
+		fake_acceptor() : winstd::sspi_acceptor(NULL, ASC_REQ_ALLOCATE_MEMORY | ASC_REQ_CONFIDENTIALITY, 16, 2) {}
+
+		size_t deleted = 0;
+
+	protected:
+		SECURITY_STATUS accept(PCredHandle, PCtxtHandle context, PSecBufferDesc input, ULONG context_req, PCtxtHandle new_context, PSecBufferDesc output, PULONG attrib, PTimeStamp) override
+		{
+			Assert::IsFalse(context_req & ASC_REQ_ALLOCATE_MEMORY);
+			const string_view token(static_cast<const char*>(input->pBuffers[0].pvBuffer), input->pBuffers[0].cbBuffer);
+			SecBuffer& out = output->pBuffers[0];
+			if (token.size() < 5)
+				return SEC_E_INCOMPLETE_MESSAGE;
+			const char* reply;
+			SECURITY_STATUS status;
+			if (!context && token == "hello") {
+				new_context->dwLower = 42;
+				reply = "challenge";
+				status = SEC_I_CONTINUE_NEEDED;
+			}
+			else if (context && context->dwLower == 42 && token.substr(0, 5) == "proof") {
+				reply = "ok";
+				status = SEC_E_OK;
+				if (token.size() > 5) {
+					input->pBuffers[1].BufferType = SECBUFFER_EXTRA;
+					input->pBuffers[1].cbBuffer = static_cast<ULONG>(token.size() - 5);
+				}
+			}
+			else if (!context && token == "complete") {
+				new_context->dwLower = 42;
+				reply = "done";
+				status = SEC_I_COMPLETE_NEEDED;
+			}
+			else
+				return SEC_E_LOGON_DENIED;
+			out.cbBuffer = static_cast<ULONG>(strlen(reply));
+			memcpy(out.pvBuffer, reply, out.cbBuffer);
+			*attrib = ASC_RET_CONFIDENTIALITY;
+			return status;
+		}
+
+		SECURITY_STATUS complete_token(PCtxtHandle, PSecBufferDesc) override
+		{
+			return SEC_E_INTERNAL_ERROR;
+		}
+
+		void delete_context(PCtxtHandle context) noexcept override
+		{
+			if (context->dwLower == 42)
+				++deleted;
+		}
+	};
+
+	TEST_CLASS(Sec)
+	{
+	public:
+		TEST_METHOD(sspi_acceptor)
+		{
+			fake_acceptor acceptor;
+			{
+				auto s = acceptor.acquire();
+				Assert::IsTrue(s->get_state() == winstd::sspi_acceptor::state::idle);
+				Assert::AreEqual(SEC_E_INCOMPLETE_MESSAGE, acceptor.step(*s, "hel", 3));
+				Assert::IsTrue(s->get_state() == winstd::sspi_acceptor::state::incomplete);
+				Assert::IsNull(s->context());
+				Assert::AreEqual(SEC_I_CONTINUE_NEEDED, acceptor.step(*s, "hello", 5));
+				Assert::IsTrue(s->get_state() == winstd::sspi_acceptor::state::in_progress);
+				Assert::AreEqual(string("challenge"), string(static_cast<const char*>(s->token()), s->token_size()));
+				Assert::AreEqual(SEC_E_OK, acceptor.step(*s, "proof+app", 9));
+				Assert::IsTrue(s->get_state() == winstd::sspi_acceptor::state::complete);
+				Assert::AreEqual(string("ok"), string(static_cast<const char*>(s->token()), s->token_size()));
+				Assert::AreEqual<size_t>(4, s->extra());
+				Assert::AreEqual<ULONG>(ASC_RET_CONFIDENTIALITY, s->attributes());
+				Assert::IsNotNull(s->context());
+				Assert::AreEqual<size_t>(3, s->legs().size());
+			}
+			Assert::AreEqual<size_t>(1, acceptor.deleted);
+			Assert::AreEqual<size_t>(1, acceptor.idle());
+			{
+				auto s = acceptor.acquire();
+				Assert::AreEqual<size_t>(0, acceptor.idle());
+				Assert::IsTrue(s->get_state() == winstd::sspi_acceptor::state::idle);
+				Assert::AreEqual<size_t>(0, s->legs().size());
+				Assert::AreEqual(SEC_E_LOGON_DENIED, acceptor.step(*s, "proof", 5));
+				Assert::IsTrue(s->get_state() == winstd::sspi_acceptor::state::failed);
+				Assert::AreEqual(SEC_E_LOGON_DENIED, acceptor.step(*s, "hello", 5));
+			}
+			{
+				auto a = acceptor.acquire(), b = acceptor.acquire(), c = acceptor.acquire();
+			}
+			Assert::AreEqual<size_t>(2, acceptor.idle());
+			auto stats = acceptor.get_stats();
+			Assert::AreEqual<uint64_t>(1, stats.completed);
+			Assert::AreEqual<uint64_t>(1, stats.failed);
+			Assert::AreEqual<uint64_t>(4, stats.legs);
+
+			// A context created by a leg that fails to complete is still deleted.
+			{
+				auto s = acceptor.acquire();
+				Assert::AreEqual(SEC_E_INTERNAL_ERROR, acceptor.step(*s, "complete", 8));
+				Assert::IsTrue(s->get_state() == winstd::sspi_acceptor::state::failed);
+			}
+			Assert::AreEqual<size_t>(2, acceptor.deleted);
+		}
+	};
+}
@@ -10,6 +10,101 @@ using namespace Microsoft::VisualStudio::CppUnitTestFramework;
 
 namespace UnitTests
 {
+	class fake_env_expander : public winstd::env_expander
+	{
+	public:
+		fake_env_expander() : winstd::env_expander(2) {}
+
+		env_map vars;
+		size_t snapshots = 0;
+
+	protected:
+		void snapshot(_Out_ env_map& env) override
+		{
+			++snapshots;
+			env = vars;
+		}
+	};
+
+	class failing_file_copier : public winstd::file_copier
+	{
+	public:
+		failing_file_copier(const winstd::file_copy_options& options) : winstd::file_copier(options) {}
+
+	protected:
+		void write(request&) override
+		{
+			throw winstd::win_runtime_error(ERROR_DISK_FULL, "WriteFile failed");
+		}
+	};
+
+	static void add_process(_Inout_ vector<unsigned char>& buf, _Inout_ size_t& last, _In_ DWORD pid, _In_ DWORD parent, _In_ LONGLONG create_time, _In_z_ const wchar_t* image)
+	{
+		// Records are captured at address 0: image name pointers are offsets into the buffer.
+		const size_t at = buf.size(), length = wcslen(image) * sizeof(wchar_t);
+		if (at)
+			reinterpret_cast<winstd::internal::system_process_information*>(buf.data() + last)->NextEntryOffset = static_cast<ULONG>(at - last);
+		last = at;
+		winstd::internal::system_process_information spi = {};
+		spi.UniqueProcessId = reinterpret_cast<HANDLE>(static_cast<ULONG_PTR>(pid));
+		spi.InheritedFromUniqueProcessId = reinterpret_cast<HANDLE>(static_cast<ULONG_PTR>(parent));
+		spi.CreateTime = create_time;
+		spi.ImageName.Length = spi.ImageName.MaximumLength = static_cast<USHORT>(length);
+		spi.ImageName.Buffer = length ? reinterpret_cast<PWSTR>(at + sizeof(spi)) : NULL;
+		buf.resize(at + ((sizeof(spi) + length + 7) & ~static_cast<size_t>(7)));
+		memcpy(buf.data() + at, &spi, sizeof(spi));
+		memcpy(buf.data() + at + sizeof(spi), image, length);
+	}
+
+	static void add_usn_record(_Inout_ vector<unsigned char>& buf, _In_ USN usn, _In_ ULONGLONG id, _In_ ULONGLONG parent, _In_ DWORD reason, _In_z_ const wchar_t* name)
+	{
+		const size_t at = buf.size(), length = wcslen(name) * sizeof(wchar_t), size = (offsetof(USN_RECORD_V2, FileName) + length + 7) & ~static_cast<size_t>(7);
+		USN_RECORD_V2 r = {};
+		r.RecordLength = static_cast<DWORD>(size);
+		r.MajorVersion = 2;
+		r.FileReferenceNumber = id;
+		r.ParentFileReferenceNumber = parent;
+		r.Usn = usn;
+		r.Reason = reason;
+		r.FileNameLength = static_cast<WORD>(length);
+		r.FileNameOffset = offsetof(USN_RECORD_V2, FileName);
+		buf.resize(at + size);
+		memcpy(buf.data() + at, &r, offsetof(USN_RECORD_V2, FileName));
+		memcpy(buf.data() + at + r.FileNameOffset, name, length);
+	}
+
+	class fake_usn_journal : public winstd::usn_journal
+	{
+	public:
+		fake_usn_journal() : winstd::usn_journal(NULL, 0x1000) {}
+
+		USN_JOURNAL_DATA_V0 journal = {};
+		vector<vector<unsigned char>> batches;
+		size_t reads = 0;
+
+	protected:
+		void query(_Out_ USN_JOURNAL_DATA_V0& data) override
+		{
+			data = journal;
+		}
+
+		DWORD read_journal(_In_ const READ_USN_JOURNAL_DATA_V1& in, _Out_writes_bytes_to_(size, return) void* data, _In_ DWORD size) override
+		{
+			Assert::AreEqual<DWORDLONG>(journal.UsnJournalID, in.UsnJournalID);
+			USN next = in.StartUsn;
+			DWORD returned = sizeof(USN);
+			if (reads < batches.size()) {
+				auto& batch = batches[reads++];
+				Assert::IsTrue(sizeof(USN) + batch.size() <= size);
+				memcpy(static_cast<unsigned char*>(data) + sizeof(USN), batch.data(), batch.size());
+				returned += static_cast<DWORD>(batch.size());
+				next += 100;
+			}
+			memcpy(data, &next, sizeof(USN));
+			return returned;
+		}
+	};
+
 	TEST_CLASS(Win)
 	{
 	public:
@@ -103,5 +198,193 @@ namespace UnitTests
 			unique_ptr<ACL, winstd::LocalFree_delete<ACL>> acl;
 			Assert::AreEqual<DWORD>(ERROR_SUCCESS, ::SetEntriesInAcl((ULONG)eas.size(), eas.data(), NULL, acl));
 		}
+
+		TEST_METHOD(env_expander)
+		{
+			fake_env_expander env;
+			env.vars = { { L"SystemRoot", L"C:\\Windows" }, { L"A", L"1" } };
+			wstring value;
+			env.expand(L"%systemroot%\\System32", value);
+			Assert::AreEqual(L"C:\\Windows\\System32", value.c_str());
+			env.expand(L"%%", value);
+			Assert::AreEqual(L"%%", value.c_str());
+			env.expand(L"%UNDEF%A%", value);
+			Assert::AreEqual(L"%UNDEF1", value.c_str());
+			env.expand(L"100%", value);
+			Assert::AreEqual(L"100%", value.c_str());
+
+			wchar_t buf[8];
+			Assert::AreEqual<size_t>(20, env.expand(L"%SystemRoot%\\System32", buf, _countof(buf)));
+			Assert::AreEqual(L"C:\\Wind", buf);
+			Assert::AreEqual<size_t>(2, env.expand(L"%A%", NULL, 0));
+
+			env.vars[L"A"] = L"2";
+			env.expand(L"%A%", value);
+			Assert::AreEqual(L"1", value.c_str());
+			Assert::IsFalse(env.on_setting_change(WM_SETTINGCHANGE, (LPARAM)L"Policy"));
+			Assert::IsTrue(env.on_setting_change(WM_SETTINGCHANGE, (LPARAM)L"Environment"));
+			env.expand(L"%A%", value);
+			Assert::AreEqual(L"2", value.c_str());
+			Assert::AreEqual<size_t>(2, env.snapshots);
+		}
+
+		TEST_METHOD(process_table)
+		{
+			vector<unsigned char> before, after;
+			size_t last = 0;
+			add_process(before, last, 0, 0, 0, L"");
+			add_process(before, last, 4, 0, 0, L"System");
+			add_process(before, last, 600, 4, 10, L"smss.exe");
+			add_process(before, last, 700, 600, 20, L"winlogon.exe");
+			add_process(before, last, 520, 600, 15, L"WinLogon.EXE");
+			add_process(before, last, 900, 700, 30, L"svchost.exe");
+			winstd::process_table a;
+			a.parse(before.data(), before.size(), 0);
+			Assert::AreEqual<size_t>(6, a.size());
+			Assert::AreEqual<DWORD>(520, a.entries()[2].pid);
+			Assert::IsNotNull(a.find(700));
+			Assert::IsTrue(a.find(700)->image == L"winlogon.exe");
+			Assert::IsNull(a.find(701));
+			auto images = a.find_image(L"WINLOGON.exe");
+			Assert::AreEqual<size_t>(2, images.size());
+			Assert::AreEqual<DWORD>(520, images.begin()[0]->pid);
+			Assert::AreEqual<DWORD>(700, images.begin()[1]->pid);
+			Assert::IsTrue(a.find_image(L"cmd.exe").empty());
+			auto children = a.children(600);
+			Assert::AreEqual<size_t>(2, children.size());
+			Assert::AreEqual<DWORD>(520, children.begin()[0]->pid);
+			Assert::AreEqual<DWORD>(700, a.parent(*a.find(900))->pid);
+			Assert::IsNull(a.parent(*a.find(0)));
+
+			last = 0;
+			add_process(after, last, 0, 0, 0, L"");
+			add_process(after, last, 4, 0, 0, L"System");
+			add_process(after, last, 600, 4, 10, L"smss.exe");
+			add_process(after, last, 700, 600, 20, L"winlogon.exe");
+			add_process(after, last, 900, 700, 99, L"svchost.exe");
+			add_process(after, last, 1000, 900, 100, L"cmd.exe");
+			winstd::process_table b;
+			b.parse(after.data(), after.size(), 0);
+			vector<const winstd::process_table::entry*> started, exited;
+			winstd::process_table::diff(a, b, started, exited);
+			Assert::AreEqual<size_t>(2, started.size());
+			Assert::AreEqual<DWORD>(900, started[0]->pid);
+			Assert::AreEqual<DWORD>(1000, started[1]->pid);
+			Assert::AreEqual<size_t>(2, exited.size());
+			Assert::AreEqual<DWORD>(520, exited[0]->pid);
+			Assert::AreEqual<LONGLONG>(30, exited[1]->create_time);
+
+			after.resize(after.size() - 8);
+			Assert::ExpectException<invalid_argument>([&] { b.parse(after.data(), after.size(), 0); });
+			Assert::ExpectException<invalid_argument>([&] { b.parse(before.data(), before.size()); });
+
+			winstd::process_table live;
+			live.capture();
+			const auto self = live.find(GetCurrentProcessId());
+			Assert::IsNotNull(self);
+			Assert::IsFalse(self->image.empty());
+			Assert::IsFalse(live.find_image(self->image).empty());
+		}
+
+		TEST_METHOD(file_copier)
+		{
+			WCHAR temp[MAX_PATH];
+			Assert::AreNotEqual<DWORD>(0, GetTempPathW(_countof(temp), temp));
+			const wstring source = wstring(temp) + L"WinStd-file_copier.src", destination = wstring(temp) + L"WinStd-file_copier.dst";
+			vector<unsigned char> data(3 * 0x10000 + 123);
+			for (size_t i = 0; i < data.size(); ++i)
+				data[i] = static_cast<unsigned char>(i * 7 + 3);
+			{
+				winstd::file f(CreateFileW(source.c_str(), GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_TEMPORARY, NULL));
+				Assert::IsTrue(!!f);
+				DWORD written;
+				Assert::IsTrue(!!WriteFile(f, data.data(), static_cast<DWORD>(data.size()), &written, NULL));
+			}
+
+			winstd::file_copy_options options;
+			options.chunk_size = 0x10000;
+			options.queue_depth = 4;
+			options.ranges = 2;
+			winstd::file_copier copier(options);
+			copier.copy(source.c_str(), destination.c_str());
+			auto stats = copier.get_stats();
+			Assert::AreEqual<uint64_t>(data.size(), stats.bytes);
+			Assert::AreEqual<uint64_t>(4, stats.writes);
+			Assert::IsTrue(stats.max_depth <= 4);
+
+			vector<unsigned char> copied(data.size() + 1);
+			{
+				winstd::file f(CreateFileW(destination.c_str(), GENERIC_READ, 0, NULL, OPEN_EXISTING, 0, NULL));
+				Assert::IsTrue(!!f);
+				DWORD read;
+				Assert::IsTrue(!!ReadFile(f, copied.data(), static_cast<DWORD>(copied.size()), &read, NULL));
+				Assert::AreEqual<DWORD>(static_cast<DWORD>(data.size()), read);
+			}
+			copied.resize(data.size());
+			Assert::IsTrue(copied == data);
+
+			// A failed copy leaves no preallocated content behind.
+			failing_file_copier failing(options);
+			Assert::ExpectException<winstd::win_runtime_error>([&] { failing.copy(source.c_str(), destination.c_str()); });
+			WIN32_FILE_ATTRIBUTE_DATA attr;
+			Assert::IsTrue(!!GetFileAttributesExW(destination.c_str(), GetFileExInfoStandard, &attr));
+			Assert::AreEqual<DWORD>(0, attr.nFileSizeLow);
+			Assert::AreEqual<DWORD>(0, attr.nFileSizeHigh);
+			DeleteFileW(source.c_str());
+			DeleteFileW(destination.c_str());
+
+			Assert::ExpectException<winstd::win_runtime_error>([&] { copier.copy(source.c_str(), destination.c_str()); });
+			Assert::ExpectException<invalid_argument>([] { winstd::file_copy_options bad; bad.queue_depth = 0; winstd::file_copier c(bad); });
+			Assert::ExpectException<invalid_argument>([] { winstd::file_copy_options bad; bad.queue_depth = SIZE_MAX / bad.chunk_size + 1; winstd::file_copier c(bad); });
+		}
+
+		TEST_METHOD(usn_journal)
+		{
+			vector<unsigned char> records;
+			add_usn_record(records, 10, 5, 1, USN_REASON_FILE_CREATE, L"a.txt");
+			const USN_RECORD_COMMON_HEADER v4 = { 24, 4, 0 };
+			records.resize(records.size() + v4.RecordLength);
+			memcpy(records.data() + records.size() - v4.RecordLength, &v4, sizeof(v4));
+			add_usn_record(records, 11, 6, 1, USN_REASON_DATA_EXTEND, L"big.bin");
+			size_t count = 0;
+			for (auto& r : winstd::usn_records(records.data(), records.size())) {
+				Assert::AreEqual<LONGLONG>(10 + count, r.usn);
+				Assert::AreEqual<ULONGLONG>(5 + count, r.file_id.low);
+				Assert::IsTrue(r.name == (count ? L"big.bin" : L"a.txt"));
+				++count;
+			}
+			Assert::AreEqual<size_t>(2, count);
+			Assert::ExpectException<invalid_argument>([&] { winstd::usn_records(records.data(), records.size() - 8).begin(); });
+
+			fake_usn_journal journal;
+			journal.journal.UsnJournalID = 77;
+			journal.journal.LowestValidUsn = 50;
+			journal.journal.NextUsn = 500;
+			journal.batches.resize(2);
+			add_usn_record(journal.batches[0], 100, 5, 1, USN_REASON_FILE_CREATE, L"tmp");
+			add_usn_record(journal.batches[0], 101, 5, 1, USN_REASON_FILE_CREATE | USN_REASON_FILE_DELETE | USN_REASON_CLOSE, L"tmp");
+			add_usn_record(journal.batches[0], 102, 8, 1, USN_REASON_RENAME_OLD_NAME, L"old.txt");
+			add_usn_record(journal.batches[1], 103, 8, 2, USN_REASON_RENAME_NEW_NAME | USN_REASON_CLOSE, L"new.txt");
+			add_usn_record(journal.batches[1], 104, 9, 1, USN_REASON_DATA_EXTEND, L"log");
+			Assert::IsTrue(journal.start());
+			Assert::AreEqual<USN>(500, journal.cursor().usn);
+			const winstd::usn_cursor saved = { 77, 60 };
+			Assert::IsTrue(journal.start(&saved));
+			winstd::usn_change_set changes;
+			Assert::AreEqual<size_t>(5, journal.read(changes));
+			Assert::AreEqual<USN>(260, journal.cursor().usn);
+			Assert::AreEqual<size_t>(2, changes.size());
+			auto& renamed = changes.changes().at({ 8, 0 });
+			Assert::AreEqual(L"new.txt", renamed.name.c_str());
+			Assert::AreEqual(L"old.txt", renamed.old_name.c_str());
+			Assert::AreEqual<ULONGLONG>(2, renamed.parent_id.low);
+			Assert::AreEqual<ULONGLONG>(1, renamed.old_parent_id.low);
+			Assert::AreEqual<DWORD>(USN_REASON_DATA_EXTEND, changes.changes().at({ 9, 0 }).reason);
+
+			const winstd::usn_cursor purged = { 77, 10 }, recreated = { 78, 100 };
+			Assert::IsFalse(journal.start(&purged));
+			Assert::AreEqual<USN>(500, journal.cursor().usn);
+			Assert::IsFalse(journal.start(&recreated));
+		}
 	};
 }
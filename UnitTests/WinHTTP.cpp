@@ -0,0 +1,230 @@
+﻿/*
+	SPDX-License-Identifier: MIT
+	Copyright © 2022-2024 Amebis
+*/
+
+#include "pch.h"
+
+using namespace std;
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace UnitTests
+{
+	class fake_proxy_resolver_cache : public winstd::proxy_resolver_cache
+	{
+	public:
+		fake_proxy_resolver_cache(size_t capacity = 1024) : winstd::proxy_resolver_cache(NULL, NULL, chrono::seconds(60), chrono::seconds(5), capacity) {}
+
+		atomic<int> calls = 0;
+		bool fail = false;
+		bool changed = false;
+		chrono::steady_clock::time_point time;
+
+	protected:
+		winstd::proxy_info resolve(LPCWSTR url) override
+		{
+			++calls;
+			this_thread::sleep_for(chrono::milliseconds(10));
+			if (fail)
+				throw runtime_error("resolution failed");
+			winstd::proxy_info info;
+			info.access_type = WINHTTP_ACCESS_TYPE_NAMED_PROXY;
+			info.proxy = wstring(L"proxy for ") + url;
+			return info;
+		}
+
+		chrono::steady_clock::time_point now() const override
+		{
+			return time;
+		}
+
+		bool network_changed() override
+		{
+			const bool result = changed;
+			changed = false;
+			return result;
+		}
+	};
+
+	TEST_CLASS(WinHTTP)
+	{
+	public:
+		TEST_METHOD(http_response_parser)
+		{
+			static const char response[] =
+				"HTTP/1.1 200 OK\r\n"
+				"Content-Type: text/plain\r\n"
+				"Transfer-Encoding: gzip, chunked\r\n"
+				"X-Empty:\r\n"
+				"\r\n"
+				"5;name=value\r\nhello\r\n"
+				"A\r\n, world!!!\r\n"
+				"0\r\nTrailer: x\r\n\r\n"
+				"HTTP/1.1";
+			const size_t size = _countof(response) - 1;
+
+			// Feed in pieces of every size to exercise resuming.
+			for (size_t step = 1; step <= size; ++step) {
+				winstd::http_header headers[4];
+				winstd::http_response_parser parser(headers, _countof(headers));
+				string buffer;
+				size_t offset = 0;
+				do {
+					Assert::IsTrue(offset < size);
+					const size_t n = min(step, size - offset);
+					buffer.append(response + offset, n);
+					offset += n;
+				} while (!parser.parse_head(buffer.data(), buffer.size()));
+				Assert::AreEqual(1u, parser.version());
+				Assert::AreEqual(200u, parser.status());
+				Assert::IsTrue(parser.reason() == "OK");
+				Assert::AreEqual<size_t>(3, parser.header_count());
+				Assert::IsTrue(headers[0].name == "Content-Type" && headers[0].value == "text/plain");
+				Assert::IsTrue(headers[2].value.empty());
+				Assert::IsNotNull(parser.find("transfer-encoding"));
+				Assert::IsNull(parser.find("Content-Length"));
+				Assert::IsTrue(parser.body_framing() == winstd::http_response_parser::framing::chunked);
+
+				string body, data = buffer.substr(parser.head_size());
+				for (;;) {
+					size_t consumed, produced;
+					const bool done = parser.parse_body(data.data(), data.size(), consumed, produced);
+					body.append(data.data(), produced);
+					if (done) {
+						Assert::IsTrue(data.substr(consumed) + string(response + offset, size - offset) == "HTTP/1.1");
+						break;
+					}
+					Assert::AreEqual(data.size(), consumed);
+					Assert::IsTrue(offset < size);
+					const size_t n = min(step, size - offset);
+					data.assign(response + offset, n);
+					offset += n;
+				}
+				Assert::AreEqual(string("hello, world!!!"), body);
+			}
+
+			{
+				static const char text[] = "HTTP/1.0 404 Not Found\r\ncontent-length: 3\r\n\r\nabcdef";
+				winstd::http_header headers[1];
+				winstd::http_response_parser parser(headers, _countof(headers));
+				Assert::IsTrue(parser.parse_head(text, _countof(text) - 1));
+				Assert::AreEqual(0u, parser.version());
+				Assert::AreEqual(404u, parser.status());
+				Assert::IsTrue(parser.body_framing() == winstd::http_response_parser::framing::length);
+				char data[6];
+				memcpy(data, text + parser.head_size(), sizeof(data));
+				size_t consumed, produced;
+				Assert::IsTrue(parser.parse_body(data, sizeof(data), consumed, produced));
+				Assert::AreEqual<size_t>(3, consumed);
+				Assert::AreEqual<size_t>(3, produced);
+			}
+
+			{
+				static const char text[] = "HTTP/1.1 304 Not Modified\r\nContent-Length: 3\r\n\r\n";
+				winstd::http_header headers[1];
+				winstd::http_response_parser parser(headers, _countof(headers));
+				Assert::IsTrue(parser.parse_head(text, _countof(text) - 1));
+				Assert::IsTrue(parser.body_framing() == winstd::http_response_parser::framing::none);
+				Assert::IsTrue(parser.finish());
+			}
+
+			static const char* invalid[] = {
+				"HTTP/1.1 200 OK\nA: b\r\n\r\n",
+				"HTTP/2 200 OK\r\n\r\n",
+				"HTTP/1.1 200 OK\r\nA : b\r\n\r\n",
+				"HTTP/1.1 200 OK\r\n A: b\r\n\r\n",
+				"HTTP/1.1 200 OK\r\nA: b\x01\r\n\r\n",
+				"HTTP/1.1 200 OK\r\nContent-Length: 1\r\nContent-Length: 2\r\n\r\n",
+				"HTTP/1.1 200 OK\r\nA: 1\r\nB: 2\r\n\r\n",
+			};
+			for (auto text : invalid) {
+				winstd::http_header headers[1];
+				winstd::http_response_parser parser(headers, _countof(headers));
+				Assert::ExpectException<invalid_argument>([&] { parser.parse_head(text, strlen(text)); });
+			}
+
+			static const char* invalid_chunked[] = { "x\r\n", "5x\r\n", "1\r\nab", "1000000000000000\r\n" };
+			for (auto text : invalid_chunked) {
+				static const char head[] = "HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\n";
+				winstd::http_header headers[1];
+				winstd::http_response_parser parser(headers, _countof(headers));
+				Assert::IsTrue(parser.parse_head(head, _countof(head) - 1));
+				string data(text);
+				size_t consumed, produced;
+				Assert::ExpectException<invalid_argument>([&] { parser.parse_body(data.data(), data.size(), consumed, produced); });
+			}
+
+			{
+				static const char text[] = "HTTP/1.1 200 OK\r\n";
+				winstd::http_limits limits;
+				limits.max_head = 16;
+				winstd::http_header headers[1];
+				winstd::http_response_parser parser(headers, _countof(headers), limits);
+				Assert::ExpectException<invalid_argument>([&] { parser.parse_head(text, _countof(text) - 1); });
+			}
+		}
+
+		TEST_METHOD(proxy_resolver_cache)
+		{
+			fake_proxy_resolver_cache cache;
+			Assert::AreEqual(wstring(L"proxy for https://example.com/"), cache.get(L"HTTPS", L"Example.com").proxy);
+			cache.get(L"https", L"example.com");
+			Assert::AreEqual(1, cache.calls.load());
+			cache.get(L"http", L"example.com");
+			Assert::AreEqual(2, cache.calls.load());
+			Assert::AreEqual(wstring(L"proxy for http://[::1]/"), cache.get(L"http", L"::1").proxy);
+			cache.get(L"http", L"[::1]");
+			Assert::AreEqual(3, cache.calls.load());
+
+			// Expiry and network change
+			cache.time += chrono::seconds(61);
+			cache.get(L"https", L"example.com");
+			Assert::AreEqual(4, cache.calls.load());
+			cache.changed = true;
+			cache.get(L"https", L"example.com");
+			Assert::AreEqual(5, cache.calls.load());
+
+			// Last known good fallback, retried after the shorter interval
+			cache.invalidate();
+			cache.fail = true;
+			Assert::AreEqual(wstring(L"proxy for https://example.com/"), cache.get(L"https", L"example.com").proxy);
+			cache.get(L"https", L"example.com");
+			Assert::AreEqual(6, cache.calls.load());
+			cache.time += chrono::seconds(6);
+			cache.get(L"https", L"example.com");
+			Assert::AreEqual(7, cache.calls.load());
+
+			// Failures without fallback are cached too
+			Assert::ExpectException<runtime_error>([&] { cache.get(L"https", L"new.example.com"); });
+			Assert::ExpectException<runtime_error>([&] { cache.get(L"https", L"new.example.com"); });
+			Assert::AreEqual(8, cache.calls.load());
+
+			// Concurrent lookups coalesce
+			cache.fail = false;
+			cache.time += chrono::seconds(6);
+			const auto before = cache.get_stats();
+			vector<thread> threads;
+			for (int i = 0; i < 8; ++i)
+				threads.emplace_back([&] { cache.get(L"https", L"new.example.com"); });
+			for (auto& t : threads)
+				t.join();
+			const auto after = cache.get_stats();
+			Assert::AreEqual<uint64_t>(1, after.resolutions - before.resolutions);
+			Assert::AreEqual<uint64_t>(8, (after.resolutions - before.resolutions) + (after.coalesced - before.coalesced) + (after.hits - before.hits));
+			Assert::AreEqual<uint64_t>(2, after.fallbacks);
+
+			// Least recently used hosts are evicted
+			fake_proxy_resolver_cache small(2);
+			small.get(L"https", L"a.example.com");
+			small.get(L"https", L"b.example.com");
+			small.get(L"https", L"a.example.com");
+			small.get(L"https", L"c.example.com");
+			Assert::AreEqual<size_t>(2, small.size());
+			Assert::AreEqual(3, small.calls.load());
+			small.get(L"https", L"a.example.com");
+			Assert::AreEqual(3, small.calls.load());
+			small.get(L"https", L"b.example.com");
+			Assert::AreEqual(4, small.calls.load());
+		}
+	};
+}
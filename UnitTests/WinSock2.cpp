@@ -0,0 +1,196 @@
+﻿/*
+	SPDX-License-Identifier: MIT
+	Copyright © 2022-2024 Amebis
+*/
+
+#include "pch.h"
+
+using namespace std;
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace UnitTests
+{
+	class fake_udp_batch : public winstd::udp_batch
+	{
+	public:
+		fake_udp_batch(bool supported) : winstd::udp_batch(INVALID_SOCKET), supported(supported) {}
+
+		bool supported;
+		DWORD segment = 0;
+		vector<pair<string, DWORD>> sent, inbound;
+
+	protected:
+		bool set_send_segment(DWORD size) override
+		{
+			if (!supported)
+				return false;
+			segment = size;
+			return true;
+		}
+
+		bool set_recv_coalesced(DWORD) override
+		{
+			return supported;
+		}
+
+		void send_msg(const WSAMSG& msg) override
+		{
+			Assert::AreEqual<int>(sizeof(SOCKADDR_IN), msg.namelen);
+			sent.push_back({ string(msg.lpBuffers[0].buf, msg.lpBuffers[0].len), segment });
+		}
+
+		bool recv_msg(WSAMSG& msg, DWORD& received) override
+		{
+			if (inbound.empty())
+				return false;
+			auto& in = inbound.front();
+			memcpy(msg.lpBuffers[0].buf, in.first.data(), in.first.size());
+			received = static_cast<DWORD>(in.first.size());
+			SOCKADDR_IN from = {};
+			from.sin_family = AF_INET;
+			from.sin_port = htons(53);
+			memcpy(msg.name, &from, sizeof(from));
+			msg.namelen = sizeof(from);
+			if (in.second) {
+				WSACMSGHDR* c = WSA_CMSG_FIRSTHDR(&msg);
+				c->cmsg_level = IPPROTO_UDP;
+				c->cmsg_type = 3; // UDP_COALESCED_INFO
+				c->cmsg_len = WSA_CMSG_LEN(sizeof(DWORD));
+				memcpy(WSA_CMSG_DATA(c), &in.second, sizeof(DWORD));
+				msg.Control.len = static_cast<ULONG>(WSA_CMSG_SPACE(sizeof(DWORD)));
+			}
+			else
+				msg.Control.len = 0;
+			inbound.erase(inbound.begin());
+			return true;
+		}
+	};
+
+	TEST_CLASS(WinSock2)
+	{
+	public:
+		TEST_METHOD(ip_address)
+		{
+			static const char* canonical[] = {
+				"0.0.0.0", "127.0.0.1", "192.168.100.255",
+				"::", "::1", "2001:db8::1", "2001:db8:0:1:1:1:1:1", "2001:0:0:1::1", "fe80::1%12", "::ffff:10.1.2.3", "1::" };
+			for (auto text : canonical) {
+				winstd::ip_address a;
+				Assert::IsTrue(winstd::ip_address::parse(text, strlen(text), a));
+				Assert::AreEqual(string(text), a.to_string());
+			}
+
+			winstd::ip_address a, b;
+			Assert::IsTrue(winstd::ip_address::parse(L"2001:DB8:0:0:0:0:0:1", 20, a));
+			Assert::AreEqual(wstring(L"2001:db8::1"), a.to_wstring());
+			Assert::IsTrue(winstd::ip_address::parse("::ffff:0a01:0203", 16, b));
+			Assert::IsTrue(b.is_v4_mapped());
+			Assert::AreEqual(string("10.1.2.3"), b.unmapped().to_string());
+
+			SOCKADDR_INET sa;
+			a.to_sockaddr(sa, 443);
+			Assert::AreEqual<int>(AF_INET6, sa.si_family);
+			Assert::IsTrue(winstd::ip_address(reinterpret_cast<const SOCKADDR*>(&sa)) == a);
+			IN6_ADDR in6;
+			Assert::AreEqual(1, InetPtonA(AF_INET6, "2001:db8::1", &in6));
+			Assert::IsTrue(winstd::ip_address(in6) == a);
+
+			static const char* invalid[] = {
+				"", "1.2.3", "1.2.3.4.5", "256.1.1.1", "01.2.3.4", "1.2.3.4 ", ":", ":::", "1::2::3", "12345::", "1:2:3:4:5:6:7:8:9",
+				"1:2:3:4:5:6:7::8", "::1.2.3", "fe80::1%", "fe80::1%x", "1.2.3.4%1" };
+			for (auto text : invalid)
+				Assert::IsFalse(winstd::ip_address::parse(text, strlen(text), a));
+		}
+
+		TEST_METHOD(ip_prefix_trie)
+		{
+			static const char* prefixes[] = { "0.0.0.0/0", "10.0.0.0/8", "10.1.0.0/16", "2001:db8::/32", "2001:db8:1::/48" };
+			winstd::ip_prefix_trie<int> trie;
+			int value = 0;
+			for (auto text : prefixes) {
+				winstd::ip_address prefix;
+				unsigned int bits;
+				Assert::IsTrue(winstd::ip_address::parse_cidr(text, strlen(text), prefix, bits));
+				trie.insert(prefix, bits, ++value);
+			}
+			Assert::AreEqual<size_t>(5, trie.size());
+
+			static const pair<const char*, int> queries[] = {
+				{ "10.1.2.3", 3 }, { "10.2.3.4", 2 }, { "8.8.8.8", 1 }, { "::ffff:10.1.0.1", 3 },
+				{ "2001:db8:1::5", 5 }, { "2001:db8:2::5", 4 }, { "2002::1", 0 } };
+			for (auto& q : queries) {
+				winstd::ip_address a;
+				Assert::IsTrue(winstd::ip_address::parse(q.first, strlen(q.first), a));
+				auto match = trie.match(a);
+				Assert::AreEqual(q.second, match ? *match : 0);
+			}
+
+			winstd::ip_address prefix;
+			unsigned int bits;
+
+			// Short IPv4-mapped prefixes stay IPv6; long ones become IPv4.
+			winstd::ip_prefix_trie<int> mapped;
+			Assert::IsTrue(winstd::ip_address::parse_cidr("::ffff:0:0/80", 13, prefix, bits));
+			mapped.insert(prefix, bits, 1);
+			Assert::IsTrue(winstd::ip_address::parse_cidr("::ffff:10.0.0.0/104", 19, prefix, bits));
+			mapped.insert(prefix, bits, 2);
+			static const pair<const char*, int> mapped_queries[] = {
+				{ "1.2.3.4", 0 }, { "10.1.2.3", 2 }, { "::ffff:1.2.3.4", 1 }, { "::ffff:10.1.2.3", 2 }, { "::1", 1 }, { "2001:db8::1", 0 } };
+			for (auto& q : mapped_queries) {
+				winstd::ip_address a;
+				Assert::IsTrue(winstd::ip_address::parse(q.first, strlen(q.first), a));
+				auto match = mapped.match(a);
+				Assert::AreEqual(q.second, match ? *match : 0);
+			}
+
+			Assert::IsFalse(winstd::ip_address::parse_cidr("10.0.0.0/33", 11, prefix, bits));
+			Assert::IsFalse(winstd::ip_address::parse_cidr("10.0.0.0/", 9, prefix, bits));
+		}
+
+		TEST_METHOD(udp_batch)
+		{
+			SOCKADDR_IN a = {}, b = {};
+			a.sin_family = b.sin_family = AF_INET;
+			a.sin_port = htons(1);
+			b.sin_port = htons(2);
+			static const pair<const char*, SOCKADDR_IN*> out[] = {
+				{ "aaa", &a }, { "bbb", &a }, { "cc", &a }, { "ddd", &a }, { "eeee", &b }, { "", &b }, { "ffffff", &b } };
+
+			fake_udp_batch plain(false);
+			for (auto& o : out)
+				plain.push(o.first, strlen(o.first), reinterpret_cast<const SOCKADDR*>(o.second), sizeof(SOCKADDR_IN));
+			plain.flush();
+			Assert::AreEqual<size_t>(0, plain.pending());
+			Assert::AreEqual<size_t>(_countof(out), plain.sent.size());
+			for (size_t i = 0; i < _countof(out); ++i)
+				Assert::AreEqual(string(out[i].first), plain.sent[i].first);
+
+			fake_udp_batch coalesced(true);
+			for (auto& o : out)
+				coalesced.push(o.first, strlen(o.first), reinterpret_cast<const SOCKADDR*>(o.second), sizeof(SOCKADDR_IN));
+			coalesced.flush();
+			static const pair<const char*, DWORD> expected[] = {
+				{ "aaabbbcc", 3 }, { "ddd", 3 }, { "eeee", 0 }, { "", 0 }, { "ffffff", 0 } };
+			Assert::AreEqual<size_t>(_countof(expected), coalesced.sent.size());
+			for (size_t i = 0; i < _countof(expected); ++i) {
+				Assert::AreEqual(string(expected[i].first), coalesced.sent[i].first);
+				Assert::AreEqual(expected[i].second, coalesced.sent[i].second);
+			}
+
+			coalesced.inbound = { { "1112223", 3 }, { "", 0 }, { "xyz", 0 } };
+			static const char* batches[] = { "111|222|3|", "|", "xyz|" };
+			for (auto batch : batches) {
+				Assert::IsTrue(coalesced.receive());
+				string text;
+				winstd::udp_batch::datagram d;
+				while (coalesced.next(d)) {
+					Assert::AreEqual<int>(53, ntohs(reinterpret_cast<const SOCKADDR_IN*>(d.from)->sin_port));
+					text.append(reinterpret_cast<const char*>(d.data), d.size);
+					text += '|';
+				}
+				Assert::AreEqual(string(batch), text);
+			}
+			Assert::IsFalse(coalesced.receive());
+		}
+	};
+}
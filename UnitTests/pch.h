@@ -20,6 +20,7 @@
 #include <WinStd/SetupAPI.h>
 #include <WinStd/Shell.h>
 #include <WinStd/Win.h>
+#include <WinStd/WinHTTP.h>
 #include <WinStd/WinSock2.h>
 #include <WinStd/WinTrust.h>
 #include <WinStd/WLAN.h>
@@ -11,8 +11,22 @@
 #include "Common.h"
 #include <assert.h>
 #include <unknwn.h>
+#include <objidl.h>
+#include <atomic>
+#include <cfloat>
+#include <charconv>
+#include <chrono>
+#include <cmath>
+#include <exception>
+#include <limits>
+#include <map>
+#include <memory>
+#include <mutex>
 #include <stdexcept>
 #include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
 
 namespace winstd
 {
@@ -1728,5 +1742,2595 @@ namespace winstd
         return fallback;
     }
 
+    /// @}
+}
+
+namespace winstd
+{
+    /// \addtogroup WinStdCOM
+    /// @{
+
+    ///
+    /// Pool of fixed-size memory chunks
+    ///
+    /// Released chunks are kept for reuse up to a limit, so streams that are created and destroyed repeatedly do not go back to
+    /// the heap for every chunk. The pool is thread-safe.
+    ///
+    class chunk_pool
+    {
+        WINSTD_NONCOPYABLE(chunk_pool)
+        WINSTD_NONMOVABLE(chunk_pool)
+
+    public:
+        ///
+        /// Constructs a pool
+        ///
+        /// \param[in] chunk_size  Size of each chunk in bytes
+        /// \param[in] max_free    Maximum number of released chunks kept for reuse
+        ///
+        chunk_pool(_In_ size_t chunk_size = 0x10000, _In_ size_t max_free = 0x100) :
+            m_chunk_size(chunk_size),
+            m_max_free(max_free)
+        {
+            if (!chunk_size)
+                throw std::invalid_argument("zero chunk size");
+        }
+
+        ///
+        /// Frees all pooled chunks
+        ///
+        virtual ~chunk_pool()
+        {
+            for (auto c : m_free)
+                delete[] c;
+        }
+
+        ///
+        /// Returns the process-wide pool with 64 KiB chunks
+        ///
+        static chunk_pool& instance()
+        {
+            static chunk_pool pool;
+            return pool;
+        }
+
+        ///
+        /// Returns size of each chunk in bytes
+        ///
+        size_t chunk_size() const noexcept { return m_chunk_size; }
+
+        ///
+        /// Takes a chunk from the pool or allocates a new one
+        ///
+        /// \return Uninitialized chunk of `chunk_size()` bytes
+        ///
+        uint8_t* acquire()
+        {
+            {
+                std::lock_guard<std::mutex> lock(m_lock);
+                if (!m_free.empty()) {
+                    uint8_t* c = m_free.back();
+                    m_free.pop_back();
+                    return c;
+                }
+            }
+            return new uint8_t[m_chunk_size];
+        }
+
+        ///
+        /// Returns a chunk to the pool
+        ///
+        /// \param[in] c  Chunk previously returned by `acquire()`
+        ///
+        void release(_In_ uint8_t* c) noexcept
+        {
+            if (!c)
+                return;
+            try {
+                std::lock_guard<std::mutex> lock(m_lock);
+                if (m_free.size() < m_max_free) {
+                    m_free.push_back(c);
+                    return;
+                }
+            } catch (...) {}
+            delete[] c;
+        }
+
+    protected:
+        const size_t m_chunk_size;    ///< Chunk size in bytes
+        const size_t m_max_free;      ///< Maximum number of pooled chunks
+        std::mutex m_lock;            ///< Guards m_free
+        std::vector<uint8_t*> m_free; ///< Pooled chunks
+    };
+
+    ///
+    /// Growable byte store made of pooled fixed-size chunks
+    ///
+    /// Growing never moves existing data: new chunks are appended. Areas that were never written read as zeros.
+    /// The store is not thread-safe.
+    ///
+    class chunk_store
+    {
+        WINSTD_NONCOPYABLE(chunk_store)
+
+    public:
+        ///
+        /// Constructs an empty store
+        ///
+        /// \param[in] pool  Pool to take chunks from. Must outlive the store.
+        ///
+        chunk_store(_In_ chunk_pool& pool = chunk_pool::instance()) noexcept :
+            m_pool(&pool),
+            m_size(0)
+        {}
+
+        ///
+        /// Moves a store
+        ///
+        chunk_store(_Inout_ chunk_store&& other) noexcept :
+            m_pool(other.m_pool),
+            m_chunks(std::move(other.m_chunks)),
+            m_size(other.m_size)
+        {
+            other.m_size = 0;
+        }
+
+        ///
+        /// Returns all chunks to the pool
+        ///
+        virtual ~chunk_store()
+        {
+            for (auto c : m_chunks)
+                m_pool->release(c);
+        }
+
+        ///
+        /// Returns data size in bytes
+        ///
+        size_t size() const noexcept { return m_size; }
+
+        ///
+        /// Returns number of bytes allocated
+        ///
+        size_t capacity() const noexcept { return m_chunks.size() * m_pool->chunk_size(); }
+
+        ///
+        /// Grows or shrinks the store
+        ///
+        /// \param[in] size  New size in bytes
+        ///
+        void resize(_In_ size_t size)
+        {
+            const size_t chunk_size = m_pool->chunk_size();
+            if (size > m_size) {
+                const size_t count = size / chunk_size + (size % chunk_size ? 1 : 0);
+                m_chunks.reserve(count);
+                while (m_chunks.size() < count)
+                    m_chunks.push_back(m_pool->acquire());
+                for (size_t pos = m_size; pos < size;) {
+                    const size_t offset = pos % chunk_size, n = (std::min)(chunk_size - offset, size - pos);
+                    memset(m_chunks[pos / chunk_size] + offset, 0, n);
+                    pos += n;
+                }
+            } else {
+                const size_t count = size / chunk_size + (size % chunk_size ? 1 : 0);
+                while (m_chunks.size() > count) {
+                    m_pool->release(m_chunks.back());
+                    m_chunks.pop_back();
+                }
+            }
+            m_size = size;
+        }
+
+        ///
+        /// Reads data
+        ///
+        /// \param[in ] pos  Offset to read from
+        /// \param[out] dst  Buffer to read into
+        /// \param[in ] n    Number of bytes to read
+        ///
+        /// \return Number of bytes read. Less than `n` when reading past the end.
+        ///
+        size_t read(_In_ size_t pos, _Out_writes_bytes_(n) void* dst, _In_ size_t n) const noexcept
+        {
+            size_t total = 0;
+            for_each_span(pos, n, [&](const uint8_t* data, size_t count) {
+                memcpy(static_cast<uint8_t*>(dst) + total, data, count);
+                total += count;
+                return true;
+            });
+            return total;
+        }
+
+        ///
+        /// Writes data growing the store as needed
+        ///
+        /// \param[in] pos  Offset to write to
+        /// \param[in] src  Data to write
+        /// \param[in] n    Number of bytes to write
+        ///
+        void write(_In_ size_t pos, _In_reads_bytes_(n) const void* src, _In_ size_t n)
+        {
+            if (pos + n < pos)
+                throw std::invalid_argument("write beyond address space");
+            if (pos + n > m_size)
+                resize(pos + n);
+            const size_t chunk_size = m_pool->chunk_size();
+            for (size_t done = 0; done < n;) {
+                const size_t offset = (pos + done) % chunk_size, count = (std::min)(chunk_size - offset, n - done);
+                memcpy(m_chunks[(pos + done) / chunk_size] + offset, static_cast<const uint8_t*>(src) + done, count);
+                done += count;
+            }
+        }
+
+        ///
+        /// Calls a function for each contiguous span of data in the range without copying it
+        ///
+        /// \param[in] pos  Offset of the range
+        /// \param[in] n    Length of the range. Trimmed at the end of data.
+        /// \param[in] fn   Function `bool fn(const uint8_t* data, size_t count)`. Return `false` to stop.
+        ///
+        /// \return `true` when all spans were processed; `false` when `fn` stopped early.
+        ///
+        template <class _Fn>
+        bool for_each_span(_In_ size_t pos, _In_ size_t n, _In_ _Fn fn) const
+        {
+            if (pos >= m_size)
+                return true;
+            n = (std::min)(n, m_size - pos);
+            const size_t chunk_size = m_pool->chunk_size();
+            for (size_t done = 0; done < n;) {
+                const size_t offset = (pos + done) % chunk_size, count = (std::min)(chunk_size - offset, n - done);
+                if (!fn(static_cast<const uint8_t*>(m_chunks[(pos + done) / chunk_size] + offset), count))
+                    return false;
+                done += count;
+            }
+            return true;
+        }
+
+    protected:
+        chunk_pool* m_pool;              ///< Chunk pool
+        std::vector<uint8_t*> m_chunks;  ///< Chunks
+        size_t m_size;                   ///< Data size
+    };
+
+    /// \cond internal
+    namespace internal
+    {
+        ///
+        /// Lock doing nothing for single-threaded objects
+        ///
+        struct null_lock
+        {
+            void lock() noexcept {}
+            void unlock() noexcept {}
+        };
+    }
+    /// \endcond
+
+    ///
+    /// Base class for IStream implementations
+    ///
+    /// Implements IUnknown and the IStream members that are the same for all WinStd streams.
+    ///
+    /// \tparam _MT  `true` to make the stream safe to use from multiple threads. Single-threaded streams do no locking at all.
+    ///
+    template <bool _MT>
+    class stream_base : public IStream
+    {
+        WINSTD_NONCOPYABLE(stream_base)
+        WINSTD_NONMOVABLE(stream_base)
+
+    public:
+        /// \cond internal
+        typedef typename std::conditional<_MT, std::mutex, internal::null_lock>::type lock_type;
+        /// \endcond
+
+    protected:
+        ///
+        /// Constructs the object with a reference count of 1
+        ///
+        stream_base() noexcept : m_refcount(1), m_position(0) {}
+
+    public:
+        ///
+        /// Destroys the object
+        ///
+        virtual ~stream_base() {}
+
+        /// \name IUnknown
+        /// @{
+        STDMETHOD(QueryInterface)(_In_ REFIID riid, _COM_Outptr_ void** ppvObject) override
+        {
+            if (!ppvObject)
+                return E_POINTER;
+            if (riid == __uuidof(IUnknown) || riid == __uuidof(ISequentialStream) || riid == __uuidof(IStream)) {
+                *ppvObject = static_cast<IStream*>(this);
+                AddRef();
+                return S_OK;
+            }
+            *ppvObject = NULL;
+            return E_NOINTERFACE;
+        }
+
+        STDMETHOD_(ULONG, AddRef)() override
+        {
+            if constexpr (_MT)
+                return static_cast<ULONG>(InterlockedIncrement(&m_refcount));
+            else
+                return static_cast<ULONG>(++m_refcount);
+        }
+
+        STDMETHOD_(ULONG, Release)() override
+        {
+            LONG refcount;
+            if constexpr (_MT)
+                refcount = InterlockedDecrement(&m_refcount);
+            else
+                refcount = --m_refcount;
+            if (!refcount)
+                delete this;
+            return static_cast<ULONG>(refcount);
+        }
+        /// @}
+
+        /// \name IStream
+        /// @{
+        STDMETHOD(Seek)(_In_ LARGE_INTEGER dlibMove, _In_ DWORD dwOrigin, _Out_opt_ ULARGE_INTEGER* plibNewPosition) override
+        {
+            std::lock_guard<lock_type> lock(m_lock);
+            LONGLONG base;
+            switch (dwOrigin) {
+            case STREAM_SEEK_SET: base = 0; break;
+            case STREAM_SEEK_CUR: base = static_cast<LONGLONG>(m_position); break;
+            case STREAM_SEEK_END: base = static_cast<LONGLONG>(size()); break;
+            default: return STG_E_INVALIDFUNCTION;
+            }
+            const LONGLONG position = base + dlibMove.QuadPart;
+            if (position < 0)
+                return STG_E_INVALIDFUNCTION;
+            m_position = static_cast<ULONGLONG>(position);
+            if (plibNewPosition)
+                plibNewPosition->QuadPart = m_position;
+            return S_OK;
+        }
+
+        STDMETHOD(Commit)(_In_ DWORD grfCommitFlags) override
+        {
+            UNREFERENCED_PARAMETER(grfCommitFlags);
+            return S_OK;
+        }
+
+        STDMETHOD(Revert)() override
+        {
+            return E_NOTIMPL;
+        }
+
+        STDMETHOD(LockRegion)(_In_ ULARGE_INTEGER libOffset, _In_ ULARGE_INTEGER cb, _In_ DWORD dwLockType) override
+        {
+            UNREFERENCED_PARAMETER(libOffset);
+            UNREFERENCED_PARAMETER(cb);
+            UNREFERENCED_PARAMETER(dwLockType);
+            return STG_E_INVALIDFUNCTION;
+        }
+
+        STDMETHOD(UnlockRegion)(_In_ ULARGE_INTEGER libOffset, _In_ ULARGE_INTEGER cb, _In_ DWORD dwLockType) override
+        {
+            UNREFERENCED_PARAMETER(libOffset);
+            UNREFERENCED_PARAMETER(cb);
+            UNREFERENCED_PARAMETER(dwLockType);
+            return STG_E_INVALIDFUNCTION;
+        }
+
+        STDMETHOD(Stat)(_Out_ STATSTG* pstatstg, _In_ DWORD grfStatFlag) override
+        {
+            UNREFERENCED_PARAMETER(grfStatFlag);
+            if (!pstatstg)
+                return STG_E_INVALIDPOINTER;
+            std::lock_guard<lock_type> lock(m_lock);
+            memset(pstatstg, 0, sizeof(*pstatstg));
+            pstatstg->type = STGTY_STREAM;
+            pstatstg->cbSize.QuadPart = size();
+            pstatstg->grfMode = mode();
+            return S_OK;
+        }
+        /// @}
+
+    protected:
+        ///
+        /// Returns stream size in bytes. Called with the lock held.
+        ///
+        virtual ULONGLONG size() const noexcept = 0;
+
+        ///
+        /// Returns STGM access mode of the stream
+        ///
+        virtual DWORD mode() const noexcept = 0;
+
+    protected:
+        LONG m_refcount;       ///< Reference count
+        ULONGLONG m_position;  ///< Seek pointer
+        lock_type m_lock;      ///< Guards stream state
+    };
+
+    ///
+    /// Read-only IStream over a borrowed memory span
+    ///
+    /// The data is not copied. The memory must remain valid and unchanged until the last reference to the stream and all its
+    /// clones is released, unless an owner object keeping the memory alive is attached.
+    ///
+    /// \tparam _MT  `true` to make the stream safe to use from multiple threads
+    ///
+    template <bool _MT = false>
+    class span_stream : public stream_base<_MT>
+    {
+    protected:
+        ///
+        /// Constructs the stream
+        ///
+        span_stream(_In_reads_bytes_(size) const void* data, _In_ size_t size, _In_ const std::shared_ptr<const void>& owner) noexcept :
+            m_data(static_cast<const uint8_t*>(data)),
+            m_size(size),
+            m_owner(owner)
+        {}
+
+    public:
+        ///
+        /// Creates a stream over a memory span
+        ///
+        /// \param[in] data   Data
+        /// \param[in] size   Data size in bytes
+        /// \param[in] owner  Optional object keeping the data alive. Released with the last clone of the stream.
+        ///
+        /// \return Stream
+        ///
+        static com_obj<IStream> create(_In_reads_bytes_(size) const void* data, _In_ size_t size, _In_opt_ std::shared_ptr<const void> owner = nullptr)
+        {
+            if (!data && size)
+                throw std::invalid_argument("data is NULL");
+            return com_obj<IStream>(static_cast<IStream*>(new span_stream(data, size, owner)));
+        }
+
+        /// \name ISequentialStream
+        /// @{
+        STDMETHOD(Read)(_Out_writes_bytes_to_(cb, *pcbRead) void* pv, _In_ ULONG cb, _Out_opt_ ULONG* pcbRead) override
+        {
+            if (!pv)
+                return STG_E_INVALIDPOINTER;
+            std::lock_guard<lock_type> lock(this->m_lock);
+            ULONG count = 0;
+            if (this->m_position < m_size) {
+                count = static_cast<ULONG>((std::min)(static_cast<ULONGLONG>(cb), m_size - this->m_position));
+                memcpy(pv, m_data + this->m_position, count);
+                this->m_position += count;
+            }
+            if (pcbRead)
+                *pcbRead = count;
+            return count == cb ? S_OK : S_FALSE;
+        }
+
+        STDMETHOD(Write)(_In_reads_bytes_(cb) const void* pv, _In_ ULONG cb, _Out_opt_ ULONG* pcbWritten) override
+        {
+            UNREFERENCED_PARAMETER(pv);
+            UNREFERENCED_PARAMETER(cb);
+            if (pcbWritten)
+                *pcbWritten = 0;
+            return STG_E_ACCESSDENIED;
+        }
+        /// @}
+
+        /// \name IStream
+        /// @{
+        STDMETHOD(SetSize)(_In_ ULARGE_INTEGER libNewSize) override
+        {
+            UNREFERENCED_PARAMETER(libNewSize);
+            return STG_E_ACCESSDENIED;
+        }
+
+        STDMETHOD(CopyTo)(_In_ IStream* pstm, _In_ ULARGE_INTEGER cb, _Out_opt_ ULARGE_INTEGER* pcbRead, _Out_opt_ ULARGE_INTEGER* pcbWritten) override
+        {
+            if (!pstm)
+                return STG_E_INVALIDPOINTER;
+            std::lock_guard<lock_type> lock(this->m_lock);
+            ULONGLONG read = 0, written = 0;
+            HRESULT hr = S_OK;
+            if (this->m_position < m_size) {
+                // Write straight from the span: no intermediate buffer.
+                const ULONGLONG n = (std::min)(cb.QuadPart, m_size - this->m_position);
+                for (ULONG count; read < n; read += count) {
+                    count = static_cast<ULONG>((std::min)(n - read, static_cast<ULONGLONG>(ULONG_MAX)));
+                    ULONG w = 0;
+                    hr = pstm->Write(m_data + this->m_position + read, count, &w);
+                    written += w;
+                    if (FAILED(hr)) {
+                        read += count;
+                        break;
+                    }
+                }
+                this->m_position += read;
+            }
+            if (pcbRead)
+                pcbRead->QuadPart = read;
+            if (pcbWritten)
+                pcbWritten->QuadPart = written;
+            return hr;
+        }
+
+        STDMETHOD(Clone)(_COM_Outptr_ IStream** ppstm) override
+        {
+            if (!ppstm)
+                return STG_E_INVALIDPOINTER;
+            try {
+                std::lock_guard<lock_type> lock(this->m_lock);
+                span_stream* stream = new span_stream(m_data, m_size, m_owner);
+                stream->m_position = this->m_position;
+                *ppstm = stream;
+                return S_OK;
+            } catch (const std::bad_alloc&) {
+                *ppstm = NULL;
+                return E_OUTOFMEMORY;
+            } catch (...) {
+                *ppstm = NULL;
+                return E_FAIL;
+            }
+        }
+        /// @}
+
+    protected:
+        /// \cond internal
+        typedef typename stream_base<_MT>::lock_type lock_type;
+        ULONGLONG size() const noexcept override { return m_size; }
+        DWORD mode() const noexcept override { return STGM_READ | STGM_SHARE_DENY_WRITE; }
+        /// \endcond
+
+    protected:
+        const uint8_t* m_data;               ///< Data
+        size_t m_size;                       ///< Data size
+        std::shared_ptr<const void> m_owner; ///< Object keeping the data alive
+    };
+
+    ///
+    /// Read-only IStream over a memory-mapped file
+    ///
+    /// The file is mapped once; the stream and all its clones read directly from the view. The view is unmapped when the last
+    /// clone is released.
+    ///
+    /// \tparam _MT  `true` to make the stream safe to use from multiple threads
+    ///
+    template <bool _MT = false>
+    class mapped_stream : public span_stream<_MT>
+    {
+    public:
+        ///
+        /// Maps the whole file and creates a stream over it
+        ///
+        /// \param[in] hFile  File opened with `GENERIC_READ` access
+        ///
+        /// \return Stream
+        ///
+        /// \sa [CreateFileMapping function](https://learn.microsoft.com/en-us/windows/win32/api/winbase/nf-winbase-createfilemappingw)
+        /// \sa [MapViewOfFile function](https://learn.microsoft.com/en-us/windows/win32/api/memoryapi/nf-memoryapi-mapviewoffile)
+        ///
+        static com_obj<IStream> create(_In_ HANDLE hFile)
+        {
+            LARGE_INTEGER size;
+            if (!GetFileSizeEx(hFile, &size))
+                throw win_runtime_error("GetFileSizeEx failed");
+            if (static_cast<ULONGLONG>(size.QuadPart) > SIZE_MAX)
+                throw std::invalid_argument("file too big to map");
+            if (!size.QuadPart) {
+                // Empty files cannot be mapped.
+                return span_stream<_MT>::create("", 0);
+            }
+            HANDLE mapping = CreateFileMapping(hFile, NULL, PAGE_READONLY, 0, 0, NULL);
+            if (!mapping)
+                throw win_runtime_error("CreateFileMapping failed");
+            const void* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+            if (!view) {
+                last_error_saver last_error_save;
+                CloseHandle(mapping);
+                throw win_runtime_error("MapViewOfFile failed");
+            }
+            CloseHandle(mapping); // The view keeps the mapping object alive.
+            std::shared_ptr<const void> owner(view, [](const void* v) { UnmapViewOfFile(v); });
+            return span_stream<_MT>::create(view, static_cast<size_t>(size.QuadPart), owner);
+        }
+    };
+
+    ///
+    /// Read-write IStream over pooled memory chunks
+    ///
+    /// Growing the stream appends chunks instead of reallocating and copying. Clones share the data and have their own seek
+    /// pointer, like streams created by `CreateStreamOnHGlobal`.
+    ///
+    /// \tparam _MT  `true` to make the stream safe to use from multiple threads
+    ///
+    template <bool _MT = false>
+    class chunked_stream : public stream_base<_MT>
+    {
+    protected:
+        /// \cond internal
+        typedef typename stream_base<_MT>::lock_type lock_type;
+
+        struct shared_data
+        {
+            shared_data(_In_ chunk_pool& pool) : store(pool) {}
+            chunk_store store;
+            lock_type lock;
+        };
+
+        chunked_stream(_In_ const std::shared_ptr<shared_data>& data) noexcept : m_data(data) {}
+        /// \endcond
+
+    public:
+        ///
+        /// Creates an empty stream
+        ///
+        /// \param[in] pool  Pool to take chunks from. Must outlive the stream and all its clones.
+        ///
+        /// \return Stream
+        ///
+        static com_obj<IStream> create(_In_ chunk_pool& pool = chunk_pool::instance())
+        {
+            return com_obj<IStream>(static_cast<IStream*>(new chunked_stream(std::make_shared<shared_data>(pool))));
+        }
+
+        /// \name ISequentialStream
+        /// @{
+        STDMETHOD(Read)(_Out_writes_bytes_to_(cb, *pcbRead) void* pv, _In_ ULONG cb, _Out_opt_ ULONG* pcbRead) override
+        {
+            if (!pv)
+                return STG_E_INVALIDPOINTER;
+            std::lock_guard<lock_type> lock(this->m_lock);
+            std::lock_guard<lock_type> lock_data(m_data->lock);
+            ULONG count = 0;
+            if (this->m_position < m_data->store.size()) {
+                count = static_cast<ULONG>(m_data->store.read(static_cast<size_t>(this->m_position), pv, cb));
+                this->m_position += count;
+            }
+            if (pcbRead)
+                *pcbRead = count;
+            return count == cb ? S_OK : S_FALSE;
+        }
+
+        STDMETHOD(Write)(_In_reads_bytes_(cb) const void* pv, _In_ ULONG cb, _Out_opt_ ULONG* pcbWritten) override
+        {
+            if (pcbWritten)
+                *pcbWritten = 0;
+            if (!pv)
+                return STG_E_INVALIDPOINTER;
+            std::lock_guard<lock_type> lock(this->m_lock);
+            if (this->m_position + cb > SIZE_MAX)
+                return STG_E_MEDIUMFULL;
+            std::lock_guard<lock_type> lock_data(m_data->lock);
+            try {
+                m_data->store.write(static_cast<size_t>(this->m_position), pv, cb);
+            } catch (const std::bad_alloc&) {
+                return STG_E_MEDIUMFULL;
+            } catch (const std::length_error&) {
+                return STG_E_MEDIUMFULL;
+            } catch (...) {
+                return E_FAIL;
+            }
+            this->m_position += cb;
+            if (pcbWritten)
+                *pcbWritten = cb;
+            return S_OK;
+        }
+        /// @}
+
+        /// \name IStream
+        /// @{
+        STDMETHOD(SetSize)(_In_ ULARGE_INTEGER libNewSize) override
+        {
+            if (libNewSize.QuadPart > SIZE_MAX)
+                return STG_E_MEDIUMFULL;
+            std::lock_guard<lock_type> lock_data(m_data->lock);
+            try {
+                m_data->store.resize(static_cast<size_t>(libNewSize.QuadPart));
+            } catch (const std::bad_alloc&) {
+                return STG_E_MEDIUMFULL;
+            } catch (const std::length_error&) {
+                return STG_E_MEDIUMFULL;
+            } catch (...) {
+                return E_FAIL;
+            }
+            return S_OK;
+        }
+
+        STDMETHOD(CopyTo)(_In_ IStream* pstm, _In_ ULARGE_INTEGER cb, _Out_opt_ ULARGE_INTEGER* pcbRead, _Out_opt_ ULARGE_INTEGER* pcbWritten) override
+        {
+            if (!pstm)
+                return STG_E_INVALIDPOINTER;
+            std::lock_guard<lock_type> lock(this->m_lock);
+            std::lock_guard<lock_type> lock_data(m_data->lock);
+            ULONGLONG read = 0, written = 0;
+            HRESULT hr = S_OK;
+            if (this->m_position < m_data->store.size()) {
+                // Write straight from the chunks: no intermediate buffer.
+                const size_t n = static_cast<size_t>((std::min)(cb.QuadPart, static_cast<ULONGLONG>(m_data->store.size() - this->m_position)));
+                m_data->store.for_each_span(static_cast<size_t>(this->m_position), n, [&](const uint8_t* data, size_t count) {
+                    ULONG w = 0;
+                    hr = pstm->Write(data, static_cast<ULONG>(count), &w);
+                    read += count;
+                    written += w;
+                    return SUCCEEDED(hr);
+                });
+                this->m_position += read;
+            }
+            if (pcbRead)
+                pcbRead->QuadPart = read;
+            if (pcbWritten)
+                pcbWritten->QuadPart = written;
+            return hr;
+        }
+
+        STDMETHOD(Clone)(_COM_Outptr_ IStream** ppstm) override
+        {
+            if (!ppstm)
+                return STG_E_INVALIDPOINTER;
+            try {
+                std::lock_guard<lock_type> lock(this->m_lock);
+                chunked_stream* stream = new chunked_stream(m_data);
+                stream->m_position = this->m_position;
+                *ppstm = stream;
+                return S_OK;
+            } catch (const std::bad_alloc&) {
+                *ppstm = NULL;
+                return E_OUTOFMEMORY;
+            } catch (...) {
+                *ppstm = NULL;
+                return E_FAIL;
+            }
+        }
+        /// @}
+
+    protected:
+        /// \cond internal
+        ULONGLONG size() const noexcept override
+        {
+            std::lock_guard<lock_type> lock_data(m_data->lock);
+            return m_data->store.size();
+        }
+
+        DWORD mode() const noexcept override { return STGM_READWRITE; }
+        /// \endcond
+
+    protected:
+        std::shared_ptr<shared_data> m_data; ///< Data shared with clones
+    };
+
+    ///
+    /// Process-wide DISPID cache keyed by type information
+    ///
+    /// All objects described by the same ITypeInfo share the name-to-DISPID map, so each member name is resolved only once per
+    /// type. The cache keeps a reference to each ITypeInfo it knows, so a pointer cannot be reused by another type while cached.
+    /// The cache is thread-safe.
+    ///
+    class dispid_cache
+    {
+        WINSTD_NONCOPYABLE(dispid_cache)
+        WINSTD_NONMOVABLE(dispid_cache)
+
+    public:
+        ///
+        /// Name-to-DISPID map of a single type
+        ///
+        struct names
+        {
+            std::mutex lock;                                                        ///< Guards map
+            std::map<std::wstring, DISPID, ordinal_icase_less<wchar_t>> map;        ///< Member DISPIDs, names compared case-insensitively
+        };
+
+        ///
+        /// Constructs an empty cache
+        ///
+        dispid_cache() noexcept {}
+
+        ///
+        /// Returns the process-wide cache
+        ///
+        static dispid_cache& instance()
+        {
+            static dispid_cache cache;
+            return cache;
+        }
+
+        ///
+        /// Returns the map for a type, creating it on first use
+        ///
+        /// \param[in] type_info  Type information
+        ///
+        /// \return Name-to-DISPID map
+        ///
+        std::shared_ptr<names> get(_In_ ITypeInfo* type_info)
+        {
+            assert(type_info);
+            std::lock_guard<std::mutex> lock(m_lock);
+            auto& e = m_types[type_info];
+            if (!e.second) {
+                type_info->AddRef();
+                e.first.attach(type_info);
+                e.second = std::make_shared<names>();
+            }
+            return e.second;
+        }
+
+        ///
+        /// Forgets all types
+        ///
+        void clear()
+        {
+            std::lock_guard<std::mutex> lock(m_lock);
+            m_types.clear();
+        }
+
+    protected:
+        std::mutex m_lock;                                                                      ///< Guards m_types
+        std::map<ITypeInfo*, std::pair<com_obj<ITypeInfo>, std::shared_ptr<names>>> m_types;   ///< Maps per type
+    };
+
+    ///
+    /// Late-bound IDispatch caller with DISPID caching
+    ///
+    /// Member names are resolved once and cached per type (see `dispid_cache`), or per invoker when the object provides no type
+    /// information. Arguments are converted using `operator <<(VARIANT&, ...)` into an array on the stack in the reverse order
+    /// `IDispatch::Invoke` expects them.
+    ///
+    /// When created with `direct` and the object exposes a dual interface, calls go through `ITypeInfo::Invoke` on the
+    /// interface's vtable, bypassing the object's `IDispatch::Invoke`.
+    ///
+    /// \note Arguments of type `int` are saved as `VT_BOOL`, since `BOOL` is `int`. Use `LONG` for integers.
+    ///
+    /// The invoker itself is not thread-safe.
+    ///
+    class dispatch_invoker
+    {
+        WINSTD_NONCOPYABLE(dispatch_invoker)
+
+    public:
+        ///
+        /// Call counters
+        ///
+        struct stats
+        {
+            uint64_t calls;        ///< Number of Invoke calls
+            uint64_t direct_calls; ///< Number of calls that went through the vtable
+            uint64_t lookups;      ///< Number of name lookups
+            uint64_t misses;       ///< Number of name lookups that called IDispatch::GetIDsOfNames
+        };
+
+        ///
+        /// Constructs an invoker
+        ///
+        /// \param[in] disp    Object to call
+        /// \param[in] direct  Call through the vtable when the object exposes a dual interface
+        /// \param[in] locale  Locale for name resolution and calls
+        /// \param[in] cache   Cache to share DISPIDs through
+        ///
+        dispatch_invoker(_In_ IDispatch* disp, _In_ bool direct = false, _In_ LCID locale = LOCALE_USER_DEFAULT, _In_ dispid_cache& cache = dispid_cache::instance()) :
+            m_locale(locale),
+            m_stats{}
+        {
+            if (!disp)
+                throw std::invalid_argument("disp is NULL");
+            disp->AddRef();
+            m_disp.attach(disp);
+
+            UINT count;
+            com_obj<ITypeInfo> type_info;
+            if (SUCCEEDED(disp->GetTypeInfoCount(&count)) && count &&
+                SUCCEEDED(disp->GetTypeInfo(0, locale, &type_info)) && type_info)
+            {
+                m_names = cache.get(type_info);
+                if (direct)
+                    init_direct(type_info);
+            } else
+                m_names = std::make_shared<dispid_cache::names>();
+        }
+
+        ///
+        /// Returns the object being called
+        ///
+        IDispatch* object() const noexcept { return m_disp; }
+
+        ///
+        /// Returns call counters
+        ///
+        const stats& get_stats() const noexcept { return m_stats; }
+
+        ///
+        /// Resolves a member name
+        ///
+        /// \param[in] name  Member name
+        ///
+        /// \return DISPID
+        ///
+        /// \sa [IDispatch::GetIDsOfNames method](https://learn.microsoft.com/en-us/windows/win32/api/oaidl/nf-oaidl-idispatch-getidsofnames)
+        ///
+        DISPID dispid(_In_z_ LPCOLESTR name)
+        {
+            assert(name);
+            m_stats.lookups++;
+            {
+                std::lock_guard<std::mutex> lock(m_names->lock);
+                auto i = m_names->map.find(std::wstring_view(name));
+                if (i != m_names->map.end())
+                    return i->second;
+            }
+            m_stats.misses++;
+            DISPID id;
+            LPOLESTR n = const_cast<LPOLESTR>(name);
+            HRESULT hr = m_disp->GetIDsOfNames(IID_NULL, &n, 1, m_locale, &id);
+            if (FAILED(hr))
+                throw com_runtime_error(hr, "IDispatch::GetIDsOfNames failed");
+            std::lock_guard<std::mutex> lock(m_names->lock);
+            m_names->map.emplace(name, id);
+            return id;
+        }
+
+        ///
+        /// Calls a member
+        ///
+        /// \param[in ] id      DISPID of the member
+        /// \param[in ] flags   `DISPATCH_METHOD`, `DISPATCH_PROPERTYGET`, `DISPATCH_PROPERTYPUT`...
+        /// \param[out] result  Result. Previous content is cleared. May be NULL.
+        /// \param[in ] args    Arguments in natural order
+        ///
+        /// \sa [IDispatch::Invoke method](https://learn.microsoft.com/en-us/windows/win32/api/oaidl/nf-oaidl-idispatch-invoke)
+        ///
+        template <class... _Args>
+        void invoke(_In_ DISPID id, _In_ WORD flags, _Inout_opt_ VARIANT* result, _In_ const _Args&... args)
+        {
+            constexpr size_t count = sizeof...(_Args);
+            VARIANT argv[count ? count : 1];
+            args_guard guard(argv + count);
+            ((argv[count - 1 - guard.m_count] << args, ++guard.m_count), ...);
+
+            DISPID put_id = DISPID_PROPERTYPUT;
+            DISPPARAMS params = { argv, NULL, static_cast<UINT>(count), 0 };
+            if (flags & (DISPATCH_PROPERTYPUT | DISPATCH_PROPERTYPUTREF)) {
+                params.rgdispidNamedArgs = &put_id;
+                params.cNamedArgs = 1;
+            }
+            if (result)
+                VariantClear(result);
+            EXCEPINFO excep = {};
+            HRESULT hr;
+            m_stats.calls++;
+            if (m_direct_type) {
+                m_stats.direct_calls++;
+                hr = m_direct_type->Invoke(m_direct, id, flags, &params, result, &excep, NULL);
+            } else
+                hr = m_disp->Invoke(id, IID_NULL, m_locale, flags, &params, result, &excep, NULL);
+            if (FAILED(hr)) {
+                if (hr == DISP_E_EXCEPTION) {
+                    if (excep.pfnDeferredFillIn)
+                        excep.pfnDeferredFillIn(&excep);
+                    if (excep.scode)
+                        hr = excep.scode;
+                }
+                SysFreeString(excep.bstrSource);
+                SysFreeString(excep.bstrDescription);
+                SysFreeString(excep.bstrHelpFile);
+                throw com_runtime_error(hr, "IDispatch::Invoke failed");
+            }
+        }
+
+        ///
+        /// Calls a method
+        ///
+        /// \param[in ] name    Method name
+        /// \param[out] result  Result. Previous content is cleared. May be NULL.
+        /// \param[in ] args    Arguments in natural order
+        ///
+        template <class... _Args>
+        void call(_In_z_ LPCOLESTR name, _Inout_opt_ VARIANT* result, _In_ const _Args&... args)
+        {
+            invoke(dispid(name), DISPATCH_METHOD, result, args...);
+        }
+
+        ///
+        /// Reads a property
+        ///
+        /// \param[in ] name   Property name
+        /// \param[out] value  Property value. Previous content is cleared.
+        /// \param[in ] args   Index arguments in natural order
+        ///
+        template <class... _Args>
+        void get(_In_z_ LPCOLESTR name, _Inout_ VARIANT* value, _In_ const _Args&... args)
+        {
+            assert(value);
+            invoke(dispid(name), DISPATCH_PROPERTYGET, value, args...);
+        }
+
+        ///
+        /// Writes a property
+        ///
+        /// \param[in] name   Property name
+        /// \param[in] value  Property value
+        ///
+        template <class _Ty>
+        void put(_In_z_ LPCOLESTR name, _In_ const _Ty& value)
+        {
+            invoke(dispid(name), DISPATCH_PROPERTYPUT, NULL, value);
+        }
+
+    protected:
+        /// \cond internal
+        struct args_guard
+        {
+            args_guard(_In_ VARIANT* argv) noexcept : m_argv(argv), m_count(0) {}
+            ~args_guard()
+            {
+                // Arguments are filled from the back.
+                for (size_t i = 0; i < m_count; ++i)
+                    VariantClear(m_argv - i - 1);
+            }
+            VARIANT* m_argv;
+            size_t m_count;
+        };
+
+        void init_direct(_In_ ITypeInfo* type_info)
+        {
+            TYPEATTR* attr;
+            if (FAILED(type_info->GetTypeAttr(&attr)))
+                return;
+            const bool dual = attr->typekind == TKIND_DISPATCH && (attr->wTypeFlags & TYPEFLAG_FDUAL);
+            type_info->ReleaseTypeAttr(attr);
+            if (!dual)
+                return;
+
+            // Find the vtable interface behind the dispinterface.
+            HREFTYPE href;
+            com_obj<ITypeInfo> vtable_type;
+            if (FAILED(type_info->GetRefTypeOfImplType(-1, &href)) ||
+                FAILED(type_info->GetRefTypeInfo(href, &vtable_type)) ||
+                FAILED(vtable_type->GetTypeAttr(&attr)))
+                return;
+            const IID iid = attr->guid;
+            vtable_type->ReleaseTypeAttr(attr);
+            com_obj<IUnknown> obj;
+            if (FAILED(m_disp->QueryInterface(iid, reinterpret_cast<void**>(&obj))))
+                return;
+            m_direct = std::move(obj);
+            m_direct_type = std::move(vtable_type);
+        }
+        /// \endcond
+
+    protected:
+        com_obj<IDispatch> m_disp;                      ///< Object
+        com_obj<IUnknown> m_direct;                     ///< Vtable interface for direct calls
+        com_obj<ITypeInfo> m_direct_type;               ///< Type information of the vtable interface
+        LCID m_locale;                                  ///< Locale
+        std::shared_ptr<dispid_cache::names> m_names;   ///< DISPID cache
+        stats m_stats;                                  ///< Call counters
+    };
+
+    ///
+    /// Cache of class factories for repeated object creation
+    ///
+    /// `CoCreateInstance` looks up the CLSID and obtains the class factory on every call. This cache calls `CoGetClassObject` once
+    /// per CLSID, class context and apartment and creates objects straight through `IClassFactory::CreateInstance`. Cached
+    /// servers are kept loaded with `IClassFactory::LockServer`.
+    ///
+    /// Factories are only handed out, and only released, in the apartment they were obtained in. A factory is dropped and
+    /// obtained again when creation fails because its server is gone. Each apartment that used the cache should call clear()
+    /// before it uninitializes COM. The cache is thread-safe.
+    ///
+    class class_factory_cache
+    {
+        WINSTD_NONCOPYABLE(class_factory_cache)
+        WINSTD_NONMOVABLE(class_factory_cache)
+
+    public:
+        ///
+        /// Creation counters
+        ///
+        struct stats
+        {
+            uint64_t creations;    ///< Number of successful creations
+            uint64_t failures;     ///< Number of failed creations
+            uint64_t hits;         ///< Number of factory lookups served from the cache
+            uint64_t misses;       ///< Number of factory lookups that called `CoGetClassObject`
+            uint64_t total_ns;     ///< Total time spent creating objects in nanoseconds
+            uint64_t max_ns;       ///< Longest creation in nanoseconds
+        };
+
+        ///
+        /// Constructs an empty cache
+        ///
+        /// \param[in] lock_server  Call `IClassFactory::LockServer` on cached factories
+        ///
+        class_factory_cache(_In_ bool lock_server = true) noexcept :
+            m_lock_server(lock_server),
+            m_creations(0),
+            m_failures(0),
+            m_hits(0),
+            m_misses(0),
+            m_total_ns(0),
+            m_max_ns(0)
+        {}
+
+        ///
+        /// Unlocks and releases factories cached in the calling apartment
+        ///
+        /// Factories of other apartments cannot be released safely from here and are abandoned. Call clear() in those
+        /// apartments first.
+        ///
+        virtual ~class_factory_cache()
+        {
+            clear();
+        }
+
+        ///
+        /// Returns class factory
+        ///
+        /// \param[in ] rclsid        CLSID of the class
+        /// \param[in ] dwClsContext  Class context
+        /// \param[out] factory       Class factory
+        ///
+        /// \return Result of `CoGetClassObject` on first use in the apartment; `S_OK` afterwards
+        ///
+        /// \sa [CoGetClassObject function](https://learn.microsoft.com/en-us/windows/win32/api/combaseapi/nf-combaseapi-cogetclassobject)
+        ///
+        _Check_return_ HRESULT get(_In_ REFCLSID rclsid, _In_ DWORD dwClsContext, _Inout_ com_obj<IClassFactory>& factory)
+        {
+            const key_type key = { rclsid, dwClsContext, apartment() };
+            {
+                std::lock_guard<std::mutex> lock(m_lock);
+                auto i = m_factories.find(key);
+                if (i != m_factories.end()) {
+                    m_hits++;
+                    factory.attach_duplicated(i->second);
+                    return S_OK;
+                }
+            }
+            m_misses++;
+            com_obj<IClassFactory> f;
+            HRESULT hr = get_class_object(rclsid, dwClsContext, &f);
+            if (FAILED(hr))
+                return hr;
+            if (m_lock_server)
+                f->LockServer(TRUE);
+            std::lock_guard<std::mutex> lock(m_lock);
+            auto i = m_factories.find(key);
+            if (i == m_factories.end()) {
+                f->AddRef();
+                m_factories.emplace(key, static_cast<IClassFactory*>(f));
+            } else {
+                // Another thread of the apartment was faster.
+                if (m_lock_server)
+                    f->LockServer(FALSE);
+                f.attach_duplicated(i->second);
+            }
+            factory = std::move(f);
+            return S_OK;
+        }
+
+        ///
+        /// Creates an object
+        ///
+        /// \param[in ] rclsid        CLSID of the class
+        /// \param[in ] pUnkOuter     Controlling IUnknown for aggregation
+        /// \param[in ] dwClsContext  Class context
+        /// \param[out] v             Created object
+        ///
+        /// \return Result of `IClassFactory::CreateInstance`
+        ///
+        /// \sa [IClassFactory::CreateInstance method](https://learn.microsoft.com/en-us/windows/win32/api/unknwn/nf-unknwn-iclassfactory-createinstance)
+        ///
+        template <class T>
+        _Check_return_ HRESULT create(_In_ REFCLSID rclsid, _In_opt_ LPUNKNOWN pUnkOuter, _In_ DWORD dwClsContext, _Inout_ com_obj<T>& v)
+        {
+            const auto start = std::chrono::steady_clock::now();
+            HRESULT hr;
+            for (int attempt = 0;; ++attempt) {
+                com_obj<IClassFactory> factory;
+                hr = get(rclsid, dwClsContext, factory);
+                if (FAILED(hr))
+                    break;
+                T* obj;
+                hr = factory->CreateInstance(pUnkOuter, __uuidof(T), reinterpret_cast<void**>(&obj));
+                if (SUCCEEDED(hr)) {
+                    v.attach(obj);
+                    break;
+                }
+                if (attempt || !is_disconnected(hr))
+                    break;
+                invalidate(rclsid);
+            }
+            const uint64_t ns = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+            (SUCCEEDED(hr) ? m_creations : m_failures)++;
+            m_total_ns += ns;
+            for (uint64_t max_ns = m_max_ns; ns > max_ns && !m_max_ns.compare_exchange_weak(max_ns, ns);) {}
+            return hr;
+        }
+
+        ///
+        /// Creates an object
+        ///
+        /// \param[in] rclsid        CLSID of the class
+        /// \param[in] pUnkOuter     Controlling IUnknown for aggregation
+        /// \param[in] dwClsContext  Class context
+        ///
+        /// \return Created object
+        ///
+        template <class T>
+        com_obj<T> create(_In_ REFCLSID rclsid, _In_opt_ LPUNKNOWN pUnkOuter = NULL, _In_ DWORD dwClsContext = CLSCTX_INPROC_SERVER)
+        {
+            com_obj<T> v;
+            HRESULT hr = create(rclsid, pUnkOuter, dwClsContext, v);
+            if (FAILED(hr))
+                throw com_runtime_error(hr, "IClassFactory::CreateInstance failed");
+            return v;
+        }
+
+        ///
+        /// Drops cached factories of a class in all contexts of the calling apartment
+        ///
+        /// \param[in] rclsid  CLSID of the class
+        ///
+        void invalidate(_In_ REFCLSID rclsid)
+        {
+            const uint64_t apt = apartment();
+            std::vector<IClassFactory*> dropped;
+            {
+                std::lock_guard<std::mutex> lock(m_lock);
+                for (auto i = m_factories.begin(); i != m_factories.end();) {
+                    if (i->first.apartment == apt && guid_equal(i->first.clsid, rclsid)) {
+                        dropped.push_back(i->second);
+                        i = m_factories.erase(i);
+                    } else
+                        ++i;
+                }
+            }
+            release(dropped);
+        }
+
+        ///
+        /// Drops all factories cached in the calling apartment
+        ///
+        void clear()
+        {
+            const uint64_t apt = apartment();
+            std::vector<IClassFactory*> dropped;
+            {
+                std::lock_guard<std::mutex> lock(m_lock);
+                for (auto i = m_factories.begin(); i != m_factories.end();) {
+                    if (i->first.apartment == apt) {
+                        dropped.push_back(i->second);
+                        i = m_factories.erase(i);
+                    } else
+                        ++i;
+                }
+            }
+            release(dropped);
+        }
+
+        ///
+        /// Returns number of cached factories
+        ///
+        size_t size() const
+        {
+            std::lock_guard<std::mutex> lock(m_lock);
+            return m_factories.size();
+        }
+
+        ///
+        /// Returns creation counters
+        ///
+        stats get_stats() const noexcept
+        {
+            return { m_creations, m_failures, m_hits, m_misses, m_total_ns, m_max_ns };
+        }
+
+    protected:
+        ///
+        /// Obtains class factory
+        ///
+        /// The default implementation calls `CoGetClassObject`. Override to supply factories from elsewhere.
+        ///
+        virtual HRESULT get_class_object(_In_ REFCLSID rclsid, _In_ DWORD dwClsContext, _Outptr_ IClassFactory** factory)
+        {
+            return CoGetClassObject(rclsid, dwClsContext, NULL, __uuidof(IClassFactory), reinterpret_cast<void**>(factory));
+        }
+
+        ///
+        /// Returns `true` when the failure means the factory's server is gone and the factory should be obtained again
+        ///
+        virtual bool is_disconnected(_In_ HRESULT hr) const noexcept
+        {
+            return
+                hr == RPC_E_DISCONNECTED ||
+                hr == RPC_E_SERVER_DIED ||
+                hr == RPC_E_SERVER_DIED_DNE ||
+                hr == CO_E_OBJNOTCONNECTED ||
+                hr == HRESULT_FROM_WIN32(RPC_S_SERVER_UNAVAILABLE);
+        }
+
+        ///
+        /// Returns identifier of the calling thread's apartment
+        ///
+        /// \sa [CoGetApartmentType function](https://learn.microsoft.com/en-us/windows/win32/api/combaseapi/nf-combaseapi-cogetapartmenttype)
+        ///
+        static uint64_t apartment() noexcept
+        {
+            APTTYPE type;
+            APTTYPEQUALIFIER qualifier;
+            if (SUCCEEDED(CoGetApartmentType(&type, &qualifier)) && (type == APTTYPE_STA || type == APTTYPE_MAINSTA)) {
+                // Thread IDs are reused after a thread exits, so STA threads get a cookie that never is.
+                static std::atomic<uint64_t> next(1);
+                static thread_local const uint64_t cookie = next++;
+                return cookie;
+            }
+            // The process has one MTA, and implicit MTA threads share it.
+            return 0;
+        }
+
+        /// \cond internal
+        struct key_type
+        {
+            GUID clsid;
+            DWORD context;
+            uint64_t apartment;
+
+            bool operator<(_In_ const key_type& other) const noexcept
+            {
+                if (apartment != other.apartment) return apartment < other.apartment;
+                if (context != other.context) return context < other.context;
+                return guid_less()(clsid, other.clsid);
+            }
+        };
+
+        void release(_In_ const std::vector<IClassFactory*>& factories) noexcept
+        {
+            for (auto f : factories) {
+                if (m_lock_server)
+                    f->LockServer(FALSE);
+                f->Release();
+            }
+        }
+        /// \endcond
+
+    protected:
+        const bool m_lock_server;                           ///< Keep servers of cached factories loaded
+        mutable std::mutex m_lock;                          ///< Guards m_factories
+        std::map<key_type, IClassFactory*> m_factories;     ///< Cached factories (referenced)
+        std::atomic<uint64_t> m_creations;                  ///< Number of successful creations
+        std::atomic<uint64_t> m_failures;                   ///< Number of failed creations
+        std::atomic<uint64_t> m_hits;                       ///< Number of cache hits
+        std::atomic<uint64_t> m_misses;                     ///< Number of cache misses
+        std::atomic<uint64_t> m_total_ns;                   ///< Total creation time
+        std::atomic<uint64_t> m_max_ns;                     ///< Longest creation time
+    };
+
+    ///
+    /// Maps C++ element type to compatible SAFEARRAY VARTYPEs
+    ///
+    /// \tparam T  Element type
+    ///
+    template <class T> struct safearray_vt { static bool is_compatible(_In_ VARTYPE vt) noexcept { UNREFERENCED_PARAMETER(vt); return false; } };
+    /// \cond internal
+    template <> struct safearray_vt<CHAR>         { static bool is_compatible(_In_ VARTYPE vt) noexcept { return vt == VT_I1; } };
+    template <> struct safearray_vt<BYTE>         { static bool is_compatible(_In_ VARTYPE vt) noexcept { return vt == VT_UI1; } };
+    template <> struct safearray_vt<SHORT>        { static bool is_compatible(_In_ VARTYPE vt) noexcept { return vt == VT_I2 || vt == VT_BOOL; } };
+    template <> struct safearray_vt<USHORT>       { static bool is_compatible(_In_ VARTYPE vt) noexcept { return vt == VT_UI2; } };
+    template <> struct safearray_vt<INT>          { static bool is_compatible(_In_ VARTYPE vt) noexcept { return vt == VT_INT || vt == VT_I4; } };
+    template <> struct safearray_vt<UINT>         { static bool is_compatible(_In_ VARTYPE vt) noexcept { return vt == VT_UINT || vt == VT_UI4; } };
+    template <> struct safearray_vt<LONG>         { static bool is_compatible(_In_ VARTYPE vt) noexcept { return vt == VT_I4 || vt == VT_INT || vt == VT_ERROR; } };
+    template <> struct safearray_vt<ULONG>        { static bool is_compatible(_In_ VARTYPE vt) noexcept { return vt == VT_UI4 || vt == VT_UINT; } };
+    template <> struct safearray_vt<LONGLONG>     { static bool is_compatible(_In_ VARTYPE vt) noexcept { return vt == VT_I8; } };
+    template <> struct safearray_vt<ULONGLONG>    { static bool is_compatible(_In_ VARTYPE vt) noexcept { return vt == VT_UI8; } };
+    template <> struct safearray_vt<FLOAT>        { static bool is_compatible(_In_ VARTYPE vt) noexcept { return vt == VT_R4; } };
+    template <> struct safearray_vt<DOUBLE>       { static bool is_compatible(_In_ VARTYPE vt) noexcept { return vt == VT_R8 || vt == VT_DATE; } };
+    template <> struct safearray_vt<CY>           { static bool is_compatible(_In_ VARTYPE vt) noexcept { return vt == VT_CY; } };
+    template <> struct safearray_vt<DECIMAL>      { static bool is_compatible(_In_ VARTYPE vt) noexcept { return vt == VT_DECIMAL; } };
+    template <> struct safearray_vt<BSTR>         { static bool is_compatible(_In_ VARTYPE vt) noexcept { return vt == VT_BSTR; } };
+    template <> struct safearray_vt<IUnknown*>    { static bool is_compatible(_In_ VARTYPE vt) noexcept { return vt == VT_UNKNOWN || vt == VT_DISPATCH; } };
+    template <> struct safearray_vt<IDispatch*>   { static bool is_compatible(_In_ VARTYPE vt) noexcept { return vt == VT_DISPATCH; } };
+    template <> struct safearray_vt<VARIANT>      { static bool is_compatible(_In_ VARTYPE vt) noexcept { return vt == VT_VARIANT; } };
+    /// \endcond
+
+    /// \cond internal
+    namespace internal
+    {
+        ///
+        /// Sums elements
+        ///
+        template <class T, class _Acc>
+        _Acc reduce_sum(_In_reads_(count) const T* data, _In_ size_t count) noexcept
+        {
+            _Acc sum = 0;
+            for (size_t i = 0; i < count; ++i)
+                sum += data[i];
+            return sum;
+        }
+
+        ///
+        /// Sums doubles
+        ///
+        inline double reduce_sum(_In_reads_(count) const double* data, _In_ size_t count) noexcept
+        {
+            size_t i = 0;
+            double sum = 0;
+#ifdef WINSTD_SIMD_SSE2
+            // Two independent accumulators hide the addition latency.
+            __m128d acc0 = _mm_setzero_pd(), acc1 = _mm_setzero_pd();
+            for (; i + 4 <= count; i += 4) {
+                acc0 = _mm_add_pd(acc0, _mm_loadu_pd(data + i));
+                acc1 = _mm_add_pd(acc1, _mm_loadu_pd(data + i + 2));
+            }
+            acc0 = _mm_add_pd(acc0, acc1);
+            sum = _mm_cvtsd_f64(_mm_add_sd(acc0, _mm_unpackhi_pd(acc0, acc0)));
+#endif
+            for (; i < count; ++i)
+                sum += data[i];
+            return sum;
+        }
+
+        ///
+        /// Sums floats in double precision
+        ///
+        inline double reduce_sum(_In_reads_(count) const float* data, _In_ size_t count) noexcept
+        {
+            size_t i = 0;
+            double sum = 0;
+#ifdef WINSTD_SIMD_SSE2
+            __m128d acc0 = _mm_setzero_pd(), acc1 = _mm_setzero_pd();
+            for (; i + 4 <= count; i += 4) {
+                const __m128 v = _mm_loadu_ps(data + i);
+                acc0 = _mm_add_pd(acc0, _mm_cvtps_pd(v));
+                acc1 = _mm_add_pd(acc1, _mm_cvtps_pd(_mm_movehl_ps(v, v)));
+            }
+            acc0 = _mm_add_pd(acc0, acc1);
+            sum = _mm_cvtsd_f64(_mm_add_sd(acc0, _mm_unpackhi_pd(acc0, acc0)));
+#endif
+            for (; i < count; ++i)
+                sum += data[i];
+            return sum;
+        }
+
+        ///
+        /// Finds minimum and maximum. NaNs are skipped.
+        ///
+        template <class T>
+        void reduce_minmax(_In_reads_(count) const T* data, _In_ size_t count, _Inout_ T& min, _Inout_ T& max) noexcept
+        {
+            for (size_t i = 0; i < count; ++i) {
+                if (data[i] < min) min = data[i];
+                if (max < data[i]) max = data[i];
+            }
+        }
+
+#ifdef WINSTD_SIMD_SSE2
+        ///
+        /// Finds minimum and maximum of doubles. NaNs are skipped.
+        ///
+        inline void reduce_minmax(_In_reads_(count) const double* data, _In_ size_t count, _Inout_ double& min, _Inout_ double& max) noexcept
+        {
+            size_t i = 0;
+            if (count >= 2) {
+                // _mm_min_pd/_mm_max_pd return the second operand when either is NaN.
+                __m128d vmin = _mm_set1_pd(min), vmax = _mm_set1_pd(max);
+                for (; i + 2 <= count; i += 2) {
+                    const __m128d v = _mm_loadu_pd(data + i);
+                    vmin = _mm_min_pd(v, vmin);
+                    vmax = _mm_max_pd(v, vmax);
+                }
+                min = _mm_cvtsd_f64(_mm_min_sd(_mm_unpackhi_pd(vmin, vmin), vmin));
+                max = _mm_cvtsd_f64(_mm_max_sd(_mm_unpackhi_pd(vmax, vmax), vmax));
+            }
+            reduce_minmax<double>(data + i, count - i, min, max);
+        }
+
+        ///
+        /// Finds minimum and maximum of floats. NaNs are skipped.
+        ///
+        inline void reduce_minmax(_In_reads_(count) const float* data, _In_ size_t count, _Inout_ float& min, _Inout_ float& max) noexcept
+        {
+            size_t i = 0;
+            if (count >= 4) {
+                __m128 vmin = _mm_set1_ps(min), vmax = _mm_set1_ps(max);
+                for (; i + 4 <= count; i += 4) {
+                    const __m128 v = _mm_loadu_ps(data + i);
+                    vmin = _mm_min_ps(v, vmin);
+                    vmax = _mm_max_ps(v, vmax);
+                }
+                vmin = _mm_min_ps(_mm_movehl_ps(vmin, vmin), vmin);
+                vmax = _mm_max_ps(_mm_movehl_ps(vmax, vmax), vmax);
+                min = _mm_cvtss_f32(_mm_min_ss(_mm_shuffle_ps(vmin, vmin, 1), vmin));
+                max = _mm_cvtss_f32(_mm_max_ss(_mm_shuffle_ps(vmax, vmax, 1), vmax));
+            }
+            reduce_minmax<float>(data + i, count - i, min, max);
+        }
+#endif
+    }
+    /// \endcond
+
+    ///
+    /// Typed multidimensional view of SAFEARRAY data
+    ///
+    /// Indices are given in the usual left-to-right order and include lower bounds, like in `SafeArrayGetElement`. SAFEARRAY
+    /// data is column-major: the leftmost index changes fastest in memory. Iterate with `for_each()` or over `data()` linearly to
+    /// visit elements in memory order.
+    ///
+    /// The array is locked for the lifetime of the view.
+    ///
+    /// \tparam T  Element type. Must match the array VARTYPE, see `safearray_vt`.
+    ///
+    template <class T>
+    class safearray_view
+    {
+        WINSTD_NONCOPYABLE(safearray_view)
+        WINSTD_NONMOVABLE(safearray_view)
+
+    public:
+        ///
+        /// Locks the array and validates its element type
+        ///
+        /// \param[in] psa  SAFEARRAY
+        ///
+        /// \sa [SafeArrayLock function](https://learn.microsoft.com/en-us/windows/win32/api/oleauto/nf-oleauto-safearraylock)
+        ///
+        safearray_view(_In_ SAFEARRAY* psa) : m_sa(psa)
+        {
+            if (!psa)
+                throw std::invalid_argument("psa is NULL");
+            if (psa->cbElements != sizeof(T))
+                throw std::invalid_argument("element size mismatch");
+            VARTYPE vt;
+            if (SUCCEEDED(SafeArrayGetVartype(psa, &vt)) && !safearray_vt<T>::is_compatible(vt))
+                throw std::invalid_argument("element type mismatch");
+            HRESULT hr = SafeArrayLock(psa);
+            if (FAILED(hr))
+                throw com_runtime_error(hr, "SafeArrayLock failed");
+            m_data = static_cast<T*>(psa->pvData);
+            m_size = psa->cDims ? 1 : 0;
+            for (USHORT k = 0; k < psa->cDims; ++k)
+                m_size *= psa->rgsabound[k].cElements;
+        }
+
+        ///
+        /// Unlocks the array
+        ///
+        /// \sa [SafeArrayUnlock function](https://learn.microsoft.com/en-us/windows/win32/api/oleauto/nf-oleauto-safearrayunlock)
+        ///
+        virtual ~safearray_view()
+        {
+            SafeArrayUnlock(m_sa);
+        }
+
+        ///
+        /// Returns number of dimensions
+        ///
+        size_t rank() const noexcept { return m_sa->cDims; }
+
+        ///
+        /// Returns number of elements in a dimension
+        ///
+        /// \param[in] dim  Zero-based dimension in left-to-right order
+        ///
+        ULONG extent(_In_ size_t dim) const noexcept
+        {
+            assert(dim < rank());
+            return m_sa->rgsabound[rank() - 1 - dim].cElements;
+        }
+
+        ///
+        /// Returns lower bound of a dimension
+        ///
+        /// \param[in] dim  Zero-based dimension in left-to-right order
+        ///
+        LONG lbound(_In_ size_t dim) const noexcept
+        {
+            assert(dim < rank());
+            return m_sa->rgsabound[rank() - 1 - dim].lLbound;
+        }
+
+        ///
+        /// Returns distance between consecutive elements of a dimension in elements
+        ///
+        /// \param[in] dim  Zero-based dimension in left-to-right order
+        ///
+        size_t stride(_In_ size_t dim) const noexcept
+        {
+            size_t s = 1;
+            for (size_t d = 0; d < dim; ++d)
+                s *= extent(d);
+            return s;
+        }
+
+        ///
+        /// Returns total number of elements
+        ///
+        size_t size() const noexcept { return m_size; }
+
+        ///
+        /// Returns data in memory order
+        ///
+        T* data() const noexcept { return m_data; }
+
+        ///
+        /// Returns element
+        ///
+        /// \param[in] idx  One index per dimension in left-to-right order, including the lower bound
+        ///
+        template <class... _Idx>
+        T& operator()(_In_ _Idx... idx) const noexcept
+        {
+            assert(sizeof...(_Idx) == rank());
+            const LONG indices[] = { static_cast<LONG>(idx)... };
+            return m_data[offset(indices)];
+        }
+
+        ///
+        /// Returns memory offset of an element
+        ///
+        /// \param[in] indices  One index per dimension in left-to-right order, including the lower bound
+        ///
+        size_t offset(_In_reads_(rank()) const LONG* indices) const noexcept
+        {
+            // rgsabound lists dimensions right-to-left: evaluate Horner's scheme from the slowest dimension.
+            size_t o = 0;
+            for (USHORT k = 0, n = m_sa->cDims; k < n; ++k) {
+                const SAFEARRAYBOUND& b = m_sa->rgsabound[k];
+                assert(indices[n - 1 - k] >= b.lLbound && static_cast<ULONG>(indices[n - 1 - k] - b.lLbound) < b.cElements);
+                o = o * b.cElements + static_cast<size_t>(indices[n - 1 - k] - b.lLbound);
+            }
+            return o;
+        }
+
+        ///
+        /// Returns contiguous data of one column of a two-dimensional array
+        ///
+        /// Column `j` holds elements `(lbound(0), j)` to `(lbound(0) + extent(0) - 1, j)`.
+        ///
+        /// \param[in] j  Column index, including the lower bound
+        ///
+        T* column(_In_ LONG j) const noexcept
+        {
+            assert(rank() == 2);
+            assert(j >= lbound(1) && static_cast<ULONG>(j - lbound(1)) < extent(1));
+            return m_data + static_cast<size_t>(j - lbound(1)) * extent(0);
+        }
+
+        ///
+        /// Calls a function for each element in memory order
+        ///
+        /// \param[in] fn  Function `void fn(T& element, const LONG* indices)`. Indices are in left-to-right order, including lower
+        ///                bounds.
+        ///
+        template <class _Fn>
+        void for_each(_In_ _Fn fn) const
+        {
+            if (!m_size)
+                return;
+            const size_t n = rank();
+            std::vector<LONG> indices(n);
+            for (size_t d = 0; d < n; ++d)
+                indices[d] = lbound(d);
+            for (size_t i = 0;;) {
+                fn(m_data[i], indices.data());
+                if (++i >= m_size)
+                    break;
+                // Advance like an odometer: leftmost index first.
+                for (size_t d = 0; ++indices[d] - lbound(d) == static_cast<LONG>(extent(d)); ++d)
+                    indices[d] = lbound(d);
+            }
+        }
+
+        ///
+        /// Calls a function for consecutive chunks of data on multiple threads
+        ///
+        /// \param[in] fn       Function `void fn(T* data, size_t count, size_t offset)`. Called concurrently.
+        /// \param[in] chunk    Elements per chunk
+        /// \param[in] threads  Maximum number of threads including the calling one. 0 to use one per CPU.
+        ///
+        template <class _Fn>
+        void parallel_for_each_chunk(_In_ _Fn fn, _In_ size_t chunk = 0x10000, _In_ unsigned threads = 0) const
+        {
+            auto call = [&](size_t offset, size_t count) { fn(m_data + offset, count, offset); };
+            internal::parallel_chunks(m_size, chunk, threads, call);
+        }
+
+        ///
+        /// Returns sum of all elements
+        ///
+        /// Floating-point elements are summed in double precision.
+        ///
+        auto sum() const noexcept
+        {
+            static_assert(std::is_arithmetic<T>::value, "sum requires arithmetic element type");
+            if constexpr (std::is_floating_point<T>::value)
+                return internal::reduce_sum(m_data, m_size);
+            else if constexpr (std::is_signed<T>::value)
+                return internal::reduce_sum<T, LONGLONG>(m_data, m_size);
+            else
+                return internal::reduce_sum<T, ULONGLONG>(m_data, m_size);
+        }
+
+        ///
+        /// Returns sum of all elements computed on multiple threads
+        ///
+        /// \param[in] chunk    Elements per chunk
+        /// \param[in] threads  Maximum number of threads including the calling one. 0 to use one per CPU.
+        ///
+        auto parallel_sum(_In_ size_t chunk = 0x10000, _In_ unsigned threads = 0) const
+        {
+            typedef decltype(sum()) sum_type;
+            std::mutex lock;
+            sum_type total = 0;
+            parallel_for_each_chunk([&](const T* data, size_t count, size_t) {
+                sum_type s;
+                if constexpr (std::is_floating_point<T>::value)
+                    s = internal::reduce_sum(data, count);
+                else
+                    s = internal::reduce_sum<T, sum_type>(data, count);
+                std::lock_guard<std::mutex> l(lock);
+                total += s;
+            }, chunk, threads);
+            return total;
+        }
+
+        ///
+        /// Returns minimum and maximum element
+        ///
+        /// \return Pair of (minimum, maximum). For an empty array, (`numeric_limits<T>::max()`, `numeric_limits<T>::lowest()`).
+        ///         Floating-point NaNs are skipped.
+        ///
+        std::pair<T, T> minmax() const noexcept
+        {
+            static_assert(std::is_arithmetic<T>::value, "minmax requires arithmetic element type");
+            std::pair<T, T> result((std::numeric_limits<T>::max)(), std::numeric_limits<T>::lowest());
+            internal::reduce_minmax(m_data, m_size, result.first, result.second);
+            return result;
+        }
+
+        ///
+        /// Returns arithmetic mean of all elements
+        ///
+        /// \return Mean; NaN for an empty array.
+        ///
+        double mean() const noexcept
+        {
+            if (!m_size)
+                return std::numeric_limits<double>::quiet_NaN();
+            return static_cast<double>(sum()) / m_size;
+        }
+
+        ///
+        /// Returns number of VARIANT elements which are neither VT_EMPTY nor VT_NULL
+        ///
+        size_t count_non_empty() const noexcept
+        {
+            static_assert(std::is_same<T, VARIANT>::value, "count_non_empty requires VARIANT element type");
+            size_t count = 0;
+            for (size_t i = 0; i < m_size; ++i)
+                count += V_VT(&m_data[i]) != VT_EMPTY && V_VT(&m_data[i]) != VT_NULL;
+            return count;
+        }
+
+    protected:
+        SAFEARRAY* m_sa;  ///< SAFEARRAY
+        T* m_data;        ///< Data
+        size_t m_size;    ///< Number of elements
+    };
+
+    /// \cond internal
+    namespace internal
+    {
+        ///
+        /// Decimal number split into parts
+        ///
+        struct parsed_number
+        {
+            bool negative;       ///< Has minus sign
+            bool integer;        ///< Has no decimal point and no exponent
+            bool truncated;      ///< Has more than 19 significant digits
+            uint64_t mantissa;   ///< Up to 19 significant digits
+            int exponent;        ///< Decimal exponent
+        };
+
+        ///
+        /// Converts eight UTF-16 decimal digits
+        ///
+        /// \return `true` if all eight code units are digits
+        ///
+        inline bool parse_digits8(_In_reads_(8) const wchar_t* s, _Out_ uint32_t& value) noexcept
+        {
+#ifdef WINSTD_SIMD_SSE2
+            static_assert(sizeof(wchar_t) == 2, "wchar_t must be UTF-16");
+            const __m128i d = _mm_sub_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(s)), _mm_set1_epi16('0'));
+            // Code units below '0' wrap to negative; all eight must be 0..9.
+            const __m128i bad = _mm_or_si128(_mm_cmplt_epi16(d, _mm_setzero_si128()), _mm_cmpgt_epi16(d, _mm_set1_epi16(9)));
+            if (_mm_movemask_epi8(bad))
+                return false;
+            const __m128i pairs = _mm_madd_epi16(d, _mm_setr_epi16(10, 1, 10, 1, 10, 1, 10, 1));         // 4 x 2 digits
+            const __m128i quads = _mm_madd_epi16(_mm_packs_epi32(pairs, pairs), _mm_setr_epi16(100, 1, 100, 1, 0, 0, 0, 0)); // 2 x 4 digits
+            value = static_cast<uint32_t>(_mm_cvtsi128_si32(quads)) * 10000 + static_cast<uint32_t>(_mm_cvtsi128_si32(_mm_srli_si128(quads, 4)));
+            return true;
+#else
+            uint32_t v = 0;
+            for (size_t i = 0; i < 8; ++i) {
+                const uint32_t d = static_cast<uint32_t>(s[i]) - '0';
+                if (d > 9)
+                    return false;
+                v = v * 10 + d;
+            }
+            value = v;
+            return true;
+#endif
+        }
+
+        ///
+        /// Accumulates a run of decimal digits
+        ///
+        /// \return Number of digits consumed
+        ///
+        inline size_t parse_digits(_In_reads_(n) const wchar_t* s, _In_ size_t n, _Inout_ uint64_t& mantissa, _Inout_ int& significant, _Out_ int& dropped, _Inout_ bool& truncated) noexcept
+        {
+            size_t i = 0;
+            dropped = 0;
+            for (uint32_t v; i + 8 <= n && significant + 8 <= 19 && parse_digits8(s + i, v); i += 8) {
+                if (mantissa)
+                    significant += 8;
+                else
+                    for (uint32_t x = v; x; x /= 10) significant++;
+                mantissa = mantissa * 100000000 + v;
+            }
+            for (; i < n; ++i) {
+                const uint32_t d = static_cast<uint32_t>(s[i]) - '0';
+                if (d > 9)
+                    break;
+                if (!mantissa && !d)
+                    continue;
+                if (significant < 19) {
+                    mantissa = mantissa * 10 + d;
+                    significant++;
+                } else {
+                    dropped++;
+                    truncated |= d != 0;
+                }
+            }
+            return i;
+        }
+
+        ///
+        /// Accumulates all digits of an integer string validated by `parse_invariant_number()`
+        ///
+        /// \return `false` on overflow
+        ///
+        inline bool parse_integer_exact(_In_reads_(n) const wchar_t* s, _In_ size_t n, _Out_ uint64_t& value) noexcept
+        {
+            value = 0;
+            for (size_t i = 0; i < n; ++i) {
+                const uint32_t d = static_cast<uint32_t>(s[i]) - '0';
+                if (d > 9)
+                    continue; // Spaces and sign
+                if (value > ((std::numeric_limits<uint64_t>::max)() - d) / 10)
+                    return false;
+                value = value * 10 + d;
+            }
+            return true;
+        }
+
+        ///
+        /// Parses a number in invariant notation: `[spaces][sign]digits[.digits][(e|E)[sign]digits][spaces]`
+        ///
+        /// \return `true` if the whole string is a number in this notation
+        ///
+        inline bool parse_invariant_number(_In_reads_(n) const wchar_t* s, _In_ size_t n, _Out_ parsed_number& r) noexcept
+        {
+            r = { false, true, false, 0, 0 };
+            size_t i = 0;
+            while (i < n && s[i] == L' ') i++;
+            if (i < n && (s[i] == L'+' || s[i] == L'-'))
+                r.negative = s[i++] == L'-';
+            int significant = 0, dropped;
+            size_t digits = parse_digits(s + i, n - i, r.mantissa, significant, dropped, r.truncated);
+            i += digits;
+            r.exponent = dropped;
+            if (i < n && s[i] == L'.') {
+                i++;
+                r.integer = false;
+                const size_t fraction = parse_digits(s + i, n - i, r.mantissa, significant, dropped, r.truncated);
+                i += fraction;
+                digits += fraction;
+                r.exponent -= static_cast<int>(fraction) - dropped;
+            }
+            if (!digits)
+                return false;
+            if (i < n && (s[i] == L'e' || s[i] == L'E')) {
+                i++;
+                r.integer = false;
+                bool negative = false;
+                if (i < n && (s[i] == L'+' || s[i] == L'-'))
+                    negative = s[i++] == L'-';
+                const size_t start = i;
+                int exponent = 0;
+                for (; i < n && static_cast<uint32_t>(s[i]) - '0' <= 9; ++i)
+                    if (exponent < 100000)
+                        exponent = exponent * 10 + (s[i] - '0');
+                if (i == start)
+                    return false;
+                r.exponent += negative ? -exponent : exponent;
+            }
+            while (i < n && s[i] == L' ') i++;
+            return i == n;
+        }
+
+        ///
+        /// Converts a parsed number to double
+        ///
+        /// \param[in] r  Parsed number
+        /// \param[in] s  Original string for numbers that need full precision
+        /// \param[in] n  Length of s
+        ///
+        inline bool parsed_to_double(_In_ const parsed_number& r, _In_reads_(n) const wchar_t* s, _In_ size_t n, _Out_ double& value) noexcept
+        {
+            static const double pow10[] = {
+                1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+                1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+            if (!r.truncated && r.mantissa <= (uint64_t(1) << 53) && r.exponent >= -22 && r.exponent <= 22) {
+                // Both operands are exact: a single IEEE operation rounds correctly.
+                const double m = static_cast<double>(r.mantissa);
+                value = r.exponent < 0 ? m / pow10[-r.exponent] : m * pow10[r.exponent];
+                if (r.negative)
+                    value = -value;
+                return true;
+            }
+            char buf[64];
+            size_t j = 0;
+            for (size_t i = 0; i < n; ++i) {
+                if (s[i] == L' ' || s[i] == L'+')
+                    continue;
+                if (j >= _countof(buf))
+                    return false;
+                buf[j++] = static_cast<char>(s[i]);
+            }
+            const auto result = std::from_chars(buf, buf + j, value);
+            return result.ec == std::errc() && result.ptr == buf + j;
+        }
+
+        ///
+        /// Stores a signed integer in a VARIANT with range check
+        ///
+        template <class T>
+        HRESULT store_integer(_In_ int64_t value, _In_ VARTYPE vt, _Out_ VARIANT& v) noexcept
+        {
+            if (value < static_cast<int64_t>((std::numeric_limits<T>::min)()) ||
+                (value > 0 && static_cast<uint64_t>(value) > static_cast<uint64_t>((std::numeric_limits<T>::max)())))
+                return DISP_E_OVERFLOW;
+            V_VT(&v) = vt;
+            *reinterpret_cast<T*>(&V_I1(&v)) = static_cast<T>(value);
+            return S_OK;
+        }
+
+        ///
+        /// Stores an unsigned integer in a VARIANT with range check
+        ///
+        template <class T>
+        HRESULT store_integer(_In_ uint64_t value, _In_ VARTYPE vt, _Out_ VARIANT& v) noexcept
+        {
+            if (value > static_cast<uint64_t>((std::numeric_limits<T>::max)()))
+                return DISP_E_OVERFLOW;
+            V_VT(&v) = vt;
+            *reinterpret_cast<T*>(&V_I1(&v)) = static_cast<T>(value);
+            return S_OK;
+        }
+
+        ///
+        /// Stores a double in an integer VARIANT, rounding half to even like `VariantChangeType`
+        ///
+        template <class T>
+        HRESULT store_integer(_In_ double value, _In_ VARTYPE vt, _Out_ VARIANT& v) noexcept
+        {
+            const double r = std::nearbyint(value);
+            const double hi = std::ldexp(1.0, std::numeric_limits<T>::digits);
+            if (!(r < hi && r >= (std::is_signed<T>::value ? -hi : 0.0)))
+                return DISP_E_OVERFLOW;
+            V_VT(&v) = vt;
+            *reinterpret_cast<T*>(&V_I1(&v)) = static_cast<T>(r);
+            return S_OK;
+        }
+
+        ///
+        /// Stores a number in a VARIANT of given type
+        ///
+        /// \return `S_OK` on success; `DISP_E_OVERFLOW` when out of range; `S_FALSE` when the target type has no fast path.
+        ///
+        template <class _Ty>
+        HRESULT store_number(_In_ _Ty value, _In_ VARTYPE vt, _Out_ VARIANT& v) noexcept
+        {
+            switch (vt) {
+            case VT_I1: return store_integer<CHAR>(value, vt, v);
+            case VT_I2: return store_integer<SHORT>(value, vt, v);
+            case VT_I4: return store_integer<LONG>(value, vt, v);
+            case VT_INT: return store_integer<INT>(value, vt, v);
+            case VT_I8: return store_integer<LONGLONG>(value, vt, v);
+            case VT_UI1: return store_integer<BYTE>(value, vt, v);
+            case VT_UI2: return store_integer<USHORT>(value, vt, v);
+            case VT_UI4: return store_integer<ULONG>(value, vt, v);
+            case VT_UINT: return store_integer<UINT>(value, vt, v);
+            case VT_UI8: return store_integer<ULONGLONG>(value, vt, v);
+            case VT_R8:
+                V_VT(&v) = VT_R8;
+                V_R8(&v) = static_cast<DOUBLE>(value);
+                return S_OK;
+            case VT_R4:
+                if (std::is_floating_point<_Ty>::value && std::fabs(static_cast<double>(value)) > FLT_MAX && !std::isinf(static_cast<double>(value)))
+                    return DISP_E_OVERFLOW;
+                V_VT(&v) = VT_R4;
+                V_R4(&v) = static_cast<FLOAT>(value);
+                return S_OK;
+            }
+            return S_FALSE;
+        }
+
+        ///
+        /// Converts a VARIANT using fast paths only
+        ///
+        /// \return `S_OK` on success; an error when conversion fails; `S_FALSE` when there is no fast path for the conversion.
+        ///
+        inline HRESULT coerce_fast(_In_ const VARIANT& src, _In_ VARTYPE vt, _Out_ VARIANT& dst) noexcept
+        {
+            switch (V_VT(&src)) {
+            case VT_I1: return store_number<int64_t>(V_I1(&src), vt, dst);
+            case VT_I2: return store_number<int64_t>(V_I2(&src), vt, dst);
+            case VT_I4: return store_number<int64_t>(V_I4(&src), vt, dst);
+            case VT_INT: return store_number<int64_t>(V_INT(&src), vt, dst);
+            case VT_I8: return store_number<int64_t>(V_I8(&src), vt, dst);
+            case VT_UI1: return store_number<uint64_t>(V_UI1(&src), vt, dst);
+            case VT_UI2: return store_number<uint64_t>(V_UI2(&src), vt, dst);
+            case VT_UI4: return store_number<uint64_t>(V_UI4(&src), vt, dst);
+            case VT_UINT: return store_number<uint64_t>(V_UINT(&src), vt, dst);
+            case VT_UI8: return store_number<uint64_t>(V_UI8(&src), vt, dst);
+            case VT_R4: return store_number<double>(V_R4(&src), vt, dst);
+            case VT_R8: return store_number<double>(V_R8(&src), vt, dst);
+            case VT_BSTR: {
+                if (vt == VT_BSTR)
+                    break;
+                const BSTR s = V_BSTR(&src);
+                const size_t n = s ? SysStringLen(s) : 0;
+                parsed_number r;
+                if (!parse_invariant_number(s, n, r))
+                    return S_FALSE;
+                if (vt != VT_R4 && vt != VT_R8 && (r.truncated || (r.integer && r.exponent))) {
+                    // Beyond 19 significant digits double rounding would differ from VariantChangeTypeEx. Integers are
+                    // accumulated exactly; fractions and overflows are left to VariantChangeTypeEx.
+                    if (!r.integer || !parse_integer_exact(s, n, r.mantissa))
+                        return S_FALSE;
+                    r.truncated = false;
+                    r.exponent = 0;
+                }
+                if (r.integer && !r.truncated && !r.exponent && vt != VT_R4 && vt != VT_R8) {
+                    if (!r.negative)
+                        return store_number<uint64_t>(r.mantissa, vt, dst);
+                    if (r.mantissa <= uint64_t(1) << 63)
+                        return store_number<int64_t>(static_cast<int64_t>(0 - r.mantissa), vt, dst);
+                    return S_FALSE;
+                }
+                double value;
+                if (!parsed_to_double(r, s, n, value) || std::isinf(value))
+                    return S_FALSE;
+                return store_number<double>(value, vt, dst);
+            }
+            }
+            return S_FALSE;
+        }
+    }
+    /// \endcond
+
+    ///
+    /// Converts an array of VARIANTs to another type
+    ///
+    /// Numbers are converted directly, and with `LOCALE_INVARIANT` numbers in BSTRs are parsed directly too. All other
+    /// conversions, including BSTRs in any other locale, are left to `VariantChangeTypeEx`. Results match
+    /// `VariantChangeTypeEx` with the given locale: integers are range-checked and fractions rounded half to even.
+    ///
+    /// \param[in ] src     Source VARIANTs
+    /// \param[out] dst     Destination VARIANTs. Must be initialized; previous content is cleared. May be the same as `src`.
+    /// \param[in ] count   Number of VARIANTs
+    /// \param[in ] vt      Target type
+    /// \param[out] errors  Optional bitmap of `(count + 63) / 64` words. A bit is set for each VARIANT that failed to convert.
+    ///                     Failed destinations are left `VT_EMPTY`.
+    /// \param[in ] lcid    Locale for parsing BSTRs
+    ///
+    /// \return Number of VARIANTs that failed to convert
+    ///
+    /// \sa [VariantChangeTypeEx function](https://learn.microsoft.com/en-us/windows/win32/api/oleauto/nf-oleauto-variantchangetypeex)
+    ///
+    inline size_t VariantChangeTypeBatch(
+        _In_reads_(count) const VARIANT* src,
+        _Inout_updates_(count) VARIANT* dst,
+        _In_ size_t count,
+        _In_ VARTYPE vt,
+        _Out_writes_opt_((count + 63) / 64) uint64_t* errors = NULL,
+        _In_ LCID lcid = LOCALE_INVARIANT)
+    {
+        assert(src || !count);
+        assert(dst || !count);
+        if (errors)
+            memset(errors, 0, (count + 63) / 64 * sizeof(uint64_t));
+        size_t failed = 0;
+        for (size_t i = 0; i < count; ++i) {
+            VARIANT v;
+            V_VT(&v) = VT_EMPTY;
+            // Only BSTR parsing depends on the locale, and the fast path knows the invariant one only.
+            HRESULT hr = lcid == LOCALE_INVARIANT || V_VT(&src[i]) != VT_BSTR ? internal::coerce_fast(src[i], vt, v) : S_FALSE;
+            if (hr == S_FALSE)
+                hr = V_VT(&src[i]) == vt ? VariantCopy(&v, &src[i]) : VariantChangeTypeEx(&v, &src[i], lcid, 0, vt);
+            VariantClear(&dst[i]);
+            if (SUCCEEDED(hr))
+                dst[i] = v;
+            else {
+                failed++;
+                if (errors)
+                    errors[i / 64] |= uint64_t(1) << (i % 64);
+            }
+        }
+        return failed;
+    }
+
+    /// \cond internal
+    namespace internal
+    {
+        ///
+        /// Returns size of a fixed-size VARTYPE in bytes or 0 for other types
+        ///
+        inline size_t codec_vt_size(_In_ VARTYPE vt) noexcept
+        {
+            switch (vt) {
+            case VT_I1: case VT_UI1: return 1;
+            case VT_I2: case VT_UI2: case VT_BOOL: return 2;
+            case VT_I4: case VT_UI4: case VT_INT: case VT_UINT: case VT_R4: case VT_ERROR: return 4;
+            case VT_I8: case VT_UI8: case VT_R8: case VT_CY: case VT_DATE: return 8;
+            case VT_DECIMAL: return sizeof(DECIMAL);
+            }
+            return 0;
+        }
+
+        ///
+        /// Appends encoded data to a vector
+        ///
+        struct codec_vector_writer
+        {
+            std::vector<uint8_t>& out;
+
+            void write(_In_reads_bytes_(n) const void* data, _In_ size_t n)
+            {
+                out.insert(out.end(), static_cast<const uint8_t*>(data), static_cast<const uint8_t*>(data) + n);
+            }
+        };
+
+        ///
+        /// Writes encoded data to a stream
+        ///
+        struct codec_stream_writer
+        {
+            ISequentialStream* stream;
+
+            void write(_In_reads_bytes_(n) const void* data, _In_ size_t n)
+            {
+                for (size_t done = 0; done < n;) {
+                    const ULONG count = static_cast<ULONG>((std::min)(n - done, static_cast<size_t>(0x40000000)));
+                    ULONG written;
+                    const HRESULT hr = stream->Write(static_cast<const uint8_t*>(data) + done, count, &written);
+                    if (FAILED(hr))
+                        throw com_runtime_error(hr, "ISequentialStream::Write failed");
+                    if (!written)
+                        throw com_runtime_error(STG_E_MEDIUMFULL, "ISequentialStream::Write failed");
+                    done += written;
+                }
+            }
+        };
+
+        ///
+        /// Reads encoded data from memory
+        ///
+        struct codec_buffer_reader
+        {
+            const uint8_t* data;
+            size_t size;
+
+            void read(_Out_writes_bytes_(n) void* dst, _In_ size_t n)
+            {
+                if (n > size)
+                    throw std::invalid_argument("truncated data");
+                memcpy(dst, data, n);
+                data += n;
+                size -= n;
+            }
+
+            size_t remaining() const noexcept { return size; }
+        };
+
+        ///
+        /// Reads encoded data from a stream
+        ///
+        struct codec_stream_reader
+        {
+            ISequentialStream* stream;
+
+            void read(_Out_writes_bytes_(n) void* dst, _In_ size_t n)
+            {
+                for (size_t done = 0; done < n;) {
+                    const ULONG count = static_cast<ULONG>((std::min)(n - done, static_cast<size_t>(0x40000000)));
+                    ULONG read;
+                    const HRESULT hr = stream->Read(static_cast<uint8_t*>(dst) + done, count, &read);
+                    if (FAILED(hr))
+                        throw com_runtime_error(hr, "ISequentialStream::Read failed");
+                    if (!read)
+                        throw std::invalid_argument("truncated data");
+                    done += read;
+                }
+            }
+
+            size_t remaining() const noexcept { return SIZE_MAX; }
+        };
+    }
+    /// \endcond
+
+    ///
+    /// Compact binary serialization of VARIANTs
+    ///
+    /// Supports `VT_EMPTY`, `VT_NULL`, integers, `VT_R4`, `VT_R8`, `VT_CY`, `VT_DATE`, `VT_BOOL`, `VT_ERROR`, `VT_DECIMAL`,
+    /// `VT_BSTR` and SAFEARRAYs of these or of VARIANTs, nested up to `max_depth` levels. Interfaces, records and references
+    /// are not supported.
+    ///
+    /// Format (little-endian):
+    /// - `uint16_t` VARTYPE, followed by:
+    /// - fixed-size types: the value as in memory;
+    /// - `VT_BSTR`: `uint32_t` length in bytes (0xffffffff for NULL) followed by the string;
+    /// - `VT_ARRAY`: `uint16_t` number of dimensions, then `uint32_t` count and `int32_t` lower bound for each dimension in
+    ///   left-to-right order, then all elements in memory order. Fixed-size elements are stored as one raw block.
+    ///
+    /// Arrays of fixed-size elements are read straight into the array memory, also when decoding from a stream.
+    ///
+    class variant_codec
+    {
+    public:
+        static const unsigned max_depth = 32; ///< Maximum nesting of VARIANT arrays
+
+        ///
+        /// Returns size of encoded VARIANT in bytes
+        ///
+        /// \param[in] v  VARIANT
+        ///
+        static size_t encoded_size(_In_ const VARIANT& v)
+        {
+            counter c = { 0 };
+            encode_value(c, v, 0);
+            return c.size;
+        }
+
+        ///
+        /// Appends encoded VARIANT to a vector
+        ///
+        /// \param[in ] v    VARIANT
+        /// \param[out] out  Vector to append to
+        ///
+        static void encode(_In_ const VARIANT& v, _Inout_ std::vector<uint8_t>& out)
+        {
+            out.reserve(out.size() + encoded_size(v));
+            internal::codec_vector_writer w = { out };
+            encode_value(w, v, 0);
+        }
+
+        ///
+        /// Writes encoded VARIANT to a stream
+        ///
+        /// \param[in] v       VARIANT
+        /// \param[in] stream  Stream to write to
+        ///
+        static void encode(_In_ const VARIANT& v, _In_ ISequentialStream* stream)
+        {
+            assert(stream);
+            internal::codec_stream_writer w = { stream };
+            encode_value(w, v, 0);
+        }
+
+        ///
+        /// Decodes VARIANT from memory
+        ///
+        /// \param[in ] data  Encoded data
+        /// \param[in ] size  Size of encoded data in bytes
+        /// \param[out] v     VARIANT. Must be initialized; previous content is cleared.
+        ///
+        /// \return Number of bytes consumed
+        ///
+        static size_t decode(_In_reads_bytes_(size) const void* data, _In_ size_t size, _Inout_ VARIANT& v)
+        {
+            internal::codec_buffer_reader r = { static_cast<const uint8_t*>(data), size };
+            VariantClear(&v);
+            decode_value(r, v, 0);
+            return size - r.size;
+        }
+
+        ///
+        /// Decodes VARIANT from a stream
+        ///
+        /// Large arrays are read directly into the SAFEARRAY in chunks the stream provides; no copy of the encoded data is kept.
+        ///
+        /// \param[in ] stream  Stream to read from
+        /// \param[out] v       VARIANT. Must be initialized; previous content is cleared.
+        ///
+        static void decode(_In_ ISequentialStream* stream, _Inout_ VARIANT& v)
+        {
+            assert(stream);
+            internal::codec_stream_reader r = { stream };
+            VariantClear(&v);
+            decode_value(r, v, 0);
+        }
+
+        ///
+        /// Decodes an array into an existing SAFEARRAY
+        ///
+        /// The encoded array must have the same element type and dimensions as the target.
+        ///
+        /// \param[in] data  Encoded data
+        /// \param[in] size  Size of encoded data in bytes
+        /// \param[in] psa   Target array
+        ///
+        /// \return Number of bytes consumed
+        ///
+        static size_t decode(_In_reads_bytes_(size) const void* data, _In_ size_t size, _In_ SAFEARRAY* psa)
+        {
+            internal::codec_buffer_reader r = { static_cast<const uint8_t*>(data), size };
+            decode_into(r, psa);
+            return size - r.size;
+        }
+
+        ///
+        /// Decodes an array from a stream into an existing SAFEARRAY
+        ///
+        /// \param[in] stream  Stream to read from
+        /// \param[in] psa     Target array
+        ///
+        static void decode(_In_ ISequentialStream* stream, _In_ SAFEARRAY* psa)
+        {
+            assert(stream);
+            internal::codec_stream_reader r = { stream };
+            decode_into(r, psa);
+        }
+
+    protected:
+        /// \cond internal
+        struct counter
+        {
+            size_t size;
+            void write(_In_reads_bytes_(n) const void*, _In_ size_t n) noexcept { size += n; }
+        };
+
+        template <class _Writer>
+        static void encode_value(_Inout_ _Writer& w, _In_ const VARIANT& v, _In_ unsigned depth)
+        {
+            const VARTYPE vt = V_VT(&v);
+            if (vt & VT_ARRAY) {
+                if (vt & ~(VT_ARRAY | VT_TYPEMASK))
+                    throw std::invalid_argument("unsupported VARTYPE");
+                w.write(&vt, sizeof(vt));
+                encode_array(w, V_ARRAY(&v), vt & VT_TYPEMASK, depth);
+                return;
+            }
+            switch (vt) {
+            case VT_EMPTY:
+            case VT_NULL:
+                w.write(&vt, sizeof(vt));
+                return;
+            case VT_BSTR:
+                w.write(&vt, sizeof(vt));
+                encode_bstr(w, V_BSTR(&v));
+                return;
+            case VT_DECIMAL: {
+                // DECIMAL overlays the VARTYPE: store it zeroed.
+                DECIMAL d = V_DECIMAL(&v);
+                d.wReserved = 0;
+                w.write(&vt, sizeof(vt));
+                w.write(&d, sizeof(d));
+                return;
+            }
+            }
+            const size_t n = internal::codec_vt_size(vt);
+            if (!n)
+                throw std::invalid_argument("unsupported VARTYPE");
+            w.write(&vt, sizeof(vt));
+            w.write(&V_I1(&v), n);
+        }
+
+        template <class _Writer>
+        static void encode_bstr(_Inout_ _Writer& w, _In_opt_ BSTR s)
+        {
+            const uint32_t n = s ? SysStringByteLen(s) : UINT32_MAX;
+            w.write(&n, sizeof(n));
+            if (s)
+                w.write(s, n);
+        }
+
+        template <class _Writer>
+        static void encode_array(_Inout_ _Writer& w, _In_opt_ SAFEARRAY* psa, _In_ VARTYPE vt, _In_ unsigned depth)
+        {
+            const uint16_t dims = psa ? psa->cDims : 0;
+            w.write(&dims, sizeof(dims));
+            if (!dims)
+                return;
+            size_t count = 1;
+            for (uint16_t d = 0; d < dims; ++d) {
+                const SAFEARRAYBOUND& b = psa->rgsabound[dims - 1 - d];
+                const uint32_t n = b.cElements;
+                const int32_t lbound = b.lLbound;
+                w.write(&n, sizeof(n));
+                w.write(&lbound, sizeof(lbound));
+                count *= n;
+            }
+            safearray_accessor<uint8_t> a(psa);
+            if (vt == VT_VARIANT) {
+                if (depth >= max_depth)
+                    throw std::invalid_argument("arrays nested too deep");
+                for (size_t i = 0; i < count; ++i)
+                    encode_value(w, reinterpret_cast<const VARIANT*>(a.data())[i], depth + 1);
+            } else if (vt == VT_BSTR) {
+                for (size_t i = 0; i < count; ++i)
+                    encode_bstr(w, reinterpret_cast<const BSTR*>(a.data())[i]);
+            } else {
+                const size_t n = internal::codec_vt_size(vt);
+                if (!n || psa->cbElements != n)
+                    throw std::invalid_argument("unsupported array element type");
+                w.write(a.data(), count * n);
+            }
+        }
+
+        template <class _Reader>
+        static void decode_value(_Inout_ _Reader& r, _Inout_ VARIANT& v, _In_ unsigned depth)
+        {
+            // v is VT_EMPTY and is set only when fully decoded.
+            VARTYPE vt;
+            r.read(&vt, sizeof(vt));
+            if (vt & VT_ARRAY) {
+                if (vt & ~(VT_ARRAY | VT_TYPEMASK))
+                    throw std::invalid_argument("unsupported VARTYPE");
+                V_ARRAY(&v) = decode_array(r, vt & VT_TYPEMASK, depth);
+                V_VT(&v) = vt;
+                return;
+            }
+            switch (vt) {
+            case VT_EMPTY:
+            case VT_NULL:
+                V_VT(&v) = vt;
+                return;
+            case VT_BSTR:
+                V_BSTR(&v) = decode_bstr(r);
+                V_VT(&v) = VT_BSTR;
+                return;
+            case VT_DECIMAL:
+                r.read(&V_DECIMAL(&v), sizeof(DECIMAL));
+                V_VT(&v) = VT_DECIMAL;
+                return;
+            }
+            const size_t n = internal::codec_vt_size(vt);
+            if (!n)
+                throw std::invalid_argument("unsupported VARTYPE");
+            r.read(&V_I1(&v), n);
+            V_VT(&v) = vt;
+        }
+
+        template <class _Reader>
+        static BSTR decode_bstr(_Inout_ _Reader& r)
+        {
+            uint32_t n;
+            r.read(&n, sizeof(n));
+            if (n == UINT32_MAX)
+                return NULL;
+            if (n > r.remaining())
+                throw std::invalid_argument("truncated data");
+            bstr s;
+            s.attach(SysAllocStringByteLen(NULL, n));
+            if (!s)
+                throw std::bad_alloc();
+            r.read(static_cast<BSTR>(s), n);
+            return s.detach();
+        }
+
+        template <class _Reader>
+        static size_t decode_bounds(_Inout_ _Reader& r, _Out_ uint16_t& dims, _Out_writes_(64) SAFEARRAYBOUND* bounds)
+        {
+            r.read(&dims, sizeof(dims));
+            if (dims > 64)
+                throw std::invalid_argument("too many dimensions");
+            size_t count = dims ? 1 : 0;
+            for (uint16_t d = 0; d < dims; ++d) {
+                uint32_t n;
+                int32_t lbound;
+                r.read(&n, sizeof(n));
+                r.read(&lbound, sizeof(lbound));
+                bounds[d].cElements = n;
+                bounds[d].lLbound = lbound;
+                if (n && count > SIZE_MAX / n)
+                    throw std::invalid_argument("array too big");
+                count *= n;
+            }
+            return count;
+        }
+
+        template <class _Reader>
+        static void decode_elements(_Inout_ _Reader& r, _In_ VARTYPE vt, _Inout_ uint8_t* data, _In_ size_t count, _In_ unsigned depth)
+        {
+            if (vt == VT_VARIANT) {
+                if (depth >= max_depth)
+                    throw std::invalid_argument("arrays nested too deep");
+                if (count > r.remaining() / sizeof(VARTYPE))
+                    throw std::invalid_argument("truncated data");
+                for (size_t i = 0; i < count; ++i) {
+                    VARIANT& e = reinterpret_cast<VARIANT*>(data)[i];
+                    VariantClear(&e);
+                    decode_value(r, e, depth + 1);
+                }
+            } else if (vt == VT_BSTR) {
+                if (count > r.remaining() / sizeof(uint32_t))
+                    throw std::invalid_argument("truncated data");
+                for (size_t i = 0; i < count; ++i) {
+                    BSTR& e = reinterpret_cast<BSTR*>(data)[i];
+                    SysFreeString(e);
+                    e = NULL;
+                    e = decode_bstr(r);
+                }
+            } else
+                r.read(data, count * internal::codec_vt_size(vt));
+        }
+
+        template <class _Reader>
+        static SAFEARRAY* decode_array(_Inout_ _Reader& r, _In_ VARTYPE vt, _In_ unsigned depth)
+        {
+            uint16_t dims;
+            SAFEARRAYBOUND bounds[64];
+            const size_t count = decode_bounds(r, dims, bounds);
+            if (!dims)
+                return NULL;
+            const size_t n = internal::codec_vt_size(vt);
+            if (vt != VT_VARIANT && vt != VT_BSTR && !n)
+                throw std::invalid_argument("unsupported array element type");
+            if (n && count > r.remaining() / n)
+                throw std::invalid_argument("truncated data");
+            safearray sa(SafeArrayCreate(vt, dims, bounds));
+            if (!sa)
+                throw std::bad_alloc();
+            {
+                safearray_accessor<uint8_t> a(sa);
+                decode_elements(r, vt, a.data(), count, depth);
+            }
+            return sa.detach();
+        }
+
+        template <class _Reader>
+        static void decode_into(_Inout_ _Reader& r, _In_ SAFEARRAY* psa)
+        {
+            assert(psa);
+            VARTYPE vt, vt_target;
+            r.read(&vt, sizeof(vt));
+            HRESULT hr = SafeArrayGetVartype(psa, &vt_target);
+            if (FAILED(hr))
+                throw com_runtime_error(hr, "SafeArrayGetVartype failed");
+            if (vt != (VT_ARRAY | vt_target))
+                throw std::invalid_argument("array type mismatch");
+            uint16_t dims;
+            SAFEARRAYBOUND bounds[64];
+            const size_t count = decode_bounds(r, dims, bounds);
+            if (dims != psa->cDims)
+                throw std::invalid_argument("array shape mismatch");
+            for (uint16_t d = 0; d < dims; ++d)
+                if (bounds[d].cElements != psa->rgsabound[dims - 1 - d].cElements || bounds[d].lLbound != psa->rgsabound[dims - 1 - d].lLbound)
+                    throw std::invalid_argument("array shape mismatch");
+            const size_t n = internal::codec_vt_size(vt_target);
+            if (vt_target != VT_VARIANT && vt_target != VT_BSTR && (!n || psa->cbElements != n))
+                throw std::invalid_argument("unsupported array element type");
+            if (n && count > r.remaining() / n)
+                throw std::invalid_argument("truncated data");
+            safearray_accessor<uint8_t> a(psa);
+            decode_elements(r, vt_target, a.data(), count, 0);
+        }
+        /// \endcond
+    };
+
     /// @}
 }
\ No newline at end of file
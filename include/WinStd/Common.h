@@ -6,15 +6,29 @@
 
 #pragma once
 
+#if (defined(_MSVC_LANG) ? _MSVC_LANG : __cplusplus) < 201703L
+#error WinStd requires C++17 or later. Compile with /std:c++17.
+#endif
+
 #include <Windows.h>
 #include <assert.h>
 #include <intsafe.h>
+#include <string.h>
 #include <stdarg.h>
+#include <stdint.h>
 #include <tchar.h>
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <initializer_list>
 #include <iostream>
 #include <memory>
+#include <mutex>
 #include <stdexcept>
 #include <string>
+#include <string_view>
+#include <thread>
+#include <tuple>
 #include <vector>
 
 /// \defgroup WinStdGeneral General
@@ -33,6 +47,25 @@
 /// \defgroup WinStdExceptions Exceptions
 ///
 /// \defgroup WinStdMemSanitize Auto-sanitize Memory Management
+///
+/// \defgroup WinStdStrCmp String Comparison
+///
+/// \par Example
+/// \code
+/// // Registry path cache with case-insensitive keys, the way Windows compares file and registry names.
+/// std::unordered_map<std::wstring, DWORD, winstd::ordinal_icase_hash<>, winstd::ordinal_icase_equal_to<>> cache;
+/// cache[L"HKEY_LOCAL_MACHINE\\Software"] = 1;
+/// assert(cache.find(L"hkey_local_machine\\SOFTWARE") != cache.end());
+/// \endcode
+///
+/// \defgroup WinStdGuidContainers GUID Containers
+///
+/// \par Example
+/// \code
+/// winstd::guid_map<std::string> providers;
+/// providers[__uuidof(IUnknown)] = "IUnknown";
+/// auto it = providers.find(__uuidof(IUnknown));
+/// \endcode
 
 /// \addtogroup WinStdGeneral
 /// @{
@@ -94,6 +127,27 @@ private: \
 #define WINSTD_STACK_BUFFER_BYTES  1024
 #endif
 
+#ifndef WINSTD_NO_SIMD
+#if defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2) || defined(__SSE2__)
+///
+/// Defined when SSE2 code paths are enabled
+///
+/// All x64 CPUs support SSE2. Define `WINSTD_NO_SIMD` to use scalar code paths only.
+///
+#define WINSTD_SIMD_SSE2
+#include <emmintrin.h>
+#endif
+#if defined(__AVX2__)
+///
+/// Defined when AVX2 code paths are enabled
+///
+/// The compiler defines `__AVX2__` when compiling with `/arch:AVX2`. Define `WINSTD_NO_SIMD` to use scalar code paths only.
+///
+#define WINSTD_SIMD_AVX2
+#include <immintrin.h>
+#endif
+#endif
+
 /// @}
 
 /// \addtogroup WinStdStrFormat
@@ -1885,4 +1939,1204 @@ namespace winstd
     };
 
     /// @}
+
+    /// \addtogroup WinStdStrCmp
+    /// @{
+
+    ///
+    /// Ordinal upper-case mapping of UTF-16 code units
+    ///
+    /// The mapping is the Unicode simple uppercase mapping of the Basic Multilingual Plane, the same kind of table NTFS keeps in
+    /// `$UpCase` and `CompareStringOrdinal(bIgnoreCase = TRUE)` uses. It is locale independent: no Turkish i, no ligature expansion.
+    /// Surrogates and characters without single code unit uppercase are mapped to themselves.
+    ///
+    class ordinal_upcase_table
+    {
+        WINSTD_NONCOPYABLE(ordinal_upcase_table)
+        WINSTD_NONMOVABLE(ordinal_upcase_table)
+
+    public:
+        ///
+        /// Returns the process-wide instance
+        ///
+        /// The table is built on first use.
+        ///
+        static const ordinal_upcase_table& instance()
+        {
+            static const ordinal_upcase_table table;
+            return table;
+        }
+
+        ///
+        /// Maps a code unit to upper-case
+        ///
+        /// \param[in] c  UTF-16 code unit
+        ///
+        /// \return Upper-case code unit
+        ///
+        uint16_t operator()(_In_ uint16_t c) const noexcept
+        {
+            return static_cast<uint16_t>(c + m_pages[c >> 8][c & 0xff]);
+        }
+
+    protected:
+        /// \cond internal
+        ordinal_upcase_table()
+        {
+            struct range { uint16_t first, last, delta; uint8_t step; };
+            static const range ranges[] = {
+            { 0x0061, 0x007a, 0xffe0, 1 }, { 0x00b5, 0x00b5, 0x02e7, 1 }, { 0x00e0, 0x00f6, 0xffe0, 1 }, { 0x00f8, 0x00fe, 0xffe0, 1 },
+            { 0x00ff, 0x00ff, 0x0079, 1 }, { 0x0101, 0x012f, 0xffff, 2 }, { 0x0131, 0x0131, 0xff18, 1 }, { 0x0133, 0x0137, 0xffff, 2 },
+            { 0x013a, 0x0148, 0xffff, 2 }, { 0x014b, 0x0177, 0xffff, 2 }, { 0x017a, 0x017e, 0xffff, 2 }, { 0x017f, 0x017f, 0xfed4, 1 },
+            { 0x0180, 0x0180, 0x00c3, 1 }, { 0x0183, 0x0185, 0xffff, 2 }, { 0x0188, 0x0188, 0xffff, 1 }, { 0x018c, 0x018c, 0xffff, 1 },
+            { 0x0192, 0x0192, 0xffff, 1 }, { 0x0195, 0x0195, 0x0061, 1 }, { 0x0199, 0x0199, 0xffff, 1 }, { 0x019a, 0x019a, 0x00a3, 1 },
+            { 0x019e, 0x019e, 0x0082, 1 }, { 0x01a1, 0x01a5, 0xffff, 2 }, { 0x01a8, 0x01a8, 0xffff, 1 }, { 0x01ad, 0x01ad, 0xffff, 1 },
+            { 0x01b0, 0x01b0, 0xffff, 1 }, { 0x01b4, 0x01b6, 0xffff, 2 }, { 0x01b9, 0x01b9, 0xffff, 1 }, { 0x01bd, 0x01bd, 0xffff, 1 },
+            { 0x01bf, 0x01bf, 0x0038, 1 }, { 0x01c5, 0x01c5, 0xffff, 1 }, { 0x01c6, 0x01c6, 0xfffe, 1 }, { 0x01c8, 0x01c8, 0xffff, 1 },
+            { 0x01c9, 0x01c9, 0xfffe, 1 }, { 0x01cb, 0x01cb, 0xffff, 1 }, { 0x01cc, 0x01cc, 0xfffe, 1 }, { 0x01ce, 0x01dc, 0xffff, 2 },
+            { 0x01dd, 0x01dd, 0xffb1, 1 }, { 0x01df, 0x01ef, 0xffff, 2 }, { 0x01f2, 0x01f2, 0xffff, 1 }, { 0x01f3, 0x01f3, 0xfffe, 1 },
+            { 0x01f5, 0x01f5, 0xffff, 1 }, { 0x01f9, 0x021f, 0xffff, 2 }, { 0x0223, 0x0233, 0xffff, 2 }, { 0x023c, 0x023c, 0xffff, 1 },
+            { 0x023f, 0x0240, 0x2a3f, 1 }, { 0x0242, 0x0242, 0xffff, 1 }, { 0x0247, 0x024f, 0xffff, 2 }, { 0x0250, 0x0250, 0x2a1f, 1 },
+            { 0x0251, 0x0251, 0x2a1c, 1 }, { 0x0252, 0x0252, 0x2a1e, 1 }, { 0x0253, 0x0253, 0xff2e, 1 }, { 0x0254, 0x0254, 0xff32, 1 },
+            { 0x0256, 0x0257, 0xff33, 1 }, { 0x0259, 0x0259, 0xff36, 1 }, { 0x025b, 0x025b, 0xff35, 1 }, { 0x025c, 0x025c, 0xa54f, 1 },
+            { 0x0260, 0x0260, 0xff33, 1 }, { 0x0261, 0x0261, 0xa54b, 1 }, { 0x0263, 0x0263, 0xff31, 1 }, { 0x0265, 0x0265, 0xa528, 1 },
+            { 0x0266, 0x0266, 0xa544, 1 }, { 0x0268, 0x0268, 0xff2f, 1 }, { 0x0269, 0x0269, 0xff2d, 1 }, { 0x026a, 0x026a, 0xa544, 1 },
+            { 0x026b, 0x026b, 0x29f7, 1 }, { 0x026c, 0x026c, 0xa541, 1 }, { 0x026f, 0x026f, 0xff2d, 1 }, { 0x0271, 0x0271, 0x29fd, 1 },
+            { 0x0272, 0x0272, 0xff2b, 1 }, { 0x0275, 0x0275, 0xff2a, 1 }, { 0x027d, 0x027d, 0x29e7, 1 }, { 0x0280, 0x0280, 0xff26, 1 },
+            { 0x0282, 0x0282, 0xa543, 1 }, { 0x0283, 0x0283, 0xff26, 1 }, { 0x0287, 0x0287, 0xa52a, 1 }, { 0x0288, 0x0288, 0xff26, 1 },
+            { 0x0289, 0x0289, 0xffbb, 1 }, { 0x028a, 0x028b, 0xff27, 1 }, { 0x028c, 0x028c, 0xffb9, 1 }, { 0x0292, 0x0292, 0xff25, 1 },
+            { 0x029d, 0x029d, 0xa515, 1 }, { 0x029e, 0x029e, 0xa512, 1 }, { 0x0345, 0x0345, 0x0054, 1 }, { 0x0371, 0x0373, 0xffff, 2 },
+            { 0x0377, 0x0377, 0xffff, 1 }, { 0x037b, 0x037d, 0x0082, 1 }, { 0x03ac, 0x03ac, 0xffda, 1 }, { 0x03ad, 0x03af, 0xffdb, 1 },
+            { 0x03b1, 0x03c1, 0xffe0, 1 }, { 0x03c2, 0x03c2, 0xffe1, 1 }, { 0x03c3, 0x03cb, 0xffe0, 1 }, { 0x03cc, 0x03cc, 0xffc0, 1 },
+            { 0x03cd, 0x03ce, 0xffc1, 1 }, { 0x03d0, 0x03d0, 0xffc2, 1 }, { 0x03d1, 0x03d1, 0xffc7, 1 }, { 0x03d5, 0x03d5, 0xffd1, 1 },
+            { 0x03d6, 0x03d6, 0xffca, 1 }, { 0x03d7, 0x03d7, 0xfff8, 1 }, { 0x03d9, 0x03ef, 0xffff, 2 }, { 0x03f0, 0x03f0, 0xffaa, 1 },
+            { 0x03f1, 0x03f1, 0xffb0, 1 }, { 0x03f2, 0x03f2, 0x0007, 1 }, { 0x03f3, 0x03f3, 0xff8c, 1 }, { 0x03f5, 0x03f5, 0xffa0, 1 },
+            { 0x03f8, 0x03f8, 0xffff, 1 }, { 0x03fb, 0x03fb, 0xffff, 1 }, { 0x0430, 0x044f, 0xffe0, 1 }, { 0x0450, 0x045f, 0xffb0, 1 },
+            { 0x0461, 0x0481, 0xffff, 2 }, { 0x048b, 0x04bf, 0xffff, 2 }, { 0x04c2, 0x04ce, 0xffff, 2 }, { 0x04cf, 0x04cf, 0xfff1, 1 },
+            { 0x04d1, 0x052f, 0xffff, 2 }, { 0x0561, 0x0586, 0xffd0, 1 }, { 0x10d0, 0x10fa, 0x0bc0, 1 }, { 0x10fd, 0x10ff, 0x0bc0, 1 },
+            { 0x13f8, 0x13fd, 0xfff8, 1 }, { 0x1c80, 0x1c80, 0xe792, 1 }, { 0x1c81, 0x1c81, 0xe793, 1 }, { 0x1c82, 0x1c82, 0xe79c, 1 },
+            { 0x1c83, 0x1c84, 0xe79e, 1 }, { 0x1c85, 0x1c85, 0xe79d, 1 }, { 0x1c86, 0x1c86, 0xe7a4, 1 }, { 0x1c87, 0x1c87, 0xe7db, 1 },
+            { 0x1c88, 0x1c88, 0x89c2, 1 }, { 0x1d79, 0x1d79, 0x8a04, 1 }, { 0x1d7d, 0x1d7d, 0x0ee6, 1 }, { 0x1d8e, 0x1d8e, 0x8a38, 1 },
+            { 0x1e01, 0x1e95, 0xffff, 2 }, { 0x1e9b, 0x1e9b, 0xffc5, 1 }, { 0x1ea1, 0x1eff, 0xffff, 2 }, { 0x1f00, 0x1f07, 0x0008, 1 },
+            { 0x1f10, 0x1f15, 0x0008, 1 }, { 0x1f20, 0x1f27, 0x0008, 1 }, { 0x1f30, 0x1f37, 0x0008, 1 }, { 0x1f40, 0x1f45, 0x0008, 1 },
+            { 0x1f51, 0x1f57, 0x0008, 2 }, { 0x1f60, 0x1f67, 0x0008, 1 }, { 0x1f70, 0x1f71, 0x004a, 1 }, { 0x1f72, 0x1f75, 0x0056, 1 },
+            { 0x1f76, 0x1f77, 0x0064, 1 }, { 0x1f78, 0x1f79, 0x0080, 1 }, { 0x1f7a, 0x1f7b, 0x0070, 1 }, { 0x1f7c, 0x1f7d, 0x007e, 1 },
+            { 0x1fb0, 0x1fb1, 0x0008, 1 }, { 0x1fbe, 0x1fbe, 0xe3db, 1 }, { 0x1fd0, 0x1fd1, 0x0008, 1 }, { 0x1fe0, 0x1fe1, 0x0008, 1 },
+            { 0x1fe5, 0x1fe5, 0x0007, 1 }, { 0x214e, 0x214e, 0xffe4, 1 }, { 0x2170, 0x217f, 0xfff0, 1 }, { 0x2184, 0x2184, 0xffff, 1 },
+            { 0x24d0, 0x24e9, 0xffe6, 1 }, { 0x2c30, 0x2c5f, 0xffd0, 1 }, { 0x2c61, 0x2c61, 0xffff, 1 }, { 0x2c65, 0x2c65, 0xd5d5, 1 },
+            { 0x2c66, 0x2c66, 0xd5d8, 1 }, { 0x2c68, 0x2c6c, 0xffff, 2 }, { 0x2c73, 0x2c73, 0xffff, 1 }, { 0x2c76, 0x2c76, 0xffff, 1 },
+            { 0x2c81, 0x2ce3, 0xffff, 2 }, { 0x2cec, 0x2cee, 0xffff, 2 }, { 0x2cf3, 0x2cf3, 0xffff, 1 }, { 0x2d00, 0x2d25, 0xe3a0, 1 },
+            { 0x2d27, 0x2d27, 0xe3a0, 1 }, { 0x2d2d, 0x2d2d, 0xe3a0, 1 }, { 0xa641, 0xa66d, 0xffff, 2 }, { 0xa681, 0xa69b, 0xffff, 2 },
+            { 0xa723, 0xa72f, 0xffff, 2 }, { 0xa733, 0xa76f, 0xffff, 2 }, { 0xa77a, 0xa77c, 0xffff, 2 }, { 0xa77f, 0xa787, 0xffff, 2 },
+            { 0xa78c, 0xa78c, 0xffff, 1 }, { 0xa791, 0xa793, 0xffff, 2 }, { 0xa794, 0xa794, 0x0030, 1 }, { 0xa797, 0xa7a9, 0xffff, 2 },
+            { 0xa7b5, 0xa7c3, 0xffff, 2 }, { 0xa7c8, 0xa7ca, 0xffff, 2 }, { 0xa7d1, 0xa7d1, 0xffff, 1 }, { 0xa7d7, 0xa7d9, 0xffff, 2 },
+            { 0xa7f6, 0xa7f6, 0xffff, 1 }, { 0xab53, 0xab53, 0xfc60, 1 }, { 0xab70, 0xabbf, 0x6830, 1 }, { 0xff41, 0xff5a, 0xffe0, 1 },
+            };
+
+            size_t count = 0;
+            bool used[0x100] = {};
+            for (auto& r : ranges)
+                for (size_t page = r.first >> 8; page <= static_cast<size_t>(r.last >> 8); ++page)
+                    if (!used[page]) { used[page] = true; ++count; }
+            m_data.reset(new uint16_t[(count + 1) * 0x100]());
+            uint16_t* page = m_data.get() + 0x100;
+            for (size_t i = 0; i < 0x100; ++i)
+                if (used[i]) { m_pages[i] = page; page += 0x100; }
+                else m_pages[i] = m_data.get();
+            for (auto& r : ranges)
+                for (size_t c = r.first; c <= r.last; c += r.step)
+                    m_pages[c >> 8][c & 0xff] = r.delta;
+        }
+        /// \endcond
+
+    protected:
+        std::unique_ptr<uint16_t[]> m_data;  ///< Shared identity page followed by non-identity pages of deltas
+        uint16_t* m_pages[0x100];             ///< Pages of (upper - c) deltas indexed by high byte
+    };
+
+    ///
+    /// Maps a UTF-16 code unit to upper-case using ordinal (locale independent) rules
+    ///
+    /// \param[in] c  UTF-16 code unit
+    ///
+    /// \return Upper-case code unit
+    ///
+    inline uint16_t ordinal_upcase(_In_ uint16_t c) noexcept
+    {
+        if (c < 0x80)
+            return static_cast<uint16_t>(c - ((static_cast<uint16_t>(c - 'a') < 26) << 5));
+        return ordinal_upcase_table::instance()(c);
+    }
+
+    /// \cond internal
+    namespace internal
+    {
+#ifdef WINSTD_SIMD_SSE2
+        ///
+        /// Upper-cases eight ASCII code units
+        ///
+        inline __m128i ascii_upcase(_In_ __m128i v) noexcept
+        {
+            const __m128i lower = _mm_and_si128(
+                _mm_cmpgt_epi16(v, _mm_set1_epi16('a' - 1)),
+                _mm_cmpgt_epi16(_mm_set1_epi16('z' + 1), v));
+            return _mm_sub_epi16(v, _mm_and_si128(lower, _mm_set1_epi16(0x20)));
+        }
+#endif
+#ifdef WINSTD_SIMD_AVX2
+        ///
+        /// Upper-cases sixteen ASCII code units
+        ///
+        inline __m256i ascii_upcase(_In_ __m256i v) noexcept
+        {
+            const __m256i lower = _mm256_and_si256(
+                _mm256_cmpgt_epi16(v, _mm256_set1_epi16('a' - 1)),
+                _mm256_cmpgt_epi16(_mm256_set1_epi16('z' + 1), v));
+            return _mm256_sub_epi16(v, _mm256_and_si256(lower, _mm256_set1_epi16(0x20)));
+        }
+#endif
+
+        ///
+        /// Returns the index of the lowest set bit
+        ///
+        inline unsigned long lowest_bit(_In_ unsigned long mask) noexcept
+        {
+            unsigned long index;
+            _BitScanForward(&index, mask);
+            return index;
+        }
+
+        ///
+        /// Compares code units one by one using the upcase table
+        ///
+        inline int ordinal_icase_compare_scalar(_In_reads_(count) const uint16_t* a, _In_reads_(count) const uint16_t* b, _In_ size_t count) noexcept
+        {
+            for (size_t i = 0; i < count; ++i) {
+                if (a[i] == b[i])
+                    continue;
+                const int ua = ordinal_upcase(a[i]), ub = ordinal_upcase(b[i]);
+                if (ua != ub)
+                    return ua - ub;
+            }
+            return 0;
+        }
+
+        ///
+        /// Upper-cases four code units packed in a 64-bit word
+        ///
+        inline uint64_t ordinal_upcase4(_In_reads_(4) const uint16_t* s) noexcept
+        {
+            uint64_t w;
+            memcpy(&w, s, sizeof(w));
+            if ((w & 0xff80ff80ff80ff80) == 0) {
+                // All ASCII: lanes are below 0x80, so adding another value below 0x80 never carries into the next lane.
+                const uint64_t ge_a = w + 0x001f001f001f001f; // lane bit 7 set when c >= 'a'
+                const uint64_t gt_z = w + 0x0005000500050005; // lane bit 7 set when c > 'z'
+                return w - (((ge_a & ~gt_z) & 0x0080008000800080) >> 2);
+            }
+            return
+                static_cast<uint64_t>(ordinal_upcase(s[0]))        |
+                static_cast<uint64_t>(ordinal_upcase(s[1])) << 16  |
+                static_cast<uint64_t>(ordinal_upcase(s[2])) << 32  |
+                static_cast<uint64_t>(ordinal_upcase(s[3])) << 48;
+        }
+
+        ///
+        /// Mixes a 64-bit word into hash state
+        ///
+        inline uint64_t hash_mix(_In_ uint64_t h, _In_ uint64_t w) noexcept
+        {
+            h = (h ^ w) * 0x9e3779b97f4a7c15;
+            return h ^ (h >> 32);
+        }
+    }
+    /// \endcond
+
+    ///
+    /// Compares two UTF-16 strings ordinally ignoring case
+    ///
+    /// The result matches `CompareStringOrdinal(..., TRUE)`: code units are upper-cased using `ordinal_upcase()` and compared
+    /// numerically; when one string is a prefix of the other, the shorter one sorts first. Runs of ASCII text are compared
+    /// 8 (SSE2) or 16 (AVX2) code units at a time.
+    ///
+    /// \param[in] a   First string
+    /// \param[in] na  Length of the first string in code units
+    /// \param[in] b   Second string
+    /// \param[in] nb  Length of the second string in code units
+    ///
+    /// \return
+    /// - <0 when a < b;
+    /// - =0 when a == b;
+    /// - >0 when a > b.
+    ///
+    /// \sa [CompareStringOrdinal function](https://learn.microsoft.com/en-us/windows/win32/api/stringapiset/nf-stringapiset-comparestringordinal)
+    ///
+    template <class _Elem>
+    int ordinal_icase_compare(_In_reads_(na) const _Elem* a, _In_ size_t na, _In_reads_(nb) const _Elem* b, _In_ size_t nb) noexcept
+    {
+        static_assert(sizeof(_Elem) == sizeof(uint16_t), "UTF-16 code units expected");
+        const uint16_t* x = reinterpret_cast<const uint16_t*>(a);
+        const uint16_t* y = reinterpret_cast<const uint16_t*>(b);
+        const size_t n = na < nb ? na : nb;
+        size_t i = 0;
+#ifdef WINSTD_SIMD_AVX2
+        for (; i + 16 <= n; i += 16) {
+            const __m256i va = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(x + i));
+            const __m256i vb = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(y + i));
+            if (!_mm256_testz_si256(_mm256_or_si256(va, vb), _mm256_set1_epi16(static_cast<short>(0xff80)))) {
+                const int r = internal::ordinal_icase_compare_scalar(x + i, y + i, 16);
+                if (r) return r;
+                continue;
+            }
+            const unsigned long neq = ~static_cast<unsigned long>(_mm256_movemask_epi8(_mm256_cmpeq_epi16(internal::ascii_upcase(va), internal::ascii_upcase(vb))));
+            if (neq) {
+                const size_t j = i + internal::lowest_bit(neq) / 2;
+                return static_cast<int>(ordinal_upcase(x[j])) - ordinal_upcase(y[j]);
+            }
+        }
+#endif
+#ifdef WINSTD_SIMD_SSE2
+        for (; i + 8 <= n; i += 8) {
+            const __m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i*>(x + i));
+            const __m128i vb = _mm_loadu_si128(reinterpret_cast<const __m128i*>(y + i));
+            const __m128i high = _mm_and_si128(_mm_or_si128(va, vb), _mm_set1_epi16(static_cast<short>(0xff80)));
+            if (_mm_movemask_epi8(_mm_cmpeq_epi16(high, _mm_setzero_si128())) != 0xffff) {
+                const int r = internal::ordinal_icase_compare_scalar(x + i, y + i, 8);
+                if (r) return r;
+                continue;
+            }
+            const unsigned long neq = ~static_cast<unsigned long>(_mm_movemask_epi8(_mm_cmpeq_epi16(internal::ascii_upcase(va), internal::ascii_upcase(vb)))) & 0xffff;
+            if (neq) {
+                const size_t j = i + internal::lowest_bit(neq) / 2;
+                return static_cast<int>(ordinal_upcase(x[j])) - ordinal_upcase(y[j]);
+            }
+        }
+#endif
+        const int r = internal::ordinal_icase_compare_scalar(x + i, y + i, n - i);
+        if (r)
+            return r;
+        return na < nb ? -1 : na > nb ? 1 : 0;
+    }
+
+    ///
+    /// Compares two UTF-16 strings ordinally ignoring case
+    ///
+    /// \param[in] a  First string
+    /// \param[in] b  Second string
+    ///
+    /// \return
+    /// - <0 when a < b;
+    /// - =0 when a == b;
+    /// - >0 when a > b.
+    ///
+    template <class _Elem, class _Traits>
+    int ordinal_icase_compare(_In_ std::basic_string_view<_Elem, _Traits> a, _In_ std::basic_string_view<_Elem, _Traits> b) noexcept
+    {
+        return ordinal_icase_compare(a.data(), a.size(), b.data(), b.size());
+    }
+
+    ///
+    /// Hashes UTF-16 string ordinally ignoring case
+    ///
+    /// Strings equal by `ordinal_icase_compare()` hash equally. Four code units are folded and mixed at a time; ASCII runs are
+    /// upper-cased without table lookups.
+    ///
+    /// \param[in] s  String
+    /// \param[in] n  Length of the string in code units
+    ///
+    /// \return Hash value
+    ///
+    template <class _Elem>
+    size_t ordinal_icase_hash_value(_In_reads_(n) const _Elem* s, _In_ size_t n) noexcept
+    {
+        static_assert(sizeof(_Elem) == sizeof(uint16_t), "UTF-16 code units expected");
+        const uint16_t* x = reinterpret_cast<const uint16_t*>(s);
+        uint64_t h = 0xcbf29ce484222325;
+        size_t i = 0;
+        for (; i + 4 <= n; i += 4)
+            h = internal::hash_mix(h, internal::ordinal_upcase4(x + i));
+        if (i < n) {
+            uint16_t tail[4] = {};
+            for (size_t j = 0; i + j < n; ++j)
+                tail[j] = x[i + j];
+            h = internal::hash_mix(h, internal::ordinal_upcase4(tail));
+        }
+        return static_cast<size_t>(internal::hash_mix(h, n));
+    }
+
+    ///
+    /// Ordinal case-insensitive less-than functor for `std::map` and `std::set`
+    ///
+    /// Transparent: lookups accept `std::basic_string`, `std::basic_string_view` and zero-terminated strings without constructing a key.
+    ///
+    template <class _Elem = wchar_t, class _Traits = std::char_traits<_Elem>>
+    struct ordinal_icase_less
+    {
+        typedef void is_transparent; ///< Enables heterogeneous lookup
+
+        ///
+        /// Returns true if a sorts before b
+        ///
+        bool operator()(_In_ std::basic_string_view<_Elem, _Traits> a, _In_ std::basic_string_view<_Elem, _Traits> b) const noexcept
+        {
+            return ordinal_icase_compare(a.data(), a.size(), b.data(), b.size()) < 0;
+        }
+    };
+
+    ///
+    /// Ordinal case-insensitive equality functor for `std::unordered_map` and `std::unordered_set`
+    ///
+    /// Heterogeneous lookup in `std::unordered_map` and `std::unordered_set` requires C++20. With C++17, look up keys of the
+    /// container's key type.
+    ///
+    template <class _Elem = wchar_t, class _Traits = std::char_traits<_Elem>>
+    struct ordinal_icase_equal_to
+    {
+        typedef void is_transparent; ///< Enables heterogeneous lookup
+
+        ///
+        /// Returns true if a and b are equal ignoring case
+        ///
+        bool operator()(_In_ std::basic_string_view<_Elem, _Traits> a, _In_ std::basic_string_view<_Elem, _Traits> b) const noexcept
+        {
+            return a.size() == b.size() && ordinal_icase_compare(a.data(), a.size(), b.data(), b.size()) == 0;
+        }
+    };
+
+    ///
+    /// Ordinal case-insensitive hash functor for `std::unordered_map` and `std::unordered_set`
+    ///
+    /// Heterogeneous lookup in `std::unordered_map` and `std::unordered_set` requires C++20. With C++17, look up keys of the
+    /// container's key type.
+    ///
+    template <class _Elem = wchar_t, class _Traits = std::char_traits<_Elem>>
+    struct ordinal_icase_hash
+    {
+        typedef void is_transparent; ///< Enables heterogeneous lookup
+
+        ///
+        /// Returns hash value of the string
+        ///
+        size_t operator()(_In_ std::basic_string_view<_Elem, _Traits> s) const noexcept
+        {
+            return ordinal_icase_hash_value(s.data(), s.size());
+        }
+    };
+
+    /// @}
+
+    /// \addtogroup WinStdGuidContainers
+    /// @{
+
+    ///
+    /// Compares two GUIDs for equality
+    ///
+    /// \param[in] a  First GUID
+    /// \param[in] b  Second GUID
+    ///
+    /// \return `true` when GUIDs are equal; `false` otherwise.
+    ///
+    inline bool guid_equal(_In_ const GUID& a, _In_ const GUID& b) noexcept
+    {
+#ifdef WINSTD_SIMD_SSE2
+        return _mm_movemask_epi8(_mm_cmpeq_epi8(
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(&a)),
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(&b)))) == 0xffff;
+#else
+        return InlineIsEqualGUID(a, b) != 0;
+#endif
+    }
+
+    ///
+    /// GUID hash functor
+    ///
+    /// GUIDs are mostly random already. Still, well-known GUIDs (COM interfaces, ETW providers) often differ in a few bytes only.
+    /// Therefore both halves are folded and finalized with a cheap multiply-xorshift.
+    ///
+    struct guid_hash
+    {
+        ///
+        /// Returns hash value of the GUID
+        ///
+        size_t operator()(_In_ const GUID& guid) const noexcept
+        {
+            uint64_t lo, hi;
+            memcpy(&lo, &guid, sizeof(lo));
+            memcpy(&hi, reinterpret_cast<const uint8_t*>(&guid) + sizeof(lo), sizeof(hi));
+            uint64_t h = lo ^ (hi * 0x9e3779b97f4a7c15);
+            h = (h ^ (h >> 29)) * 0xbf58476d1ce4e5b9;
+            return static_cast<size_t>(h ^ (h >> 32));
+        }
+    };
+
+    ///
+    /// GUID equality functor
+    ///
+    struct guid_equal_to
+    {
+        ///
+        /// Returns true if GUIDs are equal
+        ///
+        bool operator()(_In_ const GUID& a, _In_ const GUID& b) const noexcept
+        {
+            return guid_equal(a, b);
+        }
+    };
+
+    ///
+    /// GUID less-than functor
+    ///
+    /// GUIDs are ordered the way their `{xxxxxxxx-xxxx-xxxx-xxxx-xxxxxxxxxxxx}` string representations sort.
+    ///
+    struct guid_less
+    {
+        ///
+        /// Returns true if a sorts before b
+        ///
+        bool operator()(_In_ const GUID& a, _In_ const GUID& b) const noexcept
+        {
+            if (a.Data1 != b.Data1) return a.Data1 < b.Data1;
+            if (a.Data2 != b.Data2) return a.Data2 < b.Data2;
+            if (a.Data3 != b.Data3) return a.Data3 < b.Data3;
+            return memcmp(a.Data4, b.Data4, sizeof(a.Data4)) < 0;
+        }
+    };
+
+    ///
+    /// GUID-keyed hash map
+    ///
+    /// Open-addressing table split into groups of 16 slots. Each slot has a control byte holding 7 bits of the key hash, so one
+    /// SSE2 compare filters a whole group before any key is touched. Candidate keys are then compared with a single 16-byte
+    /// compare. Deleted slots leave tombstones that are purged on rehash.
+    ///
+    /// \note Inserting or erasing invalidates iterators. Rehashing also invalidates references to elements.
+    ///
+    template <class _Ty>
+    class guid_map
+    {
+    public:
+        typedef GUID key_type;                          ///< Key type
+        typedef _Ty mapped_type;                        ///< Mapped type
+        typedef std::pair<const GUID, _Ty> value_type;  ///< Element type
+        typedef size_t size_type;                       ///< Size type
+
+    protected:
+        /// \cond internal
+        static const size_t group_width = 16;
+        static const int8_t ctrl_empty = -128;
+        static const int8_t ctrl_deleted = -2;
+        /// \endcond
+
+        ///
+        /// Element iterator template
+        ///
+        template <class _Map, class _Val>
+        class iterator_base
+        {
+        public:
+            typedef std::forward_iterator_tag iterator_category; ///< Iterator category
+            typedef typename guid_map::value_type value_type;    ///< Element type
+            typedef ptrdiff_t difference_type;                   ///< Difference type
+            typedef _Val* pointer;                               ///< Element pointer type
+            typedef _Val& reference;                             ///< Element reference type
+
+            iterator_base() noexcept : m_map(nullptr), m_index(0) {}
+            iterator_base(_In_ _Map* map, _In_ size_t index) noexcept : m_map(map), m_index(index) { skip(); }
+            template <class _Map2, class _Val2>
+            iterator_base(_In_ const iterator_base<_Map2, _Val2>& other) noexcept : m_map(other.m_map), m_index(other.m_index) {}
+
+            reference operator*() const noexcept { return m_map->m_slots[m_index]; }
+            pointer operator->() const noexcept { return m_map->m_slots + m_index; }
+            iterator_base& operator++() noexcept { ++m_index; skip(); return *this; }
+            iterator_base operator++(int) noexcept { iterator_base tmp(*this); ++*this; return tmp; }
+            template <class _Map2, class _Val2>
+            bool operator==(_In_ const iterator_base<_Map2, _Val2>& other) const noexcept { return m_index == other.m_index; }
+            template <class _Map2, class _Val2>
+            bool operator!=(_In_ const iterator_base<_Map2, _Val2>& other) const noexcept { return m_index != other.m_index; }
+
+        protected:
+            void skip() noexcept { while (m_index < m_map->m_capacity && m_map->m_ctrl[m_index] < 0) ++m_index; }
+
+        protected:
+            template <class, class> friend class iterator_base;
+            friend class guid_map;
+            _Map* m_map;     ///< Map
+            size_t m_index;  ///< Slot index
+        };
+
+    public:
+        typedef iterator_base<guid_map, value_type> iterator;                     ///< Iterator type
+        typedef iterator_base<const guid_map, const value_type> const_iterator;  ///< Constant iterator type
+
+    public:
+        ///
+        /// Constructs an empty map
+        ///
+        guid_map() noexcept :
+            m_slots(nullptr),
+            m_capacity(0),
+            m_size(0),
+            m_used(0)
+        {}
+
+        ///
+        /// Constructs a map from a list of elements
+        ///
+        guid_map(_In_ std::initializer_list<value_type> init) : guid_map()
+        {
+            reserve(init.size());
+            for (auto& v : init)
+                try_emplace(v.first, v.second);
+        }
+
+        ///
+        /// Copies a map
+        ///
+        guid_map(_In_ const guid_map& other) : guid_map()
+        {
+            reserve(other.m_size);
+            for (auto& v : other)
+                try_emplace(v.first, v.second);
+        }
+
+        ///
+        /// Moves a map
+        ///
+        guid_map(_Inout_ guid_map&& other) noexcept :
+            m_ctrl(std::move(other.m_ctrl)),
+            m_slots(other.m_slots),
+            m_capacity(other.m_capacity),
+            m_size(other.m_size),
+            m_used(other.m_used)
+        {
+            other.m_slots = nullptr;
+            other.m_capacity = other.m_size = other.m_used = 0;
+        }
+
+        ///
+        /// Destroys all elements and frees the table
+        ///
+        virtual ~guid_map()
+        {
+            free_table();
+        }
+
+        ///
+        /// Copies a map
+        ///
+        guid_map& operator=(_In_ const guid_map& other)
+        {
+            if (this != std::addressof(other)) {
+                guid_map tmp(other);
+                *this = std::move(tmp);
+            }
+            return *this;
+        }
+
+        ///
+        /// Moves a map
+        ///
+        guid_map& operator=(_Inout_ guid_map&& other) noexcept
+        {
+            if (this != std::addressof(other)) {
+                free_table();
+                m_ctrl = std::move(other.m_ctrl);
+                m_slots = other.m_slots;
+                m_capacity = other.m_capacity;
+                m_size = other.m_size;
+                m_used = other.m_used;
+                other.m_slots = nullptr;
+                other.m_capacity = other.m_size = other.m_used = 0;
+            }
+            return *this;
+        }
+
+        /// \name Iteration
+        /// @{
+        iterator begin() noexcept { return iterator(this, 0); }                       ///< Returns iterator to the first element
+        iterator end() noexcept { return iterator(this, m_capacity); }                ///< Returns iterator past the last element
+        const_iterator begin() const noexcept { return const_iterator(this, 0); }     ///< Returns iterator to the first element
+        const_iterator end() const noexcept { return const_iterator(this, m_capacity); } ///< Returns iterator past the last element
+        /// @}
+
+        ///
+        /// Returns the number of elements
+        ///
+        size_t size() const noexcept { return m_size; }
+
+        ///
+        /// Returns true if the map has no elements
+        ///
+        bool empty() const noexcept { return m_size == 0; }
+
+        ///
+        /// Returns the number of slots
+        ///
+        size_t capacity() const noexcept { return m_capacity; }
+
+        ///
+        /// Finds an element
+        ///
+        /// \param[in] key  Key to look for
+        ///
+        /// \return Iterator to the element found; `end()` otherwise.
+        ///
+        iterator find(_In_ const GUID& key) noexcept { return iterator(this, find_index(key, guid_hash()(key))); }
+
+        ///
+        /// Finds an element
+        ///
+        /// \param[in] key  Key to look for
+        ///
+        /// \return Iterator to the element found; `end()` otherwise.
+        ///
+        const_iterator find(_In_ const GUID& key) const noexcept { return const_iterator(this, find_index(key, guid_hash()(key))); }
+
+        ///
+        /// Returns 1 if the key is in the map; 0 otherwise
+        ///
+        size_t count(_In_ const GUID& key) const noexcept { return find_index(key, guid_hash()(key)) != m_capacity ? 1 : 0; }
+
+        ///
+        /// Returns true if the key is in the map
+        ///
+        bool contains(_In_ const GUID& key) const noexcept { return find_index(key, guid_hash()(key)) != m_capacity; }
+
+        ///
+        /// Returns reference to the mapped value, inserting a default constructed one when the key is not in the map
+        ///
+        _Ty& operator[](_In_ const GUID& key) { return try_emplace(key).first->second; }
+
+        ///
+        /// Returns reference to the mapped value
+        ///
+        /// \throw std::out_of_range when the key is not in the map
+        ///
+        const _Ty& at(_In_ const GUID& key) const
+        {
+            const size_t i = find_index(key, guid_hash()(key));
+            if (i == m_capacity)
+                throw std::out_of_range("GUID not found");
+            return m_slots[i].second;
+        }
+
+        ///
+        /// Inserts an element constructed in-place unless the key is already in the map
+        ///
+        /// \param[in] key   Key
+        /// \param[in] args  Arguments to construct the mapped value from
+        ///
+        /// \return Pair of iterator to the element and `true` if the element was inserted.
+        ///
+        template <class... _Args>
+        std::pair<iterator, bool> try_emplace(_In_ const GUID& key, _In_ _Args&&... args)
+        {
+            const size_t h = guid_hash()(key);
+            size_t i = find_index(key, h);
+            if (i != m_capacity)
+                return { iterator(this, i), false };
+            if ((m_used + 1) * 8 > m_capacity * 7) {
+                rehash(m_size + 1);
+            }
+            i = insert_index(h);
+            ::new (static_cast<void*>(m_slots + i)) value_type(std::piecewise_construct, std::forward_as_tuple(key), std::forward_as_tuple(std::forward<_Args>(args)...));
+            if (m_ctrl[i] == ctrl_empty)
+                ++m_used;
+            m_ctrl[i] = static_cast<int8_t>(h & 0x7f);
+            ++m_size;
+            return { iterator(this, i), true };
+        }
+
+        ///
+        /// Inserts an element unless the key is already in the map
+        ///
+        /// \return Pair of iterator to the element and `true` if the element was inserted.
+        ///
+        std::pair<iterator, bool> insert(_In_ const value_type& value) { return try_emplace(value.first, value.second); }
+
+        ///
+        /// Inserts or replaces an element
+        ///
+        /// \return Pair of iterator to the element and `true` if the element was inserted.
+        ///
+        template <class _Val>
+        std::pair<iterator, bool> insert_or_assign(_In_ const GUID& key, _In_ _Val&& value)
+        {
+            auto r = try_emplace(key, std::forward<_Val>(value));
+            if (!r.second)
+                r.first->second = std::forward<_Val>(value);
+            return r;
+        }
+
+        ///
+        /// Removes an element
+        ///
+        /// \param[in] key  Key of the element to remove
+        ///
+        /// \return Number of elements removed (0 or 1)
+        ///
+        size_t erase(_In_ const GUID& key)
+        {
+            const size_t i = find_index(key, guid_hash()(key));
+            if (i == m_capacity)
+                return 0;
+            erase_index(i);
+            return 1;
+        }
+
+        ///
+        /// Removes an element
+        ///
+        /// \param[in] it  Iterator to the element to remove
+        ///
+        /// \return Iterator to the following element
+        ///
+        iterator erase(_In_ const_iterator it)
+        {
+            erase_index(it.m_index);
+            return iterator(this, it.m_index + 1);
+        }
+
+        ///
+        /// Removes all elements keeping the table allocated
+        ///
+        void clear() noexcept
+        {
+            for (size_t i = 0; i < m_capacity; ++i)
+                if (m_ctrl[i] >= 0)
+                    m_slots[i].~value_type();
+            if (m_capacity)
+                memset(m_ctrl.get(), ctrl_empty, m_capacity);
+            m_size = m_used = 0;
+        }
+
+        ///
+        /// Makes room for at least `count` elements without rehashing
+        ///
+        void reserve(_In_ size_t count)
+        {
+            if (count * 8 > m_capacity * 7)
+                rehash(count);
+        }
+
+    protected:
+        /// \cond internal
+        static unsigned int match_byte(_In_reads_(group_width) const int8_t* ctrl, _In_ int8_t value) noexcept
+        {
+#ifdef WINSTD_SIMD_SSE2
+            return static_cast<unsigned int>(_mm_movemask_epi8(_mm_cmpeq_epi8(
+                _mm_loadu_si128(reinterpret_cast<const __m128i*>(ctrl)),
+                _mm_set1_epi8(value))));
+#else
+            unsigned int mask = 0;
+            for (size_t i = 0; i < group_width; ++i)
+                mask |= static_cast<unsigned int>(ctrl[i] == value) << i;
+            return mask;
+#endif
+        }
+
+        static unsigned int match_free(_In_reads_(group_width) const int8_t* ctrl) noexcept
+        {
+#ifdef WINSTD_SIMD_SSE2
+            // Empty and deleted control bytes are the only negative ones.
+            return static_cast<unsigned int>(_mm_movemask_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(ctrl))));
+#else
+            unsigned int mask = 0;
+            for (size_t i = 0; i < group_width; ++i)
+                mask |= static_cast<unsigned int>(ctrl[i] < 0) << i;
+            return mask;
+#endif
+        }
+
+        size_t find_index(_In_ const GUID& key, _In_ size_t h) const noexcept
+        {
+            if (!m_capacity)
+                return 0;
+            const size_t groups = m_capacity / group_width, mask = groups - 1;
+            const int8_t tag = static_cast<int8_t>(h & 0x7f);
+            size_t g = (h >> 7) & mask;
+            for (size_t probe = 1; probe <= groups; g = (g + probe++) & mask) {
+                const int8_t* ctrl = m_ctrl.get() + g * group_width;
+                for (unsigned int match = match_byte(ctrl, tag); match; match &= match - 1) {
+                    const size_t i = g * group_width + internal::lowest_bit(match);
+                    if (guid_equal(m_slots[i].first, key))
+                        return i;
+                }
+                if (match_byte(ctrl, ctrl_empty))
+                    break;
+            }
+            return m_capacity;
+        }
+
+        size_t insert_index(_In_ size_t h) const noexcept
+        {
+            const size_t groups = m_capacity / group_width, mask = groups - 1;
+            size_t g = (h >> 7) & mask;
+            for (size_t probe = 1;; g = (g + probe++) & mask) {
+                const unsigned int match = match_free(m_ctrl.get() + g * group_width);
+                if (match)
+                    return g * group_width + internal::lowest_bit(match);
+            }
+        }
+
+        void erase_index(_In_ size_t i)
+        {
+            assert(i < m_capacity && m_ctrl[i] >= 0);
+            m_slots[i].~value_type();
+            m_ctrl[i] = ctrl_deleted;
+            --m_size;
+        }
+
+        void rehash(_In_ size_t count)
+        {
+            size_t capacity = group_width;
+            while (count * 8 > capacity * 7)
+                capacity *= 2;
+
+            std::unique_ptr<int8_t[]> ctrl(new int8_t[capacity]);
+            memset(ctrl.get(), ctrl_empty, capacity);
+            value_type* slots = std::allocator<value_type>().allocate(capacity);
+
+            std::swap(m_ctrl, ctrl);
+            std::swap(m_slots, slots);
+            std::swap(m_capacity, capacity);
+            m_used = m_size;
+            for (size_t i = 0; i < capacity; ++i) {
+                if (ctrl[i] >= 0) {
+                    const size_t h = guid_hash()(slots[i].first);
+                    const size_t j = insert_index(h);
+                    ::new (static_cast<void*>(m_slots + j)) value_type(std::move(slots[i]));
+                    m_ctrl[j] = static_cast<int8_t>(h & 0x7f);
+                    slots[i].~value_type();
+                }
+            }
+            if (slots)
+                std::allocator<value_type>().deallocate(slots, capacity);
+        }
+
+        void free_table() noexcept
+        {
+            if (m_slots) {
+                clear();
+                std::allocator<value_type>().deallocate(m_slots, m_capacity);
+                m_slots = nullptr;
+            }
+            m_ctrl.reset();
+            m_capacity = 0;
+        }
+        /// \endcond
+
+    protected:
+        std::unique_ptr<int8_t[]> m_ctrl; ///< Control bytes: 7-bit hash tag, or ctrl_empty/ctrl_deleted
+        value_type* m_slots;              ///< Element slots
+        size_t m_capacity;                ///< Number of slots (power of two, multiple of 16)
+        size_t m_size;                    ///< Number of elements
+        size_t m_used;                    ///< Number of elements and tombstones
+    };
+
+    ///
+    /// Sorted set of GUIDs
+    ///
+    /// Keeps GUIDs in a contiguous sorted array: compact, cache-friendly to scan, and ordered for iteration and set operations.
+    /// Insertion and removal are linear, which suits sets that are built once and queried often.
+    ///
+    class guid_set
+    {
+    public:
+        typedef GUID key_type;                                  ///< Key type
+        typedef GUID value_type;                                ///< Element type
+        typedef std::vector<GUID>::const_iterator iterator;     ///< Iterator type
+        typedef std::vector<GUID>::const_iterator const_iterator; ///< Constant iterator type
+
+    public:
+        ///
+        /// Constructs an empty set
+        ///
+        guid_set() noexcept {}
+
+        ///
+        /// Constructs a set from a list of GUIDs
+        ///
+        guid_set(_In_ std::initializer_list<GUID> init) : m_data(init)
+        {
+            normalize();
+        }
+
+        ///
+        /// Constructs a set from a range of GUIDs
+        ///
+        template <class _Iter>
+        guid_set(_In_ _Iter first, _In_ _Iter last) : m_data(first, last)
+        {
+            normalize();
+        }
+
+        const_iterator begin() const noexcept { return m_data.begin(); } ///< Returns iterator to the first element
+        const_iterator end() const noexcept { return m_data.end(); }     ///< Returns iterator past the last element
+        size_t size() const noexcept { return m_data.size(); }           ///< Returns the number of elements
+        bool empty() const noexcept { return m_data.empty(); }           ///< Returns true if the set has no elements
+        void clear() noexcept { m_data.clear(); }                        ///< Removes all elements
+        void reserve(_In_ size_t count) { m_data.reserve(count); }       ///< Preallocates room for `count` elements
+
+        ///
+        /// Finds a GUID
+        ///
+        /// \return Iterator to the GUID found; `end()` otherwise.
+        ///
+        const_iterator find(_In_ const GUID& key) const noexcept
+        {
+            auto it = std::lower_bound(m_data.begin(), m_data.end(), key, guid_less());
+            return it != m_data.end() && guid_equal(*it, key) ? it : m_data.end();
+        }
+
+        ///
+        /// Returns 1 if the GUID is in the set; 0 otherwise
+        ///
+        size_t count(_In_ const GUID& key) const noexcept { return find(key) != m_data.end() ? 1 : 0; }
+
+        ///
+        /// Returns true if the GUID is in the set
+        ///
+        bool contains(_In_ const GUID& key) const noexcept { return find(key) != m_data.end(); }
+
+        ///
+        /// Inserts a GUID
+        ///
+        /// \return Pair of iterator to the GUID and `true` if the GUID was inserted.
+        ///
+        std::pair<const_iterator, bool> insert(_In_ const GUID& key)
+        {
+            auto it = std::lower_bound(m_data.begin(), m_data.end(), key, guid_less());
+            if (it != m_data.end() && guid_equal(*it, key))
+                return { it, false };
+            return { m_data.insert(it, key), true };
+        }
+
+        ///
+        /// Removes a GUID
+        ///
+        /// \return Number of GUIDs removed (0 or 1)
+        ///
+        size_t erase(_In_ const GUID& key)
+        {
+            auto it = std::lower_bound(m_data.begin(), m_data.end(), key, guid_less());
+            if (it == m_data.end() || !guid_equal(*it, key))
+                return 0;
+            m_data.erase(it);
+            return 1;
+        }
+
+    protected:
+        /// \cond internal
+        void normalize()
+        {
+            std::sort(m_data.begin(), m_data.end(), guid_less());
+            m_data.erase(std::unique(m_data.begin(), m_data.end(), guid_equal), m_data.end());
+        }
+        /// \endcond
+
+    protected:
+        std::vector<GUID> m_data; ///< Sorted GUIDs
+    };
+
+    ///
+    /// Read-mostly GUID-keyed hash map
+    ///
+    /// Readers work on an immutable snapshot and take no locks. Writers copy the current snapshot, modify the copy, and
+    /// publish it atomically (read-copy-update). Old snapshots are freed when their last reader lets go.
+    /// Use for tables that are read on hot paths and updated rarely, e.g. registered providers.
+    ///
+    /// The snapshot pointer is a `std::atomic<std::shared_ptr>` where the standard library provides one (C++20). Otherwise,
+    /// the map keeps the current and previous snapshot in alternating slots: readers copy the published slot without
+    /// locking, and a writer waits for readers still copying the other slot before it reuses it.
+    ///
+    template <class _Ty>
+    class guid_map_rcu
+    {
+        WINSTD_NONCOPYABLE(guid_map_rcu)
+        WINSTD_NONMOVABLE(guid_map_rcu)
+
+    public:
+        typedef guid_map<_Ty> map_type;                        ///< Map type
+        typedef std::shared_ptr<const map_type> snapshot_type; ///< Snapshot type
+
+    public:
+        ///
+        /// Constructs an empty map
+        ///
+#ifdef __cpp_lib_atomic_shared_ptr
+        guid_map_rcu() : m_map(std::make_shared<const map_type>())
+        {}
+#else
+        guid_map_rcu() : m_slots{ std::make_shared<const map_type>() }, m_version(0), m_readers{}
+        {}
+#endif
+
+        ///
+        /// Returns the current snapshot
+        ///
+        /// The snapshot stays valid and unchanged for as long as it is referenced.
+        ///
+        snapshot_type snapshot() const noexcept
+        {
+#ifdef __cpp_lib_atomic_shared_ptr
+            return m_map.load(std::memory_order_acquire);
+#else
+            for (;;) {
+                const size_t version = m_version.load();
+                auto& readers = m_readers[version & 1];
+                ++readers;
+                // Once the version is confirmed, writers leave the slot alone until the reader count drops.
+                if (m_version.load() == version) {
+                    snapshot_type map = m_slots[version & 1];
+                    --readers;
+                    return map;
+                }
+                --readers;
+            }
+#endif
+        }
+
+        ///
+        /// Looks up a value and copies it out
+        ///
+        /// \param[in ] key    Key to look for
+        /// \param[out] value  Value found
+        ///
+        /// \return `true` when the key was found; `false` otherwise.
+        ///
+        bool find(_In_ const GUID& key, _Out_ _Ty& value) const
+        {
+            const snapshot_type map = snapshot();
+            auto it = map->find(key);
+            if (it == map->end())
+                return false;
+            value = it->second;
+            return true;
+        }
+
+        ///
+        /// Returns true if the key is in the map
+        ///
+        bool contains(_In_ const GUID& key) const noexcept
+        {
+            return snapshot()->contains(key);
+        }
+
+        ///
+        /// Modifies the map
+        ///
+        /// Writers are serialized. The function is invoked on a private copy, which replaces the current snapshot when it returns.
+        ///
+        /// \param[in] fn  Function taking `map_type&` to modify the map with
+        ///
+        template <class _Fn>
+        void update(_In_ _Fn fn)
+        {
+            std::lock_guard<std::mutex> lock(m_writer);
+            std::shared_ptr<map_type> map = std::make_shared<map_type>(*snapshot());
+            fn(*map);
+#ifdef __cpp_lib_atomic_shared_ptr
+            m_map.store(snapshot_type(std::move(map)), std::memory_order_release);
+#else
+            const size_t version = m_version.load() + 1;
+            while (m_readers[version & 1])
+                std::this_thread::yield();
+            m_slots[version & 1] = std::move(map);
+            m_version.store(version);
+#endif
+        }
+
+    protected:
+#ifdef __cpp_lib_atomic_shared_ptr
+        std::atomic<snapshot_type> m_map;                   ///< Current snapshot
+#else
+        snapshot_type m_slots[2];                           ///< Current and previous snapshot
+        std::atomic<size_t> m_version;                      ///< Number of updates; its parity selects the current slot
+        mutable std::atomic<size_t> m_readers[2];           ///< Number of readers copying each slot
+#endif
+        std::mutex m_writer;                                ///< Serializes writers
+    };
+
+    /// \cond internal
+    namespace internal
+    {
+        ///
+        /// Calls a function for consecutive chunks of a range on multiple threads
+        ///
+        /// \param[in] count    Number of items
+        /// \param[in] chunk    Items per chunk
+        /// \param[in] threads  Maximum number of threads including the calling one. 0 to use one per CPU.
+        /// \param[in] init     Function returning per-thread state. Called once on each thread taking part.
+        /// \param[in] fn       Function `void fn(state& s, size_t offset, size_t count)`. Called concurrently.
+        ///
+        /// The first exception thrown stops all threads and is rethrown on the calling thread.
+        ///
+        template <class _Init, class _Fn>
+        void parallel_chunks(_In_ size_t count, _In_ size_t chunk, _In_ unsigned threads, _In_ _Init& init, _In_ _Fn& fn)
+        {
+            if (!chunk)
+                throw std::invalid_argument("zero chunk size");
+            const size_t chunks = count / chunk + (count % chunk ? 1 : 0);
+            if (!chunks)
+                return;
+            if (!threads)
+                threads = (std::max)(std::thread::hardware_concurrency(), 1u);
+            threads = static_cast<unsigned>((std::min)(static_cast<size_t>(threads), chunks));
+            std::atomic<size_t> next(0);
+            std::exception_ptr error;
+            std::mutex error_lock;
+            auto worker = [&] {
+                try {
+                    auto state = init();
+                    for (size_t i; (i = next++) < chunks;)
+                        fn(state, i * chunk, (std::min)(chunk, count - i * chunk));
+                } catch (...) {
+                    std::lock_guard<std::mutex> lock(error_lock);
+                    if (!error)
+                        error = std::current_exception();
+                    next = chunks;
+                }
+            };
+            std::vector<std::thread> pool;
+            try {
+                if (threads > 1) {
+                    pool.reserve(threads - 1);
+                    for (unsigned i = 1; i < threads; ++i)
+                        pool.emplace_back(worker);
+                }
+            }
+            catch (...) {
+                // Joinable threads must not be destroyed: stop and join those already started.
+                next = chunks;
+                for (auto& t : pool)
+                    t.join();
+                throw;
+            }
+            worker();
+            for (auto& t : pool)
+                t.join();
+            if (error)
+                std::rethrow_exception(error);
+        }
+
+        ///
+        /// Calls a function for consecutive chunks of a range on multiple threads
+        ///
+        /// \param[in] count    Number of items
+        /// \param[in] chunk    Items per chunk
+        /// \param[in] threads  Maximum number of threads including the calling one. 0 to use one per CPU.
+        /// \param[in] fn       Function `void fn(size_t offset, size_t count)`. Called concurrently.
+        ///
+        template <class _Fn>
+        void parallel_chunks(_In_ size_t count, _In_ size_t chunk, _In_ unsigned threads, _In_ _Fn& fn)
+        {
+            auto init = [] { return 0; };
+            auto call = [&](int, size_t offset, size_t n) { fn(offset, n); };
+            parallel_chunks(count, chunk, threads, init, call);
+        }
+    }
+    /// \endcond
+
+    /// @}
 }
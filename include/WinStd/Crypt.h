@@ -11,8 +11,15 @@
 #include "Common.h"
 #include <assert.h>
 #include <WinCrypt.h>
+#include <bcrypt.h>
 #include <algorithm>
+#include <atomic>
+#include <exception>
+#include <mutex>
 #include <string>
+#include <string_view>
+#include <thread>
+#include <type_traits>
 #include <vector>
 
 /// \addtogroup WinStdCryptoAPI
@@ -793,6 +800,215 @@ namespace winstd
     #pragma warning(pop)
 
     /// @}
+
+    /// \addtogroup WinStdExceptions
+    /// @{
+
+    ///
+    /// CNG runtime error
+    ///
+    /// \note Must be defined as derived class from num_runtime_error<> to allow correct type info for dynamic typecasting and prevent folding with other derivates of num_runtime_error<>.
+    ///
+    class bcrypt_runtime_error : public num_runtime_error<NTSTATUS>
+    {
+    public:
+        ///
+        /// Constructs an exception
+        ///
+        /// \param[in] num  CNG status code
+        /// \param[in] msg  Error message
+        ///
+        bcrypt_runtime_error(_In_ error_type num, _In_ const std::string& msg) : num_runtime_error<NTSTATUS>(num, msg)
+        {}
+
+        ///
+        /// Constructs an exception
+        ///
+        /// \param[in] num  CNG status code
+        /// \param[in] msg  Error message
+        ///
+        bcrypt_runtime_error(_In_ error_type num, _In_opt_z_ const char *msg = nullptr) : num_runtime_error<NTSTATUS>(num, msg)
+        {}
+    };
+
+    /// @}
+
+    /// \addtogroup WinStdCryptoAPI
+    /// @{
+
+    ///
+    /// BCRYPT_ALG_HANDLE wrapper class
+    ///
+    /// \sa [BCryptOpenAlgorithmProvider function](https://learn.microsoft.com/en-us/windows/win32/api/bcrypt/nf-bcrypt-bcryptopenalgorithmprovider)
+    ///
+    class bcrypt_alg : public handle<BCRYPT_ALG_HANDLE, NULL>
+    {
+        WINSTD_HANDLE_IMPL(bcrypt_alg, BCRYPT_ALG_HANDLE, NULL)
+
+    public:
+        ///
+        /// Closes the algorithm provider.
+        ///
+        /// \sa [BCryptCloseAlgorithmProvider function](https://learn.microsoft.com/en-us/windows/win32/api/bcrypt/nf-bcrypt-bcryptclosealgorithmprovider)
+        ///
+        virtual ~bcrypt_alg()
+        {
+            if (m_h != invalid)
+                free_internal();
+        }
+
+    protected:
+        ///
+        /// Closes the algorithm provider.
+        ///
+        /// \sa [BCryptCloseAlgorithmProvider function](https://learn.microsoft.com/en-us/windows/win32/api/bcrypt/nf-bcrypt-bcryptclosealgorithmprovider)
+        ///
+        void free_internal() noexcept override
+        {
+            BCryptCloseAlgorithmProvider(m_h, 0);
+        }
+    };
+
+    ///
+    /// BCRYPT_HASH_HANDLE wrapper class
+    ///
+    /// Hashes created with `BCRYPT_HASH_REUSABLE_FLAG` are ready for the next message after `finish()`, so one hash object can
+    /// serve any number of messages without allocating.
+    ///
+    /// \sa [BCryptCreateHash function](https://learn.microsoft.com/en-us/windows/win32/api/bcrypt/nf-bcrypt-bcryptcreatehash)
+    ///
+    class bcrypt_hash : public dplhandle<BCRYPT_HASH_HANDLE, NULL>
+    {
+        WINSTD_DPLHANDLE_IMPL(bcrypt_hash, BCRYPT_HASH_HANDLE, NULL)
+
+    public:
+        ///
+        /// Destroys the hash.
+        ///
+        /// \sa [BCryptDestroyHash function](https://learn.microsoft.com/en-us/windows/win32/api/bcrypt/nf-bcrypt-bcryptdestroyhash)
+        ///
+        virtual ~bcrypt_hash()
+        {
+            if (m_h != invalid)
+                free_internal();
+        }
+
+        ///
+        /// Hashes data.
+        ///
+        /// \param[in] data  Data
+        /// \param[in] size  Size of data in bytes
+        ///
+        /// \sa [BCryptHashData function](https://learn.microsoft.com/en-us/windows/win32/api/bcrypt/nf-bcrypt-bcrypthashdata)
+        ///
+        void update(_In_reads_bytes_(size) const void* data, _In_ size_t size)
+        {
+            for (size_t done = 0; done < size;) {
+                const ULONG n = static_cast<ULONG>((std::min)(size - done, static_cast<size_t>(ULONG_MAX)));
+                const NTSTATUS status = BCryptHashData(m_h, const_cast<PUCHAR>(static_cast<const UCHAR*>(data) + done), n, 0);
+                if (!BCRYPT_SUCCESS(status))
+                    throw bcrypt_runtime_error(status, "BCryptHashData failed");
+                done += n;
+            }
+        }
+
+        ///
+        /// Retrieves the hash value.
+        ///
+        /// \param[out] value  Hash value
+        /// \param[in]  size   Size of hash value in bytes. Must match the algorithm.
+        ///
+        /// \sa [BCryptFinishHash function](https://learn.microsoft.com/en-us/windows/win32/api/bcrypt/nf-bcrypt-bcryptfinishhash)
+        ///
+        void finish(_Out_writes_bytes_all_(size) void* value, _In_ ULONG size)
+        {
+            const NTSTATUS status = BCryptFinishHash(m_h, static_cast<PUCHAR>(value), size, 0);
+            if (!BCRYPT_SUCCESS(status))
+                throw bcrypt_runtime_error(status, "BCryptFinishHash failed");
+        }
+
+    protected:
+        ///
+        /// Destroys the hash.
+        ///
+        /// \sa [BCryptDestroyHash function](https://learn.microsoft.com/en-us/windows/win32/api/bcrypt/nf-bcrypt-bcryptdestroyhash)
+        ///
+        void free_internal() noexcept override
+        {
+            BCryptDestroyHash(m_h);
+        }
+
+        ///
+        /// Duplicates the hash.
+        ///
+        /// \param[in] h  Object handle of existing hash
+        ///
+        /// \return Duplicated hash handle
+        ///
+        /// \sa [BCryptDuplicateHash function](https://learn.microsoft.com/en-us/windows/win32/api/bcrypt/nf-bcrypt-bcryptduplicatehash)
+        ///
+        handle_type duplicate_internal(_In_ handle_type h) const override
+        {
+            handle_type hNew;
+            const NTSTATUS status = BCryptDuplicateHash(h, &hNew, NULL, 0, 0);
+            if (BCRYPT_SUCCESS(status))
+                return hNew;
+            throw bcrypt_runtime_error(status, "BCryptDuplicateHash failed");
+        }
+    };
+
+    ///
+    /// BCRYPT_KEY_HANDLE wrapper class
+    ///
+    /// \sa [BCryptGenerateSymmetricKey function](https://learn.microsoft.com/en-us/windows/win32/api/bcrypt/nf-bcrypt-bcryptgeneratesymmetrickey)
+    ///
+    class bcrypt_key : public dplhandle<BCRYPT_KEY_HANDLE, NULL>
+    {
+        WINSTD_DPLHANDLE_IMPL(bcrypt_key, BCRYPT_KEY_HANDLE, NULL)
+
+    public:
+        ///
+        /// Destroys the key.
+        ///
+        /// \sa [BCryptDestroyKey function](https://learn.microsoft.com/en-us/windows/win32/api/bcrypt/nf-bcrypt-bcryptdestroykey)
+        ///
+        virtual ~bcrypt_key()
+        {
+            if (m_h != invalid)
+                free_internal();
+        }
+
+    protected:
+        ///
+        /// Destroys the key.
+        ///
+        /// \sa [BCryptDestroyKey function](https://learn.microsoft.com/en-us/windows/win32/api/bcrypt/nf-bcrypt-bcryptdestroykey)
+        ///
+        void free_internal() noexcept override
+        {
+            BCryptDestroyKey(m_h);
+        }
+
+        ///
+        /// Duplicates the key.
+        ///
+        /// \param[in] h  Object handle of existing key
+        ///
+        /// \return Duplicated key handle
+        ///
+        /// \sa [BCryptDuplicateKey function](https://learn.microsoft.com/en-us/windows/win32/api/bcrypt/nf-bcrypt-bcryptduplicatekey)
+        ///
+        handle_type duplicate_internal(_In_ handle_type h) const override
+        {
+            handle_type hNew;
+            const NTSTATUS status = BCryptDuplicateKey(h, &hNew, NULL, 0, 0);
+            if (BCRYPT_SUCCESS(status))
+                return hNew;
+            throw bcrypt_runtime_error(status, "BCryptDuplicateKey failed");
+        }
+    };
+
+    /// @}
 }
 
 /// \addtogroup WinStdCryptoAPI
@@ -909,6 +1125,2054 @@ static bool CryptDeriveKey(_In_ HCRYPTPROV hProv, _In_ ALG_ID Algid, _In_ HCRYPT
     return bResult;
 }
 
+///
+/// Loads and initializes a CNG provider.
+///
+/// \sa [BCryptOpenAlgorithmProvider function](https://learn.microsoft.com/en-us/windows/win32/api/bcrypt/nf-bcrypt-bcryptopenalgorithmprovider)
+///
+static NTSTATUS BCryptOpenAlgorithmProvider(_Inout_ winstd::bcrypt_alg &alg, _In_z_ LPCWSTR pszAlgId, _In_opt_z_ LPCWSTR pszImplementation, _In_ ULONG dwFlags)
+{
+    BCRYPT_ALG_HANDLE h;
+    NTSTATUS status = BCryptOpenAlgorithmProvider(&h, pszAlgId, pszImplementation, dwFlags);
+    if (BCRYPT_SUCCESS(status))
+        alg.attach(h);
+    return status;
+}
+
+///
+/// Creates a hash or MAC object.
+///
+/// \sa [BCryptCreateHash function](https://learn.microsoft.com/en-us/windows/win32/api/bcrypt/nf-bcrypt-bcryptcreatehash)
+///
+static NTSTATUS BCryptCreateHash(_Inout_ BCRYPT_ALG_HANDLE hAlgorithm, _Out_writes_bytes_all_opt_(cbHashObject) PUCHAR pbHashObject, _In_ ULONG cbHashObject, _In_reads_bytes_opt_(cbSecret) PUCHAR pbSecret, _In_ ULONG cbSecret, _In_ ULONG dwFlags, _Inout_ winstd::bcrypt_hash &hash)
+{
+    BCRYPT_HASH_HANDLE h;
+    NTSTATUS status = BCryptCreateHash(hAlgorithm, &h, pbHashObject, cbHashObject, pbSecret, cbSecret, dwFlags);
+    if (BCRYPT_SUCCESS(status))
+        hash.attach(h);
+    return status;
+}
+
+///
+/// Creates a key object for use with a symmetrical key encryption algorithm from a supplied key.
+///
+/// \sa [BCryptGenerateSymmetricKey function](https://learn.microsoft.com/en-us/windows/win32/api/bcrypt/nf-bcrypt-bcryptgeneratesymmetrickey)
+///
+static NTSTATUS BCryptGenerateSymmetricKey(_Inout_ BCRYPT_ALG_HANDLE hAlgorithm, _Out_writes_bytes_all_opt_(cbKeyObject) PUCHAR pbKeyObject, _In_ ULONG cbKeyObject, _In_reads_bytes_(cbSecret) PUCHAR pbSecret, _In_ ULONG cbSecret, _In_ ULONG dwFlags, _Inout_ winstd::bcrypt_key &key)
+{
+    BCRYPT_KEY_HANDLE h;
+    NTSTATUS status = BCryptGenerateSymmetricKey(hAlgorithm, &h, pbKeyObject, cbKeyObject, pbSecret, cbSecret, dwFlags);
+    if (BCRYPT_SUCCESS(status))
+        key.attach(h);
+    return status;
+}
+
 #pragma warning(pop)
 
 /// @}
+
+namespace winstd
+{
+    /// \addtogroup WinStdCryptoAPI
+    /// @{
+
+    ///
+    /// Returns a DWORD property of a CNG object
+    ///
+    /// \param[in] h     CNG object handle
+    /// \param[in] name  Property name, e.g. `BCRYPT_OBJECT_LENGTH` or `BCRYPT_HASH_LENGTH`
+    ///
+    /// \sa [BCryptGetProperty function](https://learn.microsoft.com/en-us/windows/win32/api/bcrypt/nf-bcrypt-bcryptgetproperty)
+    ///
+    inline DWORD bcrypt_get_dword(_In_ BCRYPT_HANDLE h, _In_z_ LPCWSTR name)
+    {
+        DWORD value;
+        ULONG size;
+        const NTSTATUS status = BCryptGetProperty(h, name, reinterpret_cast<PUCHAR>(&value), sizeof(value), &size, 0);
+        if (!BCRYPT_SUCCESS(status))
+            throw bcrypt_runtime_error(status, "BCryptGetProperty failed");
+        return value;
+    }
+
+    ///
+    /// Pool of opened CNG algorithm providers
+    ///
+    /// Opening a provider takes milliseconds. The pool opens each combination of algorithm, implementation, flags and
+    /// chaining mode once and keeps it open for the lifetime of the pool. CNG algorithm handles may be used from multiple
+    /// threads concurrently. The pool is thread-safe.
+    ///
+    class bcrypt_alg_pool
+    {
+        WINSTD_NONCOPYABLE(bcrypt_alg_pool)
+        WINSTD_NONMOVABLE(bcrypt_alg_pool)
+
+    public:
+        ///
+        /// Constructs an empty pool
+        ///
+        bcrypt_alg_pool() noexcept {}
+
+        ///
+        /// Closes all providers
+        ///
+        virtual ~bcrypt_alg_pool() {}
+
+        ///
+        /// Returns the process-wide pool
+        ///
+        static bcrypt_alg_pool& instance()
+        {
+            static bcrypt_alg_pool pool;
+            return pool;
+        }
+
+        ///
+        /// Returns an algorithm provider, opening it on first use
+        ///
+        /// \param[in] alg_id          Algorithm identifier, e.g. `BCRYPT_SHA256_ALGORITHM`
+        /// \param[in] flags           Flags for `BCryptOpenAlgorithmProvider`, e.g. `BCRYPT_ALG_HANDLE_HMAC_FLAG`
+        /// \param[in] chaining_mode   Optional `BCRYPT_CHAINING_MODE` to set, e.g. `BCRYPT_CHAIN_MODE_GCM`
+        /// \param[in] implementation  Optional provider name
+        ///
+        /// \return Algorithm provider handle. Valid for the lifetime of the pool; do not close it.
+        ///
+        BCRYPT_ALG_HANDLE get(_In_z_ LPCWSTR alg_id, _In_ ULONG flags = 0, _In_opt_z_ LPCWSTR chaining_mode = NULL, _In_opt_z_ LPCWSTR implementation = NULL)
+        {
+            if (!implementation) implementation = L"";
+            if (!chaining_mode) chaining_mode = L"";
+            std::lock_guard<std::mutex> lock(m_lock);
+            for (auto& e : m_algs)
+                if (e.flags == flags && e.alg_id == alg_id && e.chaining_mode == chaining_mode && e.implementation == implementation)
+                    return e.alg;
+            bcrypt_alg alg;
+            NTSTATUS status = open(alg_id, flags, chaining_mode, implementation, alg);
+            if (!BCRYPT_SUCCESS(status))
+                throw bcrypt_runtime_error(status, "BCryptOpenAlgorithmProvider failed");
+            m_algs.push_back({ alg_id, implementation, chaining_mode, flags, std::move(alg) });
+            return m_algs.back().alg;
+        }
+
+        ///
+        /// Returns number of open providers
+        ///
+        size_t size() const
+        {
+            std::lock_guard<std::mutex> lock(m_lock);
+            return m_algs.size();
+        }
+
+    protected:
+        ///
+        /// Opens an algorithm provider
+        ///
+        /// \param[in ] alg_id          Algorithm identifier
+        /// \param[in ] flags           Flags for `BCryptOpenAlgorithmProvider`
+        /// \param[in ] chaining_mode   `BCRYPT_CHAINING_MODE` to set or empty string
+        /// \param[in ] implementation  Provider name or empty string
+        /// \param[out] alg             Algorithm provider
+        ///
+        /// \return Status
+        ///
+        virtual NTSTATUS open(_In_z_ LPCWSTR alg_id, _In_ ULONG flags, _In_z_ LPCWSTR chaining_mode, _In_z_ LPCWSTR implementation, _Inout_ bcrypt_alg& alg)
+        {
+            NTSTATUS status = BCryptOpenAlgorithmProvider(alg, alg_id, *implementation ? implementation : NULL, flags);
+            if (BCRYPT_SUCCESS(status) && *chaining_mode)
+                status = BCryptSetProperty(alg, BCRYPT_CHAINING_MODE, reinterpret_cast<PUCHAR>(const_cast<LPWSTR>(chaining_mode)), static_cast<ULONG>((wcslen(chaining_mode) + 1) * sizeof(WCHAR)), 0);
+            return status;
+        }
+
+    protected:
+        /// \cond internal
+        struct entry
+        {
+            std::wstring alg_id;
+            std::wstring implementation;
+            std::wstring chaining_mode;
+            ULONG flags;
+            bcrypt_alg alg;
+        };
+        /// \endcond
+
+        mutable std::mutex m_lock;   ///< Guards m_algs
+        std::vector<entry> m_algs;   ///< Open providers
+    };
+
+    ///
+    /// Reusable hash or HMAC over a caller-provided object buffer
+    ///
+    /// The hash is created with `BCRYPT_HASH_REUSABLE_FLAG` once; hashing a message afterwards performs no allocations.
+    /// Not thread-safe: use one instance per thread.
+    ///
+    class reusable_hash
+    {
+        WINSTD_NONCOPYABLE(reusable_hash)
+        WINSTD_NONMOVABLE(reusable_hash)
+
+    public:
+        ///
+        /// Creates the hash
+        ///
+        /// \param[in] alg          Algorithm provider. Use `BCRYPT_ALG_HANDLE_HMAC_FLAG` for HMAC.
+        /// \param[in] object       Hash object buffer. Must outlive this object. See object_length().
+        /// \param[in] object_size  Size of hash object buffer in bytes
+        /// \param[in] secret       HMAC key or `NULL` for plain hash
+        /// \param[in] secret_size  Size of HMAC key in bytes
+        ///
+        reusable_hash(
+            _In_ BCRYPT_ALG_HANDLE alg,
+            _Out_writes_bytes_all_(object_size) void* object, _In_ ULONG object_size,
+            _In_reads_bytes_opt_(secret_size) const void* secret = NULL, _In_ ULONG secret_size = 0) :
+            m_length(bcrypt_get_dword(alg, BCRYPT_HASH_LENGTH))
+        {
+            const NTSTATUS status = BCryptCreateHash(alg, static_cast<PUCHAR>(object), object_size, static_cast<PUCHAR>(const_cast<void*>(secret)), secret_size, BCRYPT_HASH_REUSABLE_FLAG, m_hash);
+            if (!BCRYPT_SUCCESS(status))
+                throw bcrypt_runtime_error(status, "BCryptCreateHash failed");
+        }
+
+        ///
+        /// Returns required size of hash object buffer in bytes
+        ///
+        /// \param[in] alg  Algorithm provider
+        ///
+        static ULONG object_length(_In_ BCRYPT_ALG_HANDLE alg)
+        {
+            return bcrypt_get_dword(alg, BCRYPT_OBJECT_LENGTH);
+        }
+
+        ///
+        /// Returns hash value size in bytes
+        ///
+        ULONG length() const noexcept { return m_length; }
+
+        ///
+        /// Hashes data. Call finish() to complete the message.
+        ///
+        /// \param[in] data  Data
+        /// \param[in] size  Size of data in bytes
+        ///
+        void update(_In_reads_bytes_(size) const void* data, _In_ size_t size)
+        {
+            m_hash.update(data, size);
+        }
+
+        ///
+        /// Retrieves the hash value and resets the hash for the next message
+        ///
+        /// \param[out] value  Hash value of length() bytes
+        ///
+        void finish(_Out_writes_bytes_all_(m_length) void* value)
+        {
+            m_hash.finish(value, m_length);
+        }
+
+        ///
+        /// Hashes a complete message
+        ///
+        /// \param[in ] data   Data
+        /// \param[in ] size   Size of data in bytes
+        /// \param[out] value  Hash value of length() bytes
+        ///
+        void compute(_In_reads_bytes_(size) const void* data, _In_ size_t size, _Out_writes_bytes_all_(m_length) void* value)
+        {
+            update(data, size);
+            finish(value);
+        }
+
+    protected:
+        bcrypt_hash m_hash; ///< Hash handle
+        ULONG m_length;     ///< Hash value size in bytes
+    };
+
+    ///
+    /// Encrypts data using AES-GCM
+    ///
+    /// \param[in ] key        AES key created on a provider with `BCRYPT_CHAIN_MODE_GCM`
+    /// \param[in ] nonce      Nonce. Must never repeat for the same key.
+    /// \param[in ] nonce_len  Nonce size in bytes; 12 recommended
+    /// \param[in ] aad        Additional authenticated data
+    /// \param[in ] aad_len    Size of additional authenticated data in bytes
+    /// \param[in ] plain      Plaintext
+    /// \param[out] cipher     Ciphertext. May be the same as `plain`.
+    /// \param[in ] len        Size of data in bytes
+    /// \param[out] tag        Authentication tag
+    /// \param[in ] tag_len    Tag size in bytes; 16 recommended
+    ///
+    /// \sa [BCryptEncrypt function](https://learn.microsoft.com/en-us/windows/win32/api/bcrypt/nf-bcrypt-bcryptencrypt)
+    ///
+    inline void aes_gcm_encrypt(
+        _In_ BCRYPT_KEY_HANDLE key,
+        _In_reads_bytes_(nonce_len) const void* nonce, _In_ ULONG nonce_len,
+        _In_reads_bytes_opt_(aad_len) const void* aad, _In_ ULONG aad_len,
+        _In_reads_bytes_(len) const void* plain, _Out_writes_bytes_all_(len) void* cipher, _In_ ULONG len,
+        _Out_writes_bytes_all_(tag_len) void* tag, _In_ ULONG tag_len)
+    {
+        BCRYPT_AUTHENTICATED_CIPHER_MODE_INFO info;
+        BCRYPT_INIT_AUTH_MODE_INFO(info);
+        info.pbNonce = static_cast<PUCHAR>(const_cast<void*>(nonce));
+        info.cbNonce = nonce_len;
+        info.pbAuthData = static_cast<PUCHAR>(const_cast<void*>(aad));
+        info.cbAuthData = aad_len;
+        info.pbTag = static_cast<PUCHAR>(tag);
+        info.cbTag = tag_len;
+        ULONG written;
+        const NTSTATUS status = BCryptEncrypt(key, static_cast<PUCHAR>(const_cast<void*>(plain)), len, &info, NULL, 0, static_cast<PUCHAR>(cipher), len, &written, 0);
+        if (!BCRYPT_SUCCESS(status))
+            throw bcrypt_runtime_error(status, "BCryptEncrypt failed");
+    }
+
+    ///
+    /// Encrypts data in place using AES-GCM
+    ///
+    /// \param[in ] key        AES key created on a provider with `BCRYPT_CHAIN_MODE_GCM`
+    /// \param[in ] nonce      Nonce. Must never repeat for the same key.
+    /// \param[in ] nonce_len  Nonce size in bytes; 12 recommended
+    /// \param[in ] aad        Additional authenticated data
+    /// \param[in ] aad_len    Size of additional authenticated data in bytes
+    /// \param[in ] data       Plaintext on input; ciphertext on output
+    /// \param[in ] len        Size of data in bytes
+    /// \param[out] tag        Authentication tag
+    /// \param[in ] tag_len    Tag size in bytes; 16 recommended
+    ///
+    /// \sa [BCryptEncrypt function](https://learn.microsoft.com/en-us/windows/win32/api/bcrypt/nf-bcrypt-bcryptencrypt)
+    ///
+    inline void aes_gcm_encrypt(
+        _In_ BCRYPT_KEY_HANDLE key,
+        _In_reads_bytes_(nonce_len) const void* nonce, _In_ ULONG nonce_len,
+        _In_reads_bytes_opt_(aad_len) const void* aad, _In_ ULONG aad_len,
+        _Inout_updates_bytes_(len) void* data, _In_ ULONG len,
+        _Out_writes_bytes_all_(tag_len) void* tag, _In_ ULONG tag_len)
+    {
+        aes_gcm_encrypt(key, nonce, nonce_len, aad, aad_len, data, data, len, tag, tag_len);
+    }
+
+    ///
+    /// Decrypts data in place using AES-GCM and verifies the tag
+    ///
+    /// \param[in] key        AES key created on a provider with `BCRYPT_CHAIN_MODE_GCM`
+    /// \param[in] nonce      Nonce
+    /// \param[in] nonce_len  Nonce size in bytes
+    /// \param[in] aad        Additional authenticated data
+    /// \param[in] aad_len    Size of additional authenticated data in bytes
+    /// \param[in] data       Ciphertext on input; plaintext on output
+    /// \param[in] len        Size of data in bytes
+    /// \param[in] tag        Authentication tag
+    /// \param[in] tag_len    Tag size in bytes
+    ///
+    /// \return `true` if the tag matches; `false` if the data was tampered with. The data is undefined in that case.
+    ///
+    /// \sa [BCryptDecrypt function](https://learn.microsoft.com/en-us/windows/win32/api/bcrypt/nf-bcrypt-bcryptdecrypt)
+    ///
+    inline bool aes_gcm_decrypt(
+        _In_ BCRYPT_KEY_HANDLE key,
+        _In_reads_bytes_(nonce_len) const void* nonce, _In_ ULONG nonce_len,
+        _In_reads_bytes_opt_(aad_len) const void* aad, _In_ ULONG aad_len,
+        _Inout_updates_bytes_(len) void* data, _In_ ULONG len,
+        _In_reads_bytes_(tag_len) const void* tag, _In_ ULONG tag_len)
+    {
+        BCRYPT_AUTHENTICATED_CIPHER_MODE_INFO info;
+        BCRYPT_INIT_AUTH_MODE_INFO(info);
+        info.pbNonce = static_cast<PUCHAR>(const_cast<void*>(nonce));
+        info.cbNonce = nonce_len;
+        info.pbAuthData = static_cast<PUCHAR>(const_cast<void*>(aad));
+        info.cbAuthData = aad_len;
+        info.pbTag = static_cast<PUCHAR>(const_cast<void*>(tag));
+        info.cbTag = tag_len;
+        ULONG written;
+        const NTSTATUS status = BCryptDecrypt(key, static_cast<PUCHAR>(data), len, &info, NULL, 0, static_cast<PUCHAR>(data), len, &written, 0);
+        if (status == static_cast<NTSTATUS>(0xC000A002L)) // STATUS_AUTH_TAG_MISMATCH
+            return false;
+        if (!BCRYPT_SUCCESS(status))
+            throw bcrypt_runtime_error(status, "BCryptDecrypt failed");
+        return true;
+    }
+
+    ///
+    /// Encrypts or decrypts data in place using AES-CTR
+    ///
+    /// CNG has no CTR mode: the key stream is produced by encrypting counter blocks in ECB mode, a few kilobytes per call.
+    ///
+    /// \param[in] key      AES key created on a provider with `BCRYPT_CHAIN_MODE_ECB`
+    /// \param[in] counter  Initial 16-byte counter block. Incremented as a 128-bit big-endian number per block.
+    /// \param[in] data     Data to transform
+    /// \param[in] len      Size of data in bytes
+    ///
+    inline void aes_ctr_crypt(_In_ BCRYPT_KEY_HANDLE key, _In_reads_bytes_(16) const void* counter, _Inout_updates_bytes_(len) void* data, _In_ size_t len)
+    {
+        const size_t block_count = 256;
+        uint8_t ctr[16];
+        sanitizing_blob<16 * block_count> keystream; // Wiped on every exit path
+        uint8_t* stream = keystream.m_data;
+        memcpy(ctr, counter, sizeof(ctr));
+        uint8_t* p = static_cast<uint8_t*>(data);
+        while (len) {
+            const size_t n = (std::min)(len, sizeof(keystream.m_data)), blocks = (n + 15) / 16;
+            for (size_t i = 0; i < blocks; ++i) {
+                memcpy(stream + i * 16, ctr, 16);
+                for (size_t j = 16; j-- && !++ctr[j];) {}
+            }
+            ULONG written;
+            const NTSTATUS status = BCryptEncrypt(key, stream, static_cast<ULONG>(blocks * 16), NULL, NULL, 0, stream, static_cast<ULONG>(blocks * 16), &written, 0);
+            if (!BCRYPT_SUCCESS(status))
+                throw bcrypt_runtime_error(status, "BCryptEncrypt failed");
+            for (size_t i = 0; i < n; ++i)
+                p[i] ^= stream[i];
+            p += n;
+            len -= n;
+        }
+    }
+
+    /// @}
+}
+
+namespace winstd
+{
+    /// \addtogroup WinStdCryptoAPI
+    /// @{
+
+    ///
+    /// Forward-only ASN.1 DER reader
+    ///
+    /// Values are returned as views into the source data; nothing is copied or allocated. Malformed data throws
+    /// `std::invalid_argument`.
+    ///
+    class der_reader
+    {
+    public:
+        ///
+        /// Universal tags used by X.509
+        ///
+        enum : uint8_t {
+            tag_boolean = 0x01,
+            tag_integer = 0x02,
+            tag_bit_string = 0x03,
+            tag_octet_string = 0x04,
+            tag_null = 0x05,
+            tag_oid = 0x06,
+            tag_utf8_string = 0x0c,
+            tag_printable_string = 0x13,
+            tag_t61_string = 0x14,
+            tag_ia5_string = 0x16,
+            tag_utc_time = 0x17,
+            tag_generalized_time = 0x18,
+            tag_universal_string = 0x1c,
+            tag_bmp_string = 0x1e,
+            tag_sequence = 0x30,
+            tag_set = 0x31,
+            tag_context = 0x80,      ///< Context-specific class bit
+            tag_constructed = 0x20,  ///< Constructed encoding bit
+        };
+
+        ///
+        /// Tag-length-value element
+        ///
+        struct tlv
+        {
+            uint8_t tag;             ///< Identifier octet
+            std::string_view value;  ///< Contents octets
+            std::string_view raw;    ///< Complete encoding including identifier and length octets
+        };
+
+        ///
+        /// Constructs a reader over DER data
+        ///
+        /// \param[in] data  DER data
+        ///
+        der_reader(_In_ std::string_view data) noexcept : m_data(data) {}
+
+        ///
+        /// Constructs a reader over DER data
+        ///
+        /// \param[in] data  DER data
+        /// \param[in] size  Size of DER data in bytes
+        ///
+        der_reader(_In_reads_bytes_(size) const void* data, _In_ size_t size) noexcept : m_data(static_cast<const char*>(data), size) {}
+
+        ///
+        /// Returns `true` when all elements have been read
+        ///
+        bool empty() const noexcept { return m_data.empty(); }
+
+        ///
+        /// Returns the identifier octet of the next element or 0 when empty
+        ///
+        uint8_t peek() const noexcept { return m_data.empty() ? 0 : static_cast<uint8_t>(m_data[0]); }
+
+        ///
+        /// Reads the next element
+        ///
+        tlv next()
+        {
+            if (m_data.size() < 2)
+                throw std::invalid_argument("truncated DER");
+            const uint8_t* p = reinterpret_cast<const uint8_t*>(m_data.data());
+            tlv t;
+            t.tag = p[0];
+            if ((t.tag & 0x1f) == 0x1f)
+                throw std::invalid_argument("unsupported DER tag");
+            size_t header = 2, len = p[1];
+            if (len & 0x80) {
+                const size_t n = len & 0x7f;
+                if (!n || n > sizeof(uint32_t))
+                    throw std::invalid_argument("invalid DER length");
+                if (m_data.size() < 2 + n)
+                    throw std::invalid_argument("truncated DER");
+                len = 0;
+                for (size_t i = 0; i < n; ++i)
+                    len = (len << 8) | p[2 + i];
+                header += n;
+            }
+            if (len > m_data.size() - header)
+                throw std::invalid_argument("truncated DER");
+            t.value = m_data.substr(header, len);
+            t.raw = m_data.substr(0, header + len);
+            m_data.remove_prefix(header + len);
+            return t;
+        }
+
+        ///
+        /// Reads the next element and checks its identifier octet
+        ///
+        /// \param[in] tag  Expected identifier octet
+        ///
+        tlv next(_In_ uint8_t tag)
+        {
+            tlv t = next();
+            if (t.tag != tag)
+                throw std::invalid_argument("unexpected DER tag");
+            return t;
+        }
+
+        ///
+        /// Reads the next element if it has the given identifier octet
+        ///
+        /// \param[in ] tag  Expected identifier octet
+        /// \param[out] t    Element
+        ///
+        /// \return `true` if the element was read
+        ///
+        bool next_if(_In_ uint8_t tag, _Out_ tlv& t)
+        {
+            if (peek() != tag)
+                return false;
+            t = next();
+            return true;
+        }
+
+    protected:
+        std::string_view m_data; ///< Remaining data
+    };
+
+    ///
+    /// Formats a DER-encoded object identifier in dotted notation
+    ///
+    /// \param[in] oid  Contents octets of the OID, e.g. `x509_attribute::oid`
+    ///
+    /// \return Dotted OID, e.g. `"2.5.4.3"`
+    ///
+    inline std::string der_oid_to_string(_In_ std::string_view oid)
+    {
+        std::string str;
+        uint64_t value = 0;
+        bool first = true;
+        for (const char c : oid) {
+            if (value > (UINT64_MAX >> 7))
+                throw std::invalid_argument("OID component too large");
+            value = (value << 7) | (static_cast<uint8_t>(c) & 0x7f);
+            if (static_cast<uint8_t>(c) & 0x80)
+                continue;
+            if (first) {
+                const uint64_t root = value < 40 ? 0 : value < 80 ? 1 : 2;
+                str += std::to_string(root);
+                str += '.';
+                str += std::to_string(value - root * 40);
+                first = false;
+            }
+            else {
+                str += '.';
+                str += std::to_string(value);
+            }
+            value = 0;
+        }
+        return str;
+    }
+
+    ///
+    /// Converts a DER UTCTime or GeneralizedTime to `FILETIME` units
+    ///
+    /// \param[in] tag    `der_reader::tag_utc_time` or `der_reader::tag_generalized_time`
+    /// \param[in] value  Contents octets
+    ///
+    /// \return Number of 100-nanosecond intervals since January 1, 1601 (UTC)
+    ///
+    inline uint64_t der_time_to_filetime(_In_ uint8_t tag, _In_ std::string_view value)
+    {
+        const size_t year_digits = tag == der_reader::tag_utc_time ? 2 : tag == der_reader::tag_generalized_time ? 4 : 0;
+        if (!year_digits || value.size() != year_digits + 11 || value.back() != 'Z')
+            throw std::invalid_argument("invalid DER time");
+        unsigned int f[6];
+        for (size_t i = 0, pos = 0; i < 6; ++i) {
+            const size_t n = i == 0 ? year_digits : 2;
+            f[i] = 0;
+            for (size_t j = 0; j < n; ++j, ++pos) {
+                if (value[pos] < '0' || '9' < value[pos])
+                    throw std::invalid_argument("invalid DER time");
+                f[i] = f[i] * 10 + (value[pos] - '0');
+            }
+        }
+        if (year_digits == 2)
+            f[0] += f[0] < 50 ? 2000 : 1900;
+        if (f[0] < 1601 || f[1] < 1 || f[1] > 12 || f[2] < 1 || f[2] > 31 || f[3] > 23 || f[4] > 59 || f[5] > 60)
+            throw std::invalid_argument("invalid DER time");
+
+        // Days since 1601-01-01 (proleptic Gregorian calendar)
+        const unsigned int y = f[0] - (f[1] <= 2), m = f[1] <= 2 ? f[1] + 9 : f[1] - 3;
+        const uint64_t days = static_cast<uint64_t>(y) * 365 + y / 4 - y / 100 + y / 400 + (153 * m + 2) / 5 + f[2] - 1 - 584694;
+        return (((days * 24 + f[3]) * 60 + f[4]) * 60 + f[5]) * 10000000;
+    }
+
+    ///
+    /// Relative distinguished name attribute
+    ///
+    struct x509_attribute
+    {
+        size_t rdn;              ///< Zero-based index of the RDN this attribute belongs to
+        std::string_view oid;    ///< Attribute type OID contents octets
+        uint8_t tag;             ///< Value string type, e.g. `der_reader::tag_utf8_string`
+        std::string_view value;  ///< Value contents octets
+    };
+
+    ///
+    /// Subject alternative name entry
+    ///
+    struct x509_general_name
+    {
+        uint8_t type;            ///< GeneralName choice: 1 = rfc822Name, 2 = dNSName, 6 = URI, 7 = iPAddress...
+        std::string_view value;  ///< Value contents octets; for directoryName the DER-encoded Name
+    };
+
+    ///
+    /// Certificate extension
+    ///
+    struct x509_extension
+    {
+        std::string_view oid;    ///< Extension OID contents octets
+        bool critical;           ///< Is extension critical?
+        std::string_view value;  ///< DER-encoded extension value
+    };
+
+    ///
+    /// X.509 certificate parsed in a single pass over its DER encoding
+    ///
+    /// All accessors return views into the encoded certificate, which must outlive this object. Reusing one object for
+    /// many certificates retains the capacity of the internal vectors.
+    ///
+    class x509_cert
+    {
+    public:
+        ///
+        /// Constructs an empty certificate
+        ///
+        x509_cert() noexcept {}
+
+        ///
+        /// Parses a certificate
+        ///
+        /// \param[in] data  DER-encoded certificate, e.g. `CERT_CONTEXT::pbCertEncoded`
+        /// \param[in] size  Size of encoded certificate in bytes
+        ///
+        x509_cert(_In_reads_bytes_(size) const void* data, _In_ size_t size)
+        {
+            parse(data, size);
+        }
+
+        ///
+        /// Parses a certificate
+        ///
+        /// \param[in] data  DER-encoded certificate, e.g. `CERT_CONTEXT::pbCertEncoded`
+        /// \param[in] size  Size of encoded certificate in bytes
+        ///
+        void parse(_In_reads_bytes_(size) const void* data, _In_ size_t size)
+        {
+            m_subject_attributes.clear();
+            m_issuer_attributes.clear();
+            m_alt_names.clear();
+            m_ekus.clear();
+            m_extensions.clear();
+            m_version = 1;
+
+            der_reader cert(data, size);
+            auto cert_seq = cert.next(der_reader::tag_sequence);
+            m_encoded = cert_seq.raw;
+            der_reader cert_r(cert_seq.value);
+            auto tbs = cert_r.next(der_reader::tag_sequence);
+            m_tbs = tbs.raw;
+            der_reader sig_alg(cert_r.next(der_reader::tag_sequence).value);
+            m_signature_algorithm = sig_alg.next(der_reader::tag_oid).value;
+            m_signature = cert_r.next(der_reader::tag_bit_string).value;
+
+            der_reader r(tbs.value);
+            der_reader::tlv t;
+            if (r.next_if(der_reader::tag_context | der_reader::tag_constructed | 0, t)) {
+                auto v = der_reader(t.value).next(der_reader::tag_integer).value;
+                if (v.size() != 1)
+                    throw std::invalid_argument("invalid certificate version");
+                m_version = static_cast<uint8_t>(v[0]) + 1;
+            }
+            m_serial = r.next(der_reader::tag_integer).value;
+            r.next(der_reader::tag_sequence);
+            auto issuer = r.next(der_reader::tag_sequence);
+            m_issuer = issuer.raw;
+            parse_name(issuer.value, m_issuer_attributes);
+            der_reader validity(r.next(der_reader::tag_sequence).value);
+            m_not_before = validity.next();
+            m_not_after = validity.next();
+            auto subject = r.next(der_reader::tag_sequence);
+            m_subject = subject.raw;
+            parse_name(subject.value, m_subject_attributes);
+            m_public_key_info = r.next(der_reader::tag_sequence).raw;
+            r.next_if(der_reader::tag_context | 1, t);
+            r.next_if(der_reader::tag_context | 2, t);
+            if (r.next_if(der_reader::tag_context | der_reader::tag_constructed | 3, t)) {
+                der_reader exts(der_reader(t.value).next(der_reader::tag_sequence).value);
+                while (!exts.empty()) {
+                    der_reader ext(exts.next(der_reader::tag_sequence).value);
+                    x509_extension e;
+                    e.oid = ext.next(der_reader::tag_oid).value;
+                    e.critical = false;
+                    if (ext.next_if(der_reader::tag_boolean, t))
+                        e.critical = t.value.size() == 1 && t.value[0] != 0;
+                    e.value = ext.next(der_reader::tag_octet_string).value;
+                    m_extensions.push_back(e);
+                    if (e.oid == std::string_view("\x55\x1d\x11", 3))
+                        parse_alt_names(e.value);
+                    else if (e.oid == std::string_view("\x55\x1d\x25", 3))
+                        parse_ekus(e.value);
+                }
+            }
+        }
+
+        ///
+        /// Returns the complete DER encoding
+        ///
+        std::string_view encoded() const noexcept { return m_encoded; }
+
+        ///
+        /// Returns DER-encoded TBSCertificate
+        ///
+        std::string_view tbs() const noexcept { return m_tbs; }
+
+        ///
+        /// Returns certificate version (1, 2 or 3)
+        ///
+        unsigned int version() const noexcept { return m_version; }
+
+        ///
+        /// Returns serial number contents octets (big-endian, two's complement)
+        ///
+        std::string_view serial() const noexcept { return m_serial; }
+
+        ///
+        /// Returns DER-encoded issuer Name
+        ///
+        std::string_view issuer() const noexcept { return m_issuer; }
+
+        ///
+        /// Returns DER-encoded subject Name
+        ///
+        std::string_view subject() const noexcept { return m_subject; }
+
+        ///
+        /// Returns issuer attributes in encoding order
+        ///
+        const std::vector<x509_attribute>& issuer_attributes() const noexcept { return m_issuer_attributes; }
+
+        ///
+        /// Returns subject attributes in encoding order
+        ///
+        const std::vector<x509_attribute>& subject_attributes() const noexcept { return m_subject_attributes; }
+
+        ///
+        /// Returns "not before" time
+        ///
+        const der_reader::tlv& not_before() const noexcept { return m_not_before; }
+
+        ///
+        /// Returns "not after" time
+        ///
+        const der_reader::tlv& not_after() const noexcept { return m_not_after; }
+
+        ///
+        /// Returns DER-encoded SubjectPublicKeyInfo
+        ///
+        std::string_view public_key_info() const noexcept { return m_public_key_info; }
+
+        ///
+        /// Returns signature algorithm OID contents octets
+        ///
+        std::string_view signature_algorithm() const noexcept { return m_signature_algorithm; }
+
+        ///
+        /// Returns signature BIT STRING contents octets
+        ///
+        std::string_view signature() const noexcept { return m_signature; }
+
+        ///
+        /// Returns extensions in encoding order
+        ///
+        const std::vector<x509_extension>& extensions() const noexcept { return m_extensions; }
+
+        ///
+        /// Returns subject alternative names
+        ///
+        const std::vector<x509_general_name>& alt_names() const noexcept { return m_alt_names; }
+
+        ///
+        /// Returns extended key usage OID contents octets
+        ///
+        const std::vector<std::string_view>& ekus() const noexcept { return m_ekus; }
+
+        ///
+        /// Returns the first attribute of given type
+        ///
+        /// \param[in] attributes  Attribute list, e.g. subject_attributes()
+        /// \param[in] oid         Attribute type OID contents octets, e.g. `std::string_view("\x55\x04\x03", 3)` for commonName
+        ///
+        /// \return Attribute or `NULL` if not found
+        ///
+        static const x509_attribute* find(_In_ const std::vector<x509_attribute>& attributes, _In_ std::string_view oid) noexcept
+        {
+            for (auto& a : attributes)
+                if (a.oid == oid)
+                    return &a;
+            return NULL;
+        }
+
+        ///
+        /// Returns subject commonName value or empty view
+        ///
+        std::string_view common_name() const noexcept
+        {
+            auto a = find(m_subject_attributes, std::string_view("\x55\x04\x03", 3));
+            return a ? a->value : std::string_view();
+        }
+
+        ///
+        /// Computes the certificate thumbprint
+        ///
+        /// \param[in ] hash   Hash to use, e.g. SHA-1 for the thumbprint shown by Windows
+        /// \param[out] value  Hash value of `hash.length()` bytes
+        ///
+        void thumbprint(_Inout_ reusable_hash& hash, _Out_ void* value) const
+        {
+            hash.compute(m_encoded.data(), m_encoded.size(), value);
+        }
+
+    protected:
+        /// \cond internal
+        static void parse_name(_In_ std::string_view name, _Inout_ std::vector<x509_attribute>& attributes)
+        {
+            der_reader r(name);
+            for (size_t rdn = 0; !r.empty(); ++rdn) {
+                der_reader set(r.next(der_reader::tag_set).value);
+                while (!set.empty()) {
+                    der_reader atv(set.next(der_reader::tag_sequence).value);
+                    x509_attribute a;
+                    a.rdn = rdn;
+                    a.oid = atv.next(der_reader::tag_oid).value;
+                    auto v = atv.next();
+                    a.tag = v.tag;
+                    a.value = v.value;
+                    attributes.push_back(a);
+                }
+            }
+        }
+
+        void parse_alt_names(_In_ std::string_view value)
+        {
+            der_reader r(der_reader(value).next(der_reader::tag_sequence).value);
+            while (!r.empty()) {
+                auto t = r.next();
+                if (!(t.tag & der_reader::tag_context))
+                    throw std::invalid_argument("invalid GeneralName");
+                x509_general_name n;
+                n.type = t.tag & 0x1f;
+                n.value = n.type == 4 ? der_reader(t.value).next(der_reader::tag_sequence).raw : t.value;
+                m_alt_names.push_back(n);
+            }
+        }
+
+        void parse_ekus(_In_ std::string_view value)
+        {
+            der_reader r(der_reader(value).next(der_reader::tag_sequence).value);
+            while (!r.empty())
+                m_ekus.push_back(r.next(der_reader::tag_oid).value);
+        }
+        /// \endcond
+
+    protected:
+        std::string_view m_encoded;                     ///< Certificate DER
+        std::string_view m_tbs;                         ///< TBSCertificate DER
+        unsigned int m_version = 1;                     ///< Version
+        std::string_view m_serial;                      ///< Serial number
+        std::string_view m_signature_algorithm;         ///< Signature algorithm OID
+        std::string_view m_signature;                   ///< Signature
+        std::string_view m_issuer;                      ///< Issuer Name DER
+        std::string_view m_subject;                     ///< Subject Name DER
+        std::string_view m_public_key_info;             ///< SubjectPublicKeyInfo DER
+        der_reader::tlv m_not_before = {};              ///< Not before
+        der_reader::tlv m_not_after = {};               ///< Not after
+        std::vector<x509_attribute> m_issuer_attributes;  ///< Issuer attributes
+        std::vector<x509_attribute> m_subject_attributes; ///< Subject attributes
+        std::vector<x509_general_name> m_alt_names;     ///< Subject alternative names
+        std::vector<std::string_view> m_ekus;           ///< Extended key usages
+        std::vector<x509_extension> m_extensions;       ///< Extensions
+    };
+
+    ///
+    /// Parses certificates on multiple threads
+    ///
+    /// Each worker thread reuses one x509_cert and one SHA-1 reusable_hash for all certificates it processes.
+    ///
+    /// \param[in] certs    Certificates
+    /// \param[in] count    Number of certificates
+    /// \param[in] fn       Callback `void fn(size_t index, const x509_cert* cert, const uint8_t* thumbprint)`. `cert` and
+    ///                     `thumbprint` (20-byte SHA-1) are `NULL` when the certificate is malformed. Called concurrently.
+    /// \param[in] threads  Number of threads; 0 to use all hardware threads
+    ///
+    /// Exceptions thrown by `fn` are rethrown on the calling thread after all workers stop.
+    ///
+    template <class _Fn>
+    void x509_parse_batch(_In_reads_(count) const PCCERT_CONTEXT* certs, _In_ size_t count, _In_ _Fn fn, _In_ size_t threads = 0)
+    {
+        BCRYPT_ALG_HANDLE sha1 = bcrypt_alg_pool::instance().get(BCRYPT_SHA1_ALGORITHM);
+        const ULONG object_length = reusable_hash::object_length(sha1);
+        struct worker_state
+        {
+            std::unique_ptr<uint8_t[]> object;
+            reusable_hash hash;
+            x509_cert cert;
+        };
+        auto init = [&] {
+            std::unique_ptr<uint8_t[]> object(new uint8_t[object_length]);
+            uint8_t* buffer = object.get();
+            return worker_state{ std::move(object), reusable_hash(sha1, buffer, object_length), x509_cert() };
+        };
+        auto call = [&](worker_state& s, size_t offset, size_t n) {
+            uint8_t thumbprint[20];
+            for (size_t i = offset, end = offset + n; i < end; ++i) {
+                bool valid;
+                try {
+                    s.cert.parse(certs[i]->pbCertEncoded, certs[i]->cbCertEncoded);
+                    s.cert.thumbprint(s.hash, thumbprint);
+                    valid = true;
+                }
+                catch (std::invalid_argument&) {
+                    valid = false;
+                }
+                if (valid)
+                    fn(i, static_cast<const x509_cert*>(&s.cert), static_cast<const uint8_t*>(thumbprint));
+                else
+                    fn(i, static_cast<const x509_cert*>(NULL), static_cast<const uint8_t*>(NULL));
+            }
+        };
+        internal::parallel_chunks(count, 1, static_cast<unsigned>((std::min)(threads, static_cast<size_t>(UINT_MAX))), init, call);
+    }
+
+    /// @}
+}
+
+namespace winstd
+{
+    /// \addtogroup WinStdCryptoAPI
+    /// @{
+
+    ///
+    /// Buffered cryptographically secure random number source
+    ///
+    /// Small requests (nonces, salts, GUIDs) are served from a buffer refilled from the system RNG a page at a time,
+    /// instead of calling into the provider for each request. Served bytes are wiped from the buffer. Large requests
+    /// bypass the buffer. Not thread-safe: use local() to get the calling thread's instance.
+    ///
+    class random_pool
+    {
+        WINSTD_NONCOPYABLE(random_pool)
+        WINSTD_NONMOVABLE(random_pool)
+
+    public:
+        static constexpr size_t buffer_size = 0x1000; ///< Buffer size in bytes
+
+        ///
+        /// Constructs an empty pool. The buffer is filled on first use.
+        ///
+        random_pool() noexcept : m_available(0) {}
+
+        ///
+        /// Wipes the buffer
+        ///
+        virtual ~random_pool()
+        {
+            SecureZeroMemory(m_buffer, sizeof(m_buffer));
+        }
+
+        ///
+        /// Returns the calling thread's pool
+        ///
+        /// This is the pool installed with install(), or the default pool of the thread.
+        ///
+        static random_pool& local()
+        {
+            if (random_pool* installed = slot())
+                return *installed;
+            static thread_local random_pool pool;
+            return pool;
+        }
+
+        ///
+        /// Replaces the calling thread's pool, e.g. with one overriding generate()
+        ///
+        /// \param[in] pool  Pool for local() to return on this thread, or `NULL` to restore the default pool. Must remain
+        ///                  valid until replaced.
+        ///
+        /// \return Previously installed pool or `NULL`
+        ///
+        static random_pool* install(_In_opt_ random_pool* pool) noexcept
+        {
+            random_pool* previous = slot();
+            slot() = pool;
+            return previous;
+        }
+
+        ///
+        /// Fills memory with random data
+        ///
+        /// \param[out] data  Data
+        /// \param[in]  size  Size of data in bytes
+        ///
+        void fill(_Out_writes_bytes_all_(size) void* data, _In_ size_t size)
+        {
+            if (size >= buffer_size / 2) {
+                generate(data, size);
+                return;
+            }
+            uint8_t* p = static_cast<uint8_t*>(data);
+            while (size) {
+                if (!m_available) {
+                    generate(m_buffer, sizeof(m_buffer));
+                    m_available = sizeof(m_buffer);
+                }
+                const size_t n = (std::min)(size, m_available);
+                uint8_t* src = m_buffer + sizeof(m_buffer) - m_available;
+                memcpy(p, src, n);
+                SecureZeroMemory(src, n);
+                m_available -= n;
+                p += n;
+                size -= n;
+            }
+        }
+
+        ///
+        /// Returns a random value
+        ///
+        template <class T>
+        T get()
+        {
+            static_assert(std::is_trivially_copyable<T>::value, "T must be trivially copyable");
+            T value;
+            fill(&value, sizeof(value));
+            return value;
+        }
+
+        ///
+        /// Returns a random (version 4) GUID
+        ///
+        GUID guid()
+        {
+            GUID g = get<GUID>();
+            g.Data3 = static_cast<unsigned short>((g.Data3 & 0x0fff) | 0x4000);
+            g.Data4[0] = static_cast<unsigned char>((g.Data4[0] & 0x3f) | 0x80);
+            return g;
+        }
+
+        ///
+        /// Wipes and discards buffered random data
+        ///
+        void wipe() noexcept
+        {
+            SecureZeroMemory(m_buffer, sizeof(m_buffer));
+            m_available = 0;
+        }
+
+    protected:
+        ///
+        /// Fills memory with random data from the system RNG
+        ///
+        /// \param[out] data  Data
+        /// \param[in]  size  Size of data in bytes
+        ///
+        /// \sa [BCryptGenRandom function](https://learn.microsoft.com/en-us/windows/win32/api/bcrypt/nf-bcrypt-bcryptgenrandom)
+        ///
+        virtual void generate(_Out_writes_bytes_all_(size) void* data, _In_ size_t size)
+        {
+            for (uint8_t* p = static_cast<uint8_t*>(data); size;) {
+                const ULONG n = static_cast<ULONG>((std::min)(size, static_cast<size_t>(ULONG_MAX)));
+                const NTSTATUS status = BCryptGenRandom(NULL, p, n, BCRYPT_USE_SYSTEM_PREFERRED_RNG);
+                if (!BCRYPT_SUCCESS(status))
+                    throw bcrypt_runtime_error(status, "BCryptGenRandom failed");
+                p += n;
+                size -= n;
+            }
+        }
+
+        /// \cond internal
+        static random_pool*& slot() noexcept
+        {
+            static thread_local random_pool* installed = NULL;
+            return installed;
+        }
+        /// \endcond
+
+    protected:
+        uint8_t m_buffer[buffer_size]; ///< Random data; the last m_available bytes are unused
+        size_t m_available;            ///< Number of unused bytes in m_buffer
+    };
+
+    /// @}
+}
+namespace winstd
+{
+    /// \addtogroup WinStdCryptoAPI
+    /// @{
+
+    ///
+    /// Text decoding mode
+    ///
+    enum class codec_mode {
+        strict = 0,  ///< Reject white space and non-canonical encoding; base64 must be padded
+        lenient,     ///< Skip white space (and `:`/`-` separators in hex); base64 padding is optional
+    };
+
+    /// \cond internal
+    namespace internal {
+        inline constexpr char base64_alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+        struct base64_table_t
+        {
+            int8_t v[256];
+            constexpr base64_table_t() : v()
+            {
+                for (size_t i = 0; i < 256; ++i)
+                    v[i] = -1;
+                for (size_t i = 0; i < 64; ++i)
+                    v[static_cast<uint8_t>(base64_alphabet[i])] = static_cast<int8_t>(i);
+            }
+        };
+        inline constexpr base64_table_t base64_table{};
+
+        inline bool codec_is_space(_In_ char c) noexcept
+        {
+            return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+        }
+
+#ifdef WINSTD_SIMD_AVX2
+        // Encodes 24 bytes to 32 characters. Reads 28 bytes.
+        inline void base64_encode_avx2(_In_reads_bytes_(28) const uint8_t* p, _Out_writes_(32) char* o) noexcept
+        {
+            __m256i in = _mm256_inserti128_si256(
+                _mm256_castsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p))),
+                _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 12)), 1);
+            in = _mm256_shuffle_epi8(in, _mm256_setr_epi8(
+                1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10,
+                1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10));
+            const __m256i t0 = _mm256_mulhi_epu16(_mm256_and_si256(in, _mm256_set1_epi32(0x0fc0fc00)), _mm256_set1_epi32(0x04000040));
+            const __m256i t1 = _mm256_mullo_epi16(_mm256_and_si256(in, _mm256_set1_epi32(0x003f03f0)), _mm256_set1_epi32(0x01000010));
+            const __m256i idx = _mm256_or_si256(t0, t1);
+
+            // Map 6-bit values to ASCII by adding a per-range offset.
+            __m256i range = _mm256_subs_epu8(idx, _mm256_set1_epi8(51));
+            range = _mm256_or_si256(range, _mm256_and_si256(_mm256_cmpgt_epi8(_mm256_set1_epi8(26), idx), _mm256_set1_epi8(13)));
+            const __m256i offset = _mm256_shuffle_epi8(_mm256_setr_epi8(
+                'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0,
+                'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0), range);
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(o), _mm256_add_epi8(offset, idx));
+        }
+
+        // Decodes 32 characters to 24 bytes. Returns false if any character is not in the alphabet.
+        inline bool base64_decode_avx2(_In_reads_(32) const char* p, _Out_writes_bytes_(24) uint8_t* o) noexcept
+        {
+            __m256i in = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+            const __m256i mask_2f = _mm256_set1_epi8(0x2f);
+            const __m256i hi_nibbles = _mm256_and_si256(_mm256_srli_epi32(in, 4), mask_2f);
+            const __m256i lo = _mm256_shuffle_epi8(_mm256_setr_epi8(
+                0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x13, 0x1a, 0x1b, 0x1b, 0x1b, 0x1a,
+                0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x13, 0x1a, 0x1b, 0x1b, 0x1b, 0x1a), _mm256_and_si256(in, mask_2f));
+            const __m256i hi = _mm256_shuffle_epi8(_mm256_setr_epi8(
+                0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10,
+                0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10), hi_nibbles);
+            if (!_mm256_testz_si256(lo, hi))
+                return false;
+            const __m256i roll = _mm256_shuffle_epi8(_mm256_setr_epi8(
+                0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0,
+                0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0), _mm256_add_epi8(_mm256_cmpeq_epi8(in, mask_2f), hi_nibbles));
+            in = _mm256_add_epi8(in, roll);
+
+            // Pack four 6-bit values into three bytes.
+            in = _mm256_maddubs_epi16(in, _mm256_set1_epi32(0x01400140));
+            in = _mm256_madd_epi16(in, _mm256_set1_epi32(0x00011000));
+            in = _mm256_shuffle_epi8(in, _mm256_setr_epi8(
+                2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1,
+                2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1));
+            in = _mm256_permutevar8x32_epi32(in, _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 3, 7));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(o), _mm256_castsi256_si128(in));
+            _mm_storel_epi64(reinterpret_cast<__m128i*>(o + 16), _mm256_extracti128_si256(in, 1));
+            return true;
+        }
+#endif
+
+#ifdef WINSTD_SIMD_SSE2
+        // Converts 16 nibbles to hexadecimal digits.
+        inline __m128i hex_digits_sse2(_In_ __m128i n, _In_ __m128i letter_offset) noexcept
+        {
+            return _mm_add_epi8(_mm_add_epi8(n, _mm_set1_epi8('0')), _mm_and_si128(_mm_cmpgt_epi8(n, _mm_set1_epi8(9)), letter_offset));
+        }
+
+        // Converts 16 hexadecimal digits to nibbles. Returns false if any character is not a hexadecimal digit.
+        inline bool hex_values_sse2(_In_ __m128i c, _Out_ __m128i& n) noexcept
+        {
+            const __m128i lower = _mm_or_si128(c, _mm_set1_epi8(0x20));
+            const __m128i digit = _mm_and_si128(_mm_cmpgt_epi8(c, _mm_set1_epi8('0' - 1)), _mm_cmplt_epi8(c, _mm_set1_epi8('9' + 1)));
+            const __m128i alpha = _mm_and_si128(_mm_cmpgt_epi8(lower, _mm_set1_epi8('a' - 1)), _mm_cmplt_epi8(lower, _mm_set1_epi8('f' + 1)));
+            if (_mm_movemask_epi8(_mm_or_si128(digit, alpha)) != 0xffff)
+                return false;
+            n = _mm_or_si128(
+                _mm_and_si128(digit, _mm_sub_epi8(c, _mm_set1_epi8('0'))),
+                _mm_and_si128(alpha, _mm_sub_epi8(lower, _mm_set1_epi8('a' - 10))));
+            return true;
+        }
+
+        // Decodes 32 hexadecimal digits to 16 bytes. Returns false if any character is not a hexadecimal digit.
+        inline bool hex_decode_sse2(_In_reads_(32) const char* p, _Out_writes_bytes_(16) uint8_t* o) noexcept
+        {
+            __m128i n0, n1;
+            if (!hex_values_sse2(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p)), n0) ||
+                !hex_values_sse2(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 16)), n1))
+                return false;
+            const __m128i mask = _mm_set1_epi16(0x00ff);
+            n0 = _mm_or_si128(_mm_slli_epi16(_mm_and_si128(n0, mask), 4), _mm_srli_epi16(n0, 8));
+            n1 = _mm_or_si128(_mm_slli_epi16(_mm_and_si128(n1, mask), 4), _mm_srli_epi16(n1, 8));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(o), _mm_packus_epi16(n0, n1));
+            return true;
+        }
+#endif
+    }
+    /// \endcond
+
+    ///
+    /// Returns length of base64 encoding
+    ///
+    /// \param[in] size  Size of data in bytes
+    ///
+    inline size_t base64_encoded_size(_In_ size_t size) noexcept
+    {
+        return (size + 2) / 3 * 4;
+    }
+
+    ///
+    /// Encodes data as base64
+    ///
+    /// \param[in ] data  Data
+    /// \param[in ] size  Size of data in bytes
+    /// \param[out] text  Output buffer of at least `base64_encoded_size(size)` characters. No zero terminator is written.
+    ///
+    /// \return Number of characters written
+    ///
+    inline size_t base64_encode(_In_reads_bytes_(size) const void* data, _In_ size_t size, _Out_writes_(base64_encoded_size(size)) char* text) noexcept
+    {
+        const uint8_t* p = static_cast<const uint8_t*>(data);
+        char* o = text;
+#ifdef WINSTD_SIMD_AVX2
+        for (; size >= 28; p += 24, size -= 24, o += 32)
+            internal::base64_encode_avx2(p, o);
+#endif
+        for (; size >= 3; p += 3, size -= 3, o += 4) {
+            const uint32_t v = (static_cast<uint32_t>(p[0]) << 16) | (static_cast<uint32_t>(p[1]) << 8) | p[2];
+            o[0] = internal::base64_alphabet[v >> 18];
+            o[1] = internal::base64_alphabet[(v >> 12) & 0x3f];
+            o[2] = internal::base64_alphabet[(v >> 6) & 0x3f];
+            o[3] = internal::base64_alphabet[v & 0x3f];
+        }
+        if (size) {
+            const uint32_t v = (static_cast<uint32_t>(p[0]) << 16) | (size > 1 ? static_cast<uint32_t>(p[1]) << 8 : 0);
+            o[0] = internal::base64_alphabet[v >> 18];
+            o[1] = internal::base64_alphabet[(v >> 12) & 0x3f];
+            o[2] = size > 1 ? internal::base64_alphabet[(v >> 6) & 0x3f] : '=';
+            o[3] = '=';
+            o += 4;
+        }
+        return static_cast<size_t>(o - text);
+    }
+
+    ///
+    /// Encodes data as base64 and appends it to a string
+    ///
+    /// \param[in   ] data  Data
+    /// \param[in   ] size  Size of data in bytes
+    /// \param[inout] text  String to append to, e.g. `std::string` or `sanitizing_string`
+    ///
+    template<class _Traits, class _Ax>
+    void base64_encode(_In_reads_bytes_(size) const void* data, _In_ size_t size, _Inout_ std::basic_string<char, _Traits, _Ax>& text)
+    {
+        const size_t offset = text.size();
+        text.resize(offset + base64_encoded_size(size));
+        base64_encode(data, size, &text[offset]);
+    }
+
+    ///
+    /// Streaming base64 decoder
+    ///
+    /// Feed text in chunks of any size with update() and complete with finish().
+    ///
+    class base64_decoder
+    {
+    public:
+        ///
+        /// Constructs a decoder
+        ///
+        /// \param[in] mode  Decoding mode
+        ///
+        base64_decoder(_In_ codec_mode mode = codec_mode::strict) noexcept :
+            m_mode(mode),
+            m_acc(0),
+            m_num(0),
+            m_pad(0)
+        {}
+
+        ///
+        /// Returns maximum number of bytes update() writes for given text length
+        ///
+        static size_t max_output(_In_ size_t len) noexcept
+        {
+            return (len + 3) / 4 * 3;
+        }
+
+        ///
+        /// Decodes a chunk of text
+        ///
+        /// \param[in ] text  Base64 text
+        /// \param[in ] len   Length of text in characters
+        /// \param[out] data  Output buffer of at least `max_output(len)` bytes
+        ///
+        /// \return Number of bytes written
+        ///
+        size_t update(_In_reads_(len) const char* text, _In_ size_t len, _Out_writes_bytes_to_(max_output(len), return) void* data)
+        {
+            uint8_t* o = static_cast<uint8_t*>(data);
+            for (size_t i = 0; i < len;) {
+#ifdef WINSTD_SIMD_AVX2
+                if (!m_num && !m_pad) {
+                    for (; len - i >= 32 && internal::base64_decode_avx2(text + i, o); i += 32, o += 24);
+                    if (i >= len)
+                        break;
+                }
+#endif
+                const char c = text[i++];
+                const int8_t v = internal::base64_table.v[static_cast<uint8_t>(c)];
+                if (v >= 0 && !m_pad) {
+                    m_acc = (m_acc << 6) | static_cast<uint32_t>(v);
+                    if (++m_num == 4) {
+                        o[0] = static_cast<uint8_t>(m_acc >> 16);
+                        o[1] = static_cast<uint8_t>(m_acc >> 8);
+                        o[2] = static_cast<uint8_t>(m_acc);
+                        o += 3;
+                        m_acc = 0;
+                        m_num = 0;
+                    }
+                }
+                else if (c == '=' && m_num >= 2 && m_num + m_pad < 4)
+                    ++m_pad;
+                else if (m_mode != codec_mode::lenient || !internal::codec_is_space(c))
+                    throw std::invalid_argument("invalid base64 data");
+            }
+            return static_cast<size_t>(o - static_cast<uint8_t*>(data));
+        }
+
+        ///
+        /// Completes decoding and resets the decoder
+        ///
+        /// \param[out] data  Output buffer of at least 2 bytes
+        ///
+        /// \return Number of bytes written
+        ///
+        size_t finish(_Out_writes_bytes_to_(2, return) void* data)
+        {
+            uint8_t* o = static_cast<uint8_t*>(data);
+            size_t written = 0;
+            if (m_num) {
+                if (m_num == 1 || (m_mode == codec_mode::strict && m_num + m_pad != 4))
+                    throw std::invalid_argument("incomplete base64 data");
+                if (m_num == 2) {
+                    if (m_mode == codec_mode::strict && (m_acc & 0xf))
+                        throw std::invalid_argument("non-canonical base64 data");
+                    o[0] = static_cast<uint8_t>(m_acc >> 4);
+                    written = 1;
+                }
+                else {
+                    if (m_mode == codec_mode::strict && (m_acc & 0x3))
+                        throw std::invalid_argument("non-canonical base64 data");
+                    o[0] = static_cast<uint8_t>(m_acc >> 10);
+                    o[1] = static_cast<uint8_t>(m_acc >> 2);
+                    written = 2;
+                }
+            }
+            m_acc = 0;
+            m_num = 0;
+            m_pad = 0;
+            return written;
+        }
+
+    protected:
+        codec_mode m_mode; ///< Decoding mode
+        uint32_t m_acc;    ///< Bits of incomplete group
+        size_t m_num;      ///< Number of characters in incomplete group
+        size_t m_pad;      ///< Number of padding characters seen
+    };
+
+    ///
+    /// Streaming base64 encoder
+    ///
+    /// Feed data in chunks of any size with update() and complete with finish().
+    ///
+    class base64_encoder
+    {
+    public:
+        ///
+        /// Constructs an encoder
+        ///
+        base64_encoder() noexcept : m_num(0) {}
+
+        ///
+        /// Returns maximum number of characters update() writes for given data size
+        ///
+        static size_t max_output(_In_ size_t size) noexcept
+        {
+            return (size + 2) / 3 * 4;
+        }
+
+        ///
+        /// Encodes a chunk of data
+        ///
+        /// \param[in ] data  Data
+        /// \param[in ] size  Size of data in bytes
+        /// \param[out] text  Output buffer of at least `max_output(size)` characters
+        ///
+        /// \return Number of characters written
+        ///
+        size_t update(_In_reads_bytes_(size) const void* data, _In_ size_t size, _Out_writes_to_(max_output(size), return) char* text) noexcept
+        {
+            const uint8_t* p = static_cast<const uint8_t*>(data);
+            size_t written = 0;
+            if (m_num) {
+                for (; m_num < 3 && size; --size)
+                    m_buf[m_num++] = *p++;
+                if (m_num < 3)
+                    return 0;
+                written = base64_encode(m_buf, 3, text);
+                m_num = 0;
+            }
+            const size_t whole = size / 3 * 3;
+            written += base64_encode(p, whole, text + written);
+            m_num = size - whole;
+            memcpy(m_buf, p + whole, m_num);
+            return written;
+        }
+
+        ///
+        /// Completes encoding, including padding, and resets the encoder
+        ///
+        /// \param[out] text  Output buffer of at least 4 characters
+        ///
+        /// \return Number of characters written
+        ///
+        size_t finish(_Out_writes_to_(4, return) char* text) noexcept
+        {
+            const size_t written = base64_encode(m_buf, m_num, text);
+            m_num = 0;
+            return written;
+        }
+
+    protected:
+        uint8_t m_buf[3]; ///< Incomplete group
+        size_t m_num;     ///< Number of bytes in m_buf
+    };
+
+    ///
+    /// Returns exact size of decoded base64 data
+    ///
+    /// In strict mode the result is computed from the length. In lenient mode the text is scanned. The result is
+    /// meaningless for invalid text, which base64_decode() rejects.
+    ///
+    /// \param[in] text  Base64 text
+    /// \param[in] len   Length of text in characters
+    /// \param[in] mode  Decoding mode
+    ///
+    inline size_t base64_decoded_size(_In_reads_(len) const char* text, _In_ size_t len, _In_ codec_mode mode = codec_mode::strict) noexcept
+    {
+        size_t n;
+        if (mode == codec_mode::strict) {
+            n = len;
+            for (size_t i = 0; i < 2 && n && text[n - 1] == '='; ++i, --n);
+        }
+        else {
+            n = 0;
+            for (size_t i = 0; i < len; ++i)
+                if (internal::base64_table.v[static_cast<uint8_t>(text[i])] >= 0)
+                    ++n;
+        }
+        return n / 4 * 3 + (n % 4 ? n % 4 - 1 : 0);
+    }
+
+    ///
+    /// Decodes base64 text
+    ///
+    /// \param[in ] text  Base64 text
+    /// \param[in ] len   Length of text in characters
+    /// \param[out] data  Output buffer of at least `base64_decoded_size(text, len, mode)` bytes
+    /// \param[in ] mode  Decoding mode
+    ///
+    /// \return Number of bytes written
+    ///
+    inline size_t base64_decode(_In_reads_(len) const char* text, _In_ size_t len, _Out_ void* data, _In_ codec_mode mode = codec_mode::strict)
+    {
+        base64_decoder decoder(mode);
+        const size_t written = decoder.update(text, len, data);
+        return written + decoder.finish(static_cast<uint8_t*>(data) + written);
+    }
+
+    ///
+    /// Decodes base64 text and appends it to a vector
+    ///
+    /// \param[in   ] text  Base64 text
+    /// \param[in   ] len   Length of text in characters
+    /// \param[inout] data  Vector to append to
+    /// \param[in   ] mode  Decoding mode
+    ///
+    template<class _Ty, class _Ax>
+    void base64_decode(_In_reads_(len) const char* text, _In_ size_t len, _Inout_ std::vector<_Ty, _Ax>& data, _In_ codec_mode mode = codec_mode::strict)
+    {
+        static_assert(sizeof(_Ty) == 1, "_Ty must be one byte");
+        const size_t offset = data.size();
+        data.resize(offset + base64_decoded_size(text, len, mode));
+        try {
+            data.resize(offset + base64_decode(text, len, data.data() + offset, mode));
+        }
+        catch (...) {
+            data.resize(offset);
+            throw;
+        }
+    }
+
+    ///
+    /// Encodes data as hexadecimal digits
+    ///
+    /// Hexadecimal encoding has no state between bytes: large inputs can be encoded in chunks of any size.
+    ///
+    /// \param[in ] data   Data
+    /// \param[in ] size   Size of data in bytes
+    /// \param[out] text   Output buffer of at least `2 * size` characters. No zero terminator is written.
+    /// \param[in ] upper  Use uppercase letters?
+    ///
+    /// \return Number of characters written
+    ///
+    inline size_t hex_encode(_In_reads_bytes_(size) const void* data, _In_ size_t size, _Out_writes_(2 * size) char* text, _In_ bool upper = false) noexcept
+    {
+        const uint8_t* p = static_cast<const uint8_t*>(data);
+        char* o = text;
+#ifdef WINSTD_SIMD_SSE2
+        const __m128i letter_offset = _mm_set1_epi8(upper ? 'A' - '0' - 10 : 'a' - '0' - 10), mask = _mm_set1_epi8(0x0f);
+        for (; size >= 16; p += 16, size -= 16, o += 32) {
+            const __m128i in = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+            const __m128i hi = _mm_and_si128(_mm_srli_epi16(in, 4), mask), lo = _mm_and_si128(in, mask);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(o), internal::hex_digits_sse2(_mm_unpacklo_epi8(hi, lo), letter_offset));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(o + 16), internal::hex_digits_sse2(_mm_unpackhi_epi8(hi, lo), letter_offset));
+        }
+#endif
+        const char* digits = upper ? "0123456789ABCDEF" : "0123456789abcdef";
+        for (; size; ++p, --size, o += 2) {
+            o[0] = digits[*p >> 4];
+            o[1] = digits[*p & 0xf];
+        }
+        return static_cast<size_t>(o - text);
+    }
+
+    ///
+    /// Encodes data as hexadecimal digits and appends it to a string
+    ///
+    /// \param[in   ] data   Data
+    /// \param[in   ] size   Size of data in bytes
+    /// \param[inout] text   String to append to, e.g. `std::string` or `sanitizing_string`
+    /// \param[in   ] upper  Use uppercase letters?
+    ///
+    template<class _Traits, class _Ax>
+    void hex_encode(_In_reads_bytes_(size) const void* data, _In_ size_t size, _Inout_ std::basic_string<char, _Traits, _Ax>& text, _In_ bool upper = false)
+    {
+        const size_t offset = text.size();
+        text.resize(offset + 2 * size);
+        hex_encode(data, size, &text[offset], upper);
+    }
+
+    ///
+    /// Streaming hexadecimal decoder
+    ///
+    /// Feed text in chunks of any size with update() and complete with finish().
+    ///
+    class hex_decoder
+    {
+    public:
+        ///
+        /// Constructs a decoder
+        ///
+        /// \param[in] mode  Decoding mode
+        ///
+        hex_decoder(_In_ codec_mode mode = codec_mode::strict) noexcept :
+            m_mode(mode),
+            m_acc(0),
+            m_num(0)
+        {}
+
+        ///
+        /// Returns maximum number of bytes update() writes for given text length
+        ///
+        static size_t max_output(_In_ size_t len) noexcept
+        {
+            return (len + 1) / 2;
+        }
+
+        ///
+        /// Decodes a chunk of text
+        ///
+        /// \param[in ] text  Hexadecimal text
+        /// \param[in ] len   Length of text in characters
+        /// \param[out] data  Output buffer of at least `max_output(len)` bytes
+        ///
+        /// \return Number of bytes written
+        ///
+        size_t update(_In_reads_(len) const char* text, _In_ size_t len, _Out_writes_bytes_to_(max_output(len), return) void* data)
+        {
+            uint8_t* o = static_cast<uint8_t*>(data);
+            for (size_t i = 0; i < len;) {
+#ifdef WINSTD_SIMD_SSE2
+                if (!m_num) {
+                    for (; len - i >= 32 && internal::hex_decode_sse2(text + i, o); i += 32, o += 16);
+                    if (i >= len)
+                        break;
+                }
+#endif
+                const char c = text[i++];
+                uint8_t v;
+                if ('0' <= c && c <= '9')
+                    v = static_cast<uint8_t>(c - '0');
+                else if ('a' <= (c | 0x20) && (c | 0x20) <= 'f')
+                    v = static_cast<uint8_t>((c | 0x20) - 'a' + 10);
+                else if (m_mode == codec_mode::lenient && (internal::codec_is_space(c) || c == ':' || c == '-'))
+                    continue;
+                else
+                    throw std::invalid_argument("invalid hexadecimal data");
+                if (m_num) {
+                    *o++ = static_cast<uint8_t>((m_acc << 4) | v);
+                    m_num = 0;
+                }
+                else {
+                    m_acc = v;
+                    m_num = 1;
+                }
+            }
+            return static_cast<size_t>(o - static_cast<uint8_t*>(data));
+        }
+
+        ///
+        /// Completes decoding and resets the decoder
+        ///
+        void finish()
+        {
+            const bool complete = !m_num;
+            m_num = 0;
+            if (!complete)
+                throw std::invalid_argument("odd number of hexadecimal digits");
+        }
+
+    protected:
+        codec_mode m_mode; ///< Decoding mode
+        uint8_t m_acc;     ///< Pending high nibble
+        size_t m_num;      ///< Number of pending nibbles
+    };
+
+    ///
+    /// Returns exact size of decoded hexadecimal data
+    ///
+    /// In strict mode the result is computed from the length. In lenient mode the text is scanned.
+    ///
+    /// \param[in] text  Hexadecimal text
+    /// \param[in] len   Length of text in characters
+    /// \param[in] mode  Decoding mode
+    ///
+    inline size_t hex_decoded_size(_In_reads_(len) const char* text, _In_ size_t len, _In_ codec_mode mode = codec_mode::strict) noexcept
+    {
+        if (mode == codec_mode::strict)
+            return len / 2;
+        size_t n = 0;
+        for (size_t i = 0; i < len; ++i)
+            if (('0' <= text[i] && text[i] <= '9') || ('a' <= (text[i] | 0x20) && (text[i] | 0x20) <= 'f'))
+                ++n;
+        return n / 2;
+    }
+
+    ///
+    /// Decodes hexadecimal text
+    ///
+    /// \param[in ] text  Hexadecimal text
+    /// \param[in ] len   Length of text in characters
+    /// \param[out] data  Output buffer of at least `hex_decoded_size(text, len, mode)` bytes
+    /// \param[in ] mode  Decoding mode
+    ///
+    /// \return Number of bytes written
+    ///
+    inline size_t hex_decode(_In_reads_(len) const char* text, _In_ size_t len, _Out_ void* data, _In_ codec_mode mode = codec_mode::strict)
+    {
+        hex_decoder decoder(mode);
+        const size_t written = decoder.update(text, len, data);
+        decoder.finish();
+        return written;
+    }
+
+    ///
+    /// Decodes hexadecimal text and appends it to a vector
+    ///
+    /// \param[in   ] text  Hexadecimal text
+    /// \param[in   ] len   Length of text in characters
+    /// \param[inout] data  Vector to append to
+    /// \param[in   ] mode  Decoding mode
+    ///
+    template<class _Ty, class _Ax>
+    void hex_decode(_In_reads_(len) const char* text, _In_ size_t len, _Inout_ std::vector<_Ty, _Ax>& data, _In_ codec_mode mode = codec_mode::strict)
+    {
+        static_assert(sizeof(_Ty) == 1, "_Ty must be one byte");
+        const size_t offset = data.size();
+        data.resize(offset + hex_decoded_size(text, len, mode));
+        try {
+            data.resize(offset + hex_decode(text, len, data.data() + offset, mode));
+        }
+        catch (...) {
+            data.resize(offset);
+            throw;
+        }
+    }
+
+    /// @}
+}
+
+namespace winstd
+{
+    /// \addtogroup WinStdCryptoAPI
+    /// @{
+
+    ///
+    /// Envelope encryption of many secrets under one DPAPI-protected data-encryption key
+    ///
+    /// Protecting every secret with DPAPI costs an LSA round trip per secret. The vault instead protects only a 256-bit
+    /// data-encryption key (DEK) with DPAPI and encrypts secrets in process with AES-GCM. After rotate() new secrets are
+    /// encrypted with a fresh DEK, while older keys remain available for decryption until retired. rewrap() moves
+    /// envelopes to the current key in bulk.
+    ///
+    /// Envelope format: version (1 byte, 1), DEK id (4 bytes, little-endian), nonce (12 bytes), ciphertext, tag (16 bytes).
+    /// Version and DEK id are authenticated as additional data. Nonces are random; do not encrypt more than 2^32 secrets
+    /// under a single DEK.
+    ///
+    /// The vault is thread-safe.
+    ///
+    class secret_vault
+    {
+        WINSTD_NONCOPYABLE(secret_vault)
+        WINSTD_NONMOVABLE(secret_vault)
+
+    public:
+        typedef std::vector<uint8_t, sanitizing_allocator<uint8_t>> buffer; ///< Plaintext buffer
+
+        static constexpr size_t header_size = 1 + 4 + 12;           ///< Envelope header size in bytes
+        static constexpr size_t overhead = header_size + 16;        ///< Envelope size minus plaintext size in bytes
+
+        ///
+        /// Constructs a vault without keys
+        ///
+        /// \param[in] dpapi_flags  Flags for `CryptProtectData`/`CryptUnprotectData`, e.g. `CRYPTPROTECT_LOCAL_MACHINE`
+        ///
+        secret_vault(_In_ DWORD dpapi_flags = CRYPTPROTECT_UI_FORBIDDEN) noexcept :
+            m_dpapi_flags(dpapi_flags),
+            m_current(0),
+            m_last(0)
+        {}
+
+        ///
+        /// Destroys the vault and wipes all keys
+        ///
+        virtual ~secret_vault() {}
+
+        ///
+        /// Returns current DEK id or 0 if the vault has no keys
+        ///
+        uint32_t key_id() const
+        {
+            std::lock_guard<std::mutex> lock(m_lock);
+            return m_current;
+        }
+
+        ///
+        /// Generates a new DEK and makes it current
+        ///
+        /// Previous keys remain available for decryption. The new id is greater than any id ever issued or loaded by this
+        /// vault, including retired ones, so envelopes of a retired DEK never match a new one.
+        ///
+        /// \return Id of the new DEK
+        ///
+        uint32_t rotate()
+        {
+            auto k = std::make_shared<key_entry>();
+            random_pool::local().fill(k->secret.m_data, sizeof(k->secret.m_data));
+            import(*k);
+            std::lock_guard<std::mutex> lock(m_lock);
+            if (m_last == UINT32_MAX)
+                throw std::invalid_argument("key ids exhausted");
+            const uint32_t id = ++m_last;
+            m_keys.push_back({ id, std::move(k) });
+            return m_current = id;
+        }
+
+        ///
+        /// Returns a DEK protected with DPAPI for persistent storage
+        ///
+        /// \param[in ] id       DEK id
+        /// \param[out] wrapped  DPAPI-protected DEK
+        ///
+        void wrap(_In_ uint32_t id, _Out_ std::vector<uint8_t>& wrapped) const
+        {
+            auto k = find(id);
+            if (!k)
+                throw std::invalid_argument("unknown key");
+            protect(k->secret.m_data, sizeof(k->secret.m_data), wrapped);
+        }
+
+        ///
+        /// Loads a DPAPI-protected DEK
+        ///
+        /// This is the only operation that calls DPAPI to decrypt; call it once per DEK when the process starts.
+        ///
+        /// \param[in] id       DEK id
+        /// \param[in] wrapped  DPAPI-protected DEK
+        /// \param[in] size     Size of wrapped in bytes
+        /// \param[in] current  Make the key current?
+        ///
+        void load(_In_ uint32_t id, _In_reads_bytes_(size) const void* wrapped, _In_ size_t size, _In_ bool current = true)
+        {
+            if (!id)
+                throw std::invalid_argument("invalid key id");
+            auto k = std::make_shared<key_entry>();
+            unprotect(wrapped, size, k->secret.m_data, sizeof(k->secret.m_data));
+            import(*k);
+            std::lock_guard<std::mutex> lock(m_lock);
+            auto i = std::lower_bound(m_keys.begin(), m_keys.end(), id, [](const auto& e, uint32_t id) { return e.first < id; });
+            if (i != m_keys.end() && i->first == id)
+                i->second = std::move(k);
+            else
+                m_keys.insert(i, { id, std::move(k) });
+            if (m_last < id)
+                m_last = id;
+            if (current)
+                m_current = id;
+        }
+
+        ///
+        /// Removes a DEK. Envelopes encrypted with it can no longer be decrypted.
+        ///
+        /// \param[in] id  DEK id
+        ///
+        void retire(_In_ uint32_t id)
+        {
+            std::lock_guard<std::mutex> lock(m_lock);
+            if (id == m_current)
+                throw std::invalid_argument("cannot retire current key");
+            m_keys.erase(std::remove_if(m_keys.begin(), m_keys.end(), [id](const auto& e) { return e.first == id; }), m_keys.end());
+        }
+
+        ///
+        /// Returns DEK id of an envelope
+        ///
+        /// \param[in] envelope  Envelope
+        /// \param[in] size      Size of envelope in bytes
+        ///
+        static uint32_t key_id(_In_reads_bytes_(size) const void* envelope, _In_ size_t size)
+        {
+            const uint8_t* p = static_cast<const uint8_t*>(envelope);
+            if (size < overhead || p[0] != 1)
+                throw std::invalid_argument("invalid envelope");
+            return static_cast<uint32_t>(p[1]) | (static_cast<uint32_t>(p[2]) << 8) | (static_cast<uint32_t>(p[3]) << 16) | (static_cast<uint32_t>(p[4]) << 24);
+        }
+
+        ///
+        /// Encrypts a secret with the current DEK
+        ///
+        /// \param[in ] data      Secret
+        /// \param[in ] size      Size of secret in bytes
+        /// \param[out] envelope  Envelope of `size + overhead` bytes
+        ///
+        void encrypt(_In_reads_bytes_(size) const void* data, _In_ size_t size, _Out_ std::vector<uint8_t>& envelope) const
+        {
+            uint32_t id;
+            std::shared_ptr<key_entry> k;
+            {
+                std::lock_guard<std::mutex> lock(m_lock);
+                id = m_current;
+                k = find_internal(id);
+            }
+            if (!k)
+                throw std::invalid_argument("vault has no key");
+            if (size > ULONG_MAX)
+                throw std::invalid_argument("secret too large");
+            envelope.resize(size + overhead);
+            uint8_t* p = envelope.data();
+            p[0] = 1;
+            p[1] = static_cast<uint8_t>(id);
+            p[2] = static_cast<uint8_t>(id >> 8);
+            p[3] = static_cast<uint8_t>(id >> 16);
+            p[4] = static_cast<uint8_t>(id >> 24);
+            random_pool::local().fill(p + 5, 12);
+            // Encrypt straight into the envelope: plaintext must not land in memory that is not wiped.
+            aes_gcm_encrypt(k->key, p + 5, 12, p, 5, data, p + header_size, static_cast<ULONG>(size), p + header_size + size, 16);
+        }
+
+        ///
+        /// Decrypts a secret
+        ///
+        /// \param[in ] envelope  Envelope
+        /// \param[in ] size      Size of envelope in bytes
+        /// \param[out] data      Secret
+        ///
+        void decrypt(_In_reads_bytes_(size) const void* envelope, _In_ size_t size, _Out_ buffer& data) const
+        {
+            auto k = find(key_id(envelope, size));
+            if (!k)
+                throw std::invalid_argument("unknown key");
+            if (size - overhead > ULONG_MAX)
+                throw std::invalid_argument("invalid envelope");
+            const uint8_t* p = static_cast<const uint8_t*>(envelope);
+            const size_t n = size - overhead;
+            data.assign(p + header_size, p + header_size + n);
+            if (!aes_gcm_decrypt(k->key, p + 5, 12, p, 5, data.data(), static_cast<ULONG>(n), p + header_size + n, 16)) {
+                SecureZeroMemory(data.data(), data.size());
+                data.clear();
+                throw std::invalid_argument("envelope authentication failed");
+            }
+        }
+
+        ///
+        /// Re-encrypts envelopes that are not encrypted with the current DEK
+        ///
+        /// \param[inout] envelopes  Envelopes
+        /// \param[in   ] count      Number of envelopes
+        ///
+        /// \return Number of envelopes re-encrypted
+        ///
+        size_t rewrap(_Inout_updates_(count) std::vector<uint8_t>* envelopes, _In_ size_t count) const
+        {
+            const uint32_t current = key_id();
+            buffer plain;
+            size_t rewrapped = 0;
+            for (size_t i = 0; i < count; ++i) {
+                auto& e = envelopes[i];
+                if (key_id(e.data(), e.size()) == current)
+                    continue;
+                decrypt(e.data(), e.size(), plain);
+                encrypt(plain.data(), plain.size(), e);
+                ++rewrapped;
+            }
+            return rewrapped;
+        }
+
+    protected:
+        /// \cond internal
+        struct key_entry
+        {
+            sanitizing_blob<32> secret;
+            bcrypt_key key;
+        };
+
+        void import(_Inout_ key_entry& k) const
+        {
+            BCRYPT_ALG_HANDLE alg = bcrypt_alg_pool::instance().get(BCRYPT_AES_ALGORITHM, 0, BCRYPT_CHAIN_MODE_GCM);
+            const NTSTATUS status = BCryptGenerateSymmetricKey(alg, NULL, 0, k.secret.m_data, sizeof(k.secret.m_data), 0, k.key);
+            if (!BCRYPT_SUCCESS(status))
+                throw bcrypt_runtime_error(status, "BCryptGenerateSymmetricKey failed");
+        }
+
+        std::shared_ptr<key_entry> find_internal(_In_ uint32_t id) const
+        {
+            auto i = std::lower_bound(m_keys.begin(), m_keys.end(), id, [](const auto& e, uint32_t id) { return e.first < id; });
+            return i != m_keys.end() && i->first == id ? i->second : nullptr;
+        }
+
+        std::shared_ptr<key_entry> find(_In_ uint32_t id) const
+        {
+            std::lock_guard<std::mutex> lock(m_lock);
+            return find_internal(id);
+        }
+        /// \endcond
+
+        ///
+        /// Protects a DEK
+        ///
+        /// \param[in ] key      DEK
+        /// \param[in ] size     Size of DEK in bytes
+        /// \param[out] wrapped  Protected DEK
+        ///
+        /// \sa [CryptProtectData function](https://learn.microsoft.com/en-us/windows/win32/api/dpapi/nf-dpapi-cryptprotectdata)
+        ///
+        virtual void protect(_In_reads_bytes_(size) const void* key, _In_ size_t size, _Out_ std::vector<uint8_t>& wrapped) const
+        {
+            DATA_BLOB in = { static_cast<DWORD>(size), static_cast<BYTE*>(const_cast<void*>(key)) };
+            data_blob out;
+            if (!CryptProtectData(&in, NULL, NULL, NULL, NULL, m_dpapi_flags, &out))
+                throw win_runtime_error("CryptProtectData failed");
+            wrapped.assign(out.data(), out.data() + out.size());
+        }
+
+        ///
+        /// Unprotects a DEK
+        ///
+        /// \param[in ] wrapped       Protected DEK
+        /// \param[in ] wrapped_size  Size of protected DEK in bytes
+        /// \param[out] key           DEK
+        /// \param[in ] size          Size of DEK in bytes
+        ///
+        /// \sa [CryptUnprotectData function](https://learn.microsoft.com/en-us/windows/win32/api/dpapi/nf-dpapi-cryptunprotectdata)
+        ///
+        virtual void unprotect(_In_reads_bytes_(wrapped_size) const void* wrapped, _In_ size_t wrapped_size, _Out_writes_bytes_all_(size) void* key, _In_ size_t size) const
+        {
+            DATA_BLOB in = { static_cast<DWORD>(wrapped_size), static_cast<BYTE*>(const_cast<void*>(wrapped)) };
+            data_blob out;
+            if (!CryptUnprotectData(&in, NULL, NULL, NULL, NULL, m_dpapi_flags, &out))
+                throw win_runtime_error("CryptUnprotectData failed");
+            const bool valid = out.size() == size;
+            if (valid)
+                memcpy(key, out.data(), size);
+            SecureZeroMemory(out.data(), out.size());
+            if (!valid)
+                throw std::invalid_argument("invalid key size");
+        }
+
+    protected:
+        DWORD m_dpapi_flags;                                                    ///< DPAPI flags
+        mutable std::mutex m_lock;                                              ///< Guards m_keys, m_current and m_last
+        std::vector<std::pair<uint32_t, std::shared_ptr<key_entry>>> m_keys;   ///< Keys ordered by id
+        uint32_t m_current;                                                     ///< Current key id
+        uint32_t m_last;                                                        ///< Highest key id ever issued or loaded
+    };
+
+    /// @}
+}
\ No newline at end of file
@@ -15,7 +15,11 @@
 #include <eapmethodtypes.h>
 #include <eappapis.h>
 #include <WinSock2.h>
+#include <algorithm>
 #include <memory>
+#include <stdexcept>
+#include <string_view>
+#include <vector>
 
 #pragma warning(push)
 #pragma warning(disable: 26812) // Windows EAP API is using unscoped enums
@@ -698,4 +702,324 @@ namespace winstd
     /// @}
 }
 
+namespace winstd
+{
+    /// \addtogroup WinStdEAPAPI
+    /// @{
+
+    ///
+    /// EAP-TLS/PEAP/TTLS message fragmentation and reassembly (RFC 5216, section 3.2)
+    ///
+    /// Operates on EAP type data: the Flags octet, the optional TLS Message Length and the TLS data that follow the EAP
+    /// Type octet. Single-fragment inbound messages are returned as views into the received packet; fragmented
+    /// messages are reassembled into a buffer sized once from the TLS Message Length. Outbound messages are split into
+    /// fragment views of the caller's message. Protocol violations and limit breaches throw `std::invalid_argument` and
+    /// reset the inbound state.
+    ///
+    class eap_tls_fragmenter
+    {
+    public:
+        ///
+        /// EAP-TLS flags
+        ///
+        enum : BYTE {
+            flag_length_included = 0x80,   ///< L: TLS Message Length field present
+            flag_more_fragments  = 0x40,   ///< M: More fragments follow
+            flag_start           = 0x20,   ///< S: EAP-TLS start
+        };
+
+        static constexpr size_t eap_header_size = 5; ///< Code, Identifier, Length and Type octets
+
+        ///
+        /// Outbound fragment
+        ///
+        struct fragment
+        {
+            BYTE flags;         ///< Flags octet
+            uint32_t length;    ///< TLS Message Length; valid when `flags & flag_length_included`
+            const BYTE* data;   ///< Fragment data; points into the message being sent
+            size_t size;        ///< Fragment data size in bytes
+
+            ///
+            /// Returns type data size in bytes, including the Flags octet and TLS Message Length
+            ///
+            size_t type_data_size() const noexcept
+            {
+                return 1 + (flags & flag_length_included ? 4 : 0) + size;
+            }
+
+            ///
+            /// Returns EAP packet size in bytes
+            ///
+            size_t packet_size() const noexcept
+            {
+                return eap_header_size + type_data_size();
+            }
+
+            ///
+            /// Writes the fragment as an EAP packet
+            ///
+            /// \param[in ] code  EAP code
+            /// \param[in ] id    Packet identifier
+            /// \param[in ] type  EAP method type
+            /// \param[out] out   Output buffer of at least packet_size() bytes, e.g. the EapHost send packet
+            ///
+            /// \return Number of bytes written
+            ///
+            size_t write_packet(_In_ EapCode code, _In_ BYTE id, _In_ eap_type_t type, _Out_writes_bytes_(packet_size()) void* out) const noexcept
+            {
+                BYTE* p = static_cast<BYTE*>(out);
+                const size_t n = packet_size();
+                p[0] = static_cast<BYTE>(code);
+                p[1] = id;
+                p[2] = static_cast<BYTE>(n >> 8);
+                p[3] = static_cast<BYTE>(n);
+                p[4] = static_cast<BYTE>(type);
+                p[5] = flags;
+                p += 6;
+                if (flags & flag_length_included) {
+                    p[0] = static_cast<BYTE>(length >> 24);
+                    p[1] = static_cast<BYTE>(length >> 16);
+                    p[2] = static_cast<BYTE>(length >> 8);
+                    p[3] = static_cast<BYTE>(length);
+                    p += 4;
+                }
+                memcpy(p, data, size);
+                return n;
+            }
+        };
+
+        ///
+        /// Constructs a fragmenter
+        ///
+        /// \param[in] max_message    Maximum inbound TLS message size in bytes
+        /// \param[in] max_fragments  Maximum number of fragments of an inbound message
+        ///
+        eap_tls_fragmenter(_In_ size_t max_message = 0x10000, _In_ size_t max_fragments = 128) noexcept :
+            m_max_message(max_message),
+            m_max_fragments(max_fragments),
+            m_in_total(0),
+            m_in_received(0),
+            m_in_fragments(0),
+            m_in_flags(0),
+            m_out_data(NULL),
+            m_out_size(0),
+            m_out_offset(0),
+            m_out_max(0),
+            m_out_flags(0)
+        {}
+
+        /// \name Inbound
+        /// @{
+
+        ///
+        /// Processes received EAP type data
+        ///
+        /// \param[in] data  Type data, starting with the Flags octet
+        /// \param[in] size  Type data size in bytes
+        ///
+        /// \return
+        /// - `true` when a message is complete; see message();
+        /// - `false` when more fragments are expected; acknowledge this one with an empty response.
+        ///
+        bool receive(_In_reads_bytes_(size) const void* data, _In_ size_t size)
+        {
+            try {
+                return receive_internal(static_cast<const BYTE*>(data), size);
+            }
+            catch (...) {
+                reset_inbound();
+                throw;
+            }
+        }
+
+        ///
+        /// Processes a received EAP packet
+        ///
+        /// \param[in] packet  EAP packet
+        /// \param[in] size    Size of the buffer holding the packet in bytes
+        ///
+        /// \return See receive(const void*, size_t)
+        ///
+        bool receive(_In_reads_bytes_(size) const EapPacket* packet, _In_ size_t size)
+        {
+            if (size < eap_header_size + 1)
+                throw std::invalid_argument("EAP packet too short");
+            const size_t length = (static_cast<size_t>(packet->Length[0]) << 8) | packet->Length[1];
+            if (length < eap_header_size + 1 || length > size)
+                throw std::invalid_argument("invalid EAP packet length");
+            return receive(reinterpret_cast<const BYTE*>(packet) + eap_header_size, length - eap_header_size);
+        }
+
+        ///
+        /// Returns Flags octet of the last received packet
+        ///
+        /// Low-order bits carry the PEAP/TTLS version.
+        ///
+        BYTE flags() const noexcept { return m_in_flags; }
+
+        ///
+        /// Returns the last complete inbound TLS message
+        ///
+        /// Single-fragment messages point into the data passed to receive() and are valid as long as it is.
+        ///
+        std::string_view message() const noexcept { return m_message; }
+
+        ///
+        /// Discards partially received message
+        ///
+        void reset_inbound() noexcept
+        {
+            m_in_total = m_in_received = m_in_fragments = 0;
+            m_message = std::string_view();
+        }
+
+        /// @}
+
+        /// \name Outbound
+        /// @{
+
+        ///
+        /// Starts sending a TLS message
+        ///
+        /// \param[in] data        TLS message. Must remain valid until the last fragment is sent.
+        /// \param[in] size        TLS message size in bytes
+        /// \param[in] max_packet  Maximum EAP packet size in bytes, e.g. `dwMaxSendPacketSize`. Sizes above 65535, the limit of the
+        ///                        EAP Length field, are clamped.
+        /// \param[in] flags       Additional flags for every fragment, e.g. PEAP version
+        ///
+        void send(_In_reads_bytes_(size) const void* data, _In_ size_t size, _In_ size_t max_packet, _In_ BYTE flags = 0)
+        {
+            if (max_packet <= eap_header_size + 1 + 4)
+                throw std::invalid_argument("maximum packet size too small");
+            if (size > UINT32_MAX)
+                throw std::invalid_argument("message too large");
+            m_out_data = static_cast<const BYTE*>(data);
+            m_out_size = size;
+            m_out_offset = 0;
+            m_out_max = (std::min)(max_packet, static_cast<size_t>(0xffff));
+            m_out_flags = flags & ~static_cast<BYTE>(flag_length_included | flag_more_fragments);
+        }
+
+        ///
+        /// Returns `true` if the message passed to send() has fragments left to send
+        ///
+        bool has_more() const noexcept { return m_out_data && (m_out_offset < m_out_size || !m_out_offset); }
+
+        ///
+        /// Returns the next outbound fragment
+        ///
+        /// Call after the peer acknowledged the previous fragment.
+        ///
+        /// \param[out] f  Fragment
+        ///
+        /// \return `true` if a fragment was returned; `false` if the message was sent completely
+        ///
+        bool next(_Out_ fragment& f) noexcept
+        {
+            if (!has_more()) {
+                m_out_data = NULL;
+                return false;
+            }
+            size_t room = m_out_max - eap_header_size - 1;
+            f.flags = m_out_flags;
+            f.length = static_cast<uint32_t>(m_out_size);
+            if (!m_out_offset && m_out_size > room) {
+                f.flags |= flag_length_included;
+                room -= 4;
+            }
+            f.data = m_out_data + m_out_offset;
+            f.size = (std::min)(room, m_out_size - m_out_offset);
+            m_out_offset += f.size;
+            if (m_out_offset < m_out_size)
+                f.flags |= flag_more_fragments;
+            else if (!m_out_size)
+                m_out_offset = 1; // Empty message is sent as a single empty fragment.
+            return true;
+        }
+
+        /// @}
+
+    protected:
+        /// \cond internal
+        bool receive_internal(_In_reads_bytes_(size) const BYTE* data, _In_ size_t size)
+        {
+            if (!size)
+                throw std::invalid_argument("missing EAP-TLS flags");
+            const BYTE flags = data[0];
+            ++data;
+            --size;
+            size_t length = SIZE_MAX;
+            if (flags & flag_length_included) {
+                if (size < 4)
+                    throw std::invalid_argument("missing TLS message length");
+                length = (static_cast<size_t>(data[0]) << 24) | (static_cast<size_t>(data[1]) << 16) | (static_cast<size_t>(data[2]) << 8) | data[3];
+                data += 4;
+                size -= 4;
+                if (length > m_max_message)
+                    throw std::invalid_argument("TLS message too large");
+            }
+            m_in_flags = flags;
+
+            if (!m_in_total) {
+                // First fragment
+                if (!(flags & flag_more_fragments)) {
+                    if (length != SIZE_MAX && length != size)
+                        throw std::invalid_argument("TLS message length mismatch");
+                    if (size > m_max_message)
+                        throw std::invalid_argument("TLS message too large");
+                    m_message = std::string_view(reinterpret_cast<const char*>(data), size);
+                    return true;
+                }
+                if (length == SIZE_MAX)
+                    throw std::invalid_argument("first fragment must include TLS message length");
+                if (size >= length)
+                    throw std::invalid_argument("TLS message length mismatch");
+                m_buffer.resize(length);
+                m_in_total = length;
+                m_in_received = 0;
+                m_in_fragments = 0;
+                m_message = std::string_view();
+            }
+            else if (length != SIZE_MAX && length != m_in_total)
+                throw std::invalid_argument("TLS message length mismatch");
+
+            if (++m_in_fragments > m_max_fragments)
+                throw std::invalid_argument("too many fragments");
+            if (size > m_in_total - m_in_received)
+                throw std::invalid_argument("fragment exceeds TLS message length");
+            memcpy(m_buffer.data() + m_in_received, data, size);
+            m_in_received += size;
+            if (flags & flag_more_fragments) {
+                if (m_in_received == m_in_total)
+                    throw std::invalid_argument("fragment exceeds TLS message length");
+                return false;
+            }
+            if (m_in_received != m_in_total)
+                throw std::invalid_argument("TLS message truncated");
+            m_message = std::string_view(reinterpret_cast<const char*>(m_buffer.data()), m_in_total);
+            m_in_total = m_in_received = m_in_fragments = 0;
+            return true;
+        }
+        /// \endcond
+
+    protected:
+        size_t m_max_message;                   ///< Maximum inbound message size
+        size_t m_max_fragments;                 ///< Maximum number of inbound fragments
+        std::vector<BYTE> m_buffer;             ///< Reassembly buffer
+        size_t m_in_total;                      ///< Inbound message size; 0 when not reassembling
+        size_t m_in_received;                   ///< Inbound bytes received
+        size_t m_in_fragments;                  ///< Inbound fragments received
+        BYTE m_in_flags;                        ///< Last inbound flags
+        std::string_view m_message;             ///< Last complete inbound message
+        const BYTE* m_out_data;                 ///< Outbound message
+        size_t m_out_size;                      ///< Outbound message size
+        size_t m_out_offset;                    ///< Outbound bytes sent
+        size_t m_out_max;                       ///< Maximum outbound packet size
+        BYTE m_out_flags;                       ///< Additional outbound flags
+    };
+
+    /// @}
+}
+
 #pragma warning(pop)
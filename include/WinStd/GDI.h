@@ -8,6 +8,17 @@
 #pragma once
 
 #include "Common.h"
+#include <objbase.h>
+#include <shellapi.h>
+#include <condition_variable>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
 
 namespace winstd
 {
@@ -221,5 +232,396 @@ namespace winstd
         HGDIOBJ m_orig; ///< Original object handle
     };
 
+    ///
+    /// Icon cache key
+    ///
+    struct icon_key
+    {
+        ///
+        /// Icon source
+        ///
+        enum class source_t
+        {
+            resource = 0,   ///< Icon resource in a module
+            file,           ///< Shell icon of a particular file
+            file_type,      ///< Shell icon of a file extension
+            directory,      ///< Shell icon of a folder
+        };
+
+        source_t source;    ///< Icon source
+        HINSTANCE module;   ///< Module for `source_t::resource`
+        std::wstring name;  ///< Resource name (`#123` for numeric IDs), lowercase path or lowercase extension
+        int size;           ///< Size in pixels at 96 DPI
+        UINT dpi;           ///< DPI
+
+        ///
+        /// Returns size in physical pixels
+        ///
+        int pixels() const noexcept { return MulDiv(size, static_cast<int>(dpi), USER_DEFAULT_SCREEN_DPI); }
+
+        ///
+        /// Makes a key for an icon resource
+        ///
+        /// \param[in] module  Module
+        /// \param[in] name    Resource name or `MAKEINTRESOURCE` ID
+        /// \param[in] size    Size in pixels at 96 DPI
+        /// \param[in] dpi     DPI
+        ///
+        static icon_key resource(_In_opt_ HINSTANCE module, _In_ LPCWSTR name, _In_ int size, _In_ UINT dpi = USER_DEFAULT_SCREEN_DPI)
+        {
+            return icon_key{ source_t::resource, module, IS_INTRESOURCE(name) ? L"#" + std::to_wstring(reinterpret_cast<uintptr_t>(name)) : std::wstring(name), size, dpi };
+        }
+
+        ///
+        /// Makes a key for the shell icon of a file
+        ///
+        /// Files whose icon depends on the type only share a key per extension. Executables, icons, cursors and
+        /// shortcuts are keyed by path.
+        ///
+        /// \param[in] path        File path
+        /// \param[in] attributes  File attributes
+        /// \param[in] size        Size in pixels at 96 DPI
+        /// \param[in] dpi         DPI
+        ///
+        static icon_key file(_In_ std::wstring_view path, _In_ DWORD attributes, _In_ int size, _In_ UINT dpi = USER_DEFAULT_SCREEN_DPI)
+        {
+            if (attributes & FILE_ATTRIBUTE_DIRECTORY)
+                return icon_key{ source_t::directory, NULL, std::wstring(), size, dpi };
+            const size_t slash = path.find_last_of(L"\\/:"), dot = path.rfind(L'.');
+            std::wstring extension;
+            if (dot != std::wstring_view::npos && (slash == std::wstring_view::npos || dot > slash))
+                extension = lowercase(path.substr(dot));
+            static const wchar_t* const per_file[] = { L".ani", L".cpl", L".cur", L".exe", L".ico", L".lnk", L".scr", L".url" };
+            for (auto e : per_file)
+                if (extension == e)
+                    return icon_key{ source_t::file, NULL, lowercase(path), size, dpi };
+            return icon_key{ source_t::file_type, NULL, std::move(extension), size, dpi };
+        }
+
+        ///
+        /// Compares keys
+        ///
+        bool operator==(_In_ const icon_key& other) const noexcept
+        {
+            return source == other.source && module == other.module && size == other.size && dpi == other.dpi && name == other.name;
+        }
+
+        ///
+        /// Compares keys
+        ///
+        bool operator!=(_In_ const icon_key& other) const noexcept { return !operator==(other); }
+
+    protected:
+        /// \cond internal
+        static std::wstring lowercase(_In_ std::wstring_view s)
+        {
+            std::wstring r(s);
+            for (auto& c : r)
+                if (L'A' <= c && c <= L'Z')
+                    c += L'a' - L'A';
+            return r;
+        }
+        /// \endcond
+    };
+
+    ///
+    /// Hash function for `icon_key`
+    ///
+    struct icon_key_hash
+    {
+        ///
+        /// Returns key hash
+        ///
+        size_t operator()(_In_ const icon_key& key) const noexcept
+        {
+            uint64_t h = std::hash<std::wstring>()(key.name);
+            h = internal::hash_mix(h, reinterpret_cast<uintptr_t>(key.module));
+            h = internal::hash_mix(h, (static_cast<uint64_t>(key.source) << 56) ^ (static_cast<uint64_t>(static_cast<unsigned int>(key.size)) << 24) ^ key.dpi);
+            return static_cast<size_t>(h);
+        }
+    };
+
+    ///
+    /// Shared icon cache
+    ///
+    /// Icons are shared by reference counting and destroyed when neither the cache nor any caller holds them. The
+    /// least recently used icons are evicted when the cache exceeds its budget; icons still held by callers are kept,
+    /// since evicting them would not free any handles. Each icon uses one USER and two GDI objects.
+    ///
+    /// Override `load()` and `submit()` to use a different loader or worker pool. Derived classes must call `wait()`
+    /// in their destructor.
+    ///
+    class icon_cache
+    {
+        WINSTD_NONCOPYABLE(icon_cache)
+        WINSTD_NONMOVABLE(icon_cache)
+
+    public:
+        ///
+        /// Cache statistics
+        ///
+        struct stats
+        {
+            uint64_t hits;      ///< Lookups served from cache
+            uint64_t misses;    ///< Lookups that loaded an icon
+            uint64_t failures;  ///< Loads that failed
+            uint64_t evictions; ///< Icons evicted
+            size_t size;        ///< Number of cached icons
+        };
+
+        ///
+        /// Constructs a cache
+        ///
+        /// \param[in] max_icons  Maximum number of cached icons not held by callers
+        ///
+        icon_cache(_In_ size_t max_icons = 1024) :
+            m_max_icons(max_icons),
+            m_pending(0),
+            m_hits(0),
+            m_misses(0),
+            m_failures(0),
+            m_evictions(0)
+        {}
+
+        ///
+        /// Waits for asynchronous loads and releases cached icons
+        ///
+        virtual ~icon_cache()
+        {
+            wait();
+        }
+
+        ///
+        /// Returns an icon, loading it on miss
+        ///
+        /// \param[in] key  Icon key
+        ///
+        /// \return Icon or `nullptr` if it cannot be loaded
+        ///
+        std::shared_ptr<icon> get(_In_ const icon_key& key)
+        {
+            auto i = lookup(key);
+            return i ? i : load_and_insert(key);
+        }
+
+        ///
+        /// Returns an icon asynchronously
+        ///
+        /// Cached icons are passed to `callback` before this method returns. Others are loaded on the worker pool
+        /// and passed to `callback` on a worker thread. Concurrent requests for the same key share one load.
+        ///
+        /// \param[in] key       Icon key
+        /// \param[in] callback  Function receiving the icon or `nullptr` if it cannot be loaded. Must not throw.
+        ///
+        void get_async(_In_ const icon_key& key, _In_ std::function<void(const std::shared_ptr<icon>&)> callback)
+        {
+            auto i = lookup(key);
+            if (i) {
+                callback(i);
+                return;
+            }
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                auto loading = m_loading.find(key);
+                if (loading != m_loading.end()) {
+                    // Join the load in progress.
+                    loading->second.push_back(std::move(callback));
+                    return;
+                }
+                m_loading[key].push_back(std::move(callback));
+                ++m_pending;
+            }
+            try {
+                submit([this, key]
+                {
+                    std::shared_ptr<icon> i;
+                    try { i = load_and_insert(key); }
+                    catch (...) {}
+                    std::vector<std::function<void(const std::shared_ptr<icon>&)>> callbacks;
+                    {
+                        std::lock_guard<std::mutex> lock(m_mutex);
+                        auto loading = m_loading.find(key);
+                        callbacks = std::move(loading->second);
+                        m_loading.erase(loading);
+                    }
+                    for (auto& callback : callbacks)
+                        callback(i);
+                    std::lock_guard<std::mutex> lock(m_mutex);
+                    if (!--m_pending)
+                        m_idle.notify_all();
+                });
+            }
+            catch (...) {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_loading.erase(key);
+                --m_pending;
+                throw;
+            }
+        }
+
+        ///
+        /// Waits for all asynchronous loads to complete
+        ///
+        void wait()
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_idle.wait(lock, [this] { return !m_pending; });
+        }
+
+        ///
+        /// Removes all icons from cache
+        ///
+        /// Icons held by callers remain valid.
+        ///
+        void clear()
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_map.clear();
+            m_lru.clear();
+        }
+
+        ///
+        /// Returns cache statistics
+        ///
+        stats get_stats() const
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            return { m_hits, m_misses, m_failures, m_evictions, m_lru.size() };
+        }
+
+    protected:
+        ///
+        /// Loads an icon
+        ///
+        /// May be called concurrently from worker threads. Shell icons are loaded in a single-threaded apartment, as
+        /// `SHGetFileInfoW` requires: COM is initialized with `COINIT_APARTMENTTHREADED` unless the thread already joined an
+        /// apartment.
+        ///
+        /// \param[in] key  Icon key
+        ///
+        /// \return Icon handle or `NULL` on failure
+        ///
+        /// \sa [LoadImageW function](https://learn.microsoft.com/en-us/windows/win32/api/winuser/nf-winuser-loadimagew)
+        /// \sa [SHGetFileInfoW function](https://learn.microsoft.com/en-us/windows/win32/api/shellapi/nf-shellapi-shgetfileinfow)
+        ///
+        virtual HICON load(_In_ const icon_key& key)
+        {
+            const int pixels = key.pixels();
+            if (key.source == icon_key::source_t::resource)
+                return static_cast<HICON>(LoadImageW(key.module, key.name.c_str(), IMAGE_ICON, pixels, pixels, LR_DEFAULTCOLOR));
+
+            // Shell icons come in small and large sizes only.
+            const HRESULT hr = CoInitializeEx(NULL, COINIT_APARTMENTTHREADED);
+            SHFILEINFOW info = {};
+            UINT flags = SHGFI_ICON | (pixels <= MulDiv(16, static_cast<int>(key.dpi), USER_DEFAULT_SCREEN_DPI) ? SHGFI_SMALLICON : SHGFI_LARGEICON);
+            DWORD attributes = FILE_ATTRIBUTE_NORMAL;
+            std::wstring path;
+            switch (key.source) {
+            case icon_key::source_t::file:
+                path = key.name;
+                break;
+            case icon_key::source_t::file_type:
+                path = L"file" + key.name;
+                flags |= SHGFI_USEFILEATTRIBUTES;
+                break;
+            default:
+                path = L"folder";
+                attributes = FILE_ATTRIBUTE_DIRECTORY;
+                flags |= SHGFI_USEFILEATTRIBUTES;
+            }
+            const bool ok = SHGetFileInfoW(path.c_str(), attributes, &info, sizeof(info), flags) != 0;
+            if (SUCCEEDED(hr))
+                CoUninitialize();
+            return ok ? info.hIcon : NULL;
+        }
+
+        ///
+        /// Runs work on the worker pool
+        ///
+        /// \param[in] work  Work item
+        ///
+        /// \sa [TrySubmitThreadpoolCallback function](https://learn.microsoft.com/en-us/windows/win32/api/threadpoolapiset/nf-threadpoolapiset-trysubmitthreadpoolcallback)
+        ///
+        virtual void submit(_In_ std::function<void()>&& work)
+        {
+            std::unique_ptr<std::function<void()>> w(new std::function<void()>(std::move(work)));
+            if (!TrySubmitThreadpoolCallback([](_Inout_ PTP_CALLBACK_INSTANCE, _Inout_opt_ PVOID context)
+                {
+                    std::unique_ptr<std::function<void()>> w(static_cast<std::function<void()>*>(context));
+                    (*w)();
+                }, w.get(), NULL))
+                throw win_runtime_error("TrySubmitThreadpoolCallback failed");
+            w.release();
+        }
+
+    protected:
+        /// \cond internal
+        typedef std::list<std::pair<icon_key, std::shared_ptr<icon>>> lru_t;
+
+        std::shared_ptr<icon> lookup(_In_ const icon_key& key)
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            auto i = m_map.find(key);
+            if (i == m_map.end())
+                return nullptr;
+            ++m_hits;
+            m_lru.splice(m_lru.begin(), m_lru, i->second);
+            return i->second->second;
+        }
+
+        std::shared_ptr<icon> load_and_insert(_In_ const icon_key& key)
+        {
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                ++m_misses;
+            }
+            const HICON h = load(key);
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (!h) {
+                ++m_failures;
+                return nullptr;
+            }
+            auto i = std::make_shared<icon>(h);
+            auto existing = m_map.find(key);
+            if (existing != m_map.end()) {
+                // Another thread loaded it meanwhile.
+                m_lru.splice(m_lru.begin(), m_lru, existing->second);
+                return existing->second->second;
+            }
+            m_lru.emplace_front(key, i);
+            m_map.emplace(key, m_lru.begin());
+            trim();
+            return i;
+        }
+
+        void trim()
+        {
+            size_t excess = m_lru.size() > m_max_icons ? m_lru.size() - m_max_icons : 0;
+            for (auto i = m_lru.end(); excess && i != m_lru.begin();) {
+                --i;
+                if (i->second.use_count() > 1)
+                    continue;
+                m_map.erase(i->first);
+                i = m_lru.erase(i);
+                ++m_evictions;
+                --excess;
+            }
+        }
+        /// \endcond
+
+    protected:
+        size_t m_max_icons;                                                             ///< Icon budget
+        mutable std::mutex m_mutex;                                                     ///< Protects members below
+        std::condition_variable m_idle;                                                 ///< Signals no pending loads
+        size_t m_pending;                                                               ///< Number of pending asynchronous loads
+        lru_t m_lru;                                                                    ///< Icons, most recently used first
+        std::unordered_map<icon_key, lru_t::iterator, icon_key_hash> m_map;             ///< Icon index
+        std::unordered_map<icon_key, std::vector<std::function<void(const std::shared_ptr<icon>&)>>, icon_key_hash> m_loading; ///< Callbacks waiting for asynchronous loads
+        uint64_t m_hits;                                                                ///< Lookups served from cache
+        uint64_t m_misses;                                                              ///< Lookups that loaded an icon
+        uint64_t m_failures;                                                            ///< Loads that failed
+        uint64_t m_evictions;                                                           ///< Icons evicted
+    };
+
     /// @}
 }
@@ -10,7 +10,10 @@
 
 #include "Common.h"
 #include <MsiQuery.h>
+#include <map>
+#include <stdexcept>
 #include <string>
+#include <string_view>
 #include <vector>
 
 /// \addtogroup WinStdMSIAPI
@@ -309,3 +312,296 @@ static INSTALLSTATE MsiGetComponentPathW(_In_z_ LPCWSTR szProduct, _In_z_ LPCWST
 }
 
 /// @}
+
+namespace winstd
+{
+    /// \addtogroup WinStdMSIAPI
+    /// @{
+
+    ///
+    /// Prefetched installer property snapshot with memoized record formatting
+    ///
+    /// Declared properties are read with a single `MsiFormatRecordW` call on a `[Name1]<US>[Name2]<US>...` template,
+    /// where US is U+001F, and stored back to back in one arena. Formatted templates are cached per property snapshot
+    /// version, which changes on every prefetch and write. Writes are queued until `commit()`; `format()` and
+    /// `prefetch()` commit first so the installer sees them. Uncommitted writes are discarded on destruction.
+    ///
+    /// Views returned by `get()` are valid until the next `prefetch()`, `get()` of an undeclared property or `set()`.
+    ///
+    class msi_property_bag
+    {
+        WINSTD_NONCOPYABLE(msi_property_bag)
+        WINSTD_NONMOVABLE(msi_property_bag)
+
+    public:
+        static constexpr wchar_t separator = L'\x1f'; ///< Value separator in prefetch template
+
+        ///
+        /// Constructs an empty bag
+        ///
+        /// \param[in] hInstall  Installer session handle
+        ///
+        msi_property_bag(_In_ MSIHANDLE hInstall) noexcept :
+            m_install(hInstall),
+            m_record(0),
+            m_version(0),
+            m_dirty(0)
+        {}
+
+        ///
+        /// Closes the formatting record
+        ///
+        virtual ~msi_property_bag()
+        {
+            if (m_record)
+                MsiCloseHandle(m_record);
+        }
+
+        ///
+        /// Reads a set of properties
+        ///
+        /// Replaces previously prefetched properties. Falls back to reading one property at a time when a value
+        /// contains the separator.
+        ///
+        /// \param[in] names  Property names
+        /// \param[in] count  Number of names
+        ///
+        void prefetch(_In_reads_(count) const LPCWSTR* names, _In_ size_t count)
+        {
+            std::wstring tmpl;
+            for (size_t i = 0; i < count; ++i) {
+                if (!is_identifier(names[i]))
+                    throw std::invalid_argument("invalid property name");
+                if (i)
+                    tmpl += separator;
+                tmpl += L'[';
+                tmpl += names[i];
+                tmpl += L']';
+            }
+            if (m_dirty)
+                commit();
+            m_entries.clear();
+            m_arena.clear();
+            ++m_version;
+            if (!count)
+                return;
+
+            const std::wstring values = format_record(tmpl);
+            if (static_cast<size_t>(std::count(values.begin(), values.end(), separator)) == count - 1) {
+                m_arena.reserve(values.size() + 1);
+                m_entries.reserve(count);
+                for (size_t i = 0, start = 0; i < count; ++i) {
+                    const size_t end = i + 1 < count ? values.find(separator, start) : values.size();
+                    add(names[i], std::wstring_view(values.data() + start, end - start));
+                    start = end + 1;
+                }
+            }
+            else {
+                for (size_t i = 0; i < count; ++i)
+                    add(names[i], get_property(names[i]));
+            }
+            std::sort(m_entries.begin(), m_entries.end(), [](_In_ const entry& a, _In_ const entry& b) { return a.name < b.name; });
+            m_entries.erase(std::unique(m_entries.begin(), m_entries.end(), [](_In_ const entry& a, _In_ const entry& b) { return a.name == b.name; }), m_entries.end());
+        }
+
+        ///
+        /// Reads a set of properties
+        ///
+        /// \param[in] names  Property names
+        ///
+        void prefetch(_In_ std::initializer_list<LPCWSTR> names)
+        {
+            prefetch(names.begin(), names.size());
+        }
+
+        ///
+        /// Returns property value
+        ///
+        /// Properties not prefetched are read individually and added to the bag.
+        ///
+        /// \param[in] name  Property name
+        ///
+        /// \return Property value
+        ///
+        std::wstring_view get(_In_z_ LPCWSTR name)
+        {
+            auto e = find(name);
+            if (e == m_entries.end() || e->name != name) {
+                const std::wstring value = get_property(name);
+                const size_t index = static_cast<size_t>(e - m_entries.begin());
+                m_entries.insert(e, entry{ name, m_arena.size(), value.size(), false });
+                m_arena.append(value);
+                m_arena += L'\0';
+                e = m_entries.begin() + static_cast<ptrdiff_t>(index);
+            }
+            return std::wstring_view(m_arena.data() + e->offset, e->length);
+        }
+
+        ///
+        /// Queues a property write
+        ///
+        /// Subsequent `get()` returns the new value.
+        ///
+        /// \param[in] name   Property name
+        /// \param[in] value  Property value
+        ///
+        void set(_In_z_ LPCWSTR name, _In_ std::wstring_view value)
+        {
+            auto e = find(name);
+            if (e == m_entries.end() || e->name != name)
+                e = m_entries.insert(e, entry{ name, 0, 0, false });
+            e->offset = m_arena.size();
+            e->length = value.size();
+            if (!e->dirty) {
+                e->dirty = true;
+                ++m_dirty;
+            }
+            m_arena.append(value);
+            m_arena += L'\0';
+            ++m_version;
+        }
+
+        ///
+        /// Sends queued writes to the installer
+        ///
+        void commit()
+        {
+            for (auto& e : m_entries) {
+                if (!e.dirty)
+                    continue;
+                set_property(e.name.c_str(), m_arena.data() + e.offset);
+                e.dirty = false;
+                --m_dirty;
+            }
+        }
+
+        ///
+        /// Formats a template using installer properties
+        ///
+        /// \param[in] tmpl  Template, e.g. `L"[INSTALLDIR]bin"`
+        ///
+        /// \return Formatted text; valid until the template is formatted again in a newer snapshot
+        ///
+        const std::wstring& format(_In_ std::wstring_view tmpl)
+        {
+            if (m_dirty)
+                commit();
+            auto m = m_memo.find(tmpl);
+            if (m == m_memo.end())
+                m = m_memo.emplace(std::wstring(tmpl), memo()).first;
+            if (!m->second.valid || m->second.version != m_version) {
+                m->second.text = format_record(tmpl);
+                m->second.version = m_version;
+                m->second.valid = true;
+            }
+            return m->second.text;
+        }
+
+        ///
+        /// Returns property snapshot version
+        ///
+        uint64_t version() const noexcept { return m_version; }
+
+    protected:
+        ///
+        /// Formats a template
+        ///
+        /// \sa [MsiFormatRecord function](https://learn.microsoft.com/en-us/windows/win32/api/msiquery/nf-msiquery-msiformatrecordw)
+        ///
+        virtual std::wstring format_record(_In_ std::wstring_view tmpl)
+        {
+            if (!m_record) {
+                m_record = MsiCreateRecord(0);
+                if (!m_record)
+                    throw win_runtime_error(ERROR_OUTOFMEMORY, "MsiCreateRecord failed");
+            }
+            UINT result = MsiRecordSetStringW(m_record, 0, std::wstring(tmpl).c_str());
+            if (result != ERROR_SUCCESS)
+                throw win_runtime_error(result, "MsiRecordSetStringW failed");
+            std::wstring text;
+            result = ::MsiFormatRecordW(m_install, m_record, text);
+            if (result != ERROR_SUCCESS)
+                throw win_runtime_error(result, "MsiFormatRecordW failed");
+            return text;
+        }
+
+        ///
+        /// Reads a property
+        ///
+        /// \sa [MsiGetProperty function](https://learn.microsoft.com/en-us/windows/win32/api/msiquery/nf-msiquery-msigetpropertyw)
+        ///
+        virtual std::wstring get_property(_In_z_ LPCWSTR name)
+        {
+            std::wstring value;
+            const UINT result = ::MsiGetPropertyW(m_install, name, value);
+            if (result != ERROR_SUCCESS)
+                throw win_runtime_error(result, "MsiGetPropertyW failed");
+            return value;
+        }
+
+        ///
+        /// Writes a property
+        ///
+        /// \sa [MsiSetProperty function](https://learn.microsoft.com/en-us/windows/win32/api/msiquery/nf-msiquery-msisetpropertyw)
+        ///
+        virtual void set_property(_In_z_ LPCWSTR name, _In_z_ LPCWSTR value)
+        {
+            const UINT result = MsiSetPropertyW(m_install, name, value);
+            if (result != ERROR_SUCCESS)
+                throw win_runtime_error(result, "MsiSetPropertyW failed");
+        }
+
+    protected:
+        /// \cond internal
+        struct entry
+        {
+            std::wstring name;
+            size_t offset;  // Value offset in arena; values are zero-terminated
+            size_t length;
+            bool dirty;     // Queued for commit
+        };
+
+        struct memo
+        {
+            std::wstring text;
+            uint64_t version = 0;
+            bool valid = false;
+        };
+
+        static bool is_identifier(_In_z_ LPCWSTR name) noexcept
+        {
+            // Letters, digits, underscores and periods; starting with a letter or underscore.
+            auto letter = [](_In_ wchar_t c) { return (L'A' <= c && c <= L'Z') || (L'a' <= c && c <= L'z') || c == L'_'; };
+            if (!letter(*name))
+                return false;
+            for (++name; *name; ++name)
+                if (!letter(*name) && !(L'0' <= *name && *name <= L'9') && *name != L'.')
+                    return false;
+            return true;
+        }
+
+        std::vector<entry>::iterator find(_In_z_ LPCWSTR name)
+        {
+            return std::lower_bound(m_entries.begin(), m_entries.end(), name, [](_In_ const entry& e, _In_z_ LPCWSTR n) { return e.name.compare(n) < 0; });
+        }
+
+        void add(_In_z_ LPCWSTR name, _In_ std::wstring_view value)
+        {
+            m_entries.push_back(entry{ name, m_arena.size(), value.size(), false });
+            m_arena.append(value);
+            m_arena += L'\0';
+        }
+        /// \endcond
+
+    protected:
+        MSIHANDLE m_install;                                        ///< Installer session
+        MSIHANDLE m_record;                                         ///< Formatting record
+        uint64_t m_version;                                         ///< Property snapshot version
+        size_t m_dirty;                                             ///< Number of queued writes
+        std::wstring m_arena;                                       ///< Property values
+        std::vector<entry> m_entries;                               ///< Properties sorted by name
+        std::map<std::wstring, memo, std::less<>> m_memo;           ///< Formatted templates
+    };
+
+    /// @}
+}
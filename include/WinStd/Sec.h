@@ -10,7 +10,12 @@
 
 #include "Common.h"
 #include <Security.h>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <vector>
 
 /// \addtogroup WinStdSecurityAPI
 /// @{
@@ -377,3 +382,381 @@ namespace winstd
 
     /// @}
 }
+
+namespace winstd
+{
+    /// \addtogroup WinStdSecurityAPI
+    /// @{
+
+    ///
+    /// Server-side SSPI handshake driver with pooled per-connection context slots
+    ///
+    /// Each connection acquires a slot and feeds the client's tokens to step() until the slot state is complete or
+    /// failed. Output tokens are written into a buffer preallocated to the package's maximum token size, so
+    /// `ASC_REQ_ALLOCATE_MEMORY` is never used and no memory is allocated per leg. Released slots are kept for reuse.
+    ///
+    /// Override accept(), complete_token() and delete_context() to drive a different security package implementation.
+    ///
+    class sspi_acceptor
+    {
+        WINSTD_NONCOPYABLE(sspi_acceptor)
+        WINSTD_NONMOVABLE(sspi_acceptor)
+
+    public:
+        ///
+        /// Handshake state
+        ///
+        enum class state {
+            idle = 0,       ///< No token processed yet
+            in_progress,    ///< Send token() to the client and wait for the next one
+            incomplete,     ///< More input data is required; call step() again with the complete message
+            complete,       ///< Authenticated; send token() to the client if not empty
+            failed,         ///< Authentication failed; see status()
+        };
+
+        ///
+        /// Timing of a single handshake leg
+        ///
+        struct leg
+        {
+            SECURITY_STATUS status;     ///< Result of `AcceptSecurityContext`
+            uint64_t duration_ns;       ///< Duration in nanoseconds
+        };
+
+        ///
+        /// Per-connection handshake state
+        ///
+        class slot
+        {
+            WINSTD_NONCOPYABLE(slot)
+            WINSTD_NONMOVABLE(slot)
+
+        public:
+            ///
+            /// Creates a slot
+            ///
+            /// \param[in] max_token  Output token buffer size in bytes
+            ///
+            slot(_In_ size_t max_token) :
+                m_token(max_token),
+                m_token_size(0),
+                m_extra(0),
+                m_has_context(false),
+                m_state(state::idle),
+                m_status(SEC_E_OK),
+                m_attrib(0)
+            {
+                m_context.dwLower = m_context.dwUpper = 0;
+                m_expires.QuadPart = -1;
+                m_legs.reserve(8);
+            }
+
+            ///
+            /// Returns handshake state
+            ///
+            state get_state() const noexcept { return m_state; }
+
+            ///
+            /// Returns status of the last leg
+            ///
+            SECURITY_STATUS status() const noexcept { return m_status; }
+
+            ///
+            /// Returns output token of the last leg
+            ///
+            const void* token() const noexcept { return m_token.data(); }
+
+            ///
+            /// Returns output token size of the last leg in bytes
+            ///
+            size_t token_size() const noexcept { return m_token_size; }
+
+            ///
+            /// Returns number of trailing input bytes the last leg did not consume
+            ///
+            /// Feed them to the next step() (or to the application protocol when complete).
+            ///
+            size_t extra() const noexcept { return m_extra; }
+
+            ///
+            /// Returns security context or `NULL` if not established yet
+            ///
+            PCtxtHandle context() noexcept { return m_has_context ? &m_context : NULL; }
+
+            ///
+            /// Returns context attributes
+            ///
+            ULONG attributes() const noexcept { return m_attrib; }
+
+            ///
+            /// Returns context expiration time
+            ///
+            TimeStamp expires() const noexcept { return m_expires; }
+
+            ///
+            /// Returns timing of legs processed so far
+            ///
+            const std::vector<leg>& legs() const noexcept { return m_legs; }
+
+        protected:
+            friend class sspi_acceptor;
+
+            std::vector<unsigned char> m_token; ///< Output token buffer
+            size_t m_token_size;                ///< Output token size
+            size_t m_extra;                     ///< Unconsumed input size
+            CtxtHandle m_context;               ///< Security context
+            bool m_has_context;                 ///< Is m_context valid?
+            state m_state;                      ///< Handshake state
+            SECURITY_STATUS m_status;           ///< Last status
+            ULONG m_attrib;                     ///< Context attributes
+            TimeStamp m_expires;                ///< Context expiration
+            std::vector<leg> m_legs;            ///< Leg timings
+        };
+
+        ///
+        /// Returns a slot to the acceptor on destruction
+        ///
+        struct slot_releaser
+        {
+            sspi_acceptor* acceptor; ///< Owning acceptor
+
+            ///
+            /// Returns slot to the pool
+            ///
+            void operator()(_In_ slot* s) const noexcept { acceptor->release(s); }
+        };
+
+        typedef std::unique_ptr<slot, slot_releaser> slot_ptr; ///< Acquired slot
+
+        ///
+        /// Handshake statistics
+        ///
+        struct stats
+        {
+            uint64_t completed;     ///< Number of completed handshakes
+            uint64_t failed;        ///< Number of failed handshakes
+            uint64_t legs;          ///< Number of legs processed
+            uint64_t total_ns;      ///< Total time spent in legs in nanoseconds
+        };
+
+        ///
+        /// Constructs an acceptor
+        ///
+        /// \param[in] credentials  Server credentials. Must outlive the acceptor.
+        /// \param[in] context_req  `ASC_REQ_*` flags. `ASC_REQ_ALLOCATE_MEMORY` is ignored.
+        /// \param[in] max_token    Output token buffer size in bytes; see max_token()
+        /// \param[in] max_idle     Maximum number of released slots kept for reuse
+        ///
+        sspi_acceptor(_In_ PCredHandle credentials, _In_ ULONG context_req, _In_ size_t max_token, _In_ size_t max_idle = 64) :
+            m_credentials(credentials),
+            m_context_req(context_req & ~static_cast<ULONG>(ASC_REQ_ALLOCATE_MEMORY)),
+            m_max_token(max_token),
+            m_max_idle(max_idle),
+            m_completed(0),
+            m_failed(0),
+            m_legs(0),
+            m_total_ns(0)
+        {}
+
+        ///
+        /// Destroys the acceptor. All slots must be released first.
+        ///
+        virtual ~sspi_acceptor() {}
+
+        ///
+        /// Returns maximum token size of a security package
+        ///
+        /// \param[in] package  Package name, e.g. `NEGOSSP_NAME`
+        ///
+        /// \sa [QuerySecurityPackageInfo function](https://learn.microsoft.com/en-us/windows/win32/api/sspi/nf-sspi-querysecuritypackageinfow)
+        ///
+        static size_t max_token(_In_z_ LPTSTR package)
+        {
+            PSecPkgInfo info;
+            SECURITY_STATUS status = QuerySecurityPackageInfo(package, &info);
+            if (FAILED(status))
+                throw sec_runtime_error(status, "QuerySecurityPackageInfo failed");
+            size_t size = info->cbMaxToken;
+            FreeContextBuffer(info);
+            return size;
+        }
+
+        ///
+        /// Acquires a slot for a new connection
+        ///
+        slot_ptr acquire()
+        {
+            {
+                std::lock_guard<std::mutex> lock(m_lock);
+                if (!m_idle.empty()) {
+                    slot* s = m_idle.back().release();
+                    m_idle.pop_back();
+                    return slot_ptr(s, slot_releaser{ this });
+                }
+            }
+            return slot_ptr(new slot(m_max_token), slot_releaser{ this });
+        }
+
+        ///
+        /// Processes a token received from the client
+        ///
+        /// \param[inout] s     Slot
+        /// \param[in   ] data  Input token
+        /// \param[in   ] size  Input token size in bytes
+        ///
+        /// \return Status of the leg. The slot state tells what to do next.
+        ///
+        SECURITY_STATUS step(_Inout_ slot& s, _In_reads_bytes_(size) const void* data, _In_ size_t size)
+        {
+            if (s.m_state == state::complete || s.m_state == state::failed)
+                return s.m_status;
+            if (size > ULONG_MAX)
+                return s.m_status = SEC_E_INVALID_TOKEN;
+
+            SecBuffer in[2] = {
+                { static_cast<ULONG>(size), SECBUFFER_TOKEN, const_cast<void*>(data) },
+                { 0, SECBUFFER_EMPTY, NULL } };
+            SecBufferDesc in_desc = { SECBUFFER_VERSION, _countof(in), in };
+            SecBuffer out = { static_cast<ULONG>(s.m_token.size()), SECBUFFER_TOKEN, s.m_token.data() };
+            SecBufferDesc out_desc = { SECBUFFER_VERSION, 1, &out };
+
+            const auto start = std::chrono::steady_clock::now();
+            SECURITY_STATUS status = accept(m_credentials, s.m_has_context ? &s.m_context : NULL, &in_desc, m_context_req, &s.m_context, &out_desc, &s.m_attrib, &s.m_expires);
+            // The context exists as soon as AcceptSecurityContext succeeds, even if completing the token fails.
+            if (!FAILED(status))
+                s.m_has_context = true;
+            if (status == SEC_I_COMPLETE_NEEDED || status == SEC_I_COMPLETE_AND_CONTINUE) {
+                const SECURITY_STATUS status_complete = complete_token(&s.m_context, &out_desc);
+                status = FAILED(status_complete) ? status_complete : status == SEC_I_COMPLETE_NEEDED ? SEC_E_OK : SEC_I_CONTINUE_NEEDED;
+            }
+            const uint64_t duration = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+
+            s.m_status = status;
+            s.m_legs.push_back({ status, duration });
+            m_legs.fetch_add(1, std::memory_order_relaxed);
+            m_total_ns.fetch_add(duration, std::memory_order_relaxed);
+            s.m_extra = in[1].BufferType == SECBUFFER_EXTRA ? in[1].cbBuffer : 0;
+            if (status == SEC_E_INCOMPLETE_MESSAGE) {
+                s.m_token_size = 0;
+                s.m_state = state::incomplete;
+                return status;
+            }
+            s.m_token_size = out.BufferType == SECBUFFER_TOKEN ? out.cbBuffer : 0;
+            if (status == SEC_E_OK) {
+                s.m_state = state::complete;
+                m_completed.fetch_add(1, std::memory_order_relaxed);
+            }
+            else if (status == SEC_I_CONTINUE_NEEDED)
+                s.m_state = state::in_progress;
+            else {
+                s.m_state = state::failed;
+                m_failed.fetch_add(1, std::memory_order_relaxed);
+            }
+            return status;
+        }
+
+        ///
+        /// Returns handshake statistics
+        ///
+        stats get_stats() const noexcept
+        {
+            return {
+                m_completed.load(std::memory_order_relaxed),
+                m_failed.load(std::memory_order_relaxed),
+                m_legs.load(std::memory_order_relaxed),
+                m_total_ns.load(std::memory_order_relaxed) };
+        }
+
+        ///
+        /// Returns number of idle slots
+        ///
+        size_t idle() const
+        {
+            std::lock_guard<std::mutex> lock(m_lock);
+            return m_idle.size();
+        }
+
+    protected:
+        ///
+        /// Returns a slot to the pool
+        ///
+        /// \param[in] s  Slot
+        ///
+        void release(_In_ slot* s) noexcept
+        {
+            if (s->m_has_context) {
+                delete_context(&s->m_context);
+                s->m_has_context = false;
+            }
+            s->m_context.dwLower = s->m_context.dwUpper = 0;
+            s->m_state = state::idle;
+            s->m_status = SEC_E_OK;
+            s->m_token_size = s->m_extra = 0;
+            s->m_attrib = 0;
+            s->m_expires.QuadPart = -1;
+            s->m_legs.clear();
+            SecureZeroMemory(s->m_token.data(), s->m_token.size());
+            try {
+                std::lock_guard<std::mutex> lock(m_lock);
+                if (m_idle.size() < m_max_idle) {
+                    m_idle.emplace_back(s);
+                    return;
+                }
+            }
+            catch (...) {}
+            delete s;
+        }
+
+        ///
+        /// Accepts a security context
+        ///
+        /// \sa [AcceptSecurityContext function](https://learn.microsoft.com/en-us/windows/win32/api/sspi/nf-sspi-acceptsecuritycontext)
+        ///
+        virtual SECURITY_STATUS accept(
+            _In_opt_    PCredHandle    credentials,
+            _In_opt_    PCtxtHandle    context,
+            _In_opt_    PSecBufferDesc input,
+            _In_        ULONG          context_req,
+            _Inout_opt_ PCtxtHandle    new_context,
+            _Inout_opt_ PSecBufferDesc output,
+            _Out_       PULONG         attrib,
+            _Out_opt_   PTimeStamp     expires)
+        {
+            return AcceptSecurityContext(credentials, context, input, context_req, SECURITY_NATIVE_DREP, new_context, output, attrib, expires);
+        }
+
+        ///
+        /// Completes an authentication token
+        ///
+        /// \sa [CompleteAuthToken function](https://learn.microsoft.com/en-us/windows/win32/api/sspi/nf-sspi-completeauthtoken)
+        ///
+        virtual SECURITY_STATUS complete_token(_In_ PCtxtHandle context, _In_ PSecBufferDesc token)
+        {
+            return CompleteAuthToken(context, token);
+        }
+
+        ///
+        /// Deletes a security context
+        ///
+        /// \sa [DeleteSecurityContext function](https://learn.microsoft.com/en-us/windows/win32/api/sspi/nf-sspi-deletesecuritycontext)
+        ///
+        virtual void delete_context(_In_ PCtxtHandle context) noexcept
+        {
+            DeleteSecurityContext(context);
+        }
+
+    protected:
+        PCredHandle m_credentials;                  ///< Server credentials
+        ULONG m_context_req;                        ///< `ASC_REQ_*` flags
+        size_t m_max_token;                         ///< Output token buffer size
+        size_t m_max_idle;                          ///< Maximum number of idle slots
+        mutable std::mutex m_lock;                  ///< Guards m_idle
+        std::vector<std::unique_ptr<slot>> m_idle;  ///< Idle slots
+        std::atomic<uint64_t> m_completed;          ///< Number of completed handshakes
+        std::atomic<uint64_t> m_failed;             ///< Number of failed handshakes
+        std::atomic<uint64_t> m_legs;               ///< Number of legs
+        std::atomic<uint64_t> m_total_ns;           ///< Total leg time in nanoseconds
+    };
+
+    /// @}
+}
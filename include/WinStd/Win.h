@@ -11,8 +11,17 @@
 #include "Common.h"
 #include <AclAPI.h>
 #include <tlhelp32.h>
+#include <winioctl.h>
 #include <winsvc.h>
+#include <winternl.h>
+#include <chrono>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <string_view>
+#include <unordered_map>
 #include <vector>
 
 #pragma warning(push)
@@ -1993,6 +2002,1405 @@ namespace winstd
         }
     };
 
+    ///
+    /// Compiled environment-string template
+    ///
+    /// Keeps the template text with the positions of its `%` characters and the variable name between each adjacent
+    /// pair. Expansion follows `ExpandEnvironmentStrings`: `%NAME%` is replaced when NAME is defined; otherwise the
+    /// opening `%` is kept literally and the closing one may open the next reference.
+    ///
+    class env_template
+    {
+    public:
+        ///
+        /// Compiles a template
+        ///
+        /// \param[in] text  Template text, e.g. `L"%SystemRoot%\\System32"`
+        ///
+        env_template(_In_ std::wstring_view text) : m_text(text)
+        {
+            for (size_t i = 0; i < m_text.size(); ++i)
+                if (m_text[i] == L'%')
+                    m_percent.push_back(i);
+            if (m_percent.size() >= 2) {
+                m_names.reserve(m_percent.size() - 1);
+                for (size_t i = 0; i + 1 < m_percent.size(); ++i)
+                    m_names.emplace_back(m_text, m_percent[i] + 1, m_percent[i + 1] - m_percent[i] - 1);
+            }
+        }
+
+        ///
+        /// Returns template text
+        ///
+        const std::wstring& text() const noexcept { return m_text; }
+
+        ///
+        /// Returns `true` if the template has no variable references
+        ///
+        bool is_literal() const noexcept { return m_names.empty(); }
+
+        ///
+        /// Expands template into a buffer
+        ///
+        /// \param[in]  lookup  Function returning `const std::wstring*` value of a variable name, or `NULL` if undefined
+        /// \param[out] buf     Output buffer; always zero-terminated when `count` is not zero
+        /// \param[in]  count   Output buffer size in characters
+        ///
+        /// \return Number of characters required including the zero terminator. When greater than `count`, the output
+        ///         was truncated.
+        ///
+        template <class _Lookup>
+        size_t expand(_In_ _Lookup&& lookup, _Out_writes_opt_(count) wchar_t* buf, _In_ size_t count) const
+        {
+            size_t length = 0;
+            auto emit = [&](_In_reads_(n) const wchar_t* s, _In_ size_t n)
+            {
+                if (length + 1 < count)
+                    memcpy(buf + length, s, (std::min)(n, count - 1 - length) * sizeof(wchar_t));
+                length += n;
+            };
+            size_t pos = 0;
+            for (size_t i = 0; i + 1 < m_percent.size();) {
+                const size_t p = m_percent[i], q = m_percent[i + 1];
+                emit(m_text.data() + pos, p - pos);
+                const std::wstring* value = m_names[i].empty() ? NULL : lookup(m_names[i]);
+                if (value) {
+                    emit(value->data(), value->size());
+                    pos = q + 1;
+                    i += 2;
+                }
+                else {
+                    emit(m_text.data() + p, q - p);
+                    pos = q;
+                    ++i;
+                }
+            }
+            emit(m_text.data() + pos, m_text.size() - pos);
+            if (count)
+                buf[(std::min)(length, count - 1)] = 0;
+            return length + 1;
+        }
+
+    protected:
+        std::wstring m_text;                ///< Template text
+        std::vector<size_t> m_percent;      ///< Positions of `%`
+        std::vector<std::wstring> m_names;  ///< Text between adjacent `%` pairs
+    };
+
+    ///
+    /// Cached environment-string expander
+    ///
+    /// Compiles each distinct template once and expands it against a snapshot of the environment block held in a
+    /// case-insensitive hash map. The snapshot is retaken after `refresh()` or a `WM_SETTINGCHANGE` "Environment"
+    /// broadcast passed to `on_setting_change()`.
+    ///
+    /// The default snapshot is the process environment, which `WM_SETTINGCHANGE` does not update. Override
+    /// `snapshot()` to read another environment, e.g. one built by `CreateEnvironmentBlock`.
+    ///
+    class env_expander
+    {
+        WINSTD_NONCOPYABLE(env_expander)
+        WINSTD_NONMOVABLE(env_expander)
+
+    public:
+        ///
+        /// Variable name to value map
+        ///
+        typedef std::unordered_map<std::wstring, std::wstring, ordinal_icase_hash<>, ordinal_icase_equal_to<>> env_map;
+
+        ///
+        /// Constructs an expander
+        ///
+        /// \param[in] max_templates  Number of cached templates; the cache is emptied when exceeded
+        ///
+        env_expander(_In_ size_t max_templates = 4096) :
+            m_max_templates(max_templates),
+            m_stale(true)
+        {}
+
+        ///
+        /// Destructs the expander
+        ///
+        virtual ~env_expander()
+        {}
+
+        ///
+        /// Expands environment-variable strings into a buffer
+        ///
+        /// \param[in]  src    Template
+        /// \param[out] buf    Output buffer; always zero-terminated when `count` is not zero
+        /// \param[in]  count  Output buffer size in characters
+        ///
+        /// \return Number of characters required including the zero terminator, as `ExpandEnvironmentStrings`
+        ///
+        size_t expand(_In_ std::wstring_view src, _Out_writes_opt_(count) wchar_t* buf, _In_ size_t count)
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            return get(src).expand(lookup{ m_env }, buf, count);
+        }
+
+        ///
+        /// Expands environment-variable strings into a string
+        ///
+        /// \param[in]  src    Template
+        /// \param[out] value  Expanded string
+        ///
+        template<class _Traits, class _Ax>
+        void expand(_In_ std::wstring_view src, _Out_ std::basic_string<wchar_t, _Traits, _Ax>& value)
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            const env_template& t = get(src);
+            value.resize(t.expand(lookup{ m_env }, NULL, 0) - 1);
+            t.expand(lookup{ m_env }, &value[0], value.size() + 1);
+        }
+
+        ///
+        /// Marks the environment snapshot stale
+        ///
+        void refresh()
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stale = true;
+        }
+
+        ///
+        /// Refreshes the snapshot on environment change broadcast
+        ///
+        /// Call from the window procedure of a top-level window.
+        ///
+        /// \param[in] msg     Window message
+        /// \param[in] lParam  Message parameter
+        ///
+        /// \return `true` if the snapshot was marked stale
+        ///
+        bool on_setting_change(_In_ UINT msg, _In_ LPARAM lParam)
+        {
+            if (msg != WM_SETTINGCHANGE || !lParam || wcscmp(reinterpret_cast<LPCWSTR>(lParam), L"Environment") != 0)
+                return false;
+            refresh();
+            return true;
+        }
+
+    protected:
+        ///
+        /// Takes an environment snapshot
+        ///
+        /// \param[out] env  Variables
+        ///
+        /// \sa [GetEnvironmentStringsW function](https://learn.microsoft.com/en-us/windows/win32/api/processenv/nf-processenv-getenvironmentstringsw)
+        ///
+        virtual void snapshot(_Out_ env_map& env)
+        {
+            std::unique_ptr<wchar_t, FreeEnvironmentStringsW_delete> block(GetEnvironmentStringsW());
+            if (!block)
+                throw win_runtime_error("GetEnvironmentStringsW failed");
+            env.clear();
+            for (const wchar_t* p = block.get(); *p;) {
+                const size_t n = wcslen(p);
+                // Per-drive current directories are stored as "=C:=C:\dir": the name may start with '='.
+                const wchar_t* eq = n > 1 ? wmemchr(p + 1, L'=', n - 1) : NULL;
+                if (eq)
+                    env.emplace(std::wstring(p, static_cast<size_t>(eq - p)), std::wstring(eq + 1, p + n));
+                p += n + 1;
+            }
+        }
+
+    protected:
+        /// \cond internal
+        struct FreeEnvironmentStringsW_delete
+        {
+            void operator()(_In_ wchar_t* p) const noexcept { FreeEnvironmentStringsW(p); }
+        };
+
+        const env_template& get(_In_ std::wstring_view src)
+        {
+            if (m_stale) {
+                snapshot(m_env);
+                m_stale = false;
+            }
+            auto t = m_templates.find(src);
+            if (t == m_templates.end()) {
+                if (m_templates.size() >= m_max_templates)
+                    m_templates.clear();
+                std::unique_ptr<env_template> compiled(new env_template(src));
+                const std::wstring_view key = compiled->text();
+                t = m_templates.emplace(key, std::move(compiled)).first;
+            }
+            return *t->second;
+        }
+
+        struct lookup
+        {
+            const env_map& env;
+
+            const std::wstring* operator()(_In_ const std::wstring& name) const
+            {
+                auto v = env.find(name);
+                return v != env.end() ? &v->second : NULL;
+            }
+        };
+        /// \endcond
+
+    protected:
+        size_t m_max_templates;                                                             ///< Template cache capacity
+        std::mutex m_mutex;                                                                 ///< Protects members below
+        bool m_stale;                                                                       ///< Is the snapshot stale?
+        env_map m_env;                                                                      ///< Environment snapshot
+        std::unordered_map<std::wstring_view, std::unique_ptr<env_template>> m_templates; ///< Compiled templates keyed by their own text
+    };
+
+    /// \cond internal
+    namespace internal {
+        // Leading fields of SYSTEM_PROCESS_INFORMATION as returned by NtQuerySystemInformation(SystemProcessInformation)
+        struct system_process_information
+        {
+            ULONG NextEntryOffset;
+            ULONG NumberOfThreads;
+            LONGLONG WorkingSetPrivateSize;
+            ULONG HardFaultCount;
+            ULONG NumberOfThreadsHighWatermark;
+            ULONGLONG CycleTime;
+            LONGLONG CreateTime;
+            LONGLONG UserTime;
+            LONGLONG KernelTime;
+            struct {
+                USHORT Length;
+                USHORT MaximumLength;
+                PWSTR Buffer;
+            } ImageName;
+            LONG BasePriority;
+            HANDLE UniqueProcessId;
+            HANDLE InheritedFromUniqueProcessId;
+            ULONG HandleCount;
+            ULONG SessionId;
+        };
+    }
+    /// \endcond
+
+    ///
+    /// Indexed snapshot of the system process table
+    ///
+    /// Captures all processes with a single `NtQuerySystemInformation(SystemProcessInformation)` call instead of a
+    /// Toolhelp walk followed by `OpenProcess` per PID. Image names are copied into one arena and the entries are
+    /// indexed by PID, by image name (case-insensitive) and by parent PID. Two snapshots are diffed with a linear merge
+    /// keyed on PID and creation time, so a recycled PID reports as an exit and a start.
+    ///
+    /// The capture buffer is kept between `capture()` calls. `parse()` accepts a buffer captured elsewhere.
+    ///
+    class process_table
+    {
+        WINSTD_NONCOPYABLE(process_table)
+
+    public:
+        ///
+        /// Process entry
+        ///
+        struct entry
+        {
+            DWORD pid;                ///< Process ID
+            DWORD parent;             ///< Parent process ID as recorded at process creation; may since have been reused
+            DWORD session;            ///< Terminal Services session ID
+            DWORD threads;            ///< Number of threads
+            DWORD handles;            ///< Number of open handles
+            LONGLONG create_time;     ///< Creation time in 100-ns units since January 1, 1601 (UTC)
+            std::wstring_view image;  ///< Image file name (e.g. `L"svchost.exe"`); empty for the System Idle Process
+        };
+
+        ///
+        /// Range of entries returned by the secondary indexes
+        ///
+        class range
+        {
+        public:
+            ///
+            /// Constructs a range
+            ///
+            range(_In_ const entry* const* first, _In_ const entry* const* last) noexcept : m_first(first), m_last(last) {}
+
+            const entry* const* begin() const noexcept { return m_first; } ///< Returns first element
+            const entry* const* end() const noexcept { return m_last; }    ///< Returns one past the last element
+            size_t size() const noexcept { return static_cast<size_t>(m_last - m_first); } ///< Returns number of entries
+            bool empty() const noexcept { return m_first == m_last; }      ///< Returns `true` if the range is empty
+
+        protected:
+            const entry* const* m_first; ///< First element
+            const entry* const* m_last;  ///< One past the last element
+        };
+
+    public:
+        ///
+        /// Constructs an empty table
+        ///
+        process_table() noexcept {}
+
+        ///
+        /// Moves a table
+        ///
+        process_table(_Inout_ process_table&& other) noexcept = default;
+
+        ///
+        /// Moves a table
+        ///
+        process_table& operator=(_Inout_ process_table&& other) noexcept = default;
+
+        virtual ~process_table() {}
+
+        ///
+        /// Captures the current system process table
+        ///
+        /// \sa [NtQuerySystemInformation function](https://learn.microsoft.com/en-us/windows/win32/api/winternl/nf-winternl-ntquerysysteminformation)
+        ///
+        void capture()
+        {
+            if (m_buffer.empty())
+                m_buffer.resize(0x40000);
+            for (;;) {
+                ULONG needed = 0;
+                const NTSTATUS status = query(m_buffer.data(), static_cast<ULONG>(m_buffer.size()), needed);
+                if (status >= 0) { // NT_SUCCESS
+                    parse(m_buffer.data(), needed && needed < m_buffer.size() ? needed : m_buffer.size());
+                    return;
+                }
+                if (status != static_cast<NTSTATUS>(0xC0000004L) /*STATUS_INFO_LENGTH_MISMATCH*/ &&
+                    status != static_cast<NTSTATUS>(0xC0000023L) /*STATUS_BUFFER_TOO_SMALL*/)
+                    throw num_runtime_error<NTSTATUS>(status, "NtQuerySystemInformation failed");
+                // Processes may start before the next call. Leave some headroom.
+                m_buffer.resize(std::max<size_t>(static_cast<size_t>(needed) + needed / 8, m_buffer.size() * 2));
+            }
+        }
+
+        ///
+        /// Parses a `SystemProcessInformation` buffer
+        ///
+        /// \param[in] data  Buffer
+        /// \param[in] size  Size of the buffer in bytes
+        ///
+        void parse(_In_reads_bytes_(size) const void* data, _In_ size_t size)
+        {
+            parse(data, size, reinterpret_cast<uintptr_t>(data));
+        }
+
+        ///
+        /// Parses a `SystemProcessInformation` buffer captured at a different address
+        ///
+        /// Image name pointers in the records are interpreted relative to `base`.
+        ///
+        /// \param[in] data  Buffer
+        /// \param[in] size  Size of the buffer in bytes
+        /// \param[in] base  Address of the buffer when it was captured
+        ///
+        void parse(_In_reads_bytes_(size) const void* data, _In_ size_t size, _In_ uintptr_t base)
+        {
+            size_t count = 0, chars = 0;
+            walk(data, size, base, [&](const internal::system_process_information&, const unsigned char*, size_t length) {
+                ++count;
+                chars += length;
+            });
+
+            m_entries.clear();
+            m_entries.reserve(count);
+            m_names.clear();
+            m_names.reserve(chars); // Entries keep views into the arena: it must not reallocate below.
+            walk(data, size, base, [&](const internal::system_process_information& spi, const unsigned char* name, size_t length) {
+                const size_t at = m_names.size();
+                m_names.resize(at + length);
+                if (length)
+                    memcpy(m_names.data() + at, name, length * sizeof(wchar_t));
+                m_entries.push_back(entry{
+                    static_cast<DWORD>(reinterpret_cast<ULONG_PTR>(spi.UniqueProcessId)),
+                    static_cast<DWORD>(reinterpret_cast<ULONG_PTR>(spi.InheritedFromUniqueProcessId)),
+                    spi.SessionId,
+                    spi.NumberOfThreads,
+                    spi.HandleCount,
+                    spi.CreateTime,
+                    std::wstring_view(length ? m_names.data() + at : NULL, length) });
+            });
+
+            std::sort(m_entries.begin(), m_entries.end(), [](_In_ const entry& a, _In_ const entry& b) { return a.pid < b.pid; });
+
+            m_by_image.clear();
+            m_by_image.reserve(m_entries.size());
+            m_by_parent.clear();
+            m_by_parent.reserve(m_entries.size());
+            for (auto& e : m_entries) {
+                m_by_image.push_back(&e);
+                if (e.parent != e.pid)
+                    m_by_parent.push_back(&e);
+            }
+            std::stable_sort(m_by_image.begin(), m_by_image.end(), [](_In_ const entry* a, _In_ const entry* b) { return ordinal_icase_less<>()(a->image, b->image); });
+            std::stable_sort(m_by_parent.begin(), m_by_parent.end(), [](_In_ const entry* a, _In_ const entry* b) { return a->parent < b->parent; });
+        }
+
+        ///
+        /// Returns all entries sorted by PID
+        ///
+        const std::vector<entry>& entries() const noexcept { return m_entries; }
+
+        ///
+        /// Returns number of processes
+        ///
+        size_t size() const noexcept { return m_entries.size(); }
+
+        ///
+        /// Finds process by ID
+        ///
+        /// \param[in] pid  Process ID
+        ///
+        /// \return Process entry; `NULL` if not found
+        ///
+        const entry* find(_In_ DWORD pid) const noexcept
+        {
+            auto e = std::lower_bound(m_entries.begin(), m_entries.end(), pid, [](_In_ const entry& a, _In_ DWORD b) { return a.pid < b; });
+            return e != m_entries.end() && e->pid == pid ? &*e : NULL;
+        }
+
+        ///
+        /// Finds processes by image file name
+        ///
+        /// \param[in] image  Image file name (case-insensitive)
+        ///
+        /// \return Matching entries ordered by PID
+        ///
+        range find_image(_In_ std::wstring_view image) const noexcept
+        {
+            struct less {
+                bool operator()(_In_ const entry* a, _In_ std::wstring_view b) const noexcept { return ordinal_icase_less<>()(a->image, b); }
+                bool operator()(_In_ std::wstring_view a, _In_ const entry* b) const noexcept { return ordinal_icase_less<>()(a, b->image); }
+            };
+            auto r = std::equal_range(m_by_image.begin(), m_by_image.end(), image, less());
+            return range(m_by_image.data() + (r.first - m_by_image.begin()), m_by_image.data() + (r.second - m_by_image.begin()));
+        }
+
+        ///
+        /// Finds processes by parent process ID
+        ///
+        /// Children of an earlier process with the same ID are included. Use `parent()` to filter them out.
+        ///
+        /// \param[in] pid  Parent process ID
+        ///
+        /// \return Matching entries ordered by PID
+        ///
+        range children(_In_ DWORD pid) const noexcept
+        {
+            struct less {
+                bool operator()(_In_ const entry* a, _In_ DWORD b) const noexcept { return a->parent < b; }
+                bool operator()(_In_ DWORD a, _In_ const entry* b) const noexcept { return a < b->parent; }
+            };
+            auto r = std::equal_range(m_by_parent.begin(), m_by_parent.end(), pid, less());
+            return range(m_by_parent.data() + (r.first - m_by_parent.begin()), m_by_parent.data() + (r.second - m_by_parent.begin()));
+        }
+
+        ///
+        /// Returns parent process entry
+        ///
+        /// \param[in] e  Process entry
+        ///
+        /// \return Parent entry; `NULL` if parent has exited or its ID has been reused by a younger process
+        ///
+        const entry* parent(_In_ const entry& e) const noexcept
+        {
+            if (e.parent == e.pid)
+                return NULL;
+            const entry* p = find(e.parent);
+            return p && p->create_time <= e.create_time ? p : NULL;
+        }
+
+        ///
+        /// Compares two snapshots
+        ///
+        /// \param[in ] before   Earlier snapshot
+        /// \param[in ] after    Later snapshot
+        /// \param[out] started  Receives entries of `after` not present in `before`
+        /// \param[out] exited   Receives entries of `before` not present in `after`
+        ///
+        static void diff(
+            _In_ const process_table& before, _In_ const process_table& after,
+            _Out_ std::vector<const entry*>& started, _Out_ std::vector<const entry*>& exited)
+        {
+            started.clear();
+            exited.clear();
+            auto a = before.m_entries.begin(), a_end = before.m_entries.end();
+            auto b = after.m_entries.begin(), b_end = after.m_entries.end();
+            while (a != a_end && b != b_end) {
+                if (a->pid < b->pid)
+                    exited.push_back(&*a++);
+                else if (b->pid < a->pid)
+                    started.push_back(&*b++);
+                else {
+                    if (a->create_time != b->create_time) {
+                        exited.push_back(&*a);
+                        started.push_back(&*b);
+                    }
+                    ++a, ++b;
+                }
+            }
+            for (; a != a_end; ++a) exited.push_back(&*a);
+            for (; b != b_end; ++b) started.push_back(&*b);
+        }
+
+    protected:
+        ///
+        /// Queries system process information
+        ///
+        /// \param[out] data    Buffer
+        /// \param[in ] size    Size of the buffer in bytes
+        /// \param[out] needed  Bytes written or required
+        ///
+        /// \return NTSTATUS code
+        ///
+        virtual NTSTATUS query(_Out_writes_bytes_to_(size, needed) void* data, _In_ ULONG size, _Out_ ULONG& needed)
+        {
+            typedef NTSTATUS(NTAPI* NtQuerySystemInformation_t)(_In_ SYSTEM_INFORMATION_CLASS, _Out_writes_bytes_opt_(size) PVOID, _In_ ULONG size, _Out_opt_ PULONG);
+            static const NtQuerySystemInformation_t pfn = reinterpret_cast<NtQuerySystemInformation_t>(GetProcAddress(GetModuleHandleW(L"ntdll.dll"), "NtQuerySystemInformation"));
+            if (!pfn)
+                throw win_runtime_error("GetProcAddress failed");
+            return pfn(SystemProcessInformation, data, size, &needed);
+        }
+
+        /// \cond internal
+        template <class _Fn>
+        static void walk(_In_reads_bytes_(size) const void* data, _In_ size_t size, _In_ uintptr_t base, _In_ _Fn&& fn)
+        {
+            const unsigned char* p = static_cast<const unsigned char*>(data);
+            for (size_t offset = 0; size;) {
+                if (size - offset < sizeof(internal::system_process_information) ||
+                    reinterpret_cast<uintptr_t>(p + offset) % alignof(internal::system_process_information))
+                    throw std::invalid_argument("truncated or misaligned process record");
+                const auto& spi = *reinterpret_cast<const internal::system_process_information*>(p + offset);
+                const size_t length = spi.ImageName.Length;
+                const unsigned char* name = NULL;
+                if (length) {
+                    const uintptr_t at = reinterpret_cast<uintptr_t>(spi.ImageName.Buffer) - base;
+                    if (length % sizeof(wchar_t) || at > size || length > size - at)
+                        throw std::invalid_argument("process image name out of bounds");
+                    name = p + at;
+                }
+                fn(spi, name, length / sizeof(wchar_t));
+                if (!spi.NextEntryOffset)
+                    break;
+                if (spi.NextEntryOffset > size - offset)
+                    throw std::invalid_argument("process record offset out of bounds");
+                offset += spi.NextEntryOffset;
+            }
+        }
+        /// \endcond
+
+    protected:
+        std::vector<unsigned char> m_buffer;  ///< Capture buffer
+        std::vector<wchar_t> m_names;         ///< Image name arena
+        std::vector<entry> m_entries;         ///< Entries sorted by PID
+        std::vector<const entry*> m_by_image; ///< Entries sorted by image name
+        std::vector<const entry*> m_by_parent; ///< Entries sorted by parent PID
+    };
+
+    ///
+    /// File copy tuning
+    ///
+    struct file_copy_options
+    {
+        size_t chunk_size = 0x100000; ///< Bytes per read and write; must be a multiple of the volume sector size
+        size_t queue_depth = 8;       ///< Number of buffers in flight
+        size_t ranges = 1;            ///< Number of file ranges copied concurrently
+        bool preallocate = true;      ///< Extend destination to full size before writing; NTFS completes file-extending writes synchronously
+        bool valid_data = false;      ///< Also skip zero-filling with `SetFileValidData`; requires `SE_MANAGE_VOLUME_NAME` enabled
+    };
+
+    ///
+    /// Unbuffered overlapped file copy engine
+    ///
+    /// Opens both files with `FILE_FLAG_NO_BUFFERING | FILE_FLAG_OVERLAPPED` and keeps up to `queue_depth` sector
+    /// aligned buffers in flight on one I/O completion port. Each buffer cycles between reading a chunk and writing it
+    /// back at the same offset. The file may be split into `ranges` contiguous ranges; free buffers pick the next chunk
+    /// from the ranges in turn, so the ranges advance concurrently. The final partial chunk is written rounded up to a
+    /// whole sector and the destination is truncated to the source size afterwards.
+    ///
+    /// With `preallocate` the destination is extended to its final size up front. Otherwise every write extends the file,
+    /// and NTFS completes such writes synchronously, which keeps the queue depth at one.
+    ///
+    /// When a copy fails, the destination is truncated to zero length, so clusters exposed by `valid_data` are not left
+    /// readable.
+    ///
+    /// I/O is issued through virtual methods, so the scheduling can be driven by other I/O back-ends or fakes.
+    ///
+    class file_copier
+    {
+        WINSTD_NONCOPYABLE(file_copier)
+        WINSTD_NONMOVABLE(file_copier)
+
+    public:
+        ///
+        /// Copy statistics
+        ///
+        struct stats
+        {
+            uint64_t bytes;         ///< Bytes copied
+            uint64_t reads;         ///< Reads completed
+            uint64_t writes;        ///< Writes completed
+            uint64_t depth_sum;     ///< Sum of the number of requests in flight sampled at each completion
+            size_t max_depth;       ///< Maximum number of requests in flight
+            std::chrono::steady_clock::duration elapsed; ///< Time spent copying
+
+            ///
+            /// Returns throughput in bytes per second
+            ///
+            double throughput() const noexcept
+            {
+                const double s = std::chrono::duration<double>(elapsed).count();
+                return s > 0 ? bytes / s : 0;
+            }
+
+            ///
+            /// Returns average number of requests in flight
+            ///
+            double queue_depth() const noexcept
+            {
+                return reads + writes ? static_cast<double>(depth_sum) / (reads + writes) : 0;
+            }
+        };
+
+    protected:
+        ///
+        /// I/O request
+        ///
+        struct request
+        {
+            OVERLAPPED overlapped;  ///< Must be the first member: completions map back to the request by address
+            unsigned char* data;    ///< Sector-aligned buffer of `chunk_size` bytes
+            ULONGLONG offset;       ///< File offset
+            DWORD size;             ///< Bytes to transfer; a multiple of the sector size
+            DWORD length;           ///< Bytes of file data in the buffer
+            bool writing;           ///< Is request writing?
+        };
+
+    public:
+        ///
+        /// Constructs a copier
+        ///
+        /// \param[in] options  Tuning options
+        ///
+        file_copier(_In_ const file_copy_options& options = file_copy_options()) :
+            m_options(options),
+            m_stats{},
+            m_next_range(0)
+        {
+            if (!m_options.chunk_size || m_options.chunk_size > MAXDWORD || !m_options.queue_depth || !m_options.ranges ||
+                m_options.queue_depth > SIZE_MAX / m_options.chunk_size)
+                throw std::invalid_argument("invalid file copy options");
+        }
+
+        virtual ~file_copier() {}
+
+        ///
+        /// Copies a file
+        ///
+        /// The destination is created or overwritten. Attributes, timestamps and alternate streams are not copied.
+        ///
+        /// \param[in] source       Source file name
+        /// \param[in] destination  Destination file name
+        ///
+        void copy(_In_z_ LPCWSTR source, _In_z_ LPCWSTR destination)
+        {
+            const auto start = std::chrono::steady_clock::now();
+            size_t in_flight = 0;
+            try {
+                DWORD sector;
+                const ULONGLONG size = open(source, destination, sector);
+                if (!sector || m_options.chunk_size % sector)
+                    throw std::invalid_argument("chunk size is not a multiple of the sector size");
+                const ULONGLONG chunk = m_options.chunk_size;
+                const ULONGLONG chunks = (size + chunk - 1) / chunk;
+                if (m_options.preallocate && size)
+                    preallocate((size + sector - 1) / sector * sector);
+
+                // Split chunks into contiguous ranges.
+                const size_t range_count = static_cast<size_t>(std::min<ULONGLONG>(m_options.ranges, std::max<ULONGLONG>(chunks, 1)));
+                m_ranges.resize(range_count);
+                for (size_t i = 0; i < range_count; ++i) {
+                    m_ranges[i].first = chunks * i / range_count * chunk;
+                    m_ranges[i].second = chunks * (i + 1) / range_count * chunk;
+                }
+                m_next_range = 0;
+
+                // Reuse buffers of earlier copies when large enough.
+                const size_t depth = static_cast<size_t>(std::min<ULONGLONG>(m_options.queue_depth, chunks));
+                if (m_requests.size() < depth) {
+                    if (!m_buffers.alloc(GetCurrentProcess(), NULL, depth * m_options.chunk_size, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE))
+                        throw win_runtime_error("VirtualAllocEx failed");
+                    m_requests.resize(depth);
+                    for (size_t i = 0; i < depth; ++i)
+                        m_requests[i].data = static_cast<unsigned char*>(static_cast<LPVOID>(m_buffers)) + i * m_options.chunk_size;
+                }
+
+                for (size_t i = 0; i < depth; ++i)
+                    if (next(m_requests[i]))
+                        ++in_flight;
+                while (in_flight) {
+                    DWORD bytes, error;
+                    request& r = wait(bytes, error);
+                    m_stats.depth_sum += in_flight;
+                    if (m_stats.max_depth < in_flight)
+                        m_stats.max_depth = in_flight;
+                    --in_flight;
+                    if (!r.writing) {
+                        ++m_stats.reads;
+                        if (error == ERROR_HANDLE_EOF)
+                            bytes = 0;
+                        else if (error != ERROR_SUCCESS)
+                            throw win_runtime_error(error, "ReadFile failed");
+                        if (bytes) {
+                            // Write whole sectors: pad the tail of the final chunk with zeros.
+                            r.length = bytes;
+                            r.size = (bytes + sector - 1) / sector * sector;
+                            memset(r.data + bytes, 0, r.size - bytes);
+                            r.writing = true;
+                            write(r);
+                            ++in_flight;
+                            continue;
+                        }
+                    }
+                    else {
+                        if (error != ERROR_SUCCESS)
+                            throw win_runtime_error(error, "WriteFile failed");
+                        ++m_stats.writes;
+                        m_stats.bytes += r.length;
+                    }
+                    if (next(r))
+                        ++in_flight;
+                }
+                finish(size);
+            }
+            catch (...) {
+                // Buffers must not be reused while I/O is still pending.
+                cancel();
+                try {
+                    for (; in_flight; --in_flight) {
+                        DWORD bytes, error;
+                        wait(bytes, error);
+                    }
+                }
+                catch (...) {}
+                discard();
+                close();
+                throw;
+            }
+            m_stats.elapsed += std::chrono::steady_clock::now() - start;
+        }
+
+        ///
+        /// Returns cumulative statistics
+        ///
+        stats get_stats() const noexcept
+        {
+            return m_stats;
+        }
+
+    protected:
+        ///
+        /// Opens source and destination files
+        ///
+        /// \param[in ] source       Source file name
+        /// \param[in ] destination  Destination file name
+        /// \param[out] sector       Transfer alignment in bytes
+        ///
+        /// \return Source file size in bytes
+        ///
+        /// \sa [CreateFileW function](https://learn.microsoft.com/en-us/windows/win32/api/fileapi/nf-fileapi-createfilew)
+        /// \sa [CreateIoCompletionPort function](https://learn.microsoft.com/en-us/windows/win32/fileio/createiocompletionport)
+        ///
+        virtual ULONGLONG open(_In_z_ LPCWSTR source, _In_z_ LPCWSTR destination, _Out_ DWORD& sector)
+        {
+            close();
+            m_source.attach(CreateFileW(source, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_NO_BUFFERING | FILE_FLAG_OVERLAPPED, NULL));
+            if (!m_source)
+                throw win_runtime_error("CreateFileW failed");
+            LARGE_INTEGER size;
+            if (!GetFileSizeEx(m_source, &size))
+                throw win_runtime_error("GetFileSizeEx failed");
+            m_destination.attach(CreateFileW(destination, GENERIC_READ | GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_FLAG_NO_BUFFERING | FILE_FLAG_OVERLAPPED, NULL));
+            if (!m_destination)
+                throw win_runtime_error("CreateFileW failed");
+            m_port.attach(CreateIoCompletionPort(m_source, NULL, 0, 1));
+            if (!m_port)
+                throw win_runtime_error("CreateIoCompletionPort failed");
+            if (!CreateIoCompletionPort(m_destination, m_port, 0, 0))
+                throw win_runtime_error("CreateIoCompletionPort failed");
+
+            sector = 0;
+            for (HANDLE h : { (HANDLE)m_source, (HANDLE)m_destination }) {
+                FILE_STORAGE_INFO info;
+                const DWORD s = GetFileInformationByHandleEx(h, FileStorageInfo, &info, sizeof(info)) ? info.PhysicalBytesPerSectorForPerformance : 4096;
+                if (sector < s)
+                    sector = s;
+            }
+            return size.QuadPart;
+        }
+
+        ///
+        /// Extends destination to full size
+        ///
+        /// Writes within the end of file are not file-extending and complete asynchronously. Writes past the valid data
+        /// length still make NTFS zero-fill the gap first, unless `valid_data` is set. `SetFileValidData` requires the
+        /// `SE_MANAGE_VOLUME_NAME` privilege to be enabled.
+        ///
+        /// \param[in] size  Destination size in bytes; a multiple of the sector size
+        ///
+        /// \sa [SetFileInformationByHandle function](https://learn.microsoft.com/en-us/windows/win32/api/fileapi/nf-fileapi-setfileinformationbyhandle)
+        /// \sa [SetFileValidData function](https://learn.microsoft.com/en-us/windows/win32/api/fileapi/nf-fileapi-setfilevaliddata)
+        ///
+        virtual void preallocate(_In_ ULONGLONG size)
+        {
+            FILE_END_OF_FILE_INFO info;
+            info.EndOfFile.QuadPart = size;
+            if (!SetFileInformationByHandle(m_destination, FileEndOfFileInfo, &info, sizeof(info)))
+                throw win_runtime_error("SetFileInformationByHandle failed");
+            if (m_options.valid_data && !SetFileValidData(m_destination, static_cast<LONGLONG>(size)))
+                throw win_runtime_error("SetFileValidData failed");
+        }
+
+        ///
+        /// Starts reading a chunk
+        ///
+        /// \param[in] r  Request with `offset`, `data` and `size` set
+        ///
+        /// \return `true` if a completion will be reported by `wait()`; `false` if the offset is past the end of file
+        ///
+        virtual bool read(_Inout_ request& r)
+        {
+            if (ReadFile(m_source, r.data, r.size, NULL, &r.overlapped))
+                return true;
+            const DWORD error = GetLastError();
+            if (error == ERROR_IO_PENDING)
+                return true;
+            if (error == ERROR_HANDLE_EOF)
+                return false;
+            throw win_runtime_error(error, "ReadFile failed");
+        }
+
+        ///
+        /// Starts writing a chunk
+        ///
+        /// \param[in] r  Request with `offset`, `data` and `size` set
+        ///
+        virtual void write(_Inout_ request& r)
+        {
+            if (!WriteFile(m_destination, r.data, r.size, NULL, &r.overlapped) && GetLastError() != ERROR_IO_PENDING)
+                throw win_runtime_error("WriteFile failed");
+        }
+
+        ///
+        /// Waits for the next completed request
+        ///
+        /// \param[out] bytes  Number of bytes transferred
+        /// \param[out] error  `ERROR_SUCCESS` or the error code of the failed request
+        ///
+        /// \return Completed request
+        ///
+        virtual request& wait(_Out_ DWORD& bytes, _Out_ DWORD& error)
+        {
+            ULONG_PTR key;
+            LPOVERLAPPED overlapped;
+            error = GetQueuedCompletionStatus(m_port, &bytes, &key, &overlapped, INFINITE) ? ERROR_SUCCESS : GetLastError();
+            if (!overlapped)
+                throw win_runtime_error(error, "GetQueuedCompletionStatus failed");
+            return *reinterpret_cast<request*>(overlapped);
+        }
+
+        ///
+        /// Sets destination size and closes files
+        ///
+        /// \param[in] size  Destination size in bytes
+        ///
+        virtual void finish(_In_ ULONGLONG size)
+        {
+            FILE_END_OF_FILE_INFO info;
+            info.EndOfFile.QuadPart = size;
+            if (!SetFileInformationByHandle(m_destination, FileEndOfFileInfo, &info, sizeof(info)))
+                throw win_runtime_error("SetFileInformationByHandle failed");
+            close();
+        }
+
+        ///
+        /// Truncates destination of a failed copy to zero length
+        ///
+        virtual void discard() noexcept
+        {
+            if (m_destination) {
+                FILE_END_OF_FILE_INFO info = {};
+                SetFileInformationByHandle(m_destination, FileEndOfFileInfo, &info, sizeof(info));
+            }
+        }
+
+        ///
+        /// Cancels pending I/O
+        ///
+        {
+            if (m_source)
+                CancelIoEx(m_source, NULL);
+            if (m_destination)
+                CancelIoEx(m_destination, NULL);
+        }
+
+        ///
+        /// Closes files
+        ///
+        virtual void close() noexcept
+        {
+            m_source.free();
+            m_destination.free();
+            m_port.free();
+        }
+
+        /// \cond internal
+        bool next(_Inout_ request& r)
+        {
+            for (size_t i = 0; i < m_ranges.size(); ++i) {
+                auto& range = m_ranges[m_next_range];
+                m_next_range = (m_next_range + 1) % m_ranges.size();
+                while (range.first < range.second) {
+                    memset(&r.overlapped, 0, sizeof(r.overlapped));
+                    r.offset = range.first;
+                    r.overlapped.Offset = static_cast<DWORD>(r.offset);
+                    r.overlapped.OffsetHigh = static_cast<DWORD>(r.offset >> 32);
+                    r.size = static_cast<DWORD>(m_options.chunk_size);
+                    r.length = 0;
+                    r.writing = false;
+                    range.first += m_options.chunk_size;
+                    if (read(r))
+                        return true;
+                    // Source shrank: the rest of this range is gone.
+                    range.first = range.second;
+                }
+            }
+            return false;
+        }
+        /// \endcond
+
+    protected:
+        file_copy_options m_options;                                ///< Tuning options
+        stats m_stats;                                              ///< Cumulative statistics
+        file m_source;                                              ///< Source file
+        file m_destination;                                         ///< Destination file
+        win_handle<NULL> m_port;                                    ///< I/O completion port
+        vmemory m_buffers;                                          ///< Request buffers
+        std::vector<request> m_requests;                            ///< Requests
+        std::vector<std::pair<ULONGLONG, ULONGLONG>> m_ranges;      ///< Remaining [start, end) offsets of each range
+        size_t m_next_range;                                        ///< Range to take the next chunk from
+    };
+
+#if _WIN32_WINNT >= _WIN32_WINNT_WIN8
+
+    ///
+    /// File identifier reported by the change journal
+    ///
+    /// 64-bit file reference numbers of `USN_RECORD_V2` are stored in `low` with `high` set to zero.
+    ///
+    struct usn_file_id
+    {
+        ULONGLONG low;  ///< Low 64 bits
+        ULONGLONG high; ///< High 64 bits
+
+        ///
+        /// Are file identifiers equal?
+        ///
+        bool operator==(_In_ const usn_file_id& other) const noexcept { return low == other.low && high == other.high; }
+
+        ///
+        /// Are file identifiers different?
+        ///
+        bool operator!=(_In_ const usn_file_id& other) const noexcept { return !operator==(other); }
+    };
+
+    ///
+    /// Hash functor for `usn_file_id`
+    ///
+    struct usn_file_id_hash
+    {
+        ///
+        /// Returns hash of file identifier
+        ///
+        size_t operator()(_In_ const usn_file_id& id) const noexcept
+        {
+            return std::hash<ULONGLONG>()(id.low ^ (id.high * 0x9e3779b97f4a7c15ull));
+        }
+    };
+
+    ///
+    /// Change journal record
+    ///
+    /// `name` refers to the read buffer and is valid until the next read.
+    ///
+    struct usn_record
+    {
+        USN usn;                ///< Update sequence number
+        usn_file_id file_id;    ///< File identifier
+        usn_file_id parent_id;  ///< Parent directory identifier
+        LONGLONG timestamp;     ///< Time of change in 100-ns units since January 1, 1601 (UTC)
+        DWORD reason;           ///< `USN_REASON_*` flags accumulated since the file was opened
+        DWORD attributes;       ///< File attributes
+        std::wstring_view name; ///< File name without path
+    };
+
+    ///
+    /// Zero-copy view of change journal records
+    ///
+    /// Iterates `USN_RECORD_V2` and `USN_RECORD_V3` records and skips records of other versions. Malformed records throw
+    /// `std::invalid_argument`.
+    ///
+    class usn_records
+    {
+    public:
+        ///
+        /// Record iterator
+        ///
+        class iterator
+        {
+        public:
+            typedef std::forward_iterator_tag iterator_category; ///< Iterator category
+            typedef usn_record value_type;                        ///< Value type
+            typedef ptrdiff_t difference_type;                    ///< Difference type
+            typedef const usn_record* pointer;                    ///< Pointer type
+            typedef const usn_record& reference;                  ///< Reference type
+
+            ///
+            /// Constructs an iterator and parses the first record
+            ///
+            /// \param[in] p    First record
+            /// \param[in] end  End of records
+            ///
+            iterator(_In_ const unsigned char* p, _In_ const unsigned char* end) : m_p(p), m_end(end) { parse(); }
+
+            reference operator*() const noexcept { return m_record; }   ///< Returns current record
+            pointer operator->() const noexcept { return &m_record; }   ///< Returns current record
+            bool operator==(_In_ const iterator& other) const noexcept { return m_p == other.m_p; } ///< Are iterators equal?
+            bool operator!=(_In_ const iterator& other) const noexcept { return m_p != other.m_p; } ///< Are iterators different?
+
+            ///
+            /// Advances to the next record
+            ///
+            iterator& operator++()
+            {
+                m_p += m_length;
+                parse();
+                return *this;
+            }
+
+        protected:
+            /// \cond internal
+            void parse()
+            {
+                for (; m_p < m_end; m_p += m_length) {
+                    USN_RECORD_COMMON_HEADER header;
+                    if (static_cast<size_t>(m_end - m_p) < sizeof(header))
+                        throw std::invalid_argument("truncated USN record");
+                    memcpy(&header, m_p, sizeof(header));
+                    if (header.RecordLength < sizeof(header) || header.RecordLength > static_cast<size_t>(m_end - m_p))
+                        throw std::invalid_argument("invalid USN record length");
+                    m_length = header.RecordLength;
+                    DWORD name_offset, name_length;
+                    if (header.MajorVersion == 2) {
+                        USN_RECORD_V2 r;
+                        if (m_length < offsetof(USN_RECORD_V2, FileName))
+                            throw std::invalid_argument("truncated USN record");
+                        memcpy(&r, m_p, offsetof(USN_RECORD_V2, FileName));
+                        m_record.usn = r.Usn;
+                        m_record.file_id = { r.FileReferenceNumber, 0 };
+                        m_record.parent_id = { r.ParentFileReferenceNumber, 0 };
+                        m_record.timestamp = r.TimeStamp.QuadPart;
+                        m_record.reason = r.Reason;
+                        m_record.attributes = r.FileAttributes;
+                        name_offset = r.FileNameOffset;
+                        name_length = r.FileNameLength;
+                    }
+                    else if (header.MajorVersion == 3) {
+                        USN_RECORD_V3 r;
+                        if (m_length < offsetof(USN_RECORD_V3, FileName))
+                            throw std::invalid_argument("truncated USN record");
+                        memcpy(&r, m_p, offsetof(USN_RECORD_V3, FileName));
+                        m_record.usn = r.Usn;
+                        memcpy(&m_record.file_id, &r.FileReferenceNumber, sizeof(m_record.file_id));
+                        memcpy(&m_record.parent_id, &r.ParentFileReferenceNumber, sizeof(m_record.parent_id));
+                        m_record.timestamp = r.TimeStamp.QuadPart;
+                        m_record.reason = r.Reason;
+                        m_record.attributes = r.FileAttributes;
+                        name_offset = r.FileNameOffset;
+                        name_length = r.FileNameLength;
+                    }
+                    else
+                        continue;
+                    if (name_length % sizeof(wchar_t) || name_offset > m_length || name_length > m_length - name_offset)
+                        throw std::invalid_argument("USN record file name out of bounds");
+                    m_record.name = std::wstring_view(reinterpret_cast<const wchar_t*>(m_p + name_offset), name_length / sizeof(wchar_t));
+                    return;
+                }
+                m_p = m_end;
+            }
+            /// \endcond
+
+        protected:
+            const unsigned char* m_p;   ///< Current record
+            const unsigned char* m_end; ///< End of records
+            size_t m_length = 0;        ///< Length of current record
+            usn_record m_record;        ///< Parsed current record
+        };
+
+    public:
+        ///
+        /// Constructs an empty view
+        ///
+        usn_records() noexcept : m_data(NULL), m_size(0) {}
+
+        ///
+        /// Constructs a view
+        ///
+        /// \param[in] data  Records as returned by `FSCTL_READ_USN_JOURNAL` after the leading USN
+        /// \param[in] size  Size of records in bytes
+        ///
+        usn_records(_In_reads_bytes_(size) const void* data, _In_ size_t size) noexcept :
+            m_data(static_cast<const unsigned char*>(data)),
+            m_size(size)
+        {}
+
+        iterator begin() const { return iterator(m_data, m_data + m_size); }          ///< Returns first record
+        iterator end() const { return iterator(m_data + m_size, m_data + m_size); }   ///< Returns end of records
+        bool empty() const noexcept { return !m_size; }                               ///< Are there no records?
+
+    protected:
+        const unsigned char* m_data; ///< Records
+        size_t m_size;               ///< Size of records in bytes
+    };
+
+    ///
+    /// Changes coalesced per file
+    ///
+    /// Reasons of all records of a file are combined and the latest name and parent are kept. The first old name of a
+    /// renamed file is remembered, so the entry at the old path can be removed. Files both created and deleted within
+    /// the set are dropped.
+    ///
+    class usn_change_set
+    {
+    public:
+        ///
+        /// Coalesced change of a file
+        ///
+        struct change
+        {
+            DWORD reason;               ///< Combined `USN_REASON_*` flags
+            DWORD attributes;           ///< Latest file attributes
+            usn_file_id parent_id;      ///< Latest parent directory identifier
+            std::wstring name;          ///< Latest file name
+            usn_file_id old_parent_id;  ///< Parent directory before rename; valid when `reason` has `USN_REASON_RENAME_OLD_NAME`
+            std::wstring old_name;      ///< File name before rename; valid when `reason` has `USN_REASON_RENAME_OLD_NAME`
+            USN usn;                    ///< Latest update sequence number
+            LONGLONG timestamp;         ///< Latest time of change
+        };
+
+        typedef std::unordered_map<usn_file_id, change, usn_file_id_hash> map_type; ///< Changes by file identifier
+
+    public:
+        ///
+        /// Adds a record
+        ///
+        /// \param[in] r  Change journal record
+        ///
+        void add(_In_ const usn_record& r)
+        {
+            auto i = m_changes.find(r.file_id);
+            if (i == m_changes.end())
+                i = m_changes.emplace(r.file_id, change{ 0, r.attributes, r.parent_id, std::wstring(r.name), {}, {}, r.usn, r.timestamp }).first;
+            change& c = i->second;
+            if (r.reason & USN_REASON_RENAME_OLD_NAME) {
+                if (!(c.reason & USN_REASON_RENAME_OLD_NAME)) {
+                    c.old_parent_id = r.parent_id;
+                    c.old_name = r.name;
+                }
+            }
+            else {
+                c.parent_id = r.parent_id;
+                c.name = r.name;
+            }
+            c.reason |= r.reason;
+            c.attributes = r.attributes;
+            c.usn = r.usn;
+            c.timestamp = r.timestamp;
+            if ((c.reason & USN_REASON_FILE_CREATE) && (r.reason & USN_REASON_FILE_DELETE))
+                m_changes.erase(i);
+        }
+
+        ///
+        /// Adds records
+        ///
+        /// \param[in] records  Change journal records
+        ///
+        void add(_In_ const usn_records& records)
+        {
+            for (auto& r : records)
+                add(r);
+        }
+
+        const map_type& changes() const noexcept { return m_changes; } ///< Returns changes by file identifier
+        size_t size() const noexcept { return m_changes.size(); }      ///< Returns number of changed files
+        bool empty() const noexcept { return m_changes.empty(); }      ///< Are there no changes?
+        void clear() noexcept { m_changes.clear(); }                   ///< Removes all changes
+
+    protected:
+        map_type m_changes; ///< Changes by file identifier
+    };
+
+    ///
+    /// Persistent change journal position
+    ///
+    struct usn_cursor
+    {
+        DWORDLONG journal_id; ///< Journal instance; changes when the journal is deleted and recreated
+        USN usn;              ///< Next update sequence number to read
+    };
+
+    ///
+    /// Change journal reader
+    ///
+    /// Reads the journal of a volume in large batches into a reusable buffer. Save `cursor()` after the changes read have
+    /// been processed and pass it to `start()` next time to continue where the reader left off.
+    ///
+    /// \sa [Change Journals](https://learn.microsoft.com/en-us/windows/win32/fileio/change-journals)
+    ///
+    class usn_journal
+    {
+        WINSTD_NONCOPYABLE(usn_journal)
+        WINSTD_NONMOVABLE(usn_journal)
+
+    public:
+        ///
+        /// Constructs a reader
+        ///
+        /// \param[in] volume       Volume handle, e.g. opened as `\\.\C:` with `GENERIC_READ`
+        /// \param[in] buffer_size  Read buffer size in bytes
+        /// \param[in] reason_mask  `USN_REASON_*` flags of records to return
+        ///
+        usn_journal(_In_ HANDLE volume, _In_ size_t buffer_size = 0x100000, _In_ DWORD reason_mask = 0xffffffff) :
+            m_volume(volume),
+            m_buffer((std::max<size_t>(buffer_size, 0x1000) + sizeof(DWORDLONG) - 1) / sizeof(DWORDLONG)),
+            m_reason_mask(reason_mask),
+            m_cursor{}
+        {}
+
+        virtual ~usn_journal() {}
+
+        ///
+        /// Positions the reader
+        ///
+        /// \param[in] from  Saved cursor to continue from; `NULL` to read changes made from now on
+        ///
+        /// \return `false` if `from` can not be continued because the journal was recreated or has been truncated past
+        /// it. The reader is positioned at the end of the journal then and the caller should rescan the volume.
+        ///
+        /// \sa [FSCTL_QUERY_USN_JOURNAL IOCTL](https://learn.microsoft.com/en-us/windows/win32/api/winioctl/ni-winioctl-fsctl_query_usn_journal)
+        ///
+        bool start(_In_opt_ const usn_cursor* from = NULL)
+        {
+            USN_JOURNAL_DATA_V0 data;
+            query(data);
+            m_cursor.journal_id = data.UsnJournalID;
+            if (from && from->journal_id == data.UsnJournalID && data.LowestValidUsn <= from->usn && from->usn <= data.NextUsn) {
+                m_cursor.usn = from->usn;
+                return true;
+            }
+            m_cursor.usn = data.NextUsn;
+            return !from;
+        }
+
+        ///
+        /// Returns current position
+        ///
+        const usn_cursor& cursor() const noexcept { return m_cursor; }
+
+        ///
+        /// Reads a batch of records
+        ///
+        /// \param[out] records  Records read; valid until the next read
+        ///
+        /// \return `true` if records were read; `false` when the end of journal was reached
+        ///
+        /// Throws `win_runtime_error` with `ERROR_JOURNAL_ENTRY_DELETED` when the records at the cursor have been purged.
+        /// Call `start()` and rescan the volume then.
+        ///
+        /// \sa [FSCTL_READ_USN_JOURNAL IOCTL](https://learn.microsoft.com/en-us/windows/win32/api/winioctl/ni-winioctl-fsctl_read_usn_journal)
+        ///
+        bool read(_Out_ usn_records& records)
+        {
+            READ_USN_JOURNAL_DATA_V1 in = {};
+            in.StartUsn = m_cursor.usn;
+            in.ReasonMask = m_reason_mask;
+            in.UsnJournalID = m_cursor.journal_id;
+            in.MinMajorVersion = 2;
+            in.MaxMajorVersion = 3;
+            const DWORD size = static_cast<DWORD>(std::min<size_t>(m_buffer.size() * sizeof(DWORDLONG), MAXDWORD));
+            const DWORD returned = read_journal(in, m_buffer.data(), size);
+            if (returned < sizeof(USN) || returned > size)
+                throw std::invalid_argument("invalid USN journal read size");
+            const USN next = *reinterpret_cast<const USN*>(m_buffer.data());
+            records = usn_records(reinterpret_cast<const unsigned char*>(m_buffer.data()) + sizeof(USN), returned - sizeof(USN));
+            m_cursor.usn = next;
+            return !records.empty();
+        }
+
+        ///
+        /// Reads all available records and coalesces them
+        ///
+        /// \param[inout] changes  Change set to add records to
+        ///
+        /// \return Number of records read
+        ///
+        size_t read(_Inout_ usn_change_set& changes)
+        {
+            size_t count = 0;
+            usn_records records;
+            while (read(records))
+                for (auto& r : records) {
+                    changes.add(r);
+                    ++count;
+                }
+            return count;
+        }
+
+    protected:
+        ///
+        /// Queries journal state
+        ///
+        /// \param[out] data  Journal state
+        ///
+        virtual void query(_Out_ USN_JOURNAL_DATA_V0& data)
+        {
+            DWORD returned;
+            if (!DeviceIoControl(m_volume, FSCTL_QUERY_USN_JOURNAL, NULL, 0, &data, sizeof(data), &returned, NULL))
+                throw win_runtime_error("DeviceIoControl(FSCTL_QUERY_USN_JOURNAL) failed");
+        }
+
+        ///
+        /// Reads journal records
+        ///
+        /// \param[in ] in    Read parameters
+        /// \param[out] data  Buffer receiving the next USN followed by records
+        /// \param[in ] size  Size of the buffer in bytes
+        ///
+        /// \return Number of bytes returned
+        ///
+        virtual DWORD read_journal(_In_ const READ_USN_JOURNAL_DATA_V1& in, _Out_writes_bytes_to_(size, return) void* data, _In_ DWORD size)
+        {
+            DWORD returned;
+            if (!DeviceIoControl(m_volume, FSCTL_READ_USN_JOURNAL, const_cast<READ_USN_JOURNAL_DATA_V1*>(&in), sizeof(in), data, size, &returned, NULL))
+                throw win_runtime_error("DeviceIoControl(FSCTL_READ_USN_JOURNAL) failed");
+            return returned;
+        }
+
+    protected:
+        HANDLE m_volume;                    ///< Volume handle
+        std::vector<DWORDLONG> m_buffer;    ///< Read buffer
+        DWORD m_reason_mask;                ///< Reasons to return
+        usn_cursor m_cursor;                ///< Current position
+    };
+
+#endif
+
     /// @}
 }
 
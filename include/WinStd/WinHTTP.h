@@ -10,7 +10,17 @@
 
 #include "Common.h"
 #include <winhttp.h>
+#include <iphlpapi.h>
+#include <chrono>
+#include <condition_variable>
+#include <exception>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
 #include <string>
+#include <string_view>
+#include <unordered_map>
 
 /// \addtogroup WinStdWinHTTP
 /// @{
@@ -96,5 +106,900 @@ namespace winstd
         }
     };
 
+    ///
+    /// HTTP header field
+    ///
+    struct http_header
+    {
+        std::string_view name;  ///< Field name as received
+        std::string_view value; ///< Field value without surrounding whitespace
+    };
+
+    /// \cond internal
+    namespace internal {
+        struct http_tchar_t
+        {
+            bool tchar[256]; // RFC 9110 token characters
+            constexpr http_tchar_t() : tchar()
+            {
+                for (unsigned int i = '0'; i <= '9'; ++i) tchar[i] = true;
+                for (unsigned int i = 'A'; i <= 'Z'; ++i) tchar[i] = tchar[i + 0x20] = true;
+                for (const char* p = "!#$%&'*+-.^_`|~"; *p; ++p) tchar[static_cast<unsigned char>(*p)] = true;
+            }
+        };
+        inline constexpr http_tchar_t http_tchar{};
+
+        ///
+        /// Returns first control character (< 0x20 or DEL) in range or `end`
+        ///
+        inline const char* http_find_ctl(_In_ const char* p, _In_ const char* end) noexcept
+        {
+#ifdef WINSTD_SIMD_AVX2
+            {
+                const __m256i max_ctl = _mm256_set1_epi8(0x1f), del = _mm256_set1_epi8(0x7f);
+                for (; end - p >= 32; p += 32) {
+                    const __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+                    const unsigned long mask = static_cast<unsigned long>(_mm256_movemask_epi8(_mm256_or_si256(
+                        _mm256_cmpeq_epi8(_mm256_min_epu8(v, max_ctl), v),
+                        _mm256_cmpeq_epi8(v, del))));
+                    if (mask)
+                        return p + lowest_bit(mask);
+                }
+            }
+#endif
+#ifdef WINSTD_SIMD_SSE2
+            {
+                const __m128i max_ctl = _mm_set1_epi8(0x1f), del = _mm_set1_epi8(0x7f);
+                for (; end - p >= 16; p += 16) {
+                    const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+                    const unsigned long mask = static_cast<unsigned long>(_mm_movemask_epi8(_mm_or_si128(
+                        _mm_cmpeq_epi8(_mm_min_epu8(v, max_ctl), v),
+                        _mm_cmpeq_epi8(v, del))));
+                    if (mask)
+                        return p + lowest_bit(mask);
+                }
+            }
+#endif
+            for (; p < end; ++p) {
+                const unsigned char c = static_cast<unsigned char>(*p);
+                if (c < 0x20 || c == 0x7f)
+                    return p;
+            }
+            return end;
+        }
+
+        inline bool http_iequals(_In_ std::string_view a, _In_ std::string_view b) noexcept
+        {
+            if (a.size() != b.size())
+                return false;
+            for (size_t i = 0; i < a.size(); ++i) {
+                char x = a[i], y = b[i];
+                if ('A' <= x && x <= 'Z') x += 'a' - 'A';
+                if ('A' <= y && y <= 'Z') y += 'a' - 'A';
+                if (x != y)
+                    return false;
+            }
+            return true;
+        }
+
+        inline int http_hex_value(_In_ char c) noexcept
+        {
+            if ('0' <= c && c <= '9') return c - '0';
+            if ('a' <= c && c <= 'f') return c - 'a' + 10;
+            if ('A' <= c && c <= 'F') return c - 'A' + 10;
+            return -1;
+        }
+
+        inline std::string_view http_trim(_In_ std::string_view s) noexcept
+        {
+            while (!s.empty() && (s.front() == ' ' || s.front() == '\t')) s.remove_prefix(1);
+            while (!s.empty() && (s.back() == ' ' || s.back() == '\t')) s.remove_suffix(1);
+            return s;
+        }
+    }
+    /// \endcond
+
+    ///
+    /// HTTP parser limits
+    ///
+    struct http_limits
+    {
+        size_t max_head = 0x10000;          ///< Maximum size of status line and headers in bytes
+        size_t max_chunk_ext = 0x400;       ///< Maximum size of chunk extensions per chunk in bytes
+        size_t max_trailers = 0x4000;       ///< Maximum size of trailer section in bytes
+        uint64_t max_body = UINT64_MAX;     ///< Maximum decoded body size in bytes
+    };
+
+    ///
+    /// Incremental HTTP/1.1 response parser
+    ///
+    /// Does not allocate or copy: header names and values are views into the caller's receive buffer and chunked
+    /// bodies are decoded in place. Header and chunk framing is strict (CRLF line endings, no obsolete line folding,
+    /// conflicting `Content-Length` rejected). Malformed input and exceeded limits throw `std::invalid_argument`.
+    ///
+    /// Typical use: call `parse_head()` with the buffer received so far until it returns `true`, then feed remaining
+    /// bytes to `parse_body()` until it returns `true`, or until `finish()` at end of stream for close-delimited bodies.
+    /// Interim 1xx responses have no body: call `reset()` and parse the final response that follows.
+    ///
+    class http_response_parser
+    {
+    public:
+        ///
+        /// Body framing
+        ///
+        enum class framing
+        {
+            none = 0,   ///< No body (HEAD, 1xx, 204, 304)
+            length,     ///< `Content-Length` delimited
+            chunked,    ///< Chunked transfer coding
+            close,      ///< Delimited by connection close
+        };
+
+        ///
+        /// Constructs a parser
+        ///
+        /// \param[in] headers      Array to receive header fields
+        /// \param[in] max_headers  Number of elements in `headers`; more header fields are rejected
+        /// \param[in] l            Limits
+        ///
+        http_response_parser(_Out_writes_(max_headers) http_header* headers, _In_ size_t max_headers, _In_ const http_limits& l = http_limits()) noexcept :
+            m_headers(headers),
+            m_max_headers(max_headers),
+            m_limits(l)
+        {
+            reset();
+        }
+
+        ///
+        /// Prepares parser for next response
+        ///
+        /// \param[in] head_request  Is the response to a HEAD request? Such responses have no body.
+        ///
+        void reset(_In_ bool head_request = false) noexcept
+        {
+            m_head_request = head_request;
+            m_state = state::head;
+            m_scan = 0;
+            m_head_size = 0;
+            m_version = 0;
+            m_status = 0;
+            m_reason = std::string_view();
+            m_header_count = 0;
+            m_framing = framing::none;
+            m_content_length = 0;
+            m_remaining = 0;
+            m_body = 0;
+            m_digits = 0;
+            m_line = 0;
+        }
+
+        /// \name Head
+        /// @{
+
+        ///
+        /// Parses status line and headers
+        ///
+        /// Resumes scanning where the previous call stopped; the buffer may be reallocated between calls as long as
+        /// the bytes already passed are kept at the start of it.
+        ///
+        /// \param[in] data  Response received so far, starting with the status line
+        /// \param[in] size  Number of bytes in `data`
+        ///
+        /// \return `true` when head is complete; `false` when more data is needed
+        ///
+        bool parse_head(_In_reads_(size) const char* data, _In_ size_t size)
+        {
+            assert(m_state == state::head);
+            const size_t limit = (std::min)(size, m_limits.max_head);
+            const char* end = data + limit;
+            for (const char* p = data + m_scan;;) {
+                p = internal::http_find_ctl(p, end);
+                if (p == end) {
+                    if (size >= m_limits.max_head)
+                        throw std::invalid_argument("HTTP head too large");
+                    m_scan = limit;
+                    return false;
+                }
+                if (*p++ == '\n' && p - data >= 4 && memcmp(p - 4, "\r\n\r\n", 4) == 0) {
+                    m_head_size = static_cast<size_t>(p - data);
+                    break;
+                }
+            }
+            parse_lines(data);
+            return true;
+        }
+
+        ///
+        /// Returns size of status line and headers including the terminating empty line
+        ///
+        size_t head_size() const noexcept { return m_head_size; }
+
+        ///
+        /// Returns HTTP minor version (0 for HTTP/1.0, 1 for HTTP/1.1)
+        ///
+        unsigned int version() const noexcept { return m_version; }
+
+        ///
+        /// Returns status code
+        ///
+        unsigned int status() const noexcept { return m_status; }
+
+        ///
+        /// Returns reason phrase
+        ///
+        std::string_view reason() const noexcept { return m_reason; }
+
+        ///
+        /// Returns header fields in order received
+        ///
+        const http_header* headers() const noexcept { return m_headers; }
+
+        ///
+        /// Returns number of header fields
+        ///
+        size_t header_count() const noexcept { return m_header_count; }
+
+        ///
+        /// Finds first header field by name
+        ///
+        /// \param[in] name  Field name; compared case-insensitively
+        ///
+        /// \return Header field or `NULL` if not found
+        ///
+        const http_header* find(_In_ std::string_view name) const noexcept
+        {
+            for (size_t i = 0; i < m_header_count; ++i)
+                if (internal::http_iequals(m_headers[i].name, name))
+                    return &m_headers[i];
+            return NULL;
+        }
+
+        ///
+        /// Returns body framing
+        ///
+        framing body_framing() const noexcept { return m_framing; }
+
+        ///
+        /// Returns `Content-Length` for `framing::length` bodies
+        ///
+        uint64_t content_length() const noexcept { return m_content_length; }
+
+        /// @}
+
+        /// \name Body
+        /// @{
+
+        ///
+        /// Decodes body bytes in place
+        ///
+        /// \param[in,out] data      Bytes following the head. Decoded body is written to the start of it.
+        /// \param[in]     size      Number of bytes in `data`
+        /// \param[out]    consumed  Number of bytes of `data` consumed. When body is complete, the rest belongs to the
+        ///                          next response.
+        /// \param[out]    produced  Number of decoded body bytes written to `data`
+        ///
+        /// \return `true` when body is complete; `false` when more data is needed
+        ///
+        bool parse_body(_Inout_updates_(size) char* data, _In_ size_t size, _Out_ size_t& consumed, _Out_ size_t& produced)
+        {
+            assert(m_state != state::head);
+            consumed = produced = 0;
+            switch (m_state) {
+            case state::done:
+                return true;
+
+            case state::body:
+                if (m_framing == framing::close) {
+                    if (size > m_limits.max_body - m_body)
+                        throw std::invalid_argument("HTTP body too large");
+                    m_body += size;
+                    consumed = produced = size;
+                    return false;
+                }
+                consumed = produced = static_cast<size_t>(std::min<uint64_t>(m_remaining, size));
+                m_remaining -= consumed;
+                m_body += consumed;
+                if (m_remaining)
+                    return false;
+                m_state = state::done;
+                return true;
+
+            default:
+                break;
+            }
+
+            size_t i = 0, o = 0;
+            while (i < size) {
+                const char c = data[i];
+                switch (m_state) {
+                case state::chunk_size: {
+                    const int digit = internal::http_hex_value(c);
+                    if (digit >= 0) {
+                        if (m_digits >= 15)
+                            throw std::invalid_argument("HTTP chunk too large");
+                        m_remaining = (m_remaining << 4) | static_cast<unsigned int>(digit);
+                        ++m_digits;
+                        ++i;
+                        break;
+                    }
+                    if (!m_digits || (c != '\r' && c != ';' && c != ' ' && c != '\t'))
+                        throw std::invalid_argument("invalid HTTP chunk size");
+                    if (m_remaining > m_limits.max_body - m_body)
+                        throw std::invalid_argument("HTTP body too large");
+                    m_line = 0;
+                    m_state = state::chunk_ext;
+                    break;
+                }
+
+                case state::chunk_ext:
+                    ++i;
+                    if (c == '\r')
+                        m_state = state::chunk_size_lf;
+                    else if (++m_line > m_limits.max_chunk_ext || is_ctl(c))
+                        throw std::invalid_argument("invalid HTTP chunk extension");
+                    break;
+
+                case state::chunk_size_lf:
+                    if (c != '\n')
+                        throw std::invalid_argument("invalid HTTP chunk");
+                    ++i;
+                    m_line = 0;
+                    m_state = m_remaining ? state::chunk_data : state::trailer_start;
+                    break;
+
+                case state::chunk_data: {
+                    const size_t n = static_cast<size_t>(std::min<uint64_t>(m_remaining, size - i));
+                    if (o != i)
+                        memmove(data + o, data + i, n);
+                    i += n;
+                    o += n;
+                    m_remaining -= n;
+                    m_body += n;
+                    if (!m_remaining)
+                        m_state = state::chunk_data_cr;
+                    break;
+                }
+
+                case state::chunk_data_cr:
+                    if (c != '\r')
+                        throw std::invalid_argument("invalid HTTP chunk");
+                    ++i;
+                    m_state = state::chunk_data_lf;
+                    break;
+
+                case state::chunk_data_lf:
+                    if (c != '\n')
+                        throw std::invalid_argument("invalid HTTP chunk");
+                    ++i;
+                    m_digits = 0;
+                    m_state = state::chunk_size;
+                    break;
+
+                case state::trailer_start:
+                    if (c == '\r') {
+                        ++i;
+                        m_state = state::trailer_end_lf;
+                    }
+                    else
+                        m_state = state::trailer;
+                    break;
+
+                case state::trailer:
+                    ++i;
+                    if (c == '\r')
+                        m_state = state::trailer_lf;
+                    else if (++m_line > m_limits.max_trailers || is_ctl(c))
+                        throw std::invalid_argument("invalid HTTP trailer");
+                    break;
+
+                case state::trailer_lf:
+                    if (c != '\n')
+                        throw std::invalid_argument("invalid HTTP trailer");
+                    ++i;
+                    m_state = state::trailer_start;
+                    break;
+
+                case state::trailer_end_lf:
+                    if (c != '\n')
+                        throw std::invalid_argument("invalid HTTP trailer");
+                    consumed = i + 1;
+                    produced = o;
+                    m_state = state::done;
+                    return true;
+
+                default:
+                    assert(0);
+                    throw std::logic_error("invalid parser state");
+                }
+            }
+            consumed = i;
+            produced = o;
+            return false;
+        }
+
+        ///
+        /// Signals end of stream
+        ///
+        /// \return `true` if the body is complete; `false` if the response was truncated
+        ///
+        bool finish() noexcept
+        {
+            if (m_state == state::body && m_framing == framing::close)
+                m_state = state::done;
+            return m_state == state::done;
+        }
+
+        ///
+        /// Returns number of decoded body bytes so far
+        ///
+        uint64_t body_size() const noexcept { return m_body; }
+
+        /// @}
+
+    protected:
+        /// \cond internal
+        enum class state
+        {
+            head = 0,
+            body,
+            chunk_size,
+            chunk_ext,
+            chunk_size_lf,
+            chunk_data,
+            chunk_data_cr,
+            chunk_data_lf,
+            trailer_start,
+            trailer,
+            trailer_lf,
+            trailer_end_lf,
+            done,
+        };
+
+        static bool is_ctl(_In_ char c) noexcept
+        {
+            return (static_cast<unsigned char>(c) < 0x20 && c != '\t') || c == 0x7f;
+        }
+
+        void parse_lines(_In_reads_(m_head_size) const char* data)
+        {
+            const char* end = data + m_head_size;
+            bool has_length = false, has_te = false, chunked = false;
+            for (const char* p = data;;) {
+                const char* line = p;
+                for (;; ++p) {
+                    p = internal::http_find_ctl(p, end);
+                    if (*p == '\r' && p[1] == '\n')
+                        break;
+                    if (*p != '\t')
+                        throw std::invalid_argument("invalid character in HTTP head");
+                }
+                const std::string_view text(line, static_cast<size_t>(p - line));
+                p += 2;
+
+                if (line == data) {
+                    parse_status_line(text);
+                    continue;
+                }
+                if (text.empty())
+                    break;
+
+                const size_t colon = text.find(':');
+                if (colon == 0 || colon == std::string_view::npos)
+                    throw std::invalid_argument("invalid HTTP header");
+                const std::string_view name = text.substr(0, colon);
+                for (char c : name)
+                    if (!internal::http_tchar.tchar[static_cast<unsigned char>(c)])
+                        throw std::invalid_argument("invalid HTTP header name");
+                if (m_header_count >= m_max_headers)
+                    throw std::invalid_argument("too many HTTP headers");
+                http_header& h = m_headers[m_header_count++];
+                h.name = name;
+                h.value = internal::http_trim(text.substr(colon + 1));
+
+                if (internal::http_iequals(name, "Content-Length")) {
+                    if (h.value.empty() || h.value.size() > 19)
+                        throw std::invalid_argument("invalid Content-Length");
+                    uint64_t length = 0;
+                    for (char c : h.value) {
+                        if (c < '0' || '9' < c)
+                            throw std::invalid_argument("invalid Content-Length");
+                        length = length * 10 + static_cast<unsigned int>(c - '0');
+                    }
+                    if (has_length && length != m_content_length)
+                        throw std::invalid_argument("conflicting Content-Length");
+                    m_content_length = length;
+                    has_length = true;
+                }
+                else if (internal::http_iequals(name, "Transfer-Encoding")) {
+                    // Only the final coding matters: chunked must be last, anything else is close-delimited.
+                    const size_t comma = h.value.rfind(',');
+                    has_te = true;
+                    chunked = internal::http_iequals(internal::http_trim(comma == std::string_view::npos ? h.value : h.value.substr(comma + 1)), "chunked");
+                }
+            }
+
+            if (m_head_request || m_status < 200 || m_status == 204 || m_status == 304)
+                m_framing = framing::none;
+            else if (has_te)
+                m_framing = chunked ? framing::chunked : framing::close;
+            else if (has_length)
+                m_framing = m_content_length ? framing::length : framing::none;
+            else
+                m_framing = framing::close;
+
+            switch (m_framing) {
+            case framing::none:
+                m_state = state::done;
+                break;
+            case framing::length:
+                if (m_content_length > m_limits.max_body)
+                    throw std::invalid_argument("HTTP body too large");
+                m_remaining = m_content_length;
+                m_state = state::body;
+                break;
+            case framing::chunked:
+                m_state = state::chunk_size;
+                break;
+            default:
+                m_state = state::body;
+            }
+        }
+
+        void parse_status_line(_In_ std::string_view text)
+        {
+            // HTTP/1.x SP 3DIGIT [SP reason]
+            if (text.size() < 12 || text.substr(0, 7) != "HTTP/1." ||
+                text[7] < '0' || '9' < text[7] || text[8] != ' ' ||
+                text[9] < '1' || '9' < text[9] || text[10] < '0' || '9' < text[10] || text[11] < '0' || '9' < text[11] ||
+                (text.size() > 12 && text[12] != ' '))
+                throw std::invalid_argument("invalid HTTP status line");
+            m_version = static_cast<unsigned int>(text[7] - '0');
+            m_status = static_cast<unsigned int>((text[9] - '0') * 100 + (text[10] - '0') * 10 + (text[11] - '0'));
+            m_reason = text.size() > 12 ? text.substr(13) : std::string_view();
+        }
+        /// \endcond
+
+    protected:
+        http_header* m_headers;         ///< Header field array
+        size_t m_max_headers;           ///< Header field array capacity
+        http_limits m_limits;           ///< Limits
+        bool m_head_request;            ///< Is the response to a HEAD request?
+        state m_state;                  ///< Parser state
+        size_t m_scan;                  ///< Head bytes scanned without finding the end
+        size_t m_head_size;             ///< Head size
+        unsigned int m_version;         ///< HTTP minor version
+        unsigned int m_status;          ///< Status code
+        std::string_view m_reason;      ///< Reason phrase
+        size_t m_header_count;          ///< Number of header fields
+        framing m_framing;              ///< Body framing
+        uint64_t m_content_length;      ///< Content-Length
+        uint64_t m_remaining;           ///< Body or chunk bytes remaining
+        uint64_t m_body;                ///< Decoded body bytes
+        unsigned int m_digits;          ///< Chunk size digits parsed
+        size_t m_line;                  ///< Chunk extension or trailer bytes skipped
+    };
+
+    ///
+    /// Proxy decision
+    ///
+    struct proxy_info
+    {
+        DWORD access_type = WINHTTP_ACCESS_TYPE_NO_PROXY;   ///< `WINHTTP_ACCESS_TYPE_NO_PROXY` or `WINHTTP_ACCESS_TYPE_NAMED_PROXY`
+        std::wstring proxy;                                 ///< Proxy list; empty for direct access
+        std::wstring bypass;                                ///< Proxy bypass list
+    };
+
+    ///
+    /// Proxy auto-config resolution cache
+    ///
+    /// Caches `WinHttpGetProxyForUrl` decisions per scheme and host. Concurrent lookups of the same key wait for a
+    /// single resolution. Cached decisions expire after a TTL and are discarded when the IP address table changes.
+    /// When resolution fails, the last known good decision is served and retried after a shorter interval. The least
+    /// recently used entries are evicted when the cache grows beyond its capacity.
+    ///
+    /// Override `resolve()`, `now()` and `network_changed()` to use a different resolver, clock or change source.
+    ///
+    class proxy_resolver_cache
+    {
+        WINSTD_NONCOPYABLE(proxy_resolver_cache)
+        WINSTD_NONMOVABLE(proxy_resolver_cache)
+
+    public:
+        ///
+        /// Cache statistics
+        ///
+        struct stats
+        {
+            uint64_t hits;          ///< Lookups served from cache
+            uint64_t resolutions;   ///< Resolutions performed
+            uint64_t coalesced;     ///< Lookups that waited for another thread's resolution
+            uint64_t fallbacks;     ///< Failed resolutions answered with the last known good decision
+        };
+
+        ///
+        /// Constructs a cache
+        ///
+        /// \param[in] session     WinHTTP session handle used for resolution
+        /// \param[in] pac_url     Proxy auto-config script URL, or `NULL` to use WPAD auto-detection
+        /// \param[in] ttl         Lifetime of resolved decisions
+        /// \param[in] retry       Lifetime of failures and of fallback decisions served after a failure
+        /// \param[in] capacity    Maximum number of cached hosts
+        ///
+        proxy_resolver_cache(
+            _In_ HINTERNET session,
+            _In_opt_z_ LPCWSTR pac_url = NULL,
+            _In_ std::chrono::steady_clock::duration ttl = std::chrono::minutes(5),
+            _In_ std::chrono::steady_clock::duration retry = std::chrono::seconds(30),
+            _In_ size_t capacity = 1024) :
+            m_session(session),
+            m_pac_url(pac_url ? pac_url : L""),
+            m_ttl(ttl),
+            m_retry(retry),
+            m_capacity(capacity),
+            m_generation(0),
+            m_hits(0),
+            m_resolutions(0),
+            m_coalesced(0),
+            m_fallbacks(0),
+            m_notify()
+        {
+            if (!capacity)
+                throw std::invalid_argument("zero capacity");
+        }
+
+        ///
+        /// Stops network change notifications
+        ///
+        virtual ~proxy_resolver_cache()
+        {
+            if (m_notify.hEvent) {
+                CancelIPChangeNotify(&m_notify);
+                CloseHandle(m_notify.hEvent);
+            }
+        }
+
+        ///
+        /// Returns proxy decision
+        ///
+        /// \param[in] scheme  URL scheme, e.g. `L"https"`
+        /// \param[in] host    Host name or IP address; compared case-insensitively. IPv6 addresses may be given with or
+        ///                    without brackets.
+        ///
+        /// \return Proxy decision
+        ///
+        /// \throws Exception thrown by `resolve()` when there is no last known good decision
+        ///
+        proxy_info get(_In_ std::wstring_view scheme, _In_ std::wstring_view host)
+        {
+            std::wstring url;
+            url.reserve(scheme.size() + 3 + host.size() + 3);
+            for (wchar_t c : scheme) url += L'A' <= c && c <= L'Z' ? static_cast<wchar_t>(c + (L'a' - L'A')) : c;
+            url += L"://";
+            const bool ipv6 = host.find(L':') != std::wstring_view::npos && host.front() != L'[';
+            if (ipv6)
+                url += L'[';
+            for (wchar_t c : host) url += L'A' <= c && c <= L'Z' ? static_cast<wchar_t>(c + (L'a' - L'A')) : c;
+            if (ipv6)
+                url += L']';
+            url += L'/';
+
+            std::unique_lock<std::mutex> lock(m_mutex);
+            if (network_changed())
+                ++m_generation;
+            // Holding a reference keeps the entry alive when it is evicted while unlocked.
+            const std::shared_ptr<entry> ptr = lookup(url);
+            entry& e = *ptr;
+            for (bool waited = false;; waited = true) {
+                if (!e.resolving && e.generation == m_generation && now() < e.expires) {
+                    if (waited)
+                        ++m_coalesced;
+                    else
+                        ++m_hits;
+                    if (e.error)
+                        std::rethrow_exception(e.error);
+                    return e.info;
+                }
+                if (!e.resolving)
+                    break;
+                m_cv.wait(lock);
+            }
+            e.resolving = true;
+            const uint64_t generation = m_generation;
+            ++m_resolutions;
+            lock.unlock();
+
+            proxy_info info;
+            std::exception_ptr error;
+            try {
+                info = resolve(url.c_str());
+            }
+            catch (...) {
+                error = std::current_exception();
+            }
+
+            lock.lock();
+            e.resolving = false;
+            e.generation = generation;
+            if (!error) {
+                e.info = std::move(info);
+                e.error = nullptr;
+                e.valid = true;
+                e.expires = now() + m_ttl;
+            }
+            else if (e.valid) {
+                ++m_fallbacks;
+                e.error = nullptr;
+                e.expires = now() + m_retry;
+            }
+            else {
+                e.error = error;
+                e.expires = now() + m_retry;
+            }
+            m_cv.notify_all();
+            if (e.error)
+                std::rethrow_exception(e.error);
+            return e.info;
+        }
+
+        ///
+        /// Expires all cached decisions
+        ///
+        /// Last known good decisions are kept as fallbacks.
+        ///
+        void invalidate()
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            ++m_generation;
+        }
+
+        ///
+        /// Returns cache statistics
+        ///
+        stats get_stats() const
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            return { m_hits, m_resolutions, m_coalesced, m_fallbacks };
+        }
+
+        ///
+        /// Returns number of cached hosts
+        ///
+        size_t size() const
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            return m_entries.size();
+        }
+
+    protected:
+        ///
+        /// Resolves proxy for a URL
+        ///
+        /// Called without the cache lock held.
+        ///
+        /// \param[in] url  URL `scheme://host/` with scheme and host in lowercase
+        ///
+        /// \return Proxy decision
+        ///
+        /// \sa [WinHttpGetProxyForUrl function](https://learn.microsoft.com/en-us/windows/win32/api/winhttp/nf-winhttp-winhttpgetproxyforurl)
+        ///
+        virtual proxy_info resolve(_In_z_ LPCWSTR url)
+        {
+            WINHTTP_AUTOPROXY_OPTIONS options = {};
+            if (m_pac_url.empty()) {
+                options.dwFlags = WINHTTP_AUTOPROXY_AUTO_DETECT;
+                options.dwAutoDetectFlags = WINHTTP_AUTO_DETECT_TYPE_DHCP | WINHTTP_AUTO_DETECT_TYPE_DNS_A;
+            }
+            else {
+                options.dwFlags = WINHTTP_AUTOPROXY_CONFIG_URL;
+                options.lpszAutoConfigUrl = m_pac_url.c_str();
+            }
+            options.fAutoLogonIfChallenged = TRUE;
+            WINHTTP_PROXY_INFO pi = {};
+            proxy_info info;
+            if (!WinHttpGetProxyForUrl(m_session, url, &options, &pi)) {
+                const DWORD error = GetLastError();
+                if (error == ERROR_WINHTTP_AUTODETECTION_FAILED)
+                    return info; // No WPAD: direct access
+                throw win_runtime_error(error, "WinHttpGetProxyForUrl failed");
+            }
+            std::unique_ptr<WCHAR, GlobalFree_delete> proxy(pi.lpszProxy), bypass(pi.lpszProxyBypass);
+            info.access_type = pi.dwAccessType;
+            if (proxy)
+                info.proxy = proxy.get();
+            if (bypass)
+                info.bypass = bypass.get();
+            return info;
+        }
+
+        ///
+        /// Returns current time
+        ///
+        virtual std::chrono::steady_clock::time_point now() const
+        {
+            return std::chrono::steady_clock::now();
+        }
+
+        ///
+        /// Checks for network changes since last call
+        ///
+        /// Called with the cache lock held. The default implementation watches the IP address table.
+        ///
+        /// \sa [NotifyAddrChange function](https://learn.microsoft.com/en-us/windows/win32/api/iphlpapi/nf-iphlpapi-notifyaddrchange)
+        ///
+        virtual bool network_changed()
+        {
+            bool changed = false;
+            if (!m_notify.hEvent) {
+                m_notify.hEvent = CreateEventW(NULL, FALSE, FALSE, NULL);
+                if (!m_notify.hEvent)
+                    throw win_runtime_error("CreateEventW failed");
+            }
+            else if (WaitForSingleObject(m_notify.hEvent, 0) == WAIT_OBJECT_0)
+                changed = true;
+            else
+                return false;
+            HANDLE h;
+            const DWORD result = NotifyAddrChange(&h, &m_notify);
+            if (result != ERROR_IO_PENDING && result != NO_ERROR)
+                throw win_runtime_error(result, "NotifyAddrChange failed");
+            return changed;
+        }
+
+    protected:
+        /// \cond internal
+        struct entry
+        {
+            proxy_info info;
+            std::exception_ptr error;
+            std::chrono::steady_clock::time_point expires;
+            uint64_t generation = 0;
+            bool valid = false;
+            bool resolving = false;
+            std::list<std::wstring>::iterator lru;
+        };
+
+        std::shared_ptr<entry> lookup(_In_ const std::wstring& url)
+        {
+            auto i = m_entries.find(url);
+            if (i != m_entries.end()) {
+                m_lru.splice(m_lru.begin(), m_lru, i->second->lru);
+                return i->second;
+            }
+            auto e = std::make_shared<entry>();
+            m_lru.push_front(url);
+            try {
+                m_entries.emplace(url, e);
+            }
+            catch (...) {
+                m_lru.pop_front();
+                throw;
+            }
+            e->lru = m_lru.begin();
+            while (m_entries.size() > m_capacity) {
+                m_entries.erase(m_lru.back());
+                m_lru.pop_back();
+            }
+            return e;
+        }
+        /// \endcond
+
+    protected:
+        HINTERNET m_session;                                ///< WinHTTP session
+        std::wstring m_pac_url;                             ///< PAC script URL
+        std::chrono::steady_clock::duration m_ttl;          ///< Decision lifetime
+        std::chrono::steady_clock::duration m_retry;        ///< Failure and fallback lifetime
+        size_t m_capacity;                                  ///< Maximum number of entries
+        mutable std::mutex m_mutex;                         ///< Protects members below
+        std::condition_variable m_cv;                       ///< Signals completed resolutions
+        std::unordered_map<std::wstring, std::shared_ptr<entry>> m_entries; ///< Cache entries
+        std::list<std::wstring> m_lru;                      ///< Keys of m_entries, most recently used first
+        uint64_t m_generation;                              ///< Incremented on network change
+        uint64_t m_hits;                                    ///< Lookups served from cache
+        uint64_t m_resolutions;                             ///< Resolutions performed
+        uint64_t m_coalesced;                               ///< Lookups that waited for a resolution
+        uint64_t m_fallbacks;                               ///< Fallbacks to last known good decision
+        OVERLAPPED m_notify;                                ///< Address change notification
+    };
+
     /// @}
 }
@@ -12,6 +12,11 @@
 #include <WinSock2.h>
 #include <ws2def.h>
 #include <WS2tcpip.h>
+#include <mswsock.h>
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+#include <vector>
 
 namespace winstd
 {
@@ -177,6 +182,925 @@ namespace winstd
 
 #endif
 
+    /// \cond internal
+    namespace internal {
+        struct ip_octet_text_t
+        {
+            char text[256][4]; // Decimal digits; text[n][3] is the number of digits.
+            constexpr ip_octet_text_t() : text()
+            {
+                for (unsigned int i = 0; i < 256; ++i) {
+                    unsigned int n = 0;
+                    if (i >= 100) text[i][n++] = static_cast<char>('0' + i / 100);
+                    if (i >= 10) text[i][n++] = static_cast<char>('0' + i / 10 % 10);
+                    text[i][n++] = static_cast<char>('0' + i % 10);
+                    text[i][3] = static_cast<char>(n);
+                }
+            }
+        };
+        inline constexpr ip_octet_text_t ip_octet_text{};
+
+        template <class T>
+        inline int ip_hex_value(_In_ T c) noexcept
+        {
+            if ('0' <= c && c <= '9') return static_cast<int>(c - '0');
+            if ('a' <= c && c <= 'f') return static_cast<int>(c - 'a' + 10);
+            if ('A' <= c && c <= 'F') return static_cast<int>(c - 'A' + 10);
+            return -1;
+        }
+    }
+    /// \endcond
+
+    ///
+    /// IPv4 or IPv6 address value
+    ///
+    /// Parses and formats addresses without `inet_pton`/`inet_ntop` or locale. IPv6 text follows RFC 5952: lowercase,
+    /// longest run of zero groups compressed, IPv4-mapped addresses in dotted notation. Numeric zone indices (`%12`) are
+    /// supported.
+    ///
+    class ip_address
+    {
+    public:
+        static constexpr size_t max_text = 64; ///< Maximum text length including zone, excluding zero terminator
+
+        ///
+        /// Constructs an unspecified address
+        ///
+        ip_address() noexcept : m_family(AF_UNSPEC), m_zone(0)
+        {
+            memset(m_addr, 0, sizeof(m_addr));
+        }
+
+        ///
+        /// Constructs an IPv4 address
+        ///
+        /// \param[in] addr  IPv4 address
+        ///
+        ip_address(_In_ const IN_ADDR& addr) noexcept : m_family(AF_INET), m_zone(0)
+        {
+            memcpy(m_addr, &addr, 4);
+            memset(m_addr + 4, 0, sizeof(m_addr) - 4);
+        }
+
+        ///
+        /// Constructs an IPv6 address
+        ///
+        /// \param[in] addr  IPv6 address
+        /// \param[in] zone  Zone (scope) index
+        ///
+        ip_address(_In_ const IN6_ADDR& addr, _In_ ULONG zone = 0) noexcept : m_family(AF_INET6), m_zone(zone)
+        {
+            memcpy(m_addr, &addr, 16);
+        }
+
+        ///
+        /// Constructs an address from a socket address
+        ///
+        /// \param[in] sa  `SOCKADDR_IN` or `SOCKADDR_IN6`, e.g. `ADDRINFO::ai_addr`. Other families give an unspecified address.
+        ///
+        ip_address(_In_ const SOCKADDR* sa) noexcept : ip_address()
+        {
+            if (sa->sa_family == AF_INET)
+                *this = ip_address(reinterpret_cast<const SOCKADDR_IN*>(sa)->sin_addr);
+            else if (sa->sa_family == AF_INET6)
+                *this = ip_address(reinterpret_cast<const SOCKADDR_IN6*>(sa)->sin6_addr, reinterpret_cast<const SOCKADDR_IN6*>(sa)->sin6_scope_id);
+        }
+
+        ///
+        /// Returns address family: `AF_INET`, `AF_INET6` or `AF_UNSPEC`
+        ///
+        ADDRESS_FAMILY family() const noexcept { return m_family; }
+
+        ///
+        /// Returns address bytes in network order
+        ///
+        const uint8_t* bytes() const noexcept { return m_addr; }
+
+        ///
+        /// Returns address size in bytes: 4, 16 or 0
+        ///
+        size_t size() const noexcept { return m_family == AF_INET ? 4 : m_family == AF_INET6 ? 16 : 0; }
+
+        ///
+        /// Returns IPv6 zone index
+        ///
+        ULONG zone() const noexcept { return m_zone; }
+
+        ///
+        /// Returns `true` if this is an IPv4-mapped IPv6 address (`::ffff:0:0/96`)
+        ///
+        bool is_v4_mapped() const noexcept
+        {
+            static const uint8_t prefix[12] = { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0xff, 0xff };
+            return m_family == AF_INET6 && memcmp(m_addr, prefix, sizeof(prefix)) == 0;
+        }
+
+        ///
+        /// Returns the IPv4 address of an IPv4-mapped IPv6 address or this address otherwise
+        ///
+        ip_address unmapped() const noexcept
+        {
+            if (!is_v4_mapped())
+                return *this;
+            ip_address a;
+            a.m_family = AF_INET;
+            memcpy(a.m_addr, m_addr + 12, 4);
+            return a;
+        }
+
+        ///
+        /// Fills a socket address
+        ///
+        /// \param[out] sa    Socket address
+        /// \param[in ] port  Port number in host order
+        ///
+        void to_sockaddr(_Out_ SOCKADDR_INET& sa, _In_ USHORT port = 0) const noexcept
+        {
+            memset(&sa, 0, sizeof(sa));
+            sa.si_family = m_family;
+            if (m_family == AF_INET) {
+                sa.Ipv4.sin_port = htons(port);
+                memcpy(&sa.Ipv4.sin_addr, m_addr, 4);
+            }
+            else if (m_family == AF_INET6) {
+                sa.Ipv6.sin6_port = htons(port);
+                memcpy(&sa.Ipv6.sin6_addr, m_addr, 16);
+                sa.Ipv6.sin6_scope_id = m_zone;
+            }
+        }
+
+        ///
+        /// Parses an IPv4 or IPv6 address
+        ///
+        /// IPv4 must be in dotted-decimal notation without leading zeros. IPv6 may use `::` compression, an embedded
+        /// IPv4 address and a numeric zone index.
+        ///
+        /// \param[in ] text  Text
+        /// \param[in ] len   Text length in characters
+        /// \param[out] addr  Address
+        ///
+        /// \return `true` if text is a valid address
+        ///
+        template <class T>
+        static bool parse(_In_reads_(len) const T* text, _In_ size_t len, _Out_ ip_address& addr) noexcept
+        {
+            addr = ip_address();
+            const T* end = text + len;
+            for (const T* p = text; p < end; ++p) {
+                if (*p == ':')
+                    return parse_v6(text, end, addr);
+                if (*p == '.')
+                    break;
+            }
+            if (!parse_v4(text, end, addr.m_addr))
+                return false;
+            addr.m_family = AF_INET;
+            return true;
+        }
+
+        ///
+        /// Parses an address prefix in CIDR notation, e.g. `"10.0.0.0/8"` or `"2001:db8::/32"`
+        ///
+        /// \param[in ] text  Text. Without `/` the prefix length is the full address length.
+        /// \param[in ] len   Text length in characters
+        /// \param[out] addr  Prefix address
+        /// \param[out] bits  Prefix length in bits
+        ///
+        /// \return `true` if text is a valid prefix
+        ///
+        template <class T>
+        static bool parse_cidr(_In_reads_(len) const T* text, _In_ size_t len, _Out_ ip_address& addr, _Out_ unsigned int& bits) noexcept
+        {
+            size_t slash = 0;
+            for (; slash < len && text[slash] != '/'; ++slash);
+            if (!parse(text, slash, addr))
+                return false;
+            const unsigned int max_bits = static_cast<unsigned int>(addr.size() * 8);
+            if (slash == len) {
+                bits = max_bits;
+                return true;
+            }
+            if (slash + 1 == len || len - slash > 4)
+                return false;
+            bits = 0;
+            for (size_t i = slash + 1; i < len; ++i) {
+                if (text[i] < '0' || '9' < text[i])
+                    return false;
+                bits = bits * 10 + static_cast<unsigned int>(text[i] - '0');
+            }
+            return bits <= max_bits;
+        }
+
+        ///
+        /// Formats the address
+        ///
+        /// \param[out] text  Output buffer of at least `max_text` characters. No zero terminator is written.
+        ///
+        /// \return Number of characters written
+        ///
+        template <class T>
+        size_t format(_Out_writes_to_(max_text, return) T* text) const noexcept
+        {
+            if (m_family == AF_INET)
+                return format_v4(m_addr, text);
+            if (m_family != AF_INET6)
+                return 0;
+
+            uint16_t words[8];
+            for (size_t i = 0; i < 8; ++i)
+                words[i] = static_cast<uint16_t>((m_addr[2 * i] << 8) | m_addr[2 * i + 1]);
+
+            // Find the longest run of two or more zero groups.
+            size_t best_start = 8, best_len = 0;
+            for (size_t i = 0; i < 8;) {
+                if (words[i]) {
+                    ++i;
+                    continue;
+                }
+                size_t j = i;
+                for (; j < 8 && !words[j]; ++j);
+                if (j - i > best_len && j - i >= 2) {
+                    best_start = i;
+                    best_len = j - i;
+                }
+                i = j;
+            }
+
+            T* o = text;
+            const bool v4 = best_start == 0 && (best_len == 6 || (best_len == 5 && words[5] == 0xffff));
+            for (size_t i = 0; i < 8; ++i) {
+                if (i == best_start) {
+                    *o++ = ':';
+                    if (i == 0)
+                        *o++ = ':';
+                    i += best_len - 1;
+                    continue;
+                }
+                if (v4 && i == 6) {
+                    o += format_v4(m_addr + 12, o);
+                    break;
+                }
+                static const char digits[] = "0123456789abcdef";
+                const uint16_t w = words[i];
+                if (w >= 0x1000) *o++ = digits[w >> 12];
+                if (w >= 0x100) *o++ = digits[(w >> 8) & 0xf];
+                if (w >= 0x10) *o++ = digits[(w >> 4) & 0xf];
+                *o++ = digits[w & 0xf];
+                if (i < 7)
+                    *o++ = ':';
+            }
+            if (m_zone) {
+                *o++ = '%';
+                T buf[10];
+                size_t n = 0;
+                for (ULONG z = m_zone; z; z /= 10)
+                    buf[n++] = static_cast<T>('0' + z % 10);
+                while (n)
+                    *o++ = buf[--n];
+            }
+            return static_cast<size_t>(o - text);
+        }
+
+        ///
+        /// Returns the address as text
+        ///
+        std::string to_string() const
+        {
+            char text[max_text];
+            return std::string(text, format(text));
+        }
+
+        ///
+        /// Returns the address as text
+        ///
+        std::wstring to_wstring() const
+        {
+            wchar_t text[max_text];
+            return std::wstring(text, format(text));
+        }
+
+        ///
+        /// Compares addresses
+        ///
+        bool operator==(_In_ const ip_address& other) const noexcept
+        {
+            return m_family == other.m_family && m_zone == other.m_zone && memcmp(m_addr, other.m_addr, sizeof(m_addr)) == 0;
+        }
+
+        ///
+        /// Compares addresses
+        ///
+        bool operator!=(_In_ const ip_address& other) const noexcept
+        {
+            return !operator==(other);
+        }
+
+        ///
+        /// Orders addresses: by family, then address, then zone
+        ///
+        bool operator<(_In_ const ip_address& other) const noexcept
+        {
+            if (m_family != other.m_family)
+                return m_family < other.m_family;
+            const int r = memcmp(m_addr, other.m_addr, sizeof(m_addr));
+            return r ? r < 0 : m_zone < other.m_zone;
+        }
+
+    protected:
+        /// \cond internal
+        template <class T>
+        static bool parse_v4(_In_ const T* p, _In_ const T* end, _Out_writes_bytes_(4) uint8_t* out) noexcept
+        {
+            for (size_t i = 0; i < 4; ++i) {
+                if (i) {
+                    if (p == end || *p != '.')
+                        return false;
+                    ++p;
+                }
+                if (p == end || *p < '0' || '9' < *p)
+                    return false;
+                unsigned int v = static_cast<unsigned int>(*p++ - '0');
+                for (size_t n = 1; p != end && '0' <= *p && *p <= '9'; ++n, ++p) {
+                    if (!v || n >= 3)
+                        return false;
+                    v = v * 10 + static_cast<unsigned int>(*p - '0');
+                }
+                if (v > 255)
+                    return false;
+                out[i] = static_cast<uint8_t>(v);
+            }
+            return p == end;
+        }
+
+        template <class T>
+        static bool parse_v6(_In_ const T* p, _In_ const T* end, _Inout_ ip_address& addr) noexcept
+        {
+            // Split off zone.
+            for (const T* z = p; z < end; ++z) {
+                if (*z != '%')
+                    continue;
+                if (z + 1 == end || end - z > 11)
+                    return false;
+                uint64_t zone = 0;
+                for (const T* d = z + 1; d < end; ++d) {
+                    if (*d < '0' || '9' < *d)
+                        return false;
+                    zone = zone * 10 + static_cast<unsigned int>(*d - '0');
+                }
+                if (zone > ULONG_MAX)
+                    return false;
+                addr.m_zone = static_cast<ULONG>(zone);
+                end = z;
+                break;
+            }
+
+            uint8_t* out = addr.m_addr;
+            size_t n = 0, gap = SIZE_MAX;
+            if (p != end && *p == ':') {
+                if (end - p < 2 || p[1] != ':')
+                    return false;
+                gap = 0;
+                p += 2;
+            }
+            while (p != end) {
+                const T* group = p;
+                unsigned int v = 0;
+                size_t digits = 0;
+                for (int h; p != end && (h = internal::ip_hex_value(*p)) >= 0; ++p, ++digits) {
+                    if (digits >= 4)
+                        return false;
+                    v = (v << 4) | static_cast<unsigned int>(h);
+                }
+                if (p != end && *p == '.') {
+                    if (n > 6 || !parse_v4(group, end, out + 2 * n))
+                        return false;
+                    n += 2;
+                    p = end;
+                    break;
+                }
+                if (!digits || n >= 8)
+                    return false;
+                out[2 * n] = static_cast<uint8_t>(v >> 8);
+                out[2 * n + 1] = static_cast<uint8_t>(v);
+                ++n;
+                if (p == end)
+                    break;
+                if (*p != ':' || ++p == end)
+                    return false;
+                if (*p == ':') {
+                    if (gap != SIZE_MAX)
+                        return false;
+                    gap = n;
+                    ++p;
+                }
+            }
+            if (gap != SIZE_MAX) {
+                if (n == 8)
+                    return false;
+                const size_t tail = n - gap;
+                memmove(out + 16 - 2 * tail, out + 2 * gap, 2 * tail);
+                memset(out + 2 * gap, 0, 16 - 2 * n);
+            }
+            else if (n != 8)
+                return false;
+            addr.m_family = AF_INET6;
+            return true;
+        }
+
+        template <class T>
+        static size_t format_v4(_In_reads_bytes_(4) const uint8_t* addr, _Out_writes_to_(15, return) T* text) noexcept
+        {
+            T* o = text;
+            for (size_t i = 0; i < 4; ++i) {
+                if (i)
+                    *o++ = '.';
+                const char* s = internal::ip_octet_text.text[addr[i]];
+                for (char j = 0; j < s[3]; ++j)
+                    *o++ = static_cast<T>(s[j]);
+            }
+            return static_cast<size_t>(o - text);
+        }
+        /// \endcond
+
+    protected:
+        uint8_t m_addr[16];         ///< Address in network order; IPv4 uses the first 4 bytes
+        ADDRESS_FAMILY m_family;    ///< Address family
+        ULONG m_zone;               ///< IPv6 zone index
+    };
+
+    ///
+    /// Longest-prefix match table of IPv4 and IPv6 prefixes
+    ///
+    /// Binary trie with nodes stored in a single vector and linked by 32-bit indices. IPv4-mapped IPv6 prefixes of 96 bits
+    /// or more are stored as IPv4 prefixes, and IPv4-mapped IPv6 addresses are matched against IPv4 prefixes first.
+    ///
+    template <class T = bool>
+    class ip_prefix_trie
+    {
+    public:
+        ///
+        /// Constructs an empty table
+        ///
+        ip_prefix_trie()
+        {
+            clear();
+        }
+
+        ///
+        /// Adds a prefix or replaces its value
+        ///
+        /// \param[in] prefix  Prefix address. Bits beyond prefix length are ignored.
+        /// \param[in] bits    Prefix length in bits
+        /// \param[in] value   Value
+        ///
+        void insert(_In_ const ip_address& prefix, _In_ unsigned int bits, _In_ const T& value)
+        {
+            if (!prefix.size() || bits > prefix.size() * 8)
+                throw std::invalid_argument("invalid prefix");
+            // Shorter mapped prefixes also cover non-mapped IPv6 addresses and stay in the IPv6 trie.
+            const ip_address a = bits >= 96 ? prefix.unmapped() : prefix;
+            if (a.family() != prefix.family())
+                bits -= 96;
+            uint32_t n = a.family() == AF_INET ? 0 : 1;
+            for (unsigned int i = 0; i < bits; ++i) {
+                const unsigned int b = (a.bytes()[i >> 3] >> (7 - (i & 7))) & 1;
+                if (!m_nodes[n].child[b]) {
+                    if (m_nodes.size() >= UINT32_MAX)
+                        throw std::length_error("too many prefixes");
+                    m_nodes[n].child[b] = static_cast<uint32_t>(m_nodes.size());
+                    m_nodes.push_back(node());
+                }
+                n = m_nodes[n].child[b];
+            }
+            if (m_nodes[n].value == no_value) {
+                m_nodes[n].value = static_cast<uint32_t>(m_values.size());
+                m_values.push_back({ value });
+            }
+            else
+                m_values[m_nodes[n].value].value = value;
+        }
+
+        ///
+        /// Returns value of the longest prefix matching an address
+        ///
+        /// \param[in] addr  Address
+        ///
+        /// \return Value or `NULL` if no prefix matches
+        ///
+        const T* match(_In_ const ip_address& addr) const noexcept
+        {
+            if (!addr.size())
+                return NULL;
+            const ip_address a = addr.unmapped();
+            uint32_t value = walk(a);
+            // Any IPv4 prefix is longer than an IPv6 prefix shorter than 96 bits.
+            if (value == no_value && a.family() != addr.family())
+                value = walk(addr);
+            return value != no_value ? &m_values[value].value : NULL;
+        }
+
+        ///
+        /// Returns number of prefixes
+        ///
+        size_t size() const noexcept { return m_values.size(); }
+
+        ///
+        /// Removes all prefixes
+        ///
+        void clear()
+        {
+            m_nodes.assign(2, node());
+            m_values.clear();
+        }
+
+    protected:
+        /// \cond internal
+        static constexpr uint32_t no_value = UINT32_MAX;
+
+        struct node
+        {
+            uint32_t child[2] = { 0, 0 };  // 0 = none; nodes 0 and 1 are roots and never children
+            uint32_t value = no_value;
+        };
+
+        uint32_t walk(_In_ const ip_address& a) const noexcept
+        {
+            const size_t bits = a.size() * 8;
+            uint32_t n = a.family() == AF_INET ? 0 : 1, value = m_nodes[n].value;
+            for (size_t i = 0; i < bits; ++i) {
+                n = m_nodes[n].child[(a.bytes()[i >> 3] >> (7 - (i & 7))) & 1];
+                if (!n)
+                    break;
+                if (m_nodes[n].value != no_value)
+                    value = m_nodes[n].value;
+            }
+            return value;
+        }
+
+        struct value_holder
+        {
+            T value; // Wrapped to avoid std::vector<bool>
+        };
+        /// \endcond
+
+    protected:
+        std::vector<node> m_nodes;          ///< Nodes; 0 is IPv4 root, 1 is IPv6 root
+        std::vector<value_holder> m_values; ///< Values
+    };
+
+    ///
+    /// Batched UDP sender and receiver
+    ///
+    /// Datagrams pushed to the same destination are packed back-to-back into one buffer and sent with a single
+    /// `WSASendMsg` using UDP segmentation offload (`UDP_SEND_MSG_SIZE`). Received coalesced buffers
+    /// (`UDP_RECV_MAX_COALESCED_SIZE`) are split back into datagrams. When the stack does not support offload, every
+    /// datagram is sent and received individually.
+    ///
+    /// The socket is not owned. Segmentation offload is a socket option: do not share the socket with other senders
+    /// while a batch is in use. Datagrams not yet flushed are discarded on destruction.
+    ///
+    class udp_batch
+    {
+        WINSTD_NONCOPYABLE(udp_batch)
+        WINSTD_NONMOVABLE(udp_batch)
+
+    public:
+        static constexpr size_t max_coalesced = 65507;  ///< Maximum total size of a coalesced send or receive
+        static constexpr size_t max_segments = 64;      ///< Maximum number of datagrams per coalesced send
+
+        ///
+        /// Received datagram
+        ///
+        struct datagram
+        {
+            const SOCKADDR* from;   ///< Source address
+            int from_len;           ///< Source address size in bytes
+            const uint8_t* data;    ///< Payload
+            size_t size;            ///< Payload size in bytes
+        };
+
+        ///
+        /// Constructs a batch
+        ///
+        /// \param[in] s            UDP socket
+        /// \param[in] buffer_size  Send buffer size in bytes. Pushing beyond it flushes. At least `max_coalesced`.
+        ///
+        udp_batch(_In_ SOCKET s, _In_ size_t buffer_size = 4 * max_coalesced) :
+            m_socket(s),
+            m_send_buffer(std::max<size_t>(buffer_size, max_coalesced)),
+            m_send_size(0),
+            m_send_offload(offload::unknown),
+            m_segment_size(0),
+            m_recv_buffer(max_coalesced),
+            m_recv_offload(offload::unknown),
+            m_recv_fn(NULL),
+            m_recv_size(0),
+            m_recv_segment(0),
+            m_recv_offset(0),
+            m_recv_left(0),
+            m_from_len(0)
+        {
+            memset(&m_from, 0, sizeof(m_from));
+        }
+
+        ///
+        /// Destructs the batch
+        ///
+        virtual ~udp_batch()
+        {}
+
+        /// \name Sending
+        /// @{
+
+        ///
+        /// Queues a datagram
+        ///
+        /// Flushes first when the send buffer is full.
+        ///
+        /// \param[in] data    Payload
+        /// \param[in] size    Payload size in bytes
+        /// \param[in] to      Destination address
+        /// \param[in] to_len  Destination address size in bytes
+        ///
+        void push(_In_reads_bytes_(size) const void* data, _In_ size_t size, _In_reads_bytes_(to_len) const SOCKADDR* to, _In_ int to_len)
+        {
+            if (size > max_coalesced)
+                throw std::invalid_argument("datagram too large");
+            if (to_len < 0 || static_cast<size_t>(to_len) > sizeof(SOCKADDR_INET))
+                throw std::invalid_argument("unsupported address");
+            if (m_send_offload == offload::unknown)
+                m_send_offload = set_send_segment(0) ? offload::available : offload::unavailable;
+            if (m_send_size + size > m_send_buffer.size())
+                flush();
+
+            memcpy(m_send_buffer.data() + m_send_size, data, size);
+            if (m_runs.empty() || !append(m_runs.back(), size, to, to_len)) {
+                m_runs.push_back(run());
+                run& r = m_runs.back();
+                memset(&r.to, 0, sizeof(r.to));
+                memcpy(&r.to, to, static_cast<size_t>(to_len));
+                r.to_len = to_len;
+                r.offset = m_send_size;
+                r.size = size;
+                r.segment = size;
+                r.count = 1;
+            }
+            m_send_size += size;
+        }
+
+        ///
+        /// Sends all queued datagrams
+        ///
+        /// On error, the queue is discarded and the exception is rethrown.
+        ///
+        void flush()
+        {
+            try {
+                for (auto& r : m_runs) {
+                    const uint8_t* data = m_send_buffer.data() + r.offset;
+                    if (r.count > 1 && m_send_offload == offload::available) {
+                        if (m_segment_size != r.segment) {
+                            if (set_send_segment(static_cast<DWORD>(r.segment)))
+                                m_segment_size = r.segment;
+                            else
+                                m_send_offload = offload::unavailable;
+                        }
+                        if (m_segment_size == r.segment) {
+                            send(r, data, r.size);
+                            continue;
+                        }
+                    }
+                    if (m_segment_size && m_segment_size < r.segment) {
+                        // A single oversized datagram would be split.
+                        set_send_segment(0);
+                        m_segment_size = 0;
+                    }
+                    if (r.count == 1)
+                        send(r, data, r.size);
+                    else {
+                        for (size_t offset = 0; offset < r.size; offset += r.segment)
+                            send(r, data + offset, (std::min)(r.segment, r.size - offset));
+                    }
+                }
+            }
+            catch (...) {
+                m_runs.clear();
+                m_send_size = 0;
+                throw;
+            }
+            m_runs.clear();
+            m_send_size = 0;
+        }
+
+        ///
+        /// Returns number of queued bytes
+        ///
+        size_t pending() const noexcept { return m_send_size; }
+
+        /// @}
+
+        /// \name Receiving
+        /// @{
+
+        ///
+        /// Receives next batch of datagrams
+        ///
+        /// Datagrams not yet iterated from the previous batch are discarded.
+        ///
+        /// \return `true` if a batch was received; `false` if a non-blocking socket has no data pending
+        ///
+        bool receive()
+        {
+            if (m_recv_offload == offload::unknown)
+                m_recv_offload = set_recv_coalesced(static_cast<DWORD>(max_coalesced)) ? offload::available : offload::unavailable;
+
+            alignas(WSACMSGHDR) char control[WSA_CMSG_SPACE(sizeof(DWORD)) + 64];
+            WSABUF buf = { static_cast<ULONG>(m_recv_buffer.size()), reinterpret_cast<CHAR*>(m_recv_buffer.data()) };
+            WSAMSG msg = {};
+            msg.name = reinterpret_cast<LPSOCKADDR>(&m_from);
+            msg.namelen = sizeof(m_from);
+            msg.lpBuffers = &buf;
+            msg.dwBufferCount = 1;
+            msg.Control.buf = control;
+            msg.Control.len = sizeof(control);
+            m_recv_size = m_recv_segment = m_recv_offset = m_recv_left = 0;
+            DWORD received;
+            if (!recv_msg(msg, received))
+                return false;
+
+            m_from_len = msg.namelen;
+            m_recv_size = received;
+            m_recv_segment = received;
+            if (msg.Control.len) {
+                for (WSACMSGHDR* c = WSA_CMSG_FIRSTHDR(&msg); c; c = WSA_CMSG_NXTHDR(&msg, c)) {
+                    if (c->cmsg_level == IPPROTO_UDP && c->cmsg_type == udp_coalesced_info && c->cmsg_len >= WSA_CMSG_LEN(sizeof(DWORD))) {
+                        DWORD segment;
+                        memcpy(&segment, WSA_CMSG_DATA(c), sizeof(segment));
+                        if (segment)
+                            m_recv_segment = segment;
+                        break;
+                    }
+                }
+            }
+            m_recv_left = m_recv_segment ? (m_recv_size + m_recv_segment - 1) / m_recv_segment : 1; // Zero-length datagram
+            return true;
+        }
+
+        ///
+        /// Returns next datagram of the received batch
+        ///
+        /// \param[out] d  Datagram. Valid until next `receive()` call.
+        ///
+        /// \return `true` if a datagram was returned; `false` when the batch is exhausted
+        ///
+        bool next(_Out_ datagram& d) noexcept
+        {
+            if (!m_recv_left)
+                return false;
+            d.from = reinterpret_cast<const SOCKADDR*>(&m_from);
+            d.from_len = m_from_len;
+            d.data = m_recv_buffer.data() + m_recv_offset;
+            d.size = (std::min)(m_recv_segment, m_recv_size - m_recv_offset);
+            m_recv_offset += d.size;
+            --m_recv_left;
+            return true;
+        }
+
+        /// @}
+
+    protected:
+        ///
+        /// Sets segment size of subsequent sends
+        ///
+        /// \param[in] size  Segment size in bytes; 0 disables segmentation
+        ///
+        /// \return `true` on success; `false` when segmentation offload is not supported
+        ///
+        virtual bool set_send_segment(_In_ DWORD size)
+        {
+            if (setsockopt(m_socket, IPPROTO_UDP, udp_send_msg_size, reinterpret_cast<const char*>(&size), sizeof(size)) == 0)
+                return true;
+            const int error = WSAGetLastError();
+            if (error == WSAEINVAL || error == WSAENOPROTOOPT || error == WSAEOPNOTSUPP)
+                return false;
+            throw ws2_runtime_error(error, "setsockopt(UDP_SEND_MSG_SIZE) failed");
+        }
+
+        ///
+        /// Enables receive coalescing
+        ///
+        /// \param[in] size  Maximum coalesced size in bytes
+        ///
+        /// \return `true` on success; `false` when receive coalescing is not supported
+        ///
+        virtual bool set_recv_coalesced(_In_ DWORD size)
+        {
+            if (setsockopt(m_socket, IPPROTO_UDP, udp_recv_max_coalesced_size, reinterpret_cast<const char*>(&size), sizeof(size)) == 0)
+                return true;
+            const int error = WSAGetLastError();
+            if (error == WSAEINVAL || error == WSAENOPROTOOPT || error == WSAEOPNOTSUPP)
+                return false;
+            throw ws2_runtime_error(error, "setsockopt(UDP_RECV_MAX_COALESCED_SIZE) failed");
+        }
+
+        ///
+        /// Sends a message
+        ///
+        /// \param[in] msg  Message
+        ///
+        virtual void send_msg(_In_ const WSAMSG& msg)
+        {
+            DWORD sent;
+            if (WSASendMsg(m_socket, const_cast<LPWSAMSG>(&msg), 0, &sent, NULL, NULL) == SOCKET_ERROR)
+                throw ws2_runtime_error("WSASendMsg failed");
+        }
+
+        ///
+        /// Receives a message
+        ///
+        /// \param[in,out] msg       Message
+        /// \param[out]    received  Number of bytes received
+        ///
+        /// \return `true` on success; `false` if a non-blocking socket has no data pending
+        ///
+        virtual bool recv_msg(_Inout_ WSAMSG& msg, _Out_ DWORD& received)
+        {
+            if (!m_recv_fn) {
+                GUID id = WSAID_WSARECVMSG;
+                DWORD size;
+                if (WSAIoctl(m_socket, SIO_GET_EXTENSION_FUNCTION_POINTER, &id, sizeof(id), &m_recv_fn, sizeof(m_recv_fn), &size, NULL, NULL) == SOCKET_ERROR)
+                    throw ws2_runtime_error("WSAIoctl(WSAID_WSARECVMSG) failed");
+            }
+            if (m_recv_fn(m_socket, &msg, &received, NULL, NULL) == 0)
+                return true;
+            const int error = WSAGetLastError();
+            if (error == WSAEWOULDBLOCK)
+                return false;
+            throw ws2_runtime_error(error, "WSARecvMsg failed");
+        }
+
+    protected:
+        /// \cond internal
+        // ws2ipdef.h values; older SDKs lack them.
+        static constexpr int udp_send_msg_size = 2;
+        static constexpr int udp_recv_max_coalesced_size = 3;
+        static constexpr int udp_coalesced_info = 3;
+
+        enum class offload { unknown, available, unavailable };
+
+        struct run
+        {
+            SOCKADDR_INET to;
+            int to_len;
+            size_t offset, size, segment, count;
+        };
+
+        bool append(_Inout_ run& r, _In_ size_t size, _In_reads_bytes_(to_len) const SOCKADDR* to, _In_ int to_len) const noexcept
+        {
+            // Only the last segment of a coalesced send may be shorter. Empty datagrams cannot be coalesced.
+            if (m_send_offload != offload::available ||
+                r.count >= max_segments ||
+                r.size != r.segment * r.count ||
+                !size || size > r.segment ||
+                r.size + size > max_coalesced ||
+                r.to_len != to_len ||
+                memcmp(&r.to, to, static_cast<size_t>(to_len)) != 0)
+                return false;
+            r.size += size;
+            ++r.count;
+            return true;
+        }
+
+        void send(_In_ run& r, _In_reads_bytes_(size) const uint8_t* data, _In_ size_t size)
+        {
+            WSABUF buf = { static_cast<ULONG>(size), reinterpret_cast<CHAR*>(const_cast<uint8_t*>(data)) };
+            WSAMSG msg = {};
+            msg.name = reinterpret_cast<LPSOCKADDR>(&r.to);
+            msg.namelen = r.to_len;
+            msg.lpBuffers = &buf;
+            msg.dwBufferCount = 1;
+            send_msg(msg);
+        }
+        /// \endcond
+
+    protected:
+        SOCKET m_socket;                        ///< Socket
+        std::vector<uint8_t> m_send_buffer;     ///< Send buffer
+        size_t m_send_size;                     ///< Number of bytes queued
+        std::vector<run> m_runs;                ///< Queued coalesced sends
+        offload m_send_offload;                 ///< Segmentation offload support
+        size_t m_segment_size;                  ///< Current `UDP_SEND_MSG_SIZE`
+        std::vector<uint8_t> m_recv_buffer;     ///< Receive buffer
+        offload m_recv_offload;                 ///< Receive coalescing support
+        LPFN_WSARECVMSG m_recv_fn;              ///< `WSARecvMsg` entry point
+        size_t m_recv_size;                     ///< Number of bytes received
+        size_t m_recv_segment;                  ///< Received datagram size; last one may be shorter
+        size_t m_recv_offset;                   ///< Offset of next datagram
+        size_t m_recv_left;                     ///< Number of datagrams not yet iterated
+        SOCKADDR_INET m_from;                   ///< Source address of received batch
+        int m_from_len;                         ///< Source address size
+    };
+
     /// @}
 }
 